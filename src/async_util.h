@@ -0,0 +1,431 @@
+#ifndef AUPROC_ASYNC_UTIL_H
+#define AUPROC_ASYNC_UTIL_H
+
+#include "util.h"
+
+/* -------------------------------------------------------------------------------------------- */
+
+/**
+ * Atomic counter for exchanging indices and flags between the realtime
+ * thread and other threads without locking. Stores are release operations,
+ * loads are acquire operations.
+ */
+#if defined(AUPROC_ASYNC_USE_WIN32)
+    typedef volatile LONG AtomicCounter;
+#elif defined(AUPROC_ASYNC_USE_STDATOMIC)
+    typedef atomic_int    AtomicCounter;
+#elif defined(AUPROC_ASYNC_USE_GNU)
+    typedef int           AtomicCounter;
+#endif
+
+static inline int atomic_get(AtomicCounter* value)
+{
+#if defined(AUPROC_ASYNC_USE_WIN32)
+    return InterlockedCompareExchange(value, 0, 0);
+#elif defined(AUPROC_ASYNC_USE_STDATOMIC)
+    return atomic_load_explicit(value, memory_order_acquire);
+#elif defined(AUPROC_ASYNC_USE_GNU)
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void atomic_set(AtomicCounter* value, int newValue)
+{
+#if defined(AUPROC_ASYNC_USE_WIN32)
+    InterlockedExchange(value, newValue);
+#elif defined(AUPROC_ASYNC_USE_STDATOMIC)
+    atomic_store_explicit(value, newValue, memory_order_release);
+#elif defined(AUPROC_ASYNC_USE_GNU)
+    __atomic_store_n(value, newValue, __ATOMIC_RELEASE);
+#endif
+}
+
+static inline int atomic_inc(AtomicCounter* value)
+{
+#if defined(AUPROC_ASYNC_USE_WIN32)
+    return InterlockedIncrement(value);
+#elif defined(AUPROC_ASYNC_USE_STDATOMIC)
+    return atomic_fetch_add(value, 1) + 1;
+#elif defined(AUPROC_ASYNC_USE_GNU)
+    return __atomic_add_fetch(value, 1, __ATOMIC_ACQ_REL);
+#endif
+}
+
+static inline int atomic_dec(AtomicCounter* value)
+{
+#if defined(AUPROC_ASYNC_USE_WIN32)
+    return InterlockedDecrement(value);
+#elif defined(AUPROC_ASYNC_USE_STDATOMIC)
+    return atomic_fetch_sub(value, 1) - 1;
+#elif defined(AUPROC_ASYNC_USE_GNU)
+    return __atomic_sub_fetch(value, 1, __ATOMIC_ACQ_REL);
+#endif
+}
+
+static inline int atomic_swap(AtomicCounter* value, int newValue)
+{
+#if defined(AUPROC_ASYNC_USE_WIN32)
+    return InterlockedExchange(value, newValue);
+#elif defined(AUPROC_ASYNC_USE_STDATOMIC)
+    return atomic_exchange(value, newValue);
+#elif defined(AUPROC_ASYNC_USE_GNU)
+    return __atomic_exchange_n(value, newValue, __ATOMIC_ACQ_REL);
+#endif
+}
+
+/**
+ * Sets the value to newValue if it is equal to expected. Returns true if
+ * the value was set.
+ */
+static inline bool atomic_compare_swap(AtomicCounter* value, int expected, int newValue)
+{
+#if defined(AUPROC_ASYNC_USE_WIN32)
+    return InterlockedCompareExchange(value, newValue, expected) == expected;
+#elif defined(AUPROC_ASYNC_USE_STDATOMIC)
+    return atomic_compare_exchange_strong(value, &expected, newValue);
+#elif defined(AUPROC_ASYNC_USE_GNU)
+    return __atomic_compare_exchange_n(value, &expected, newValue, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/**
+ * Atomic pointer for handing over objects between threads.
+ */
+#if defined(AUPROC_ASYNC_USE_WIN32)
+    typedef PVOID volatile AtomicPtr;
+#elif defined(AUPROC_ASYNC_USE_STDATOMIC)
+    typedef _Atomic(void*) AtomicPtr;
+#elif defined(AUPROC_ASYNC_USE_GNU)
+    typedef void*          AtomicPtr;
+#endif
+
+static inline void* atomic_get_ptr(AtomicPtr* ptr)
+{
+#if defined(AUPROC_ASYNC_USE_WIN32)
+    return InterlockedCompareExchangePointer(ptr, NULL, NULL);
+#elif defined(AUPROC_ASYNC_USE_STDATOMIC)
+    return atomic_load_explicit(ptr, memory_order_acquire);
+#elif defined(AUPROC_ASYNC_USE_GNU)
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void* atomic_swap_ptr(AtomicPtr* ptr, void* newValue)
+{
+#if defined(AUPROC_ASYNC_USE_WIN32)
+    return InterlockedExchangePointer(ptr, newValue);
+#elif defined(AUPROC_ASYNC_USE_STDATOMIC)
+    return atomic_exchange(ptr, newValue);
+#elif defined(AUPROC_ASYNC_USE_GNU)
+    return __atomic_exchange_n(ptr, newValue, __ATOMIC_ACQ_REL);
+#endif
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+#define ATOMIC_SNAPSHOT_SLOTS 3
+
+typedef struct AtomicSnapshot AtomicSnapshot;
+
+/**
+ * Lock-free handover of a fixed size data block, e.g. filter coefficients,
+ * from one producer thread to one consumer thread. The producer fills a
+ * free slot and publishes it, the consumer switches to the latest published
+ * slot. One slot is used by the consumer, one may be published but not yet
+ * taken, so the producer always finds a free slot.
+ */
+struct AtomicSnapshot
+{
+    AtomicCounter  pending;                        /* published slot index + 1, 0 if none */
+    AtomicCounter  used[ATOMIC_SNAPSHOT_SLOTS];
+    int            current;                        /* slot used by the consumer */
+    size_t         slotSize;
+    char*          data;
+};
+
+/**
+ * Allocates the slots, initially slot 0 is used by the consumer and
+ * all data is zero.
+ */
+static inline bool atomic_snapshot_init(AtomicSnapshot* s, size_t slotSize)
+{
+    memset(s, 0, sizeof(AtomicSnapshot));
+    s->data = calloc(ATOMIC_SNAPSHOT_SLOTS, slotSize);
+    if (!s->data) {
+        return false;
+    }
+    s->slotSize = slotSize;
+    atomic_set(&s->used[0], true);
+    return true;
+}
+
+static inline void atomic_snapshot_free(AtomicSnapshot* s)
+{
+    if (s->data) {
+        free(s->data);
+        s->data = NULL;
+    }
+}
+
+/**
+ * Consumer side: data of the slot that is currently used.
+ */
+static inline void* atomic_snapshot_current(AtomicSnapshot* s)
+{
+    return s->data + s->current * s->slotSize;
+}
+
+/**
+ * Consumer side: switches to the latest published slot. Returns true if
+ * the current data has changed.
+ */
+static inline bool atomic_snapshot_update(AtomicSnapshot* s)
+{
+    int pending = atomic_swap(&s->pending, 0);
+    if (pending > 0) {
+        atomic_set(&s->used[s->current], false);
+        s->current = pending - 1;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Producer side: returns a free slot that can be filled and published.
+ */
+static inline void* atomic_snapshot_begin(AtomicSnapshot* s)
+{
+    for (int i = 0; i < ATOMIC_SNAPSHOT_SLOTS; ++i) {
+        if (!atomic_get(&s->used[i])) {
+            atomic_set(&s->used[i], true);
+            return s->data + i * s->slotSize;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Producer side: publishes a slot obtained by atomic_snapshot_begin. A
+ * previously published slot that was not taken by the consumer is freed.
+ */
+static inline void atomic_snapshot_publish(AtomicSnapshot* s, void* slot)
+{
+    int index   = ((char*)slot - s->data) / s->slotSize;
+    int pending = atomic_swap(&s->pending, index + 1);
+    if (pending > 0) {
+        atomic_set(&s->used[pending - 1], false);
+    }
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+typedef struct SampleRing SampleRing;
+
+/**
+ * Lock-free single producer/single consumer ring buffer for audio samples,
+ * e.g. for passing audio data from the realtime thread to a worker thread
+ * or vice versa. The counters are wrapping sample counts.
+ */
+struct SampleRing
+{
+    float*         data;
+    uint32_t       mask;
+    AtomicCounter  writeCount;
+    AtomicCounter  readCount;
+};
+
+/**
+ * Allocates a ring buffer that can hold at least minCapacity samples.
+ */
+static inline bool sample_ring_init(SampleRing* ring, uint32_t minCapacity)
+{
+    uint32_t capacity = 1024;
+    while (capacity < minCapacity) {
+        capacity *= 2;
+    }
+    memset(ring, 0, sizeof(SampleRing));
+    ring->data = calloc(capacity, sizeof(float));
+    if (!ring->data) {
+        return false;
+    }
+    ring->mask = capacity - 1;
+    return true;
+}
+
+static inline void sample_ring_free(SampleRing* ring)
+{
+    if (ring->data) {
+        free(ring->data);
+        ring->data = NULL;
+    }
+}
+
+static inline uint32_t sample_ring_available(SampleRing* ring)
+{
+    return (uint32_t)atomic_get(&ring->writeCount) - (uint32_t)atomic_get(&ring->readCount);
+}
+
+/**
+ * Producer side: writes up to n samples, returns the number of samples written.
+ */
+static inline uint32_t sample_ring_write(SampleRing* ring, const float* src, uint32_t n)
+{
+    uint32_t w    = atomic_get(&ring->writeCount);
+    uint32_t r    = atomic_get(&ring->readCount);
+    uint32_t space = ring->mask + 1 - (w - r);
+    if (n > space) {
+        n = space;
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+        ring->data[(w + i) & ring->mask] = src[i];
+    }
+    atomic_set(&ring->writeCount, w + n);
+    return n;
+}
+
+/**
+ * Consumer side: reads up to n samples, returns the number of samples read.
+ */
+static inline uint32_t sample_ring_read(SampleRing* ring, float* dst, uint32_t n)
+{
+    uint32_t r     = atomic_get(&ring->readCount);
+    uint32_t w     = atomic_get(&ring->writeCount);
+    uint32_t avail = w - r;
+    if (n > avail) {
+        n = avail;
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+        dst[i] = ring->data[(r + i) & ring->mask];
+    }
+    atomic_set(&ring->readCount, r + n);
+    return n;
+}
+
+/**
+ * Producer side: writes up to n zero samples, returns the number of samples written.
+ */
+static inline uint32_t sample_ring_write_zeros(SampleRing* ring, uint32_t n)
+{
+    uint32_t w     = atomic_get(&ring->writeCount);
+    uint32_t r     = atomic_get(&ring->readCount);
+    uint32_t space = ring->mask + 1 - (w - r);
+    if (n > space) {
+        n = space;
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+        ring->data[(w + i) & ring->mask] = 0;
+    }
+    atomic_set(&ring->writeCount, w + n);
+    return n;
+}
+
+/**
+ * Consumer side: discards up to n samples, returns the number of samples discarded.
+ */
+static inline uint32_t sample_ring_skip(SampleRing* ring, uint32_t n)
+{
+    uint32_t r     = atomic_get(&ring->readCount);
+    uint32_t w     = atomic_get(&ring->writeCount);
+    uint32_t avail = w - r;
+    if (n > avail) {
+        n = avail;
+    }
+    atomic_set(&ring->readCount, r + n);
+    return n;
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+typedef struct AsyncThread AsyncThread;
+
+/**
+ * Background thread for non realtime work, e.g. file writing or FFT processing.
+ */
+struct AsyncThread
+{
+#if defined(AUPROC_ASYNC_USE_WINTHREAD)
+    HANDLE    handle;
+#elif defined(AUPROC_ASYNC_USE_PTHREAD)
+    pthread_t handle;
+#elif defined(AUPROC_ASYNC_USE_STDTHREAD)
+    thrd_t    handle;
+#endif
+    bool      started;
+    void    (*func)(void* arg);
+    void*     arg;
+};
+
+#if defined(AUPROC_ASYNC_USE_WINTHREAD)
+static DWORD WINAPI async_thread_main(LPVOID arg)
+{
+    AsyncThread* thread = (AsyncThread*) arg;
+    thread->func(thread->arg);
+    return 0;
+}
+#elif defined(AUPROC_ASYNC_USE_PTHREAD)
+static void* async_thread_main(void* arg)
+{
+    AsyncThread* thread = (AsyncThread*) arg;
+    thread->func(thread->arg);
+    return NULL;
+}
+#elif defined(AUPROC_ASYNC_USE_STDTHREAD)
+static int async_thread_main(void* arg)
+{
+    AsyncThread* thread = (AsyncThread*) arg;
+    thread->func(thread->arg);
+    return 0;
+}
+#endif
+
+/**
+ * Starts func(arg) in a new thread. Returns false if the thread could
+ * not be started. The AsyncThread struct must not be moved until
+ * async_thread_join was called.
+ */
+static inline bool async_thread_start(AsyncThread* thread, void (*func)(void* arg), void* arg)
+{
+    thread->func = func;
+    thread->arg  = arg;
+#if defined(AUPROC_ASYNC_USE_WINTHREAD)
+    thread->handle  = CreateThread(NULL, 0, async_thread_main, thread, 0, NULL);
+    thread->started = (thread->handle != NULL);
+#elif defined(AUPROC_ASYNC_USE_PTHREAD)
+    thread->started = (pthread_create(&thread->handle, NULL, async_thread_main, thread) == 0);
+#elif defined(AUPROC_ASYNC_USE_STDTHREAD)
+    thread->started = (thrd_create(&thread->handle, async_thread_main, thread) == thrd_success);
+#endif
+    return thread->started;
+}
+
+static inline void async_thread_join(AsyncThread* thread)
+{
+    if (thread->started) {
+#if defined(AUPROC_ASYNC_USE_WINTHREAD)
+        WaitForSingleObject(thread->handle, INFINITE);
+        CloseHandle(thread->handle);
+#elif defined(AUPROC_ASYNC_USE_PTHREAD)
+        pthread_join(thread->handle, NULL);
+#elif defined(AUPROC_ASYNC_USE_STDTHREAD)
+        thrd_join(thread->handle, NULL);
+#endif
+        thread->started = false;
+    }
+}
+
+static inline void async_sleep_millis(int millis)
+{
+#if defined(AUPROC_ASYNC_USE_WINTHREAD)
+    Sleep(millis);
+#elif defined(AUPROC_ASYNC_USE_STDTHREAD)
+    struct timespec ts = { millis / 1000, (millis % 1000) * 1000000L };
+    thrd_sleep(&ts, NULL);
+#else
+    struct timespec ts = { millis / 1000, (millis % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+#endif
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+#endif /* AUPROC_ASYNC_UTIL_H */
@@ -0,0 +1,554 @@
+#include "audio_analyzer.h"
+#include "async_util.h"
+#include "fft.h"
+
+#define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
+#include "auproc_capi.h"
+
+#define RECEIVER_CAPI_IMPLEMENT_GET_CAPI 1
+#include "receiver_capi.h"
+
+/* ============================================================================================ */
+
+static const char* const AUDIO_ANALYZER_CLASS_NAME = "auproc.audio_analyzer";
+
+static const char* ERROR_INVALID_AUDIO_ANALYZER = "invalid auproc.audio_analyzer";
+
+/* ============================================================================================ */
+
+#define WORKER_SLEEP_MILLIS 5
+
+typedef struct TimeStamp             TimeStamp;
+typedef struct AudioAnalyzerUserData AudioAnalyzerUserData;
+
+/**
+ * Frame time that belongs to a sample count of the ring buffer.
+ */
+struct TimeStamp
+{
+    uint32_t sampleCount;
+    uint32_t frameTime;
+};
+
+struct AudioAnalyzerUserData
+{
+    const char*        className;
+    auproc_processor*  processor;
+
+    bool               closed;
+    bool               activated;
+
+    const auproc_capi*  auprocCapi;
+    auproc_engine*      auprocEngine;
+    uint32_t            sampleRate;
+
+    auproc_connector*       audioInConnector;
+    const auproc_audiometh* audioMethods;
+
+    SampleRing         ring;
+    AtomicSnapshot     timeStamps;
+    AtomicCounter      stopRequested;
+    AsyncThread        thread;
+
+    /* the following members are only used by the worker thread */
+
+    const receiver_capi* receiverCapi;
+    receiver_object*     receiver;
+    receiver_writer*     receiverWriter;
+
+    FftPlan*           fftPlan;
+    uint32_t           size;
+    uint32_t           hop;
+    uint32_t           minDistance;
+    int                bandCount;
+    bool               decibel;
+
+    float*             window;
+    float*             frame;
+    float*             re;
+    float*             im;
+    uint32_t*          bandStart;   /* [bandCount + 1] */
+    float              scale;
+
+    uint32_t           fill;
+    uint32_t           consumed;
+    uint32_t           sinceSent;
+};
+
+/* ============================================================================================ */
+
+static void setupAudioAnalyzerMeta(lua_State* L);
+
+static int pushAudioAnalyzerMeta(lua_State* L)
+{
+    if (luaL_newmetatable(L, AUDIO_ANALYZER_CLASS_NAME)) {
+        setupAudioAnalyzerMeta(L);
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static AudioAnalyzerUserData* checkAudioAnalyzerUdata(lua_State* L, int arg)
+{
+    AudioAnalyzerUserData* udata = luaL_checkudata(L, arg, AUDIO_ANALYZER_CLASS_NAME);
+    if (udata->auprocCapi) {
+        udata->auprocCapi->checkEngineIsNotClosed(L, udata->auprocEngine);
+    }
+    if (udata->closed) {
+        luaL_error(L, ERROR_INVALID_AUDIO_ANALYZER);
+        return NULL;
+    }
+    return udata;
+}
+
+/* ============================================================================================ */
+
+static int processCallback(uint32_t nframes, void* processorData)
+{
+    AudioAnalyzerUserData* udata      = (AudioAnalyzerUserData*) processorData;
+    const auproc_capi*     auprocCapi = udata->auprocCapi;
+
+    float*   inBuf = udata->audioMethods->getAudioBuffer(udata->audioInConnector, nframes);
+    uint32_t f0    = auprocCapi->getProcessBeginFrameTime(udata->auprocEngine);
+
+    uint32_t written = sample_ring_write(&udata->ring, inBuf, nframes);
+
+    TimeStamp* ts = atomic_snapshot_begin(&udata->timeStamps);
+    if (ts) {
+        ts->sampleCount = atomic_get(&udata->ring.writeCount);
+        ts->frameTime   = f0 + written;
+        atomic_snapshot_publish(&udata->timeStamps, ts);
+    }
+
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static float toOutput(AudioAnalyzerUserData* udata, float magnitude)
+{
+    if (udata->decibel) {
+        return 20 * log10f(magnitude > 1e-10f ? magnitude : 1e-10f);
+    } else {
+        return magnitude;
+    }
+}
+
+static void analyzeFrame(AudioAnalyzerUserData* udata)
+{
+    const uint32_t size = udata->size;
+    float* re = udata->re;
+    float* im = udata->im;
+
+    /* real FFT: even and odd values are packed into a half size complex FFT */
+    for (uint32_t i = 0; i < size / 2; ++i) {
+        re[i] = udata->frame[2 * i]     * udata->window[2 * i];
+        im[i] = udata->frame[2 * i + 1] * udata->window[2 * i + 1];
+    }
+    auproc_fft_real_forward(udata->fftPlan, re, im);
+
+    /* magnitudes are stored in re[0..size/2] */
+    for (uint32_t i = 0; i <= size / 2; ++i) {
+        re[i] = sqrtf(re[i] * re[i] + im[i] * im[i]) * udata->scale;
+    }
+    atomic_snapshot_update(&udata->timeStamps);
+    TimeStamp* ts        = atomic_snapshot_current(&udata->timeStamps);
+    uint32_t   frameTime = ts->frameTime - (ts->sampleCount - udata->consumed);
+
+    const receiver_capi* receiverCapi = udata->receiverCapi;
+    receiver_writer*     writer       = udata->receiverWriter;
+
+    uint32_t count = (udata->bandCount > 0) ? (uint32_t)udata->bandCount : size / 2 + 1;
+    int      rc    = receiverCapi->addIntegerToWriter(writer, frameTime);
+    float*   data  = NULL;
+    if (rc == 0) {
+        data = receiverCapi->addArrayToWriter(writer, RECEIVER_FLOAT, count);
+    }
+    if (data) {
+        if (udata->bandCount > 0) {
+            for (int b = 0; b < udata->bandCount; ++b) {
+                uint32_t begin = udata->bandStart[b];
+                uint32_t end   = udata->bandStart[b + 1];
+                float    sum   = 0;
+                for (uint32_t i = begin; i < end; ++i) {
+                    sum += re[i] * re[i];
+                }
+                data[b] = toOutput(udata, sqrtf(sum / (end - begin)));
+            }
+        } else {
+            for (uint32_t i = 0; i < count; ++i) {
+                data[i] = toOutput(udata, re[i]);
+            }
+        }
+        rc = receiverCapi->msgToReceiver(udata->receiver, writer, false /* clear */, true /* nonblock */,
+                                         NULL /* error handler */, NULL /* error handler data */);
+    }
+    if (!data || rc != 0) {
+        receiverCapi->clearWriter(writer);
+    }
+}
+
+static void workerThread(void* arg)
+{
+    AudioAnalyzerUserData* udata = (AudioAnalyzerUserData*) arg;
+
+    while (!atomic_get(&udata->stopRequested)) {
+        while (true) {
+            uint32_t n = sample_ring_read(&udata->ring, udata->frame + udata->fill, udata->size - udata->fill);
+            udata->fill     += n;
+            udata->consumed += n;
+            if (udata->fill < udata->size) {
+                break;
+            }
+            if (udata->sinceSent >= udata->minDistance) {
+                analyzeFrame(udata);
+                udata->sinceSent = 0;
+            }
+            udata->sinceSent += udata->hop;
+            udata->fill      -= udata->hop;
+            memmove(udata->frame, udata->frame + udata->hop, sizeof(float) * udata->fill);
+        }
+        async_sleep_millis(WORKER_SLEEP_MILLIS);
+    }
+}
+
+/* ============================================================================================ */
+
+static void engineClosedCallback(void* processorData)
+{
+    AudioAnalyzerUserData* udata = (AudioAnalyzerUserData*) processorData;
+
+    udata->closed    = true;
+    udata->activated = false;
+}
+
+static void engineReleasedCallback(void* processorData)
+{
+    AudioAnalyzerUserData* udata = (AudioAnalyzerUserData*) processorData;
+
+    udata->closed       = true;
+    udata->activated    = false;
+    udata->auprocCapi    = NULL;
+    udata->auprocEngine  = NULL;
+}
+
+/* ============================================================================================ */
+
+static void setupBands(AudioAnalyzerUserData* udata, double minFreq)
+{
+    const uint32_t bins    = udata->size / 2 + 1;
+    const double   binFreq = (double)udata->sampleRate / udata->size;
+    const double   maxFreq = udata->sampleRate / 2.0;
+
+    for (int b = 0; b <= udata->bandCount; ++b) {
+        double   f = minFreq * pow(maxFreq / minFreq, (double)b / udata->bandCount);
+        uint32_t i = (uint32_t)(f / binFreq + 0.5);
+        udata->bandStart[b] = (i < bins) ? i : bins;
+    }
+    udata->bandStart[udata->bandCount] = bins;
+    for (int b = 0; b < udata->bandCount; ++b) {
+        /* each band contains at least one bin */
+        if (udata->bandStart[b + 1] <= udata->bandStart[b]) {
+            udata->bandStart[b + 1] = udata->bandStart[b] + 1;
+        }
+    }
+    for (int b = udata->bandCount; b > 0; --b) {
+        if (udata->bandStart[b - 1] >= udata->bandStart[b]) {
+            udata->bandStart[b - 1] = udata->bandStart[b] - 1;
+        }
+    }
+}
+
+static int AudioAnalyzer_new(lua_State* L)
+{
+    const int conArg  = 1;
+    const int recvArg = 2;
+    const int optArg  = 3;
+    lua_settop(L, optArg);                                /* -> args */
+    AudioAnalyzerUserData* udata = lua_newuserdata(L, sizeof(AudioAnalyzerUserData));
+    memset(udata, 0, sizeof(AudioAnalyzerUserData));
+    udata->className = AUDIO_ANALYZER_CLASS_NAME;
+    pushAudioAnalyzerMeta(L);                             /* -> args, udata, meta */
+    lua_setmetatable(L, -2);                              /* -> args, udata */
+    int versionError = 0;
+    const auproc_capi* capi = auproc_get_capi(L, conArg, &versionError);
+    auproc_engine* engine = NULL;
+    auproc_info    info   = {0};
+    if (capi) {
+        engine = capi->getEngine(L, conArg, &info);
+    }
+    if (!capi || !engine) {
+        if (versionError) {
+            return luaL_argerror(L, conArg, "auproc version mismatch");
+        } else {
+            return luaL_argerror(L, conArg, "expected connector object");
+        }
+    }
+    if (info.sampleRate == 0) {
+        return luaL_argerror(L, conArg, "cannot determine sample rate");
+    }
+    udata->sampleRate = info.sampleRate;
+
+    int errReason = 0;
+    const receiver_capi* receiverCapi = receiver_get_capi(L, recvArg, &errReason);
+    if (!receiverCapi) {
+        if (errReason == 1) {
+            return luaL_argerror(L, recvArg, "receiver capi version mismatch");
+        } else {
+            return luaL_argerror(L, recvArg, "expected object with receiver capi");
+        }
+    }
+    receiver_object* receiver = receiverCapi->toReceiver(L, recvArg);
+    if (!receiver) {
+        return luaL_argerror(L, recvArg, "expected object with receiver capi");
+    }
+    udata->receiverCapi = receiverCapi;
+    udata->receiver     = receiver;
+    receiverCapi->retainReceiver(receiver);
+
+    udata->receiverWriter = receiverCapi->newWriter(16 * 1024, 1);
+    if (!udata->receiverWriter) {
+        return luaL_error(L, "out of memory");
+    }
+
+    lua_Number  size       = 2048;
+    lua_Number  hop        = 0;
+    lua_Number  rate       = 20;
+    lua_Number  bands      = 0;
+    lua_Number  minFreq    = 20;
+    const char* windowName = "hann";
+
+    if (!lua_isnoneornil(L, optArg)) {
+        luaL_checktype(L, optArg, LUA_TTABLE);
+        size    = auproc_util_opt_number_field(L, optArg, "size",    size);
+        hop     = auproc_util_opt_number_field(L, optArg, "hop",     hop);
+        rate    = auproc_util_opt_number_field(L, optArg, "rate",    rate);
+        bands   = auproc_util_opt_number_field(L, optArg, "bands",   bands);
+        minFreq = auproc_util_opt_number_field(L, optArg, "minFreq", minFreq);
+        lua_getfield(L, optArg, "window");                /* -> args, udata, window */
+        if (!lua_isnil(L, -1)) {
+            windowName = lua_tostring(L, -1);
+            luaL_argcheck(L, windowName, optArg, "string expected for field 'window'");
+        }
+        lua_getfield(L, optArg, "db");                    /* -> args, udata, window, db */
+        udata->decibel = lua_toboolean(L, -1);
+        lua_pop(L, 1);                                    /* -> args, udata, window */
+    }
+    if (hop == 0) {
+        hop = size / 2;
+    }
+    luaL_argcheck(L, auproc_fft_is_valid_size(size), optArg, "power of two expected for field 'size'");
+    luaL_argcheck(L, hop >= 1 && hop <= size,        optArg, "invalid value for field 'hop'");
+    luaL_argcheck(L, rate > 0,                       optArg, "positive value expected for field 'rate'");
+    luaL_argcheck(L, bands >= 0 && bands <= size / 2, optArg, "invalid value for field 'bands'");
+    luaL_argcheck(L, minFreq > 0 && minFreq < udata->sampleRate / 2.0, 
+                                                     optArg, "invalid value for field 'minFreq'");
+
+    udata->size        = size;
+    udata->hop         = hop;
+    udata->minDistance = udata->sampleRate / rate;
+    udata->sinceSent   = udata->minDistance;
+    udata->bandCount   = bands;
+
+    udata->fftPlan   = auproc_fft_new(udata->size / 2);
+    udata->window    = malloc(sizeof(float) * udata->size);
+    udata->frame     = malloc(sizeof(float) * udata->size);
+    udata->re        = malloc(sizeof(float) * udata->size);
+    udata->im        = malloc(sizeof(float) * udata->size);
+    udata->bandStart = malloc(sizeof(uint32_t) * (udata->bandCount + 1));
+    if (   !udata->fftPlan || !udata->window || !udata->frame || !udata->re || !udata->im 
+        || !udata->bandStart
+        || !sample_ring_init(&udata->ring, 4 * udata->size + udata->sampleRate / 2)
+        || !atomic_snapshot_init(&udata->timeStamps, sizeof(TimeStamp)))
+    {
+        return luaL_error(L, "out of memory");
+    }
+    if (!auproc_fft_window(udata->window, udata->size, windowName)) {
+        return luaL_argerror(L, optArg, lua_pushfstring(L, "invalid window '%s'", windowName));
+    }
+    lua_settop(L, optArg + 1);                            /* -> args, udata */
+    {
+        double sum = 0;
+        for (uint32_t i = 0; i < udata->size; ++i) {
+            sum += udata->window[i];
+        }
+        udata->scale = 2 / sum;
+    }
+    if (udata->bandCount > 0) {
+        setupBands(udata, minFreq);
+    }
+    const char* processorName = lua_pushfstring(L, "%s: %p", AUDIO_ANALYZER_CLASS_NAME, udata);   /* -> args, udata, name */
+
+    auproc_con_reg conReg = {AUPROC_AUDIO, AUPROC_IN, NULL};
+    auproc_con_reg_err regError = {0};
+    auproc_processor* proc = capi->registerProcessor(L, conArg, 1, engine, processorName, udata,
+                                                         processCallback, NULL, engineClosedCallback, engineReleasedCallback,
+                                                         &conReg, &regError);
+    lua_pop(L, 1); /* -> args, udata */
+
+    if (!proc)
+    {
+        if (regError.errorType == AUPROC_REG_ERR_CONNCTOR_INVALID) {
+            return luaL_argerror(L, conArg, "invalid connector object");
+        }
+        else if (regError.errorType == AUPROC_REG_ERR_ENGINE_MISMATCH)
+        {
+            const char* msg = lua_pushfstring(L, "connector belongs to other %s",
+                                                 capi->engine_category_name);
+            return luaL_argerror(L, conArg, msg);
+        }
+        else if (regError.errorType == AUPROC_REG_ERR_ARG_INVALID
+              || regError.errorType == AUPROC_REG_ERR_WRONG_DIRECTION
+              || regError.errorType == AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE)
+        {
+            return luaL_argerror(L, conArg, "expected AUDIO IN connector");
+        }
+        else {
+            return luaL_error(L, "cannot register processor (err=%d)", regError.errorType);
+        }
+    }
+    udata->processor        = proc;
+    udata->activated        = false;
+    udata->auprocCapi       = capi;
+    udata->auprocEngine     = engine;
+    udata->audioInConnector = conReg.connector;
+    udata->audioMethods     = conReg.audioMethods;
+
+    if (!async_thread_start(&udata->thread, workerThread, udata)) {
+        return luaL_error(L, "cannot start worker thread");
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioAnalyzer_release(lua_State* L)
+{
+    AudioAnalyzerUserData* udata = luaL_checkudata(L, 1, AUDIO_ANALYZER_CLASS_NAME);
+    udata->closed    = true;
+    udata->activated = false;
+    if (udata->auprocCapi) {
+        udata->auprocCapi->unregisterProcessor(L, udata->auprocEngine, udata->processor);
+        udata->processor   = NULL;
+        udata->auprocCapi   = NULL;
+        udata->auprocEngine = NULL;
+    }
+    if (udata->thread.started) {
+        atomic_set(&udata->stopRequested, true);
+        async_thread_join(&udata->thread);
+    }
+    if (udata->receiver) {
+        if (udata->receiverWriter) {
+            udata->receiverCapi->freeWriter(udata->receiverWriter);
+            udata->receiverWriter = NULL;
+        }
+        udata->receiverCapi->releaseReceiver(udata->receiver);
+        udata->receiver     = NULL;
+        udata->receiverCapi = NULL;
+    }
+    if (udata->fftPlan) {
+        auproc_fft_free(udata->fftPlan);
+        udata->fftPlan = NULL;
+    }
+    if (udata->window)    { free(udata->window);    udata->window    = NULL; }
+    if (udata->frame)     { free(udata->frame);     udata->frame     = NULL; }
+    if (udata->re)        { free(udata->re);        udata->re        = NULL; }
+    if (udata->im)        { free(udata->im);        udata->im        = NULL; }
+    if (udata->bandStart) { free(udata->bandStart); udata->bandStart = NULL; }
+    sample_ring_free(&udata->ring);
+    atomic_snapshot_free(&udata->timeStamps);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioAnalyzer_toString(lua_State* L)
+{
+    AudioAnalyzerUserData* udata = luaL_checkudata(L, 1, AUDIO_ANALYZER_CLASS_NAME);
+
+    lua_pushfstring(L, "%s: %p", AUDIO_ANALYZER_CLASS_NAME, udata);
+
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioAnalyzer_activate(lua_State* L)
+{
+    AudioAnalyzerUserData* udata = checkAudioAnalyzerUdata(L, 1);
+    if (!udata->activated) {
+        udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = true;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioAnalyzer_deactivate(lua_State* L)
+{
+    AudioAnalyzerUserData* udata = checkAudioAnalyzerUdata(L, 1);
+    if (udata->activated) {
+        udata->auprocCapi->deactivateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = false;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static const luaL_Reg AudioAnalyzerMethods[] =
+{
+    { "activate",    AudioAnalyzer_activate },
+    { "deactivate",  AudioAnalyzer_deactivate },
+    { "close",       AudioAnalyzer_release },
+    { NULL,          NULL } /* sentinel */
+};
+
+static const luaL_Reg AudioAnalyzerMetaMethods[] =
+{
+    { "__tostring", AudioAnalyzer_toString },
+    { "__gc",       AudioAnalyzer_release  },
+
+    { NULL,       NULL } /* sentinel */
+};
+
+static const luaL_Reg ModuleFunctions[] =
+{
+    { "new_audio_analyzer", AudioAnalyzer_new },
+    { NULL,                 NULL } /* sentinel */
+};
+
+/* ============================================================================================ */
+
+static void setupAudioAnalyzerMeta(lua_State* L)
+{                                                          /* -> meta */
+    lua_pushstring(L, AUDIO_ANALYZER_CLASS_NAME);          /* -> meta, className */
+    lua_setfield(L, -2, "__metatable");                    /* -> meta */
+
+    luaL_setfuncs(L, AudioAnalyzerMetaMethods, 0);         /* -> meta */
+
+    lua_newtable(L);                                       /* -> meta, AudioAnalyzerClass */
+    luaL_setfuncs(L, AudioAnalyzerMethods, 0);             /* -> meta, AudioAnalyzerClass */
+    lua_setfield (L, -2, "__index");                       /* -> meta */
+}
+
+
+/* ============================================================================================ */
+
+int auproc_audio_analyzer_init_module(lua_State* L, int module)
+{
+    if (luaL_newmetatable(L, AUDIO_ANALYZER_CLASS_NAME)) {
+        setupAudioAnalyzerMeta(L);
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, module);
+        luaL_setfuncs(L, ModuleFunctions, 0);
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+/* ============================================================================================ */
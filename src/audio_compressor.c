@@ -0,0 +1,730 @@
+#include "audio_compressor.h"
+#include "async_util.h"
+#include "simd_util.h"
+
+#define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
+#include "auproc_capi.h"
+
+/* ============================================================================================ */
+
+static const char* const AUDIO_COMPRESSOR_CLASS_NAME = "auproc.audio_compressor";
+
+static const char* ERROR_INVALID_AUDIO_COMPRESSOR = "invalid auproc.audio_compressor";
+
+/* ============================================================================================ */
+
+#define BLOCK_FRAMES  64
+
+typedef struct CompParams              CompParams;
+typedef struct CompCoeffs              CompCoeffs;
+typedef struct ChannelConnection       ChannelConnection;
+typedef struct AudioCompressorUserData AudioCompressorUserData;
+
+/**
+ * Parameters as given by the caller.
+ */
+struct CompParams
+{
+    double  threshold;    /* dB */
+    double  ratio;
+    double  knee;         /* dB */
+    double  attack;       /* seconds */
+    double  release;      /* seconds */
+    double  makeup;       /* dB */
+    bool    limit;
+};
+
+/**
+ * Values derived from CompParams for the realtime thread.
+ */
+struct CompCoeffs
+{
+    float   threshold;
+    float   thresholdGain;
+    float   slope;        /* 1/ratio - 1 */
+    float   knee;
+    float   attackCoeff;
+    float   releaseCoeff;
+    float   makeupGain;
+    bool    limit;
+};
+
+struct ChannelConnection
+{
+    auproc_connector*       inConnector;
+    const auproc_audiometh* inMethods;
+    auproc_connector*       outConnector;
+    const auproc_audiometh* outMethods;
+    float*                  inBuf;
+    float*                  outBuf;
+    float*                  delay;
+};
+
+struct AudioCompressorUserData
+{
+    const char*        className;
+    auproc_processor*  processor;
+
+    bool               closed;
+    bool               activated;
+
+    const auproc_capi*  auprocCapi;
+    auproc_engine*      auprocEngine;
+    uint32_t            sampleRate;
+
+    auproc_con_reg*     connectorRegs;
+    ChannelConnection*  channels;
+    int                 channelCount;
+
+    auproc_connector*       sideConnector;
+    const auproc_audiometh* sideMethods;
+
+    CompParams         params;
+    AtomicSnapshot     coeffs;
+
+    uint32_t           lookahead;
+    uint32_t           delayMask;
+    uint32_t           delayPos;
+
+    float              detector[BLOCK_FRAMES];
+    float              gain[BLOCK_FRAMES];
+    float              smoothed;
+
+    /* Sliding minimum of the target gain over lookahead + 1 frames
+     * (monotonic queue) and moving average over lookahead frames
+     * for the limiter. */
+    uint32_t           frameCount;
+    uint32_t           minMask;
+    uint32_t           minHead;
+    uint32_t           minTail;
+    uint32_t*          minIndex;
+    float*             minValue;
+    float*             box;
+    uint32_t           boxSize;
+    uint32_t           boxPos;
+    double             boxSum;
+    bool               limiting;           /* box is filled */
+};
+
+/* ============================================================================================ */
+
+static void setupAudioCompressorMeta(lua_State* L);
+
+static int pushAudioCompressorMeta(lua_State* L)
+{
+    if (luaL_newmetatable(L, AUDIO_COMPRESSOR_CLASS_NAME)) {
+        setupAudioCompressorMeta(L);
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static AudioCompressorUserData* checkAudioCompressorUdata(lua_State* L, int arg)
+{
+    AudioCompressorUserData* udata = luaL_checkudata(L, arg, AUDIO_COMPRESSOR_CLASS_NAME);
+    if (udata->auprocCapi) {
+        udata->auprocCapi->checkEngineIsNotClosed(L, udata->auprocEngine);
+    }
+    if (udata->closed) {
+        luaL_error(L, ERROR_INVALID_AUDIO_COMPRESSOR);
+        return NULL;
+    }
+    return udata;
+}
+
+/* ============================================================================================ */
+
+static void setCoeffs(CompCoeffs* c, const CompParams* p, uint32_t sampleRate)
+{
+    c->threshold     = p->threshold;
+    c->thresholdGain = pow(10, p->threshold / 20);
+    c->slope         = 1 / p->ratio - 1;
+    c->knee          = p->knee;
+    c->attackCoeff   = auproc_util_time_coeff(p->attack,  sampleRate);
+    c->releaseCoeff  = auproc_util_time_coeff(p->release, sampleRate);
+    c->makeupGain    = pow(10, p->makeup / 20);
+    c->limit         = p->limit;
+}
+
+/* ============================================================================================ */
+
+/**
+ * Static gain curve with soft knee, level and result in dB.
+ */
+static inline float gainComputer(const CompCoeffs* c, float level)
+{
+    float over = level - c->threshold;
+    if (2 * over <= -c->knee) {
+        return 0;
+    } else if (2 * over < c->knee) {
+        float x = over + c->knee / 2;
+        return c->slope * x * x / (2 * c->knee);
+    } else {
+        return c->slope * over;
+    }
+}
+
+/**
+ * det[i] = max(det[i], |in[i]|), or |in[i]| if init is true.
+ */
+static void absMax(float* restrict det, const float* restrict in, uint32_t m, bool init)
+{
+    uint32_t i = 0;
+    for (; i + VEC4_WIDTH <= m; i += VEC4_WIDTH) {
+        Vec4 a = vec4_abs(vec4_load(in + i));
+        vec4_store(det + i, init ? a : vec4_max(a, vec4_load(det + i)));
+    }
+    for (; i < m; ++i) {
+        float a = fabsf(in[i]);
+        det[i] = (init || a > det[i]) ? a : det[i];
+    }
+}
+
+/**
+ * out[i] = in[i] * gain[i]
+ */
+static void mulFrames(float* restrict out, const float* restrict in, const float* restrict gain, uint32_t m)
+{
+    uint32_t i = 0;
+    for (; i + VEC4_WIDTH <= m; i += VEC4_WIDTH) {
+        vec4_store(out + i, vec4_mul(vec4_load(in + i), vec4_load(gain + i)));
+    }
+    for (; i < m; ++i) {
+        out[i] = in[i] * gain[i];
+    }
+}
+
+/**
+ * Computes the target gain for the detector values in udata->detector.
+ */
+static void computeTargetGain(AudioCompressorUserData* udata, const CompCoeffs* c, uint32_t m)
+{
+    const float* restrict det  = udata->detector;
+    float*       restrict gain = udata->gain;
+
+    if (c->limit) {
+        const float t = c->thresholdGain;
+        for (uint32_t i = 0; i < m; ++i) {
+            gain[i] = t / (det[i] > t ? det[i] : t);
+        }
+    } else {
+        for (uint32_t i = 0; i < m; ++i) {
+            float level = 20 * log10f(det[i] > 1e-9f ? det[i] : 1e-9f);
+            gain[i] = powf(10, gainComputer(c, level) / 20);
+        }
+    }
+}
+
+/**
+ * Smoothes the target gain in udata->gain in place.
+ */
+static void smoothGain(AudioCompressorUserData* udata, const CompCoeffs* c, uint32_t m)
+{
+    float*         gain    = udata->gain;
+    uint32_t*      minIdx  = udata->minIndex;
+    float*         minVal  = udata->minValue;
+    const uint32_t minMask = udata->minMask;
+    const uint32_t window  = udata->lookahead + 1;
+    const float    att     = c->attackCoeff;
+    const float    rel     = c->releaseCoeff;
+    float          s       = udata->smoothed;
+
+    if (c->limit && !udata->limiting) {
+        /* the moving average starts from the current gain */
+        for (uint32_t i = 0; i < udata->boxSize; ++i) {
+            udata->box[i] = s;
+        }
+        udata->boxSum = (double)s * udata->boxSize;
+    }
+    udata->limiting = c->limit;
+
+    for (uint32_t i = 0; i < m; ++i) {
+        const uint32_t t      = udata->frameCount++;
+        const float    target = gain[i];
+
+        /* sliding minimum over the last lookahead + 1 frames */
+        while (udata->minTail != udata->minHead && minVal[(udata->minTail - 1) & minMask] >= target) {
+            udata->minTail -= 1;
+        }
+        minIdx[udata->minTail & minMask] = t;
+        minVal[udata->minTail & minMask] = target;
+        udata->minTail += 1;
+        if (t - minIdx[udata->minHead & minMask] >= window) {
+            udata->minHead += 1;
+        }
+        float g;
+        if (c->limit) {
+            /* instant attack to the held minimum, then moving average over
+             * the lookahead: the gain is always below the target gain when
+             * the delayed frame arrives */
+            float h = minVal[udata->minHead & minMask];
+            s = rel * s + (1 - rel) * h;
+            if (s > h) {
+                s = h;
+            }
+            udata->boxSum += s - udata->box[udata->boxPos];
+            udata->box[udata->boxPos] = s;
+            if (++udata->boxPos == udata->boxSize) {
+                udata->boxPos = 0;
+            }
+            g = udata->boxSum / udata->boxSize;
+        } else {
+            float k = (target < s) ? att : rel;
+            s = k * s + (1 - k) * target;
+            g = s;
+        }
+        gain[i] = g;
+    }
+    udata->smoothed = s;
+}
+
+static int processCallback(uint32_t nframes, void* processorData)
+{
+    AudioCompressorUserData* udata    = (AudioCompressorUserData*) processorData;
+    ChannelConnection*       channels = udata->channels;
+    const int                n        = udata->channelCount;
+
+    atomic_snapshot_update(&udata->coeffs);
+    const CompCoeffs* coeffs = atomic_snapshot_current(&udata->coeffs);
+
+    for (int ch = 0; ch < n; ++ch) {
+        channels[ch].inBuf  = channels[ch].inMethods ->getAudioBuffer(channels[ch].inConnector,  nframes);
+        channels[ch].outBuf = channels[ch].outMethods->getAudioBuffer(channels[ch].outConnector, nframes);
+    }
+    const float* side = NULL;
+    if (udata->sideConnector) {
+        side = udata->sideMethods->getAudioBuffer(udata->sideConnector, nframes);
+    }
+    const uint32_t lookahead = udata->lookahead;
+    const uint32_t mask      = udata->delayMask;
+    const float    makeup    = coeffs->makeupGain;
+
+    float* restrict det  = udata->detector;
+    float* restrict gain = udata->gain;
+
+    for (uint32_t f0 = 0; f0 < nframes; f0 += BLOCK_FRAMES)
+    {
+        uint32_t m = (nframes - f0 < BLOCK_FRAMES) ? nframes - f0 : BLOCK_FRAMES;
+
+        if (side) {
+            absMax(det, side + f0, m, true);
+        } else {
+            for (int ch = 0; ch < n; ++ch) {
+                absMax(det, channels[ch].inBuf + f0, m, ch == 0);
+            }
+        }
+        computeTargetGain(udata, coeffs, m);
+        smoothGain(udata, coeffs, m);
+
+        const Vec4 makeupv = vec4_set1(makeup);
+        uint32_t   i       = 0;
+        for (; i + VEC4_WIDTH <= m; i += VEC4_WIDTH) {
+            vec4_store(gain + i, vec4_mul(vec4_load(gain + i), makeupv));
+        }
+        for (; i < m; ++i) {
+            gain[i] *= makeup;
+        }
+        const uint32_t pos = udata->delayPos;
+        const uint32_t rd  = (pos - lookahead) & mask;
+        for (int ch = 0; ch < n; ++ch) {
+            const float* restrict in    = channels[ch].inBuf + f0;
+            float*       restrict out   = channels[ch].outBuf + f0;
+            float*       restrict delay = channels[ch].delay;
+            /* the delay line is at least lookahead + BLOCK_FRAMES long, i.e.
+             * each access is at most split into two contiguous parts */
+            uint32_t w = (m < mask + 1 - pos) ? m : mask + 1 - pos;
+            memcpy(delay + pos, in,     sizeof(float) * w);
+            memcpy(delay,       in + w, sizeof(float) * (m - w));
+            uint32_t r = (m < mask + 1 - rd) ? m : mask + 1 - rd;
+            mulFrames(out,     delay + rd, gain,     r);
+            mulFrames(out + r, delay,      gain + r, m - r);
+        }
+        udata->delayPos = (pos + m) & mask;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static void engineClosedCallback(void* processorData)
+{
+    AudioCompressorUserData* udata = (AudioCompressorUserData*) processorData;
+
+    udata->closed    = true;
+    udata->activated = false;
+}
+
+static void engineReleasedCallback(void* processorData)
+{
+    AudioCompressorUserData* udata = (AudioCompressorUserData*) processorData;
+
+    udata->closed       = true;
+    udata->activated    = false;
+    udata->auprocCapi    = NULL;
+    udata->auprocEngine  = NULL;
+}
+
+/* ============================================================================================ */
+
+/**
+ * Reads the parameters from the table at arg, missing fields keep
+ * their values.
+ */
+static void checkParams(lua_State* L, int arg, CompParams* p)
+{
+    luaL_checktype(L, arg, LUA_TTABLE);
+
+    lua_getfield(L, arg, "limit");                        /* -> limit */
+    if (!lua_isnil(L, -1)) {
+        p->limit = lua_toboolean(L, -1);
+    }
+    lua_pop(L, 1);                                        /* -> */
+
+    p->threshold = auproc_util_opt_number_field(L, arg, "threshold", p->threshold);
+    p->ratio     = auproc_util_opt_number_field(L, arg, "ratio",     p->ratio);
+    p->knee      = auproc_util_opt_number_field(L, arg, "knee",      p->knee);
+    p->attack    = auproc_util_opt_number_field(L, arg, "attack",    p->attack);
+    p->release   = auproc_util_opt_number_field(L, arg, "release",   p->release);
+    p->makeup    = auproc_util_opt_number_field(L, arg, "makeup",    p->makeup);
+
+    luaL_argcheck(L, p->ratio >= 1,   arg, "ratio must be >= 1");
+    luaL_argcheck(L, p->knee >= 0,    arg, "knee must be >= 0");
+    luaL_argcheck(L, p->attack >= 0,  arg, "attack must be >= 0");
+    luaL_argcheck(L, p->release >= 0, arg, "release must be >= 0");
+}
+
+static int AudioCompressor_new(lua_State* L)
+{
+    const int firstArg = 1;
+    const int lastArg  = lua_gettop(L);
+
+    AudioCompressorUserData* udata = lua_newuserdata(L, sizeof(AudioCompressorUserData));
+    memset(udata, 0, sizeof(AudioCompressorUserData));
+    udata->className = AUDIO_COMPRESSOR_CLASS_NAME;
+    pushAudioCompressorMeta(L);                           /* -> udata, meta */
+    lua_setmetatable(L, -2);                              /* -> udata */
+    int versionError = 0;
+    const auproc_capi* capi = auproc_get_capi(L, firstArg, &versionError);
+    auproc_engine* engine = NULL;
+    auproc_info    info   = {0};
+    if (capi) {
+        engine = capi->getEngine(L, firstArg, &info);
+    }
+    if (!capi || !engine) {
+        if (versionError) {
+            return luaL_argerror(L, firstArg, "auproc capi version mismatch");
+        } else {
+            return luaL_argerror(L, firstArg, "expected connector object");
+        }
+    }
+    if (info.sampleRate == 0) {
+        return luaL_argerror(L, firstArg, "cannot determine sample rate");
+    }
+    const int firstConArg = (capi->getObjectType(L, firstArg) == AUPROC_TENGINE) ? firstArg + 1 : firstArg;
+    int lastConArg = lastArg;
+    for (int i = firstConArg; i <= lastArg; ++i) {
+        if (!capi->getConnectorType(L, i)) {
+            lastConArg = i - 1;
+            break;
+        }
+    }
+    const int conCount = lastConArg - firstConArg + 1;
+    const int optArg   = lastConArg + 1;
+
+    if (conCount < 2) {
+        return luaL_argerror(L, firstConArg, "expected same number of input and output connector objects");
+    }
+    const int  n         = conCount / 2;
+    const int  outConArg = firstConArg + n;
+    const bool hasSide   = (conCount % 2 != 0);
+
+    udata->sampleRate = info.sampleRate;
+    udata->params.threshold = -20;
+    udata->params.ratio     = 4;
+    udata->params.knee      = 6;
+    udata->params.attack    = 0.005;
+    udata->params.release   = 0.1;
+    udata->params.makeup    = 0;
+    udata->params.limit     = false;
+
+    lua_Number lookahead = 0;
+    if (optArg <= lastArg) {
+        checkParams(L, optArg, &udata->params);
+        lookahead = auproc_util_opt_number_field(L, optArg, "lookahead", 0);
+        luaL_argcheck(L, 0 <= lookahead && lookahead <= 1, optArg, "lookahead out of range");
+    }
+    udata->lookahead = (uint32_t)(lookahead * info.sampleRate + 0.5);
+
+    uint32_t delaySize = 1;
+    while (delaySize < udata->lookahead + BLOCK_FRAMES) {
+        delaySize *= 2;
+    }
+    uint32_t minSize = 1;
+    while (minSize < udata->lookahead + 2) {
+        minSize *= 2;
+    }
+    udata->delayMask    = delaySize - 1;
+    udata->minMask      = minSize - 1;
+    udata->boxSize      = udata->lookahead > 0 ? udata->lookahead : 1;
+    udata->smoothed     = 1;
+    udata->boxSum       = udata->boxSize;
+    udata->channelCount = n;
+    udata->channels      = calloc(n, sizeof(ChannelConnection));
+    udata->connectorRegs = calloc(conCount, sizeof(auproc_con_reg));
+    udata->minIndex      = calloc(minSize, sizeof(uint32_t));
+    udata->minValue      = calloc(minSize, sizeof(float));
+    udata->box           = calloc(udata->boxSize, sizeof(float));
+    if (   !udata->channels || !udata->connectorRegs
+        || !udata->minIndex || !udata->minValue || !udata->box
+        || !atomic_snapshot_init(&udata->coeffs, sizeof(CompCoeffs)))
+    {
+        return luaL_error(L, "out of memory");
+    }
+    for (uint32_t i = 0; i < udata->boxSize; ++i) {
+        udata->box[i] = 1;
+    }
+    for (int i = 0; i < n; ++i) {
+        udata->channels[i].delay = calloc(delaySize, sizeof(float));
+        if (!udata->channels[i].delay) {
+            return luaL_error(L, "out of memory");
+        }
+    }
+    setCoeffs(atomic_snapshot_current(&udata->coeffs), &udata->params, info.sampleRate);
+
+    const char* processorName = lua_pushfstring(L, "%s: %p", AUDIO_COMPRESSOR_CLASS_NAME, udata);   /* -> udata, name */
+
+    auproc_con_reg* conRegs = udata->connectorRegs;
+
+    const auproc_con_reg inConReg  = {AUPROC_AUDIO, AUPROC_IN,  NULL};
+    const auproc_con_reg outConReg = {AUPROC_AUDIO, AUPROC_OUT, NULL};
+
+    for (int i = 0; i < n; ++i) {
+        conRegs[i]     = inConReg;
+        conRegs[n + i] = outConReg;
+    }
+    if (hasSide) {
+        conRegs[2 * n] = inConReg;
+    }
+
+    auproc_con_reg_err regError = {0};
+    auproc_processor* proc = capi->registerProcessor(L, firstConArg, conCount, engine, processorName, udata,
+                                                         processCallback, NULL, engineClosedCallback, engineReleasedCallback,
+                                                         conRegs, &regError);
+    lua_pop(L, 1); /* -> udata */
+
+    if (!proc)
+    {
+        if (regError.conIndex >= 0)
+        {
+            int  errArg = firstConArg + regError.conIndex;
+            bool isOut  = (outConArg <= errArg && errArg < outConArg + n);
+
+            if (regError.errorType == AUPROC_REG_ERR_CONNCTOR_INVALID)
+            {
+                return luaL_argerror(L, errArg, "invalid connector object");
+            }
+            if (   regError.errorType == AUPROC_REG_ERR_ENGINE_MISMATCH)
+            {
+                const char* msg = lua_pushfstring(L, "connector belongs to other %s",
+                                                     capi->engine_category_name);
+                return luaL_argerror(L, errArg, msg);
+            }
+            if (regError.errorType == AUPROC_REG_ERR_ARG_INVALID
+             || regError.errorType == AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE)
+            {
+                if (!isOut) {
+                    return luaL_argerror(L, errArg, "expected AUDIO IN connector");
+                } else {
+                    return luaL_argerror(L, errArg, "expected AUDIO OUT connector");
+                }
+            }
+            if (regError.errorType == AUPROC_REG_ERR_WRONG_DIRECTION)
+            {
+                if (!isOut) {
+                    return luaL_argerror(L, errArg, "given connector is not readable");
+                } else {
+                    return luaL_argerror(L, errArg, "given connector is not writable");
+                }
+            }
+        }
+        return luaL_error(L, "cannot register processor (err=%d)", regError.errorType);
+    }
+
+    udata->processor    = proc;
+    udata->activated    = false;
+    udata->auprocCapi   = capi;
+    udata->auprocEngine = engine;
+
+    for (int i = 0; i < n; ++i) {
+        udata->channels[i].inConnector  = conRegs[i].connector;
+        udata->channels[i].inMethods    = conRegs[i].audioMethods;
+        udata->channels[i].outConnector = conRegs[n + i].connector;
+        udata->channels[i].outMethods   = conRegs[n + i].audioMethods;
+    }
+    if (hasSide) {
+        udata->sideConnector = conRegs[2 * n].connector;
+        udata->sideMethods   = conRegs[2 * n].audioMethods;
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioCompressor_release(lua_State* L)
+{
+    AudioCompressorUserData* udata = luaL_checkudata(L, 1, AUDIO_COMPRESSOR_CLASS_NAME);
+    udata->closed    = true;
+    udata->activated = false;
+    if (udata->auprocCapi) {
+        udata->auprocCapi->unregisterProcessor(L, udata->auprocEngine, udata->processor);
+        udata->processor   = NULL;
+        udata->auprocCapi   = NULL;
+        udata->auprocEngine = NULL;
+    }
+    if (udata->connectorRegs) {
+        free(udata->connectorRegs);
+        udata->connectorRegs = NULL;
+    }
+    if (udata->channels) {
+        for (int i = 0; i < udata->channelCount; ++i) {
+            free(udata->channels[i].delay);
+        }
+        free(udata->channels);
+        udata->channels     = NULL;
+        udata->channelCount = 0;
+    }
+    if (udata->minIndex) {
+        free(udata->minIndex);
+        udata->minIndex = NULL;
+    }
+    if (udata->minValue) {
+        free(udata->minValue);
+        udata->minValue = NULL;
+    }
+    if (udata->box) {
+        free(udata->box);
+        udata->box = NULL;
+    }
+    atomic_snapshot_free(&udata->coeffs);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioCompressor_toString(lua_State* L)
+{
+    AudioCompressorUserData* udata = luaL_checkudata(L, 1, AUDIO_COMPRESSOR_CLASS_NAME);
+
+    lua_pushfstring(L, "%s: %p", AUDIO_COMPRESSOR_CLASS_NAME, udata);
+
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioCompressor_activate(lua_State* L)
+{
+    AudioCompressorUserData* udata = checkAudioCompressorUdata(L, 1);
+    if (!udata->activated) {
+        udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = true;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioCompressor_deactivate(lua_State* L)
+{
+    AudioCompressorUserData* udata = checkAudioCompressorUdata(L, 1);
+    if (udata->activated) {
+        udata->auprocCapi->deactivateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = false;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioCompressor_set(lua_State* L)
+{
+    AudioCompressorUserData* udata = checkAudioCompressorUdata(L, 1);
+
+    CompParams p = udata->params;
+    checkParams(L, 2, &p);
+    udata->params = p;
+
+    CompCoeffs* slot = atomic_snapshot_begin(&udata->coeffs);
+    setCoeffs(slot, &p, udata->sampleRate);
+    atomic_snapshot_publish(&udata->coeffs, slot);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioCompressor_latency(lua_State* L)
+{
+    AudioCompressorUserData* udata = checkAudioCompressorUdata(L, 1);
+    lua_pushinteger(L, udata->lookahead);
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static const luaL_Reg AudioCompressorMethods[] =
+{
+    { "activate",    AudioCompressor_activate },
+    { "deactivate",  AudioCompressor_deactivate },
+    { "set",         AudioCompressor_set },
+    { "latency",     AudioCompressor_latency },
+    { "close",       AudioCompressor_release },
+    { NULL,          NULL } /* sentinel */
+};
+
+static const luaL_Reg AudioCompressorMetaMethods[] =
+{
+    { "__tostring", AudioCompressor_toString },
+    { "__gc",       AudioCompressor_release  },
+
+    { NULL,       NULL } /* sentinel */
+};
+
+static const luaL_Reg ModuleFunctions[] =
+{
+    { "new_audio_compressor", AudioCompressor_new },
+    { NULL,                   NULL } /* sentinel */
+};
+
+/* ============================================================================================ */
+
+static void setupAudioCompressorMeta(lua_State* L)
+{                                                          /* -> meta */
+    lua_pushstring(L, AUDIO_COMPRESSOR_CLASS_NAME);        /* -> meta, className */
+    lua_setfield(L, -2, "__metatable");                    /* -> meta */
+
+    luaL_setfuncs(L, AudioCompressorMetaMethods, 0);       /* -> meta */
+
+    lua_newtable(L);                                       /* -> meta, AudioCompressorClass */
+    luaL_setfuncs(L, AudioCompressorMethods, 0);           /* -> meta, AudioCompressorClass */
+    lua_setfield (L, -2, "__index");                       /* -> meta */
+}
+
+
+/* ============================================================================================ */
+
+int auproc_audio_compressor_init_module(lua_State* L, int module)
+{
+    if (luaL_newmetatable(L, AUDIO_COMPRESSOR_CLASS_NAME)) {
+        setupAudioCompressorMeta(L);
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, module);
+        luaL_setfuncs(L, ModuleFunctions, 0);
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+/* ============================================================================================ */
@@ -0,0 +1,799 @@
+#include "audio_convolver.h"
+#include "async_util.h"
+#include "simd_util.h"
+#include "fft.h"
+
+#define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
+#include "auproc_capi.h"
+
+/* ============================================================================================ */
+
+static const char* const AUDIO_CONVOLVER_CLASS_NAME = "auproc.audio_convolver";
+
+static const char* ERROR_INVALID_AUDIO_CONVOLVER = "invalid auproc.audio_convolver";
+
+/* ============================================================================================ */
+
+#define WORKER_SLEEP_MILLIS 2
+
+typedef struct Kernel                 Kernel;
+typedef struct Partitions             Partitions;
+typedef struct AudioConvolverUserData AudioConvolverUserData;
+
+/**
+ * The first head partition of the impulse response is convolved directly
+ * in the time domain, its taps are stored in reverse order. The rest of
+ * the impulse response is given as spectra of the partitions, bins 0..size
+ * of the zero padded partitions. The head partitions have the head partition
+ * size and cover the next two tail partitions of the impulse response, the
+ * tail partitions cover the rest.
+ */
+struct Kernel
+{
+    float*    direct;
+    uint32_t  headCount;
+    uint32_t  tailCount;
+    float*    headRe;
+    float*    headIm;
+    float*    tailRe;
+    float*    tailIm;
+};
+
+/**
+ * Uniformly partitioned overlap-save convolution with a frequency domain
+ * delay line of input spectra.
+ */
+struct Partitions
+{
+    uint32_t  size;
+    uint32_t  count;
+    FftPlan*  plan;                /* real FFT of size * 2 values */
+    float*    fdlRe;               /* count * (size + 1) */
+    float*    fdlIm;
+    uint32_t  fdlPos;
+    float*    input;               /* size * 2 */
+    float*    re;                  /* size + 1 */
+    float*    im;
+};
+
+struct AudioConvolverUserData
+{
+    const char*        className;
+    auproc_processor*  processor;
+
+    bool               closed;
+    bool               activated;
+
+    const auproc_capi*  auprocCapi;
+    auproc_engine*      auprocEngine;
+
+    auproc_connector*       audioInConnector;
+    const auproc_audiometh* audioInMethods;
+    auproc_connector*       audioOutConnector;
+    const auproc_audiometh* audioOutMethods;
+
+    uint32_t           headSize;
+    uint32_t           tailSize;
+    uint32_t           maxLength;
+
+    AtomicPtr          newKernel;        /* set by load(), taken by the process callback */
+    AtomicPtr          pendingKernel;    /* set by the process callback, taken by the worker */
+    AtomicCounter      switchBlock;      /* tail block from which the pending kernel is used */
+
+    /* the following members are only used by the process callback */
+
+    Kernel*            kernel;
+    Partitions         head;
+    float*             directIn;         /* headSize * 2, last headSize input frames and current frames */
+    float*             headIn;           /* headSize */
+    float*             headOut;          /* headSize */
+    float*             tailOut;          /* headSize */
+    uint32_t           headFill;
+    uint32_t           blockCount;
+    uint32_t           inDebt;
+    uint32_t           outDebt;
+
+    SampleRing         inRing;
+    SampleRing         outRing;
+    AtomicCounter      stopRequested;
+    AsyncThread        thread;
+
+    /* the following members are only used by the worker thread */
+
+    Kernel*            workerKernel;
+    Partitions         tail;
+    float*             tailIn;           /* tailSize */
+    float*             tailResult;       /* tailSize */
+    uint32_t           tailBlock;
+};
+
+/* ============================================================================================ */
+
+static bool partitions_init(Partitions* p, uint32_t size, uint32_t count)
+{
+    memset(p, 0, sizeof(Partitions));
+    p->size  = size;
+    p->count = count;
+    p->plan  = auproc_fft_new(size);
+    p->fdlRe = calloc(count * (size + 1), sizeof(float));
+    p->fdlIm = calloc(count * (size + 1), sizeof(float));
+    p->input = calloc(2 * size, sizeof(float));
+    p->re    = calloc(size + 1, sizeof(float));
+    p->im    = calloc(size + 1, sizeof(float));
+    return p->plan && p->fdlRe && p->fdlIm && p->input && p->re && p->im;
+}
+
+static void partitions_free(Partitions* p)
+{
+    if (p->plan) {
+        auproc_fft_free(p->plan);
+    }
+    free(p->fdlRe);
+    free(p->fdlIm);
+    free(p->input);
+    free(p->re);
+    free(p->im);
+    memset(p, 0, sizeof(Partitions));
+}
+
+/**
+ * Convolves the next size input samples with kernelCount partition spectra, 
+ * the result are size output samples.
+ */
+static void partitions_process(Partitions* p, const float* in, 
+                               const float* kernelRe, const float* kernelIm, uint32_t kernelCount,
+                               float* out)
+{
+    const uint32_t size = p->size;
+    const uint32_t bins = size + 1;
+    float* re = p->re;
+    float* im = p->im;
+
+    memcpy(p->input, p->input + size, sizeof(float) * size);
+    memcpy(p->input + size, in, sizeof(float) * size);
+    for (uint32_t i = 0; i < size; ++i) {
+        re[i] = p->input[2 * i];
+        im[i] = p->input[2 * i + 1];
+    }
+    auproc_fft_real_forward(p->plan, re, im);
+
+    float* slotRe = p->fdlRe + p->fdlPos * bins;
+    float* slotIm = p->fdlIm + p->fdlPos * bins;
+    memcpy(slotRe, re, sizeof(float) * bins);
+    memcpy(slotIm, im, sizeof(float) * bins);
+
+    if (kernelCount > p->count) {
+        kernelCount = p->count;
+    }
+    memset(re, 0, sizeof(float) * bins);
+    memset(im, 0, sizeof(float) * bins);
+    uint32_t pos = p->fdlPos;
+    for (uint32_t j = 0; j < kernelCount; ++j) {
+        const float* xRe = p->fdlRe + pos * bins;
+        const float* xIm = p->fdlIm + pos * bins;
+        const float* hRe = kernelRe + j * bins;
+        const float* hIm = kernelIm + j * bins;
+        for (uint32_t i = 0; i < bins; ++i) {
+            re[i] += xRe[i] * hRe[i] - xIm[i] * hIm[i];
+            im[i] += xRe[i] * hIm[i] + xIm[i] * hRe[i];
+        }
+        pos = (pos > 0) ? pos - 1 : p->count - 1;
+    }
+    p->fdlPos = (p->fdlPos + 1 < p->count) ? p->fdlPos + 1 : 0;
+
+    /* the second half of the packed result are the output samples */
+    auproc_fft_real_inverse(p->plan, re, im);
+    for (uint32_t i = 0; i < size / 2; ++i) {
+        out[2 * i]     = re[size / 2 + i];
+        out[2 * i + 1] = im[size / 2 + i];
+    }
+}
+
+/* ============================================================================================ */
+
+static void freeKernel(Kernel* k)
+{
+    if (k) {
+        free(k->direct);
+        free(k->headRe);
+        free(k->headIm);
+        free(k->tailRe);
+        free(k->tailIm);
+        free(k);
+    }
+}
+
+static bool transformPartitions(const float* ir, uint32_t irLength, uint32_t size, uint32_t count,
+                                float* kernelRe, float* kernelIm)
+{
+    FftPlan* plan = auproc_fft_new(size);
+    float*   re   = malloc(sizeof(float) * (size + 1));
+    float*   im   = malloc(sizeof(float) * (size + 1));
+    bool     ok   = plan && re && im;
+    if (ok) {
+        for (uint32_t j = 0; j < count; ++j) {
+            /* partition j zero padded to 2 * size values, packed for the real FFT */
+            for (uint32_t i = 0; i < size; ++i) {
+                uint32_t k = j * size + 2 * i;
+                re[i] = (2 * i     < size && k     < irLength) ? ir[k]     : 0;
+                im[i] = (2 * i + 1 < size && k + 1 < irLength) ? ir[k + 1] : 0;
+            }
+            auproc_fft_real_forward(plan, re, im);
+            memcpy(kernelRe + j * (size + 1), re, sizeof(float) * (size + 1));
+            memcpy(kernelIm + j * (size + 1), im, sizeof(float) * (size + 1));
+        }
+    }
+    if (plan) {
+        auproc_fft_free(plan);
+    }
+    free(re);
+    free(im);
+    return ok;
+}
+
+static Kernel* newKernel(AudioConvolverUserData* udata, const float* ir, uint32_t irLength)
+{
+    const uint32_t headLength = 2 * udata->tailSize;
+    const uint32_t directSize = udata->headSize;
+
+    Kernel* k = calloc(1, sizeof(Kernel));
+    if (!k) {
+        return NULL;
+    }
+    k->direct = calloc(directSize, sizeof(float));
+    if (!k->direct) {
+        freeKernel(k);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < directSize && i < irLength; ++i) {
+        k->direct[directSize - 1 - i] = ir[i];
+    }
+    /* the partitions convolve the rest, the partitioned output is delayed by directSize */
+    if (irLength > directSize) {
+        ir       += directSize;
+        irLength -= directSize;
+    } else {
+        irLength = 0;
+    }
+    k->headCount = headLength / udata->headSize;
+    k->tailCount = (irLength > headLength) ? (irLength - headLength + udata->tailSize - 1) / udata->tailSize : 0;
+    k->headRe = calloc(k->headCount * (udata->headSize + 1), sizeof(float));
+    k->headIm = calloc(k->headCount * (udata->headSize + 1), sizeof(float));
+    k->tailRe = calloc(k->tailCount * (udata->tailSize + 1) + 1, sizeof(float));
+    k->tailIm = calloc(k->tailCount * (udata->tailSize + 1) + 1, sizeof(float));
+    if (   !k->headRe || !k->headIm || !k->tailRe || !k->tailIm
+        || !transformPartitions(ir, irLength < headLength ? irLength : headLength,
+                                udata->headSize, k->headCount, k->headRe, k->headIm)
+        || !transformPartitions(ir + headLength, irLength > headLength ? irLength - headLength : 0,
+                                udata->tailSize, k->tailCount, k->tailRe, k->tailIm))
+    {
+        freeKernel(k);
+        return NULL;
+    }
+    return k;
+}
+
+/* ============================================================================================ */
+
+static void setupAudioConvolverMeta(lua_State* L);
+
+static int pushAudioConvolverMeta(lua_State* L)
+{
+    if (luaL_newmetatable(L, AUDIO_CONVOLVER_CLASS_NAME)) {
+        setupAudioConvolverMeta(L);
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static AudioConvolverUserData* checkAudioConvolverUdata(lua_State* L, int arg)
+{
+    AudioConvolverUserData* udata = luaL_checkudata(L, arg, AUDIO_CONVOLVER_CLASS_NAME);
+    if (udata->auprocCapi) {
+        udata->auprocCapi->checkEngineIsNotClosed(L, udata->auprocEngine);
+    }
+    if (udata->closed) {
+        luaL_error(L, ERROR_INVALID_AUDIO_CONVOLVER);
+        return NULL;
+    }
+    return udata;
+}
+
+/* ============================================================================================ */
+
+/**
+ * Hands the input block over to the worker. If the ring buffer is full, 
+ * the samples are replaced by zeros later to keep the tail aligned.
+ */
+static void writeTailInput(AudioConvolverUserData* udata)
+{
+    if (udata->inDebt > 0) {
+        udata->inDebt -= sample_ring_write_zeros(&udata->inRing, udata->inDebt);
+    }
+    if (udata->inDebt > 0) {
+        udata->inDebt += udata->headSize;
+    } else {
+        uint32_t n = sample_ring_write(&udata->inRing, udata->headIn, udata->headSize);
+        udata->inDebt += udata->headSize - n;
+    }
+}
+
+/**
+ * Takes the tail output for the current block from the worker. Samples that 
+ * the worker could not deliver in time are replaced by zeros and discarded 
+ * later to keep the tail aligned.
+ */
+static void readTailOutput(AudioConvolverUserData* udata)
+{
+    if (udata->outDebt > 0) {
+        udata->outDebt -= sample_ring_skip(&udata->outRing, udata->outDebt);
+    }
+    uint32_t n = 0;
+    if (udata->outDebt == 0) {
+        n = sample_ring_read(&udata->outRing, udata->tailOut, udata->headSize);
+    }
+    if (n < udata->headSize) {
+        memset(udata->tailOut + n, 0, sizeof(float) * (udata->headSize - n));
+        udata->outDebt += udata->headSize - n;
+    }
+}
+
+/**
+ * Adds the convolution of the n input frames with the first head partition
+ * of the impulse response to out.
+ */
+static void convolveDirect(AudioConvolverUserData* udata, const float* in, uint32_t n, float* out)
+{
+    const uint32_t headSize = udata->headSize;
+    float*         buf      = udata->directIn;
+    Kernel*        k        = udata->kernel;
+
+    memcpy(buf + headSize, in, sizeof(float) * n);
+    if (k) {
+        for (uint32_t i = 0; i < n; ++i) {
+            out[i] += vec4_dot(buf + i + 1, k->direct, headSize);
+        }
+    }
+    memmove(buf, buf + n, sizeof(float) * headSize);
+}
+
+static void processBlock(AudioConvolverUserData* udata)
+{
+    const uint32_t headSize = udata->headSize;
+    Kernel*        k        = udata->kernel;
+
+    writeTailInput(udata);
+    readTailOutput(udata);
+
+    if (k) {
+        partitions_process(&udata->head, udata->headIn, k->headRe, k->headIm, k->headCount, 
+                           udata->headOut);
+    } else {
+        partitions_process(&udata->head, udata->headIn, NULL, NULL, 0, udata->headOut);
+    }
+    for (uint32_t i = 0; i < headSize; ++i) {
+        udata->headOut[i] += udata->tailOut[i];
+    }
+    udata->blockCount += 1;
+
+    /* a new kernel is taken at tail partition boundaries only */
+    uint32_t blocksPerTail = udata->tailSize / headSize;
+    if (   udata->blockCount % blocksPerTail == 0
+        && !atomic_get_ptr(&udata->pendingKernel)
+        && atomic_get_ptr(&udata->newKernel))
+    {
+        Kernel* newKernel = atomic_swap_ptr(&udata->newKernel, NULL);
+        if (newKernel) {
+            atomic_set(&udata->switchBlock, udata->blockCount / blocksPerTail);
+            atomic_swap_ptr(&udata->pendingKernel, newKernel);
+            udata->kernel = newKernel;
+        }
+    }
+}
+
+static int processCallback(uint32_t nframes, void* processorData)
+{
+    AudioConvolverUserData* udata = (AudioConvolverUserData*) processorData;
+
+    const float* inBuf  = udata->audioInMethods->getAudioBuffer(udata->audioInConnector, nframes);
+    float*       outBuf = udata->audioOutMethods->getAudioBuffer(udata->audioOutConnector, nframes);
+
+    const uint32_t headSize = udata->headSize;
+    uint32_t i = 0;
+    while (i < nframes) {
+        uint32_t n = headSize - udata->headFill;
+        if (n > nframes - i) {
+            n = nframes - i;
+        }
+        memcpy(udata->headIn + udata->headFill, inBuf + i,                   sizeof(float) * n);
+        memcpy(outBuf + i,                      udata->headOut + udata->headFill, sizeof(float) * n);
+        convolveDirect(udata, inBuf + i, n, outBuf + i);
+        udata->headFill += n;
+        i               += n;
+        if (udata->headFill == headSize) {
+            processBlock(udata);
+            udata->headFill = 0;
+        }
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static void workerThread(void* arg)
+{
+    AudioConvolverUserData* udata = (AudioConvolverUserData*) arg;
+
+    const uint32_t tailSize = udata->tailSize;
+
+    while (!atomic_get(&udata->stopRequested)) {
+        while (   sample_ring_available(&udata->inRing) >= tailSize
+               && udata->outRing.mask + 1 - sample_ring_available(&udata->outRing) >= tailSize)
+        {
+            sample_ring_read(&udata->inRing, udata->tailIn, tailSize);
+
+            if (   atomic_get_ptr(&udata->pendingKernel)
+                && udata->tailBlock - (uint32_t)atomic_get(&udata->switchBlock) < 0x80000000)
+            {
+                freeKernel(udata->workerKernel);
+                udata->workerKernel = atomic_swap_ptr(&udata->pendingKernel, NULL);
+            }
+            Kernel* k = udata->workerKernel;
+            if (k) {
+                partitions_process(&udata->tail, udata->tailIn, k->tailRe, k->tailIm, k->tailCount,
+                                   udata->tailResult);
+            } else {
+                partitions_process(&udata->tail, udata->tailIn, NULL, NULL, 0, udata->tailResult);
+            }
+            sample_ring_write(&udata->outRing, udata->tailResult, tailSize);
+            udata->tailBlock += 1;
+        }
+        async_sleep_millis(WORKER_SLEEP_MILLIS);
+    }
+}
+
+/* ============================================================================================ */
+
+static void engineClosedCallback(void* processorData)
+{
+    AudioConvolverUserData* udata = (AudioConvolverUserData*) processorData;
+
+    udata->closed    = true;
+    udata->activated = false;
+}
+
+static void engineReleasedCallback(void* processorData)
+{
+    AudioConvolverUserData* udata = (AudioConvolverUserData*) processorData;
+
+    udata->closed       = true;
+    udata->activated    = false;
+    udata->auprocCapi    = NULL;
+    udata->auprocEngine  = NULL;
+}
+
+/* ============================================================================================ */
+
+static int AudioConvolver_new(lua_State* L)
+{
+    const int inArg   = 1;
+    const int outArg  = 2;
+    const int optArg  = 3;
+    lua_settop(L, optArg);                                /* -> args */
+    AudioConvolverUserData* udata = lua_newuserdata(L, sizeof(AudioConvolverUserData));
+    memset(udata, 0, sizeof(AudioConvolverUserData));
+    udata->className = AUDIO_CONVOLVER_CLASS_NAME;
+    pushAudioConvolverMeta(L);                            /* -> args, udata, meta */
+    lua_setmetatable(L, -2);                              /* -> args, udata */
+    int versionError = 0;
+    const auproc_capi* capi = auproc_get_capi(L, inArg, &versionError);
+    auproc_engine* engine = NULL;
+    auproc_info    info   = {0};
+    if (capi) {
+        engine = capi->getEngine(L, inArg, &info);
+    }
+    if (!capi || !engine) {
+        if (versionError) {
+            return luaL_argerror(L, inArg, "auproc version mismatch");
+        } else {
+            return luaL_argerror(L, inArg, "expected connector object");
+        }
+    }
+    if (info.sampleRate == 0) {
+        return luaL_argerror(L, inArg, "cannot determine sample rate");
+    }
+    lua_Integer headSize  = 256;
+    lua_Integer tailSize  = 4096;
+    lua_Integer maxLength = 4 * (lua_Integer)info.sampleRate;
+
+    if (!lua_isnoneornil(L, optArg)) {
+        luaL_checktype(L, optArg, LUA_TTABLE);
+        headSize  = auproc_util_opt_integer_field(L, optArg, "partition",     headSize);
+        tailSize  = auproc_util_opt_integer_field(L, optArg, "tailPartition", tailSize);
+        maxLength = auproc_util_opt_integer_field(L, optArg, "maxLength",     maxLength);
+    }
+    luaL_argcheck(L, auproc_fft_is_valid_size(headSize), optArg, 
+                     "power of two expected for field 'partition'");
+    luaL_argcheck(L, auproc_fft_is_valid_size(tailSize) && tailSize >= headSize, optArg, 
+                     "power of two not less than partition expected for field 'tailPartition'");
+    luaL_argcheck(L, maxLength > 0 && maxLength <= 0x10000000, optArg, 
+                     "invalid value for field 'maxLength'");
+
+    udata->headSize  = headSize;
+    udata->tailSize  = tailSize;
+    udata->maxLength = maxLength;
+
+    const uint32_t headLength = 2 * udata->tailSize;
+    const uint32_t tailCount  = (udata->maxLength > headLength) 
+                              ? (udata->maxLength - headLength + udata->tailSize - 1) / udata->tailSize : 0;
+
+    udata->directIn   = calloc(udata->headSize * 2, sizeof(float));
+    udata->headIn     = calloc(udata->headSize, sizeof(float));
+    udata->headOut    = calloc(udata->headSize, sizeof(float));
+    udata->tailOut    = calloc(udata->headSize, sizeof(float));
+    udata->tailIn     = calloc(udata->tailSize, sizeof(float));
+    udata->tailResult = calloc(udata->tailSize, sizeof(float));
+    if (   !udata->directIn || !udata->headIn || !udata->headOut || !udata->tailOut || !udata->tailIn || !udata->tailResult
+        || !partitions_init(&udata->head, udata->headSize, headLength / udata->headSize)
+        || !partitions_init(&udata->tail, udata->tailSize, tailCount > 0 ? tailCount : 1)
+        || !sample_ring_init(&udata->inRing,  4 * udata->tailSize + info.sampleRate / 2)
+        || !sample_ring_init(&udata->outRing, headLength + 4 * udata->tailSize + info.sampleRate / 2))
+    {
+        return luaL_error(L, "out of memory");
+    }
+    /* the tail output of the worker starts after the head */
+    sample_ring_write_zeros(&udata->outRing, headLength);
+
+    const char* processorName = lua_pushfstring(L, "%s: %p", AUDIO_CONVOLVER_CLASS_NAME, udata);   /* -> args, udata, name */
+
+    auproc_con_reg conRegs[2] = {{AUPROC_AUDIO, AUPROC_IN,  NULL},
+                                 {AUPROC_AUDIO, AUPROC_OUT, NULL}};
+    auproc_con_reg_err regError = {0};
+    auproc_processor* proc = capi->registerProcessor(L, inArg, 2, engine, processorName, udata,
+                                                         processCallback, NULL, engineClosedCallback, engineReleasedCallback,
+                                                         conRegs, &regError);
+    lua_pop(L, 1); /* -> args, udata */
+
+    if (!proc)
+    {
+        if (regError.conIndex >= 0)
+        {
+            int errArg = inArg + regError.conIndex;
+
+            if (regError.errorType == AUPROC_REG_ERR_CONNCTOR_INVALID)
+            {
+                return luaL_argerror(L, errArg, "invalid connector object");
+            }
+            if (   regError.errorType == AUPROC_REG_ERR_ENGINE_MISMATCH)
+            {
+                const char* msg = lua_pushfstring(L, "connector belongs to other %s",
+                                                     capi->engine_category_name);
+                return luaL_argerror(L, errArg, msg);
+            }
+            if (regError.errorType == AUPROC_REG_ERR_ARG_INVALID
+             || regError.errorType == AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE)
+            {
+                if (errArg < outArg) {
+                    return luaL_argerror(L, errArg, "expected AUDIO IN connector");
+                } else {
+                    return luaL_argerror(L, errArg, "expected AUDIO OUT connector");
+                }
+            }
+            if (regError.errorType == AUPROC_REG_ERR_WRONG_DIRECTION)
+            {
+                if (errArg < outArg) {
+                    return luaL_argerror(L, errArg, "given connector is not readable");
+                } else {
+                    return luaL_argerror(L, errArg, "given connector is not writable");
+                }
+            }
+        }
+        return luaL_error(L, "cannot register processor (err=%d)", regError.errorType);
+    }
+    udata->processor         = proc;
+    udata->activated         = false;
+    udata->auprocCapi        = capi;
+    udata->auprocEngine      = engine;
+    udata->audioInConnector  = conRegs[0].connector;
+    udata->audioInMethods    = conRegs[0].audioMethods;
+    udata->audioOutConnector = conRegs[1].connector;
+    udata->audioOutMethods   = conRegs[1].audioMethods;
+
+    if (!async_thread_start(&udata->thread, workerThread, udata)) {
+        return luaL_error(L, "cannot start worker thread");
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioConvolver_release(lua_State* L)
+{
+    AudioConvolverUserData* udata = luaL_checkudata(L, 1, AUDIO_CONVOLVER_CLASS_NAME);
+    udata->closed    = true;
+    udata->activated = false;
+    if (udata->auprocCapi) {
+        udata->auprocCapi->unregisterProcessor(L, udata->auprocEngine, udata->processor);
+        udata->processor   = NULL;
+        udata->auprocCapi   = NULL;
+        udata->auprocEngine = NULL;
+    }
+    if (udata->thread.started) {
+        atomic_set(&udata->stopRequested, true);
+        async_thread_join(&udata->thread);
+    }
+    /* the kernel of the process callback is either the pending or the worker kernel */
+    freeKernel(atomic_swap_ptr(&udata->newKernel,     NULL));
+    freeKernel(atomic_swap_ptr(&udata->pendingKernel, NULL));
+    freeKernel(udata->workerKernel);
+    udata->workerKernel = NULL;
+    udata->kernel       = NULL;
+
+    partitions_free(&udata->head);
+    partitions_free(&udata->tail);
+    if (udata->directIn)   { free(udata->directIn);   udata->directIn   = NULL; }
+    if (udata->headIn)     { free(udata->headIn);     udata->headIn     = NULL; }
+    if (udata->headOut)    { free(udata->headOut);    udata->headOut    = NULL; }
+    if (udata->tailOut)    { free(udata->tailOut);    udata->tailOut    = NULL; }
+    if (udata->tailIn)     { free(udata->tailIn);     udata->tailIn     = NULL; }
+    if (udata->tailResult) { free(udata->tailResult); udata->tailResult = NULL; }
+    sample_ring_free(&udata->inRing);
+    sample_ring_free(&udata->outRing);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioConvolver_toString(lua_State* L)
+{
+    AudioConvolverUserData* udata = luaL_checkudata(L, 1, AUDIO_CONVOLVER_CLASS_NAME);
+
+    lua_pushfstring(L, "%s: %p", AUDIO_CONVOLVER_CLASS_NAME, udata);
+
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioConvolver_load(lua_State* L)
+{
+    AudioConvolverUserData* udata = checkAudioConvolverUdata(L, 1);
+    const int arg = 2;
+
+    float*   ir       = NULL;
+    uint32_t irLength = 0;
+
+    if (lua_type(L, arg) == LUA_TSTRING) {
+        size_t len;
+        const char* s = lua_tolstring(L, arg, &len);
+        luaL_argcheck(L, len % sizeof(float) == 0, arg, "string length must be a multiple of 4");
+        luaL_argcheck(L, len / sizeof(float) <= udata->maxLength, arg, "impulse response is too long");
+        irLength = len / sizeof(float);
+        ir = malloc(sizeof(float) * (irLength > 0 ? irLength : 1));
+        if (!ir) {
+            return luaL_error(L, "out of memory");
+        }
+        memcpy(ir, s, len);
+    }
+    else if (lua_istable(L, arg)) {
+        lua_Integer n = luaL_len(L, arg);
+        luaL_argcheck(L, n <= udata->maxLength, arg, "impulse response is too long");
+        irLength = n;
+        ir = malloc(sizeof(float) * (irLength > 0 ? irLength : 1));
+        if (!ir) {
+            return luaL_error(L, "out of memory");
+        }
+        for (uint32_t i = 0; i < irLength; ++i) {
+            lua_rawgeti(L, arg, i + 1);                   /* -> value */
+            if (!lua_isnumber(L, -1)) {
+                free(ir);
+                return luaL_argerror(L, arg, "table of numbers expected");
+            }
+            ir[i] = lua_tonumber(L, -1);
+            lua_pop(L, 1);                                /* -> */
+        }
+    }
+    else if (!lua_isnoneornil(L, arg)) {
+        return luaL_argerror(L, arg, "table or string expected");
+    }
+    Kernel* k = newKernel(udata, ir, irLength);
+    free(ir);
+    if (!k) {
+        return luaL_error(L, "out of memory");
+    }
+    freeKernel(atomic_swap_ptr(&udata->newKernel, k));
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioConvolver_latency(lua_State* L)
+{
+    checkAudioConvolverUdata(L, 1);
+    lua_pushinteger(L, 0);
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioConvolver_activate(lua_State* L)
+{
+    AudioConvolverUserData* udata = checkAudioConvolverUdata(L, 1);
+    if (!udata->activated) {
+        udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = true;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioConvolver_deactivate(lua_State* L)
+{
+    AudioConvolverUserData* udata = checkAudioConvolverUdata(L, 1);
+    if (udata->activated) {
+        udata->auprocCapi->deactivateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = false;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static const luaL_Reg AudioConvolverMethods[] =
+{
+    { "load",        AudioConvolver_load },
+    { "latency",     AudioConvolver_latency },
+    { "activate",    AudioConvolver_activate },
+    { "deactivate",  AudioConvolver_deactivate },
+    { "close",       AudioConvolver_release },
+    { NULL,          NULL } /* sentinel */
+};
+
+static const luaL_Reg AudioConvolverMetaMethods[] =
+{
+    { "__tostring", AudioConvolver_toString },
+    { "__gc",       AudioConvolver_release  },
+
+    { NULL,       NULL } /* sentinel */
+};
+
+static const luaL_Reg ModuleFunctions[] =
+{
+    { "new_audio_convolver", AudioConvolver_new },
+    { NULL,                  NULL } /* sentinel */
+};
+
+/* ============================================================================================ */
+
+static void setupAudioConvolverMeta(lua_State* L)
+{                                                          /* -> meta */
+    lua_pushstring(L, AUDIO_CONVOLVER_CLASS_NAME);         /* -> meta, className */
+    lua_setfield(L, -2, "__metatable");                    /* -> meta */
+
+    luaL_setfuncs(L, AudioConvolverMetaMethods, 0);        /* -> meta */
+
+    lua_newtable(L);                                       /* -> meta, AudioConvolverClass */
+    luaL_setfuncs(L, AudioConvolverMethods, 0);            /* -> meta, AudioConvolverClass */
+    lua_setfield (L, -2, "__index");                       /* -> meta */
+}
+
+
+/* ============================================================================================ */
+
+int auproc_audio_convolver_init_module(lua_State* L, int module)
+{
+    if (luaL_newmetatable(L, AUDIO_CONVOLVER_CLASS_NAME)) {
+        setupAudioConvolverMeta(L);
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, module);
+        luaL_setfuncs(L, ModuleFunctions, 0);
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+/* ============================================================================================ */
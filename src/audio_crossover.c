@@ -0,0 +1,547 @@
+#include "audio_crossover.h"
+#include "async_util.h"
+#include "simd_util.h"
+
+#define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
+#include "auproc_capi.h"
+
+/* ============================================================================================ */
+
+static const char* const AUDIO_CROSSOVER_CLASS_NAME = "auproc.audio_crossover";
+
+static const char* ERROR_INVALID_AUDIO_CROSSOVER = "invalid auproc.audio_crossover";
+
+/* ============================================================================================ */
+
+#define MAX_BANDS     4
+#define MAX_STAGES    6
+#define BLOCK_FRAMES  64
+#define LANE_WIDTH    MAX_BANDS    /* == VEC4_WIDTH, all lanes are one Vec4 */
+
+typedef struct CrossoverCoeffs        CrossoverCoeffs;
+typedef struct BandConnection         BandConnection;
+typedef struct AudioCrossoverUserData AudioCrossoverUserData;
+
+/**
+ * Biquad coefficients of the cascaded filter stages. Each band has its own
+ * filter path, the paths of all bands are computed in parallel lanes, i.e.
+ * the coefficients of one stage are adjacent for all bands.
+ */
+struct CrossoverCoeffs
+{
+    int   stageCount;
+    float b0[MAX_STAGES][LANE_WIDTH];
+    float b1[MAX_STAGES][LANE_WIDTH];
+    float b2[MAX_STAGES][LANE_WIDTH];
+    float a1[MAX_STAGES][LANE_WIDTH];
+    float a2[MAX_STAGES][LANE_WIDTH];
+};
+
+struct BandConnection
+{
+    auproc_connector*       connector;
+    const auproc_audiometh* methods;
+    float*                  buf;
+};
+
+struct AudioCrossoverUserData
+{
+    const char*        className;
+    auproc_processor*  processor;
+
+    bool               closed;
+    bool               activated;
+
+    const auproc_capi*  auprocCapi;
+    auproc_engine*      auprocEngine;
+    uint32_t            sampleRate;
+
+    auproc_connector*       inConnector;
+    const auproc_audiometh* inMethods;
+    BandConnection          bands[MAX_BANDS];
+    int                     bandCount;
+
+    AtomicSnapshot     coeffs;
+
+    float              state1[MAX_STAGES][LANE_WIDTH];
+    float              state2[MAX_STAGES][LANE_WIDTH];
+    float              work[BLOCK_FRAMES][LANE_WIDTH];
+};
+
+/* ============================================================================================ */
+
+static void setupAudioCrossoverMeta(lua_State* L);
+
+static int pushAudioCrossoverMeta(lua_State* L)
+{
+    if (luaL_newmetatable(L, AUDIO_CROSSOVER_CLASS_NAME)) {
+        setupAudioCrossoverMeta(L);
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static AudioCrossoverUserData* checkAudioCrossoverUdata(lua_State* L, int arg)
+{
+    AudioCrossoverUserData* udata = luaL_checkudata(L, arg, AUDIO_CROSSOVER_CLASS_NAME);
+    if (udata->auprocCapi) {
+        udata->auprocCapi->checkEngineIsNotClosed(L, udata->auprocEngine);
+    }
+    if (udata->closed) {
+        luaL_error(L, ERROR_INVALID_AUDIO_CROSSOVER);
+        return NULL;
+    }
+    return udata;
+}
+
+/* ============================================================================================ */
+
+enum StageType
+{
+    IDENTITY, LOWPASS, HIGHPASS, ALLPASS
+};
+
+/**
+ * Sets one Butterworth (Q = 1/sqrt(2)) stage of a band path. Two cascaded lowpass or
+ * highpass stages give a Linkwitz-Riley LR4 filter. The sum of the LR4 lowpass and
+ * highpass is an allpass with the same Q, this allpass is used to align the phase
+ * of the lower bands to the higher crossover frequencies.
+ */
+static void setStage(CrossoverCoeffs* c, int stage, int band, int type, double freq, double sampleRate)
+{
+    double w0    = 2 * M_PI * freq / sampleRate;
+    double cosw  = cos(w0);
+    double alpha = sin(w0) / (2 * M_SQRT1_2);
+    double b0 = 1, b1 = 0, b2 = 0, a0 = 1, a1 = 0, a2 = 0;
+
+    switch (type) {
+        case LOWPASS:   b0 = (1 - cosw) / 2;  b1 = 1 - cosw;      b2 = (1 - cosw) / 2;
+                        a0 = 1 + alpha;       a1 = -2 * cosw;     a2 = 1 - alpha;
+                        break;
+        case HIGHPASS:  b0 = (1 + cosw) / 2;  b1 = -(1 + cosw);   b2 = (1 + cosw) / 2;
+                        a0 = 1 + alpha;       a1 = -2 * cosw;     a2 = 1 - alpha;
+                        break;
+        case ALLPASS:   b0 = 1 - alpha;       b1 = -2 * cosw;     b2 = 1 + alpha;
+                        a0 = 1 + alpha;       a1 = -2 * cosw;     a2 = 1 - alpha;
+                        break;
+    }
+    c->b0[stage][band] = b0 / a0;
+    c->b1[stage][band] = b1 / a0;
+    c->b2[stage][band] = b2 / a0;
+    c->a1[stage][band] = a1 / a0;
+    c->a2[stage][band] = a2 / a0;
+}
+
+/**
+ * Computes the filter paths for bandCount bands with the bandCount - 1
+ * ascending crossover frequencies. Band b is highpassed at all crossover
+ * frequencies below it, lowpassed at the crossover frequency above it and
+ * allpassed at all other crossover frequencies above it.
+ */
+static void setCoeffs(CrossoverCoeffs* c, int bandCount, const double* freqs, double sampleRate)
+{
+    const int n = bandCount - 1;
+
+    c->stageCount = 2 * n;
+    for (int s = 0; s < MAX_STAGES; ++s) {
+        for (int b = 0; b < LANE_WIDTH; ++b) {
+            setStage(c, s, b, IDENTITY, 0, sampleRate);
+        }
+    }
+    for (int b = 0; b < bandCount; ++b) {
+        int s = 0;
+        for (int k = 0; k < n; ++k) {
+            if (k < b) {
+                setStage(c, s++, b, HIGHPASS, freqs[k], sampleRate);
+                setStage(c, s++, b, HIGHPASS, freqs[k], sampleRate);
+            } else if (k == b) {
+                setStage(c, s++, b, LOWPASS, freqs[k], sampleRate);
+                setStage(c, s++, b, LOWPASS, freqs[k], sampleRate);
+            } else {
+                setStage(c, s++, b, ALLPASS, freqs[k], sampleRate);
+            }
+        }
+    }
+}
+
+/* ============================================================================================ */
+
+static void filterBlock(const CrossoverCoeffs* c, uint32_t nframes, float (*restrict work)[LANE_WIDTH],
+                        float (*restrict state1)[LANE_WIDTH], float (*restrict state2)[LANE_WIDTH])
+{
+    for (int s = 0; s < c->stageCount; ++s) {
+        const Vec4 b0 = vec4_load(c->b0[s]);
+        const Vec4 b1 = vec4_load(c->b1[s]);
+        const Vec4 b2 = vec4_load(c->b2[s]);
+        const Vec4 a1 = vec4_load(c->a1[s]);
+        const Vec4 a2 = vec4_load(c->a2[s]);
+        Vec4       s1 = vec4_load(state1[s]);
+        Vec4       s2 = vec4_load(state2[s]);
+        for (uint32_t i = 0; i < nframes; ++i) {
+            Vec4 in  = vec4_load(work[i]);
+            Vec4 out = vec4_madd(b0, in, s1);
+            s1 = vec4_add(vec4_sub(vec4_mul(b1, in), vec4_mul(a1, out)), s2);
+            s2 = vec4_sub(vec4_mul(b2, in), vec4_mul(a2, out));
+            vec4_store(work[i], out);
+        }
+        vec4_store(state1[s], s1);
+        vec4_store(state2[s], s2);
+    }
+}
+
+/**
+ * Returns true if the filter state has decayed, i.e. silent input gives
+ * silent output.
+ */
+static bool isStateSilent(const AudioCrossoverUserData* udata)
+{
+    const float* state1 = &udata->state1[0][0];
+    const float* state2 = &udata->state2[0][0];
+    float        max    = 0;
+    for (int i = 0; i < MAX_STAGES * LANE_WIDTH; ++i) {
+        float a = fabsf(state1[i]);
+        float b = fabsf(state2[i]);
+        max = (a > max) ? a : max;
+        max = (b > max) ? b : max;
+    }
+    return max < 1e-9f;
+}
+
+static int processCallback(uint32_t nframes, void* processorData)
+{
+    AudioCrossoverUserData* udata = (AudioCrossoverUserData*) processorData;
+    BandConnection*         bands = udata->bands;
+    const int               n     = udata->bandCount;
+    const auproc_capi*      capi  = udata->auprocCapi;
+
+    atomic_snapshot_update(&udata->coeffs);
+    const CrossoverCoeffs* coeffs = atomic_snapshot_current(&udata->coeffs);
+
+    for (int b = 0; b < n; ++b) {
+        bands[b].buf = bands[b].methods->getAudioBuffer(bands[b].connector, nframes);
+    }
+    if (auproc_is_silent(capi, udata->inMethods, udata->inConnector) && isStateSilent(udata)) {
+        memset(udata->state1, 0, sizeof(udata->state1));
+        memset(udata->state2, 0, sizeof(udata->state2));
+        for (int b = 0; b < n; ++b) {
+            memset(bands[b].buf, 0, sizeof(float) * nframes);
+            auproc_set_silent(capi, bands[b].methods, bands[b].connector, true);
+        }
+        return 0;
+    }
+    const float* inBuf = udata->inMethods->getAudioBuffer(udata->inConnector, nframes);
+    float (*work)[LANE_WIDTH] = udata->work;
+
+    for (uint32_t f0 = 0; f0 < nframes; f0 += BLOCK_FRAMES)
+    {
+        uint32_t m = (nframes - f0 < BLOCK_FRAMES) ? nframes - f0 : BLOCK_FRAMES;
+
+        const float* in = inBuf + f0;
+        for (uint32_t i = 0; i < m; ++i) {
+            for (int b = 0; b < LANE_WIDTH; ++b) {
+                work[i][b] = in[i];
+            }
+        }
+        filterBlock(coeffs, m, work, udata->state1, udata->state2);
+
+        for (int b = 0; b < n; ++b) {
+            float* out = bands[b].buf + f0;
+            for (uint32_t i = 0; i < m; ++i) {
+                out[i] = work[i][b];
+            }
+        }
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static void engineClosedCallback(void* processorData)
+{
+    AudioCrossoverUserData* udata = (AudioCrossoverUserData*) processorData;
+
+    udata->closed    = true;
+    udata->activated = false;
+}
+
+static void engineReleasedCallback(void* processorData)
+{
+    AudioCrossoverUserData* udata = (AudioCrossoverUserData*) processorData;
+
+    udata->closed       = true;
+    udata->activated    = false;
+    udata->auprocCapi    = NULL;
+    udata->auprocEngine  = NULL;
+}
+
+/* ============================================================================================ */
+
+/**
+ * Reads the crossover frequencies from the arguments starting at firstArg.
+ */
+static void checkFreqs(lua_State* L, int firstArg, int bandCount, uint32_t sampleRate, double* freqs)
+{
+    for (int k = 0; k < bandCount - 1; ++k) {
+        int        arg  = firstArg + k;
+        lua_Number freq = luaL_checknumber(L, arg);
+        luaL_argcheck(L, 0 < freq && freq < sampleRate / 2.0, arg, "invalid frequency");
+        luaL_argcheck(L, k == 0 || freq > freqs[k - 1],       arg, "frequencies must be ascending");
+        freqs[k] = freq;
+    }
+    if (!lua_isnone(L, firstArg + bandCount - 1)) {
+        luaL_argerror(L, firstArg + bandCount - 1, "too many frequencies");
+    }
+}
+
+static int AudioCrossover_new(lua_State* L)
+{
+    const int firstArg = 1;
+    const int lastArg  = lua_gettop(L);
+
+    AudioCrossoverUserData* udata = lua_newuserdata(L, sizeof(AudioCrossoverUserData));
+    memset(udata, 0, sizeof(AudioCrossoverUserData));
+    udata->className = AUDIO_CROSSOVER_CLASS_NAME;
+    pushAudioCrossoverMeta(L);                            /* -> udata, meta */
+    lua_setmetatable(L, -2);                              /* -> udata */
+    int versionError = 0;
+    const auproc_capi* capi = auproc_get_capi(L, firstArg, &versionError);
+    auproc_engine* engine = NULL;
+    auproc_info    info   = {0};
+    if (capi) {
+        engine = capi->getEngine(L, firstArg, &info);
+    }
+    if (!capi || !engine) {
+        if (versionError) {
+            return luaL_argerror(L, firstArg, "auproc capi version mismatch");
+        } else {
+            return luaL_argerror(L, firstArg, "expected connector object");
+        }
+    }
+    if (info.sampleRate == 0) {
+        return luaL_argerror(L, firstArg, "cannot determine sample rate");
+    }
+    const int firstConArg = (capi->getObjectType(L, firstArg) == AUPROC_TENGINE) ? firstArg + 1 : firstArg;
+    int lastConArg = lastArg;
+    for (int i = firstConArg; i <= lastArg; ++i) {
+        if (!capi->getConnectorType(L, i)) {
+            lastConArg = i - 1;
+            break;
+        }
+    }
+    const int conCount = lastConArg - firstConArg + 1;
+    const int freqArg  = lastConArg + 1;
+    const int n        = conCount - 1;
+
+    if (n < 2 || n > MAX_BANDS) {
+        return luaL_argerror(L, firstConArg, "expected one input connector object and "
+                                             "2 to 4 output connector objects");
+    }
+    udata->sampleRate = info.sampleRate;
+    udata->bandCount  = n;
+
+    double freqs[MAX_BANDS - 1];
+    if (freqArg <= lastArg) {
+        checkFreqs(L, freqArg, n, info.sampleRate, freqs);
+    } else {
+        static const double defaults[MAX_BANDS - 1][MAX_BANDS - 1] = { { 1000 },
+                                                                        {  250, 2500 },
+                                                                        {  200, 1000, 5000 } };
+        for (int k = 0; k < n - 1; ++k) {
+            freqs[k] = defaults[n - 2][k];
+            luaL_argcheck(L, freqs[k] < info.sampleRate / 2.0, firstConArg, "sample rate too low");
+        }
+    }
+    if (!atomic_snapshot_init(&udata->coeffs, sizeof(CrossoverCoeffs))) {
+        return luaL_error(L, "out of memory");
+    }
+    setCoeffs(atomic_snapshot_current(&udata->coeffs), n, freqs, info.sampleRate);
+
+    const char* processorName = lua_pushfstring(L, "%s: %p", AUDIO_CROSSOVER_CLASS_NAME, udata);   /* -> udata, name */
+
+    auproc_con_reg conRegs[1 + MAX_BANDS];
+    conRegs[0] = (auproc_con_reg){AUPROC_AUDIO, AUPROC_IN, NULL};
+    for (int b = 0; b < n; ++b) {
+        conRegs[1 + b] = (auproc_con_reg){AUPROC_AUDIO, AUPROC_OUT, NULL};
+    }
+    auproc_con_reg_err regError = {0};
+    auproc_processor* proc = capi->registerProcessor(L, firstConArg, conCount, engine, processorName, udata,
+                                                         processCallback, NULL, engineClosedCallback, engineReleasedCallback,
+                                                         conRegs, &regError);
+    lua_pop(L, 1); /* -> udata */
+
+    if (!proc)
+    {
+        if (regError.conIndex >= 0)
+        {
+            int errArg = firstConArg + regError.conIndex;
+
+            if (regError.errorType == AUPROC_REG_ERR_CONNCTOR_INVALID)
+            {
+                return luaL_argerror(L, errArg, "invalid connector object");
+            }
+            if (   regError.errorType == AUPROC_REG_ERR_ENGINE_MISMATCH)
+            {
+                const char* msg = lua_pushfstring(L, "connector belongs to other %s",
+                                                     capi->engine_category_name);
+                return luaL_argerror(L, errArg, msg);
+            }
+            if (regError.errorType == AUPROC_REG_ERR_ARG_INVALID
+             || regError.errorType == AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE)
+            {
+                if (errArg == firstConArg) {
+                    return luaL_argerror(L, errArg, "expected AUDIO IN connector");
+                } else {
+                    return luaL_argerror(L, errArg, "expected AUDIO OUT connector");
+                }
+            }
+            if (regError.errorType == AUPROC_REG_ERR_WRONG_DIRECTION)
+            {
+                if (errArg == firstConArg) {
+                    return luaL_argerror(L, errArg, "given connector is not readable");
+                } else {
+                    return luaL_argerror(L, errArg, "given connector is not writable");
+                }
+            }
+        }
+        return luaL_error(L, "cannot register processor (err=%d)", regError.errorType);
+    }
+
+    udata->processor    = proc;
+    udata->activated    = false;
+    udata->auprocCapi   = capi;
+    udata->auprocEngine = engine;
+    udata->inConnector  = conRegs[0].connector;
+    udata->inMethods    = conRegs[0].audioMethods;
+
+    for (int b = 0; b < n; ++b) {
+        udata->bands[b].connector = conRegs[1 + b].connector;
+        udata->bands[b].methods   = conRegs[1 + b].audioMethods;
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioCrossover_release(lua_State* L)
+{
+    AudioCrossoverUserData* udata = luaL_checkudata(L, 1, AUDIO_CROSSOVER_CLASS_NAME);
+    udata->closed    = true;
+    udata->activated = false;
+    if (udata->auprocCapi) {
+        udata->auprocCapi->unregisterProcessor(L, udata->auprocEngine, udata->processor);
+        udata->processor   = NULL;
+        udata->auprocCapi   = NULL;
+        udata->auprocEngine = NULL;
+    }
+    atomic_snapshot_free(&udata->coeffs);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioCrossover_toString(lua_State* L)
+{
+    AudioCrossoverUserData* udata = luaL_checkudata(L, 1, AUDIO_CROSSOVER_CLASS_NAME);
+
+    lua_pushfstring(L, "%s: %p", AUDIO_CROSSOVER_CLASS_NAME, udata);
+
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioCrossover_activate(lua_State* L)
+{
+    AudioCrossoverUserData* udata = checkAudioCrossoverUdata(L, 1);
+    if (!udata->activated) {
+        udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = true;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioCrossover_deactivate(lua_State* L)
+{
+    AudioCrossoverUserData* udata = checkAudioCrossoverUdata(L, 1);
+    if (udata->activated) {
+        udata->auprocCapi->deactivateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = false;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioCrossover_set(lua_State* L)
+{
+    AudioCrossoverUserData* udata = checkAudioCrossoverUdata(L, 1);
+
+    double freqs[MAX_BANDS - 1];
+    checkFreqs(L, 2, udata->bandCount, udata->sampleRate, freqs);
+
+    CrossoverCoeffs* slot = atomic_snapshot_begin(&udata->coeffs);
+    setCoeffs(slot, udata->bandCount, freqs, udata->sampleRate);
+    atomic_snapshot_publish(&udata->coeffs, slot);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static const luaL_Reg AudioCrossoverMethods[] =
+{
+    { "activate",    AudioCrossover_activate },
+    { "deactivate",  AudioCrossover_deactivate },
+    { "set",         AudioCrossover_set },
+    { "close",       AudioCrossover_release },
+    { NULL,          NULL } /* sentinel */
+};
+
+static const luaL_Reg AudioCrossoverMetaMethods[] =
+{
+    { "__tostring", AudioCrossover_toString },
+    { "__gc",       AudioCrossover_release  },
+
+    { NULL,       NULL } /* sentinel */
+};
+
+static const luaL_Reg ModuleFunctions[] =
+{
+    { "new_audio_crossover", AudioCrossover_new },
+    { NULL,                  NULL } /* sentinel */
+};
+
+/* ============================================================================================ */
+
+static void setupAudioCrossoverMeta(lua_State* L)
+{                                                          /* -> meta */
+    lua_pushstring(L, AUDIO_CROSSOVER_CLASS_NAME);         /* -> meta, className */
+    lua_setfield(L, -2, "__metatable");                    /* -> meta */
+
+    luaL_setfuncs(L, AudioCrossoverMetaMethods, 0);        /* -> meta */
+
+    lua_newtable(L);                                       /* -> meta, AudioCrossoverClass */
+    luaL_setfuncs(L, AudioCrossoverMethods, 0);            /* -> meta, AudioCrossoverClass */
+    lua_setfield (L, -2, "__index");                       /* -> meta */
+}
+
+
+/* ============================================================================================ */
+
+int auproc_audio_crossover_init_module(lua_State* L, int module)
+{
+    if (luaL_newmetatable(L, AUDIO_CROSSOVER_CLASS_NAME)) {
+        setupAudioCrossoverMeta(L);
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, module);
+        luaL_setfuncs(L, ModuleFunctions, 0);
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+/* ============================================================================================ */
@@ -0,0 +1,733 @@
+#include "audio_delay.h"
+#include "async_util.h"
+#include "simd_util.h"
+
+#define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
+#include "auproc_capi.h"
+
+#define SENDER_CAPI_IMPLEMENT_GET_CAPI 1
+#include "sender_capi.h"
+
+/* ============================================================================================ */
+
+static const char* const AUDIO_DELAY_CLASS_NAME = "auproc.audio_delay";
+
+static const char* ERROR_INVALID_AUDIO_DELAY = "invalid auproc.audio_delay";
+
+/* ============================================================================================ */
+
+#define MAX_TAPS      16
+#define MAX_PLAYING   (2 * MAX_TAPS)
+#define BLOCK_FRAMES  64
+
+typedef struct DelayTaps          DelayTaps;
+typedef struct PlayingTaps        PlayingTaps;
+typedef struct OutputConnection   OutputConnection;
+typedef struct AudioDelayUserData AudioDelayUserData;
+
+/**
+ * Tap settings: output connector index (0-based), delay in frames 
+ * and gain factor.
+ */
+struct DelayTaps
+{
+    int   tapCount;
+    int   out[MAX_TAPS];
+    float delay[MAX_TAPS];
+    float gain[MAX_TAPS];
+};
+
+/**
+ * Taps that are currently audible: output connector index, delay and gain
+ * reached at the end of the last block and the index of the tap in DelayTaps
+ * that is followed, or -1 if the tap fades out. Faded out taps are removed
+ * after the block, so there are never more than MAX_TAPS taps playing at the 
+ * beginning of a process cycle.
+ */
+struct PlayingTaps
+{
+    int   tapCount;
+    int   out[MAX_PLAYING];
+    float delay[MAX_PLAYING];
+    float gain[MAX_PLAYING];
+    int   target[MAX_PLAYING];
+};
+
+struct OutputConnection
+{
+    auproc_connector*       connector;
+    const auproc_audiometh* methods;
+    float*                  buf;
+};
+
+struct AudioDelayUserData
+{
+    const char*        className;
+    auproc_processor*  processor;
+
+    bool               closed;
+    bool               activated;
+
+    const auproc_capi*  auprocCapi;
+    auproc_engine*      auprocEngine;
+    uint32_t            sampleRate;
+
+    auproc_con_reg*     connectorRegs;
+    auproc_connector*       inConnector;
+    const auproc_audiometh* inMethods;
+    OutputConnection*   outputs;
+    int                 outputCount;
+
+    const sender_capi* senderCapi;
+    sender_reader*     senderReader;
+    sender_object*     sender;
+
+    AtomicSnapshot     taps;
+    PlayingTaps        current;
+
+    float              maxDelay;       /* in frames */
+    float*             ring;
+    uint32_t           mask;
+    uint32_t           writePos;
+    uint32_t           silentFrames;   /* number of silent input frames written into ring */
+    float              line[BLOCK_FRAMES + 1];
+};
+
+/* ============================================================================================ */
+
+static void setupAudioDelayMeta(lua_State* L);
+
+static int pushAudioDelayMeta(lua_State* L)
+{
+    if (luaL_newmetatable(L, AUDIO_DELAY_CLASS_NAME)) {
+        setupAudioDelayMeta(L);
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static AudioDelayUserData* checkAudioDelayUdata(lua_State* L, int arg)
+{
+    AudioDelayUserData* udata = luaL_checkudata(L, arg, AUDIO_DELAY_CLASS_NAME);
+    if (udata->auprocCapi) {
+        udata->auprocCapi->checkEngineIsNotClosed(L, udata->auprocEngine);
+    }
+    if (udata->closed) {
+        luaL_error(L, ERROR_INVALID_AUDIO_DELAY);
+        return NULL;
+    }
+    return udata;
+}
+
+/* ============================================================================================ */
+
+static bool nextNumber(const sender_capi* senderCapi, sender_reader* reader, lua_Number* value)
+{
+    sender_capi_value senderValue;
+    senderCapi->nextValueFromReader(reader, &senderValue);
+    if (senderValue.type == SENDER_CAPI_TYPE_INTEGER) {
+        *value = senderValue.intVal;
+        return true;
+    } else if (senderValue.type == SENDER_CAPI_TYPE_NUMBER) {
+        *value = senderValue.numVal;
+        return true;
+    }
+    return false;
+}
+
+static bool isValidTap(AudioDelayUserData* udata, lua_Integer out, lua_Number delay)
+{
+    return 1 <= out && out <= udata->outputCount && 0 <= delay && delay <= udata->maxDelay;
+}
+
+/**
+ * Reads the taps of a control message. Returns false if the message is invalid.
+ */
+static bool readTaps(AudioDelayUserData* udata, DelayTaps* t)
+{
+    const sender_capi* senderCapi = udata->senderCapi;
+    sender_reader*     reader     = udata->senderReader;
+    sender_capi_value  senderValue;
+
+    t->tapCount = 0;
+    while (true) {
+        senderCapi->nextValueFromReader(reader, &senderValue);
+        if (senderValue.type == SENDER_CAPI_TYPE_NONE) {
+            return true;
+        }
+        if (senderValue.type != SENDER_CAPI_TYPE_INTEGER || t->tapCount >= MAX_TAPS) {
+            return false;
+        }
+        lua_Number delay, gain;
+        if (   !nextNumber(senderCapi, reader, &delay)
+            || !nextNumber(senderCapi, reader, &gain)
+            || !isValidTap(udata, senderValue.intVal, delay))
+        {
+            return false;
+        }
+        t->out  [t->tapCount] = senderValue.intVal - 1;
+        t->delay[t->tapCount] = delay;
+        t->gain [t->tapCount] = gain;
+        t->tapCount += 1;
+    }
+}
+
+/* ============================================================================================ */
+
+/**
+ * Assigns the playing taps to the target taps. A playing tap with the same
+ * output and delay as a target tap keeps playing, so that removing or 
+ * inserting taps does not affect the other taps. Otherwise a playing tap 
+ * follows the target tap with the same index and output, i.e. its delay is
+ * modulated. Remaining target taps fade in at their delay, remaining playing
+ * taps fade out.
+ */
+static void matchTaps(PlayingTaps* p, const DelayTaps* target)
+{
+    bool assigned[MAX_TAPS] = { false };
+    int  prev[MAX_PLAYING];
+
+    for (int i = 0; i < p->tapCount; ++i) {
+        prev[i]      = p->target[i];
+        p->target[i] = -1;
+    }
+    for (int t = 0; t < target->tapCount; ++t) {
+        for (int i = 0; i < p->tapCount; ++i) {
+            if (p->target[i] < 0 && p->out[i] == target->out[t] && p->delay[i] == target->delay[t]) {
+                p->target[i] = t;
+                assigned[t]  = true;
+                break;
+            }
+        }
+    }
+    for (int t = 0; t < target->tapCount; ++t) {
+        for (int i = 0; i < p->tapCount && !assigned[t]; ++i) {
+            if (p->target[i] < 0 && prev[i] == t && p->out[i] == target->out[t]) {
+                p->target[i] = t;
+                assigned[t]  = true;
+            }
+        }
+    }
+    for (int t = 0; t < target->tapCount; ++t) {
+        if (!assigned[t] && p->tapCount < MAX_PLAYING) {
+            int i = p->tapCount++;
+            p->out   [i] = target->out[t];
+            p->delay [i] = target->delay[t];
+            p->gain  [i] = 0;
+            p->target[i] = t;
+        }
+    }
+}
+
+/**
+ * Removes the taps that have faded out.
+ */
+static void removeFadedTaps(PlayingTaps* p)
+{
+    int n = 0;
+    for (int i = 0; i < p->tapCount; ++i) {
+        if (p->target[i] >= 0) {
+            p->out   [n] = p->out[i];
+            p->delay [n] = p->delay[i];
+            p->gain  [n] = p->gain[i];
+            p->target[n] = p->target[i];
+            n += 1;
+        }
+    }
+    p->tapCount = n;
+}
+
+/**
+ * Sets the playing taps to the target taps without ramping.
+ */
+static void jumpToTarget(PlayingTaps* p, const DelayTaps* target)
+{
+    for (int t = 0; t < target->tapCount; ++t) {
+        p->out   [t] = target->out[t];
+        p->delay [t] = target->delay[t];
+        p->gain  [t] = target->gain[t];
+        p->target[t] = t;
+    }
+    p->tapCount = target->tapCount;
+}
+
+/* ============================================================================================ */
+
+/**
+ * Adds a tap with constant delay and linearly changing gain. The delayed 
+ * samples are copied into a linear buffer first, so that the interpolation
+ * loop can process four frames per Vec4.
+ */
+static void addFixedTap(AudioDelayUserData* udata, uint32_t blockPos, uint32_t m,
+                        float delay, float g0, float g1, float* restrict out)
+{
+    const uint32_t mask  = udata->mask;
+    const uint32_t whole = (uint32_t) delay;
+    const float    frac  = delay - whole;
+    float* restrict line = udata->line;
+
+    /* line[i + 1] is the sample delayed by whole frames, line[i] the next older one */
+    uint32_t start = (blockPos - whole - 1) & mask;
+    uint32_t n1    = (mask + 1 - start < m + 1) ? mask + 1 - start : m + 1;
+    memcpy(line,      udata->ring + start, sizeof(float) * n1);
+    memcpy(line + n1, udata->ring,         sizeof(float) * (m + 1 - n1));
+
+    const float dg = (g1 - g0) / m;
+    const Vec4  a  = vec4_set1(1 - frac);
+    const Vec4  b  = vec4_set1(frac);
+    uint32_t    i  = 0;
+    for (; i + VEC4_WIDTH <= m; i += VEC4_WIDTH) {
+        Vec4 g = vec4_ramp(g0 + dg * i, dg);
+        Vec4 x = vec4_madd(a, vec4_load(line + i + 1), vec4_mul(b, vec4_load(line + i)));
+        vec4_store(out + i, vec4_madd(g, x, vec4_load(out + i)));
+    }
+    for (; i < m; ++i) {
+        out[i] += (g0 + dg * i) * ((1 - frac) * line[i + 1] + frac * line[i]);
+    }
+}
+
+/**
+ * Adds a tap whose delay and gain change linearly within the block.
+ */
+static void addModulatedTap(AudioDelayUserData* udata, uint32_t blockPos, uint32_t m,
+                            float d0, float d1, float g0, float g1, float* restrict out)
+{
+    const uint32_t mask = udata->mask;
+    const float*   ring = udata->ring;
+    const float    dd   = (d1 - d0) / m;
+    const float    dg   = (g1 - g0) / m;
+
+    for (uint32_t i = 0; i < m; ++i) {
+        float    delay = d0 + dd * i;
+        uint32_t whole = (uint32_t) delay;
+        float    frac  = delay - whole;
+        uint32_t p     = blockPos + i - whole;
+        out[i] += (g0 + dg * i) * ((1 - frac) * ring[p & mask] + frac * ring[(p - 1) & mask]);
+    }
+}
+
+static int processCallback(uint32_t nframes, void* processorData)
+{
+    AudioDelayUserData* udata   = (AudioDelayUserData*) processorData;
+    OutputConnection*   outputs = udata->outputs;
+    const int           n       = udata->outputCount;
+
+    atomic_snapshot_update(&udata->taps);
+    DelayTaps* target = atomic_snapshot_current(&udata->taps);
+
+    if (udata->sender)
+    {
+        const sender_capi*   senderCapi = udata->senderCapi;
+        sender_reader*       reader     = udata->senderReader;
+
+    nextMsg:;
+        int rc = senderCapi->nextMessageFromSender(udata->sender, reader,
+                                                   true /* nonblock */, 0 /* timeout */,
+                                                   NULL /* errorHandler */, NULL /* errorHandlerData */);
+        if (rc == 0) {
+            DelayTaps t;
+            if (readTaps(udata, &t)) {
+                *target = t;
+            }
+            senderCapi->clearReader(reader);
+            goto nextMsg;
+        }
+    }
+    PlayingTaps* current = &udata->current;
+    matchTaps(current, target);
+
+    const auproc_capi* capi   = udata->auprocCapi;
+    const bool         silent = auproc_is_silent(capi, udata->inMethods, udata->inConnector);
+
+    for (int i = 0; i < n; ++i) {
+        outputs[i].buf = outputs[i].methods->getAudioBuffer(outputs[i].connector, nframes);
+        memset(outputs[i].buf, 0, sizeof(float) * nframes);
+    }
+    if (silent && udata->silentFrames > udata->mask) {
+        /* the whole ring buffer contains only zeros */
+        jumpToTarget(current, target);
+        udata->writePos += nframes;
+        for (int i = 0; i < n; ++i) {
+            auproc_set_silent(capi, outputs[i].methods, outputs[i].connector, true);
+        }
+        return 0;
+    }
+    udata->silentFrames = silent ? udata->silentFrames + nframes : 0;
+
+    const float* inBuf = silent ? NULL : udata->inMethods->getAudioBuffer(udata->inConnector, nframes);
+    for (uint32_t f0 = 0; f0 < nframes; f0 += BLOCK_FRAMES)
+    {
+        uint32_t m = (nframes - f0 < BLOCK_FRAMES) ? nframes - f0 : BLOCK_FRAMES;
+        uint32_t blockPos = udata->writePos;
+
+        if (inBuf) {
+            for (uint32_t i = 0; i < m; ++i) {
+                udata->ring[(blockPos + i) & udata->mask] = inBuf[f0 + i];
+            }
+        } else {
+            for (uint32_t i = 0; i < m; ++i) {
+                udata->ring[(blockPos + i) & udata->mask] = 0;
+            }
+        }
+        udata->writePos = blockPos + m;
+
+        for (int i = 0; i < current->tapCount; ++i) {
+            int    t   = current->target[i];
+            float* out = outputs[current->out[i]].buf + f0;
+            float  d0  = current->delay[i];
+            float  d1  = (t >= 0) ? target->delay[t] : d0;
+            float  g0  = current->gain[i];
+            float  g1  = (t >= 0) ? target->gain[t]  : 0;
+            if (d0 == d1) {
+                addFixedTap(udata, blockPos, m, d0, g0, g1, out);
+            } else {
+                addModulatedTap(udata, blockPos, m, d0, d1, g0, g1, out);
+            }
+            current->delay[i] = d1;
+            current->gain [i] = g1;
+        }
+        removeFadedTaps(current);
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static void engineClosedCallback(void* processorData)
+{
+    AudioDelayUserData* udata = (AudioDelayUserData*) processorData;
+
+    udata->closed    = true;
+    udata->activated = false;
+}
+
+static void engineReleasedCallback(void* processorData)
+{
+    AudioDelayUserData* udata = (AudioDelayUserData*) processorData;
+
+    udata->closed       = true;
+    udata->activated    = false;
+    udata->auprocCapi    = NULL;
+    udata->auprocEngine  = NULL;
+}
+
+/* ============================================================================================ */
+
+static int AudioDelay_new(lua_State* L)
+{
+    const int firstArg = 1;
+    const int lastArg  = lua_gettop(L);
+
+    AudioDelayUserData* udata = lua_newuserdata(L, sizeof(AudioDelayUserData));
+    memset(udata, 0, sizeof(AudioDelayUserData));
+    udata->className = AUDIO_DELAY_CLASS_NAME;
+    pushAudioDelayMeta(L);                                /* -> udata, meta */
+    lua_setmetatable(L, -2);                              /* -> udata */
+    int versionError = 0;
+    const auproc_capi* capi = auproc_get_capi(L, firstArg, &versionError);
+    auproc_engine* engine = NULL;
+    auproc_info    info   = {0};
+    if (capi) {
+        engine = capi->getEngine(L, firstArg, &info);
+    }
+    if (!capi || !engine) {
+        if (versionError) {
+            return luaL_argerror(L, firstArg, "auproc capi version mismatch");
+        } else {
+            return luaL_argerror(L, firstArg, "expected connector object");
+        }
+    }
+    if (info.sampleRate == 0) {
+        return luaL_argerror(L, firstArg, "cannot determine sample rate");
+    }
+    const int firstConArg = (capi->getObjectType(L, firstArg) == AUPROC_TENGINE) ? firstArg + 1 : firstArg;
+    int lastConArg = lastArg;
+    for (int i = firstConArg; i <= lastArg; ++i) {
+        if (!capi->getConnectorType(L, i)) {
+            lastConArg = i - 1;
+            break;
+        }
+    }
+    const int conCount = lastConArg - firstConArg + 1;
+    if (conCount < 2) {
+        return luaL_argerror(L, firstConArg, "expected input and output connector objects");
+    }
+    int        arg      = lastConArg + 1;
+    lua_Number maxDelay = 2;
+
+    if (arg <= lastArg && lua_type(L, arg) != LUA_TNUMBER)
+    {
+        int errReason = 0;
+        const sender_capi* senderCapi = sender_get_capi(L, arg, &errReason);
+        sender_object*     sender     = senderCapi ? senderCapi->toSender(L, arg) : NULL;
+
+        if (!senderCapi || !sender) {
+            if (errReason == 1) {
+                return luaL_argerror(L, arg, "sender capi version mismatch");
+            } else {
+                return luaL_argerror(L, arg, "expected sender capi object");
+            }
+        }
+
+        udata->senderCapi = senderCapi;
+        udata->sender     = sender;
+        senderCapi->retainSender(sender);
+
+        udata->senderReader = senderCapi->newReader(16 * 1024, 1);
+        if (!udata->senderReader) {
+            return luaL_error(L, "out of memory");
+        }
+        arg += 1;
+    }
+    if (arg <= lastArg) {
+        maxDelay = luaL_checknumber(L, arg);
+        luaL_argcheck(L, maxDelay > 0 && maxDelay <= 600, arg, "invalid maximal delay");
+    }
+    udata->sampleRate  = info.sampleRate;
+    udata->maxDelay    = ceil(maxDelay * info.sampleRate);
+    udata->outputCount = conCount - 1;
+
+    uint32_t capacity = 1024;
+    while (capacity < udata->maxDelay + BLOCK_FRAMES + 2) {
+        capacity *= 2;
+    }
+    udata->mask          = capacity - 1;
+    udata->ring          = calloc(capacity, sizeof(float));
+    udata->outputs       = calloc(udata->outputCount, sizeof(OutputConnection));
+    udata->connectorRegs = calloc(conCount, sizeof(auproc_con_reg));
+    if (   !udata->ring || !udata->outputs || !udata->connectorRegs
+        || !atomic_snapshot_init(&udata->taps, sizeof(DelayTaps)))
+    {
+        return luaL_error(L, "out of memory");
+    }
+    const char* processorName = lua_pushfstring(L, "%s: %p", AUDIO_DELAY_CLASS_NAME, udata);   /* -> udata, name */
+
+    auproc_con_reg* conRegs = udata->connectorRegs;
+
+    const auproc_con_reg inConReg  = {AUPROC_AUDIO, AUPROC_IN,  NULL};
+    const auproc_con_reg outConReg = {AUPROC_AUDIO, AUPROC_OUT, NULL};
+
+    conRegs[0] = inConReg;
+    for (int i = 1; i < conCount; ++i) {
+        conRegs[i] = outConReg;
+    }
+
+    auproc_con_reg_err regError = {0};
+    auproc_processor* proc = capi->registerProcessor(L, firstConArg, conCount, engine, processorName, udata,
+                                                         processCallback, NULL, engineClosedCallback, engineReleasedCallback,
+                                                         conRegs, &regError);
+    lua_pop(L, 1); /* -> udata */
+
+    if (!proc)
+    {
+        if (regError.conIndex >= 0)
+        {
+            int errArg = firstConArg + regError.conIndex;
+
+            if (regError.errorType == AUPROC_REG_ERR_CONNCTOR_INVALID)
+            {
+                return luaL_argerror(L, errArg, "invalid connector object");
+            }
+            if (   regError.errorType == AUPROC_REG_ERR_ENGINE_MISMATCH)
+            {
+                const char* msg = lua_pushfstring(L, "connector belongs to other %s",
+                                                     capi->engine_category_name);
+                return luaL_argerror(L, errArg, msg);
+            }
+            if (regError.errorType == AUPROC_REG_ERR_ARG_INVALID
+             || regError.errorType == AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE)
+            {
+                if (errArg == firstConArg) {
+                    return luaL_argerror(L, errArg, "expected AUDIO IN connector");
+                } else {
+                    return luaL_argerror(L, errArg, "expected AUDIO OUT connector");
+                }
+            }
+            if (regError.errorType == AUPROC_REG_ERR_WRONG_DIRECTION)
+            {
+                if (errArg == firstConArg) {
+                    return luaL_argerror(L, errArg, "given connector is not readable");
+                } else {
+                    return luaL_argerror(L, errArg, "given connector is not writable");
+                }
+            }
+        }
+        return luaL_error(L, "cannot register processor (err=%d)", regError.errorType);
+    }
+
+    udata->processor    = proc;
+    udata->activated    = false;
+    udata->auprocCapi   = capi;
+    udata->auprocEngine = engine;
+
+    udata->inConnector = conRegs[0].connector;
+    udata->inMethods   = conRegs[0].audioMethods;
+    for (int i = 0; i < udata->outputCount; ++i) {
+        udata->outputs[i].connector = conRegs[1 + i].connector;
+        udata->outputs[i].methods   = conRegs[1 + i].audioMethods;
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioDelay_release(lua_State* L)
+{
+    AudioDelayUserData* udata = luaL_checkudata(L, 1, AUDIO_DELAY_CLASS_NAME);
+    udata->closed    = true;
+    udata->activated = false;
+    if (udata->auprocCapi) {
+        udata->auprocCapi->unregisterProcessor(L, udata->auprocEngine, udata->processor);
+        udata->processor   = NULL;
+        udata->auprocCapi   = NULL;
+        udata->auprocEngine = NULL;
+    }
+    if (udata->sender) {
+        if (udata->senderReader) {
+            udata->senderCapi->freeReader(udata->senderReader);
+            udata->senderReader = NULL;
+        }
+        udata->senderCapi->releaseSender(udata->sender);
+        udata->sender     = NULL;
+        udata->senderCapi = NULL;
+    }
+    if (udata->connectorRegs) {
+        free(udata->connectorRegs);
+        udata->connectorRegs = NULL;
+    }
+    if (udata->outputs) {
+        free(udata->outputs);
+        udata->outputs     = NULL;
+        udata->outputCount = 0;
+    }
+    if (udata->ring) {
+        free(udata->ring);
+        udata->ring = NULL;
+    }
+    atomic_snapshot_free(&udata->taps);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioDelay_toString(lua_State* L)
+{
+    AudioDelayUserData* udata = luaL_checkudata(L, 1, AUDIO_DELAY_CLASS_NAME);
+
+    lua_pushfstring(L, "%s: %p", AUDIO_DELAY_CLASS_NAME, udata);
+
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioDelay_activate(lua_State* L)
+{
+    AudioDelayUserData* udata = checkAudioDelayUdata(L, 1);
+    if (!udata->activated) {
+        udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = true;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioDelay_deactivate(lua_State* L)
+{
+    AudioDelayUserData* udata = checkAudioDelayUdata(L, 1);
+    if (udata->activated) {
+        udata->auprocCapi->deactivateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = false;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioDelay_set(lua_State* L)
+{
+    AudioDelayUserData* udata = checkAudioDelayUdata(L, 1);
+    const int lastArg = lua_gettop(L);
+
+    DelayTaps t;
+    t.tapCount = 0;
+    int arg = 2;
+    while (arg <= lastArg) {
+        luaL_argcheck(L, t.tapCount < MAX_TAPS, arg, "too many taps");
+        lua_Integer out   = luaL_checkinteger(L, arg);
+        lua_Number  delay = luaL_checknumber(L, arg + 1);
+        lua_Number  gain  = luaL_checknumber(L, arg + 2);
+        if (!isValidTap(udata, out, delay)) {
+            return luaL_argerror(L, arg, "invalid tap parameters");
+        }
+        t.out  [t.tapCount] = out - 1;
+        t.delay[t.tapCount] = delay;
+        t.gain [t.tapCount] = gain;
+        t.tapCount += 1;
+        arg += 3;
+    }
+    DelayTaps* slot = atomic_snapshot_begin(&udata->taps);
+    *slot = t;
+    atomic_snapshot_publish(&udata->taps, slot);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static const luaL_Reg AudioDelayMethods[] =
+{
+    { "activate",    AudioDelay_activate },
+    { "deactivate",  AudioDelay_deactivate },
+    { "set",         AudioDelay_set },
+    { "close",       AudioDelay_release },
+    { NULL,          NULL } /* sentinel */
+};
+
+static const luaL_Reg AudioDelayMetaMethods[] =
+{
+    { "__tostring", AudioDelay_toString },
+    { "__gc",       AudioDelay_release  },
+
+    { NULL,       NULL } /* sentinel */
+};
+
+static const luaL_Reg ModuleFunctions[] =
+{
+    { "new_audio_delay", AudioDelay_new },
+    { NULL,              NULL } /* sentinel */
+};
+
+/* ============================================================================================ */
+
+static void setupAudioDelayMeta(lua_State* L)
+{                                                          /* -> meta */
+    lua_pushstring(L, AUDIO_DELAY_CLASS_NAME);             /* -> meta, className */
+    lua_setfield(L, -2, "__metatable");                    /* -> meta */
+
+    luaL_setfuncs(L, AudioDelayMetaMethods, 0);            /* -> meta */
+
+    lua_newtable(L);                                       /* -> meta, AudioDelayClass */
+    luaL_setfuncs(L, AudioDelayMethods, 0);                /* -> meta, AudioDelayClass */
+    lua_setfield (L, -2, "__index");                       /* -> meta */
+}
+
+
+/* ============================================================================================ */
+
+int auproc_audio_delay_init_module(lua_State* L, int module)
+{
+    if (luaL_newmetatable(L, AUDIO_DELAY_CLASS_NAME)) {
+        setupAudioDelayMeta(L);
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, module);
+        luaL_setfuncs(L, ModuleFunctions, 0);
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+/* ============================================================================================ */
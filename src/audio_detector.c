@@ -0,0 +1,537 @@
+#include "audio_detector.h"
+
+#define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
+#include "auproc_capi.h"
+
+#define RECEIVER_CAPI_IMPLEMENT_GET_CAPI 1
+#include "receiver_capi.h"
+
+/* ============================================================================================ */
+
+static const char* const AUDIO_DETECTOR_CLASS_NAME = "auproc.audio_detector";
+
+static const char* ERROR_INVALID_AUDIO_DETECTOR = "invalid auproc.audio_detector";
+
+/* ============================================================================================ */
+
+#define MAX_TONES     32
+#define DTMF_TWIST    2.5   /* maximal amplitude ratio between low and high group tone (8 dB) */
+#define DTMF_PURITY   0.5   /* minimal fraction of the block energy in both tones */
+
+static const double DTMF_FREQS[8] = { 697, 770, 852, 941, 1209, 1336, 1477, 1633 };
+
+static const char DTMF_DIGITS[4][4] = { { '1', '2', '3', 'A' },
+                                        { '4', '5', '6', 'B' },
+                                        { '7', '8', '9', 'C' },
+                                        { '*', '0', '#', 'D' } };
+
+typedef struct ToneState              ToneState;
+typedef struct AudioDetectorUserData  AudioDetectorUserData;
+
+/**
+ * A detected tone, i.e. a run of subsequent blocks in which the tone was present.
+ */
+struct ToneState
+{
+    int       tone;        /* index into freqs or DTMF digit index, -1 if none */
+    uint32_t  startFrame;
+    uint32_t  blocks;
+};
+
+struct AudioDetectorUserData
+{
+    const char*        className;
+    auproc_processor*  processor;
+
+    bool               closed;
+    bool               activated;
+
+    const auproc_capi*  auprocCapi;
+    auproc_engine*      auprocEngine;
+
+    auproc_connector*       inConnector;
+    const auproc_audiometh* inMethods;
+
+    const receiver_capi* receiverCapi;
+    receiver_object*     receiver;
+    receiver_writer*     receiverWriter;
+
+    bool      dtmf;
+    int       toneCount;
+    double    freqs[MAX_TONES];
+    double    coeffs[MAX_TONES];
+    double    s1[MAX_TONES];
+    double    s2[MAX_TONES];
+    double    energy;
+
+    uint32_t  blockFrames;
+    uint32_t  blockFill;
+    uint32_t  minBlocks;
+    double    threshold;   /* minimal linear amplitude */
+
+    ToneState tones[MAX_TONES];
+};
+
+/* ============================================================================================ */
+
+static void setupAudioDetectorMeta(lua_State* L);
+
+static int pushAudioDetectorMeta(lua_State* L)
+{
+    if (luaL_newmetatable(L, AUDIO_DETECTOR_CLASS_NAME)) {
+        setupAudioDetectorMeta(L);
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static AudioDetectorUserData* checkAudioDetectorUdata(lua_State* L, int arg)
+{
+    AudioDetectorUserData* udata = luaL_checkudata(L, arg, AUDIO_DETECTOR_CLASS_NAME);
+    if (udata->auprocCapi) {
+        udata->auprocCapi->checkEngineIsNotClosed(L, udata->auprocEngine);
+    }
+    if (udata->closed) {
+        luaL_error(L, ERROR_INVALID_AUDIO_DETECTOR);
+        return NULL;
+    }
+    return udata;
+}
+
+/* ============================================================================================ */
+
+static void sendEvent(AudioDetectorUserData* udata, const ToneState* t)
+{
+    if (t->blocks < udata->minBlocks) {
+        return;
+    }
+    const receiver_capi* receiverCapi = udata->receiverCapi;
+    receiver_writer*     writer       = udata->receiverWriter;
+
+    int rc;
+    if (udata->dtmf) {
+        rc = receiverCapi->addStringToWriter(writer, &DTMF_DIGITS[t->tone / 4][t->tone % 4], 1);
+    } else {
+        rc = receiverCapi->addNumberToWriter(writer, udata->freqs[t->tone]);
+    }
+    if (rc == 0) rc = receiverCapi->addIntegerToWriter(writer, t->startFrame);
+    if (rc == 0) rc = receiverCapi->addIntegerToWriter(writer, t->blocks * udata->blockFrames);
+    if (rc == 0) {
+        rc = receiverCapi->msgToReceiver(udata->receiver, writer, false /* clear */, true /* nonblock */,
+                                         NULL /* error handler */, NULL /* error handler data */);
+    }
+    if (rc != 0) {
+        receiverCapi->clearWriter(writer);
+    }
+}
+
+/**
+ * Continues the tone state t if the given tone is present in the block
+ * starting at blockStart, otherwise finishes it.
+ */
+static void updateTone(AudioDetectorUserData* udata, ToneState* t, int tone, uint32_t blockStart)
+{
+    if (t->tone >= 0 && t->tone != tone) {
+        sendEvent(udata, t);
+        t->tone = -1;
+    }
+    if (tone >= 0) {
+        if (t->tone < 0) {
+            t->tone       = tone;
+            t->startFrame = blockStart;
+            t->blocks     = 0;
+        }
+        t->blocks += 1;
+    }
+}
+
+/* ============================================================================================ */
+
+static void finishBlock(AudioDetectorUserData* udata, uint32_t blockStart)
+{
+    const int    n = udata->toneCount;
+    const double N = udata->blockFrames;
+    double       amplitudes[MAX_TONES];
+
+    for (int i = 0; i < n; ++i) {
+        double s1 = udata->s1[i];
+        double s2 = udata->s2[i];
+        double power = s1 * s1 + s2 * s2 - udata->coeffs[i] * s1 * s2;
+        amplitudes[i] = (power > 0) ? 2 * sqrt(power) / N : 0;
+        udata->s1[i] = 0;
+        udata->s2[i] = 0;
+    }
+    if (udata->dtmf)
+    {
+        int lo = 0;
+        int hi = 4;
+        for (int i = 1; i < 4; ++i) {
+            if (amplitudes[i]     > amplitudes[lo]) lo = i;
+            if (amplitudes[4 + i] > amplitudes[hi]) hi = 4 + i;
+        }
+        const double al = amplitudes[lo];
+        const double ah = amplitudes[hi];
+        /* energy of a sine with amplitude a over N frames is a^2 * N / 2 */
+        const double toneEnergy = (al * al + ah * ah) * N / 2;
+        int digit = -1;
+        if (   al >= udata->threshold && ah >= udata->threshold
+            && al <= DTMF_TWIST * ah  && ah <= DTMF_TWIST * al
+            && toneEnergy >= DTMF_PURITY * udata->energy)
+        {
+            digit = 4 * lo + (hi - 4);
+        }
+        updateTone(udata, &udata->tones[0], digit, blockStart);
+    }
+    else
+    {
+        for (int i = 0; i < n; ++i) {
+            updateTone(udata, &udata->tones[i], (amplitudes[i] >= udata->threshold) ? i : -1, blockStart);
+        }
+    }
+    udata->energy = 0;
+}
+
+/* ============================================================================================ */
+
+static void filterFrames(AudioDetectorUserData* udata, const float* in, uint32_t count)
+{
+    const int               n      = udata->toneCount;
+    const double* restrict  coeffs = udata->coeffs;
+    double* restrict        s1     = udata->s1;
+    double* restrict        s2     = udata->s2;
+    double                  energy = 0;
+
+    for (uint32_t k = 0; k < count; ++k) {
+        const double x = in ? in[k] : 0;
+        energy += x * x;
+        for (int i = 0; i < n; ++i) {
+            double s0 = x + coeffs[i] * s1[i] - s2[i];
+            s2[i] = s1[i];
+            s1[i] = s0;
+        }
+    }
+    udata->energy += energy;
+}
+
+/* ============================================================================================ */
+
+static int processCallback(uint32_t nframes, void* processorData)
+{
+    AudioDetectorUserData* udata = (AudioDetectorUserData*) processorData;
+    const auproc_capi*     capi  = udata->auprocCapi;
+
+    uint32_t f0 = capi->getProcessBeginFrameTime(udata->auprocEngine);
+
+    const float* in = NULL;
+    if (!auproc_is_silent(capi, udata->inMethods, udata->inConnector)) {
+        in = udata->inMethods->getAudioBuffer(udata->inConnector, nframes);
+    }
+    uint32_t i = 0;
+    while (i < nframes) {
+        uint32_t m = udata->blockFrames - udata->blockFill;
+        if (m > nframes - i) {
+            m = nframes - i;
+        }
+        filterFrames(udata, in ? in + i : NULL, m);
+        i                += m;
+        udata->blockFill += m;
+        if (udata->blockFill == udata->blockFrames) {
+            finishBlock(udata, f0 + i - udata->blockFrames);
+            udata->blockFill = 0;
+        }
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static void engineClosedCallback(void* processorData)
+{
+    AudioDetectorUserData* udata = (AudioDetectorUserData*) processorData;
+
+    udata->closed    = true;
+    udata->activated = false;
+}
+
+static void engineReleasedCallback(void* processorData)
+{
+    AudioDetectorUserData* udata = (AudioDetectorUserData*) processorData;
+
+    udata->closed       = true;
+    udata->activated    = false;
+    udata->auprocCapi    = NULL;
+    udata->auprocEngine  = NULL;
+}
+
+/* ============================================================================================ */
+
+/**
+ * Reads the parameters from the table at arg and sets up the filter bank.
+ */
+static void checkParams(lua_State* L, int arg, AudioDetectorUserData* udata, uint32_t sampleRate)
+{
+    luaL_checktype(L, arg, LUA_TTABLE);
+
+    lua_getfield(L, arg, "dtmf");                         /* -> dtmf */
+    udata->dtmf = lua_toboolean(L, -1);
+    lua_pop(L, 1);                                        /* -> */
+
+    lua_getfield(L, arg, "freqs");                        /* -> freqs */
+    if (udata->dtmf) {
+        luaL_argcheck(L, lua_isnil(L, -1), arg, "fields 'dtmf' and 'freqs' cannot be combined");
+        udata->toneCount = 8;
+        memcpy(udata->freqs, DTMF_FREQS, sizeof(DTMF_FREQS));
+    }
+    else {
+        luaL_argcheck(L, lua_istable(L, -1), arg, "table expected for field 'freqs'");
+        int n = lua_rawlen(L, -1);
+        luaL_argcheck(L, n >= 1 && n <= MAX_TONES, arg, "invalid number of frequencies");
+        for (int i = 0; i < n; ++i) {
+            lua_rawgeti(L, -1, i + 1);                    /* -> freqs, freq */
+            double f = lua_tonumber(L, -1);
+            luaL_argcheck(L, lua_isnumber(L, -1) && f > 0 && f < sampleRate / 2.0, arg,
+                          "invalid frequency");
+            udata->freqs[i] = f;
+            lua_pop(L, 1);                                /* -> freqs */
+        }
+        udata->toneCount = n;
+    }
+    lua_pop(L, 1);                                        /* -> */
+
+    double window    = auproc_util_opt_number_field(L, arg, "window",    0.02);
+    double threshold = auproc_util_opt_number_field(L, arg, "threshold", -30);
+    double duration  = auproc_util_opt_number_field(L, arg, "duration",  0.04);
+
+    luaL_argcheck(L, window > 0 && window * sampleRate >= 16, arg, "window too small");
+    luaL_argcheck(L, window <= 1,   arg, "window must be <= 1");
+    luaL_argcheck(L, duration >= 0, arg, "duration must be >= 0");
+
+    udata->blockFrames = (uint32_t)(window * sampleRate + 0.5);
+    udata->minBlocks   = (uint32_t)ceil(duration * sampleRate / udata->blockFrames);
+    if (udata->minBlocks < 1) {
+        udata->minBlocks = 1;
+    }
+    udata->threshold = pow(10, threshold / 20);
+
+    for (int i = 0; i < udata->toneCount; ++i) {
+        udata->coeffs[i] = 2 * cos(2 * M_PI * udata->freqs[i] / sampleRate);
+    }
+    for (int i = 0; i < MAX_TONES; ++i) {
+        udata->tones[i].tone = -1;
+    }
+}
+
+/* ============================================================================================ */
+
+static int AudioDetector_new(lua_State* L)
+{
+    const int conArg  = 1;
+    const int recvArg = 2;
+    const int optArg  = 3;
+    lua_settop(L, optArg);
+
+    AudioDetectorUserData* udata = lua_newuserdata(L, sizeof(AudioDetectorUserData));
+    memset(udata, 0, sizeof(AudioDetectorUserData));
+    udata->className = AUDIO_DETECTOR_CLASS_NAME;
+    pushAudioDetectorMeta(L);                             /* -> udata, meta */
+    lua_setmetatable(L, -2);                              /* -> udata */
+    int versionError = 0;
+    const auproc_capi* capi = auproc_get_capi(L, conArg, &versionError);
+    auproc_engine* engine = NULL;
+    auproc_info    info   = {0};
+    if (capi) {
+        engine = capi->getEngine(L, conArg, &info);
+    }
+    if (!capi || !engine) {
+        if (versionError) {
+            return luaL_argerror(L, conArg, "auproc capi version mismatch");
+        } else {
+            return luaL_argerror(L, conArg, "expected connector object");
+        }
+    }
+    if (info.sampleRate == 0) {
+        return luaL_argerror(L, conArg, "cannot determine sample rate");
+    }
+    {
+        int errReason = 0;
+        const receiver_capi* receiverCapi = receiver_get_capi(L, recvArg, &errReason);
+        receiver_object*     receiver     = receiverCapi ? receiverCapi->toReceiver(L, recvArg) : NULL;
+
+        if (!receiverCapi || !receiver) {
+            if (errReason == 1) {
+                return luaL_argerror(L, recvArg, "receiver capi version mismatch");
+            } else {
+                return luaL_argerror(L, recvArg, "expected object with receiver capi");
+            }
+        }
+        udata->receiverCapi = receiverCapi;
+        udata->receiver     = receiver;
+        receiverCapi->retainReceiver(receiver);
+
+        udata->receiverWriter = receiverCapi->newWriter(16 * 1024, 1);
+        if (!udata->receiverWriter) {
+            return luaL_error(L, "out of memory");
+        }
+    }
+    checkParams(L, optArg, udata, info.sampleRate);
+
+    const char* processorName = lua_pushfstring(L, "%s: %p", AUDIO_DETECTOR_CLASS_NAME, udata);   /* -> udata, name */
+
+    auproc_con_reg conReg = {AUPROC_AUDIO, AUPROC_IN, NULL};
+    auproc_con_reg_err regError = {0};
+    auproc_processor* proc = capi->registerProcessor(L, conArg, 1, engine, processorName, udata,
+                                                        processCallback, NULL, engineClosedCallback, engineReleasedCallback,
+                                                        &conReg, &regError);
+    lua_pop(L, 1); /* -> udata */
+
+    if (!proc)
+    {
+        if (regError.errorType == AUPROC_REG_ERR_CONNCTOR_INVALID) {
+            return luaL_argerror(L, conArg, "invalid connector object");
+        }
+        else if (regError.errorType == AUPROC_REG_ERR_ENGINE_MISMATCH)
+        {
+            const char* msg = lua_pushfstring(L, "connector belongs to other %s",
+                                                 capi->engine_category_name);
+            return luaL_argerror(L, conArg, msg);
+        }
+        else if (regError.errorType == AUPROC_REG_ERR_ARG_INVALID
+              || regError.errorType == AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE)
+        {
+            return luaL_argerror(L, conArg, "expected AUDIO IN connector");
+        }
+        else if (regError.errorType == AUPROC_REG_ERR_WRONG_DIRECTION)
+        {
+            return luaL_argerror(L, conArg, "given connector is not readable");
+        }
+        else {
+            return luaL_error(L, "cannot register processor (err=%d)", regError.errorType);
+        }
+    }
+
+    udata->processor    = proc;
+    udata->activated    = false;
+    udata->auprocCapi   = capi;
+    udata->auprocEngine = engine;
+    udata->inConnector  = conReg.connector;
+    udata->inMethods    = conReg.audioMethods;
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioDetector_release(lua_State* L)
+{
+    AudioDetectorUserData* udata = luaL_checkudata(L, 1, AUDIO_DETECTOR_CLASS_NAME);
+    udata->closed    = true;
+    udata->activated = false;
+    if (udata->auprocCapi) {
+        udata->auprocCapi->unregisterProcessor(L, udata->auprocEngine, udata->processor);
+        udata->processor   = NULL;
+        udata->auprocCapi   = NULL;
+        udata->auprocEngine = NULL;
+    }
+    if (udata->receiver) {
+        if (udata->receiverWriter) {
+            udata->receiverCapi->freeWriter(udata->receiverWriter);
+            udata->receiverWriter = NULL;
+        }
+        udata->receiverCapi->releaseReceiver(udata->receiver);
+        udata->receiver     = NULL;
+        udata->receiverCapi = NULL;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioDetector_toString(lua_State* L)
+{
+    AudioDetectorUserData* udata = luaL_checkudata(L, 1, AUDIO_DETECTOR_CLASS_NAME);
+
+    lua_pushfstring(L, "%s: %p", AUDIO_DETECTOR_CLASS_NAME, udata);
+
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioDetector_activate(lua_State* L)
+{
+    AudioDetectorUserData* udata = checkAudioDetectorUdata(L, 1);
+    if (!udata->activated) {
+        udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = true;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioDetector_deactivate(lua_State* L)
+{
+    AudioDetectorUserData* udata = checkAudioDetectorUdata(L, 1);
+    if (udata->activated) {
+        udata->auprocCapi->deactivateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = false;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static const luaL_Reg AudioDetectorMethods[] =
+{
+    { "activate",    AudioDetector_activate },
+    { "deactivate",  AudioDetector_deactivate },
+    { "close",       AudioDetector_release },
+    { NULL,          NULL } /* sentinel */
+};
+
+static const luaL_Reg AudioDetectorMetaMethods[] =
+{
+    { "__tostring", AudioDetector_toString },
+    { "__gc",       AudioDetector_release  },
+
+    { NULL,       NULL } /* sentinel */
+};
+
+static const luaL_Reg ModuleFunctions[] =
+{
+    { "new_audio_detector", AudioDetector_new },
+    { NULL,                 NULL } /* sentinel */
+};
+
+/* ============================================================================================ */
+
+static void setupAudioDetectorMeta(lua_State* L)
+{                                                          /* -> meta */
+    lua_pushstring(L, AUDIO_DETECTOR_CLASS_NAME);          /* -> meta, className */
+    lua_setfield(L, -2, "__metatable");                    /* -> meta */
+
+    luaL_setfuncs(L, AudioDetectorMetaMethods, 0);         /* -> meta */
+
+    lua_newtable(L);                                       /* -> meta, AudioDetectorClass */
+    luaL_setfuncs(L, AudioDetectorMethods, 0);             /* -> meta, AudioDetectorClass */
+    lua_setfield (L, -2, "__index");                       /* -> meta */
+}
+
+
+/* ============================================================================================ */
+
+int auproc_audio_detector_init_module(lua_State* L, int module)
+{
+    if (luaL_newmetatable(L, AUDIO_DETECTOR_CLASS_NAME)) {
+        setupAudioDetectorMeta(L);
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, module);
+        luaL_setfuncs(L, ModuleFunctions, 0);
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+/* ============================================================================================ */
@@ -0,0 +1,490 @@
+#include "audio_ducker.h"
+#include "async_util.h"
+#include "gain_envelope.h"
+
+#define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
+#include "auproc_capi.h"
+
+/* ============================================================================================ */
+
+static const char* const AUDIO_DUCKER_CLASS_NAME = "auproc.audio_ducker";
+
+static const char* ERROR_INVALID_AUDIO_DUCKER = "invalid auproc.audio_ducker";
+
+/* ============================================================================================ */
+
+#define BLOCK_FRAMES  64
+
+typedef struct DuckerParams          DuckerParams;
+typedef struct ChannelConnection     ChannelConnection;
+typedef struct AudioDuckerUserData   AudioDuckerUserData;
+
+/**
+ * Parameters as given by the caller.
+ */
+struct DuckerParams
+{
+    double  threshold;    /* dB */
+    double  range;        /* dB */
+    double  attack;       /* seconds */
+    double  hold;         /* seconds */
+    double  release;      /* seconds */
+};
+
+struct ChannelConnection
+{
+    auproc_connector*       inConnector;
+    const auproc_audiometh* inMethods;
+    auproc_connector*       outConnector;
+    const auproc_audiometh* outMethods;
+    float*                  inBuf;
+    float*                  outBuf;
+    bool                    silent;
+};
+
+struct AudioDuckerUserData
+{
+    const char*        className;
+    auproc_processor*  processor;
+
+    bool               closed;
+    bool               activated;
+
+    const auproc_capi*  auprocCapi;
+    auproc_engine*      auprocEngine;
+    uint32_t            sampleRate;
+
+    auproc_con_reg*     connectorRegs;
+    ChannelConnection*  channels;
+    int                 channelCount;
+
+    auproc_connector*       sideConnector;
+    const auproc_audiometh* sideMethods;
+
+    DuckerParams       params;
+    AtomicSnapshot     coeffs;
+
+    GainEnvelope       env;
+
+    float              detector[BLOCK_FRAMES];
+    float              gains[BLOCK_FRAMES];
+};
+
+/* ============================================================================================ */
+
+static void setupAudioDuckerMeta(lua_State* L);
+
+static int pushAudioDuckerMeta(lua_State* L)
+{
+    if (luaL_newmetatable(L, AUDIO_DUCKER_CLASS_NAME)) {
+        setupAudioDuckerMeta(L);
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static AudioDuckerUserData* checkAudioDuckerUdata(lua_State* L, int arg)
+{
+    AudioDuckerUserData* udata = luaL_checkudata(L, arg, AUDIO_DUCKER_CLASS_NAME);
+    if (udata->auprocCapi) {
+        udata->auprocCapi->checkEngineIsNotClosed(L, udata->auprocEngine);
+    }
+    if (udata->closed) {
+        luaL_error(L, ERROR_INVALID_AUDIO_DUCKER);
+        return NULL;
+    }
+    return udata;
+}
+
+/* ============================================================================================ */
+
+/**
+ * The envelope is open while the sidechain exceeds the threshold and for
+ * the hold time afterwards, the gain is reduced to the range while open.
+ * The ramps are exponential.
+ */
+static void setCoeffs(GainEnvelopeCoeffs* c, const DuckerParams* p, uint32_t sampleRate)
+{
+    c->openLevel    = pow(10, p->threshold / 20);
+    c->closeLevel   = c->openLevel;
+    c->holdFrames   = p->hold * sampleRate + 0.5;
+    c->openGain     = pow(10, p->range / 20);
+    c->closedGain   = 1;
+    c->attackCoeff  = auproc_util_time_coeff(p->attack,  sampleRate);
+    c->attackStep   = 0;
+    c->releaseCoeff = auproc_util_time_coeff(p->release, sampleRate);
+    c->releaseStep  = 0;
+}
+
+/* ============================================================================================ */
+
+static int processCallback(uint32_t nframes, void* processorData)
+{
+    AudioDuckerUserData* udata    = (AudioDuckerUserData*) processorData;
+    ChannelConnection*   channels = udata->channels;
+    const int            n        = udata->channelCount;
+    const auproc_capi*   capi     = udata->auprocCapi;
+
+    atomic_snapshot_update(&udata->coeffs);
+    const GainEnvelopeCoeffs* coeffs = atomic_snapshot_current(&udata->coeffs);
+
+    for (int ch = 0; ch < n; ++ch) {
+        ChannelConnection* c = channels + ch;
+        c->silent = auproc_is_silent(capi, c->inMethods, c->inConnector);
+        c->inBuf  = c->silent ? NULL : c->inMethods->getAudioBuffer(c->inConnector, nframes);
+        c->outBuf = c->outMethods->getAudioBuffer(c->outConnector, nframes);
+    }
+    const float* side = NULL;
+    if (!auproc_is_silent(capi, udata->sideMethods, udata->sideConnector)) {
+        side = udata->sideMethods->getAudioBuffer(udata->sideConnector, nframes);
+    }
+    float* restrict det   = udata->detector;
+    float* restrict gains = udata->gains;
+
+    for (uint32_t f0 = 0; f0 < nframes; f0 += BLOCK_FRAMES)
+    {
+        uint32_t m = (nframes - f0 < BLOCK_FRAMES) ? nframes - f0 : BLOCK_FRAMES;
+
+        memset(det, 0, sizeof(float) * m);
+        if (side) {
+            gain_envelope_peak(det, side + f0, m);
+        }
+        gain_envelope_compute(&udata->env, coeffs, det, gains, m);
+
+        for (int ch = 0; ch < n; ++ch) {
+            const float* restrict in  = channels[ch].inBuf;
+            float*       restrict out = channels[ch].outBuf + f0;
+            if (in) {
+                in += f0;
+                for (uint32_t i = 0; i < m; ++i) {
+                    out[i] = in[i] * gains[i];
+                }
+            } else {
+                memset(out, 0, sizeof(float) * m);
+            }
+        }
+    }
+    for (int ch = 0; ch < n; ++ch) {
+        if (channels[ch].silent) {
+            auproc_set_silent(capi, channels[ch].outMethods, channels[ch].outConnector, true);
+        }
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static void engineClosedCallback(void* processorData)
+{
+    AudioDuckerUserData* udata = (AudioDuckerUserData*) processorData;
+
+    udata->closed    = true;
+    udata->activated = false;
+}
+
+static void engineReleasedCallback(void* processorData)
+{
+    AudioDuckerUserData* udata = (AudioDuckerUserData*) processorData;
+
+    udata->closed       = true;
+    udata->activated    = false;
+    udata->auprocCapi    = NULL;
+    udata->auprocEngine  = NULL;
+}
+
+/* ============================================================================================ */
+
+/**
+ * Reads the parameters from the table at arg, missing fields keep
+ * their values.
+ */
+static void checkParams(lua_State* L, int arg, DuckerParams* p)
+{
+    luaL_checktype(L, arg, LUA_TTABLE);
+
+    p->threshold  = auproc_util_opt_number_field(L, arg, "threshold",  p->threshold);
+    p->range      = auproc_util_opt_number_field(L, arg, "range",      p->range);
+    p->attack     = auproc_util_opt_number_field(L, arg, "attack",     p->attack);
+    p->hold       = auproc_util_opt_number_field(L, arg, "hold",       p->hold);
+    p->release    = auproc_util_opt_number_field(L, arg, "release",    p->release);
+
+    luaL_argcheck(L, p->attack >= 0,     arg, "attack must be >= 0");
+    luaL_argcheck(L, p->hold >= 0,       arg, "hold must be >= 0");
+    luaL_argcheck(L, p->release >= 0,    arg, "release must be >= 0");
+    luaL_argcheck(L, p->range <= 0,      arg, "range must be <= 0");
+}
+
+static int AudioDucker_new(lua_State* L)
+{
+    const int firstArg = 1;
+    const int lastArg  = lua_gettop(L);
+
+    AudioDuckerUserData* udata = lua_newuserdata(L, sizeof(AudioDuckerUserData));
+    memset(udata, 0, sizeof(AudioDuckerUserData));
+    udata->className = AUDIO_DUCKER_CLASS_NAME;
+    pushAudioDuckerMeta(L);                               /* -> udata, meta */
+    lua_setmetatable(L, -2);                              /* -> udata */
+    int versionError = 0;
+    const auproc_capi* capi = auproc_get_capi(L, firstArg, &versionError);
+    auproc_engine* engine = NULL;
+    auproc_info    info   = {0};
+    if (capi) {
+        engine = capi->getEngine(L, firstArg, &info);
+    }
+    if (!capi || !engine) {
+        if (versionError) {
+            return luaL_argerror(L, firstArg, "auproc capi version mismatch");
+        } else {
+            return luaL_argerror(L, firstArg, "expected connector object");
+        }
+    }
+    if (info.sampleRate == 0) {
+        return luaL_argerror(L, firstArg, "cannot determine sample rate");
+    }
+    const int firstConArg = (capi->getObjectType(L, firstArg) == AUPROC_TENGINE) ? firstArg + 1 : firstArg;
+    int lastConArg = lastArg;
+    for (int i = firstConArg; i <= lastArg; ++i) {
+        if (!capi->getConnectorType(L, i)) {
+            lastConArg = i - 1;
+            break;
+        }
+    }
+    const int conCount = lastConArg - firstConArg + 1;
+    const int optArg   = lastConArg + 1;
+
+    if (conCount < 3 || conCount % 2 == 0) {
+        return luaL_argerror(L, firstConArg, "expected same number of input and output connector objects "
+                                             "and one sidechain connector object");
+    }
+    const int  n         = conCount / 2;
+    const int  outConArg = firstConArg + n;
+
+    udata->sampleRate = info.sampleRate;
+    udata->params.threshold  = -40;
+    udata->params.range      = -12;
+    udata->params.attack     = 0.01;
+    udata->params.hold       = 0.2;
+    udata->params.release    = 0.5;
+
+    if (optArg <= lastArg) {
+        checkParams(L, optArg, &udata->params);
+    }
+    udata->channelCount  = n;
+    udata->channels      = calloc(n, sizeof(ChannelConnection));
+    udata->connectorRegs = calloc(conCount, sizeof(auproc_con_reg));
+    if (   !udata->channels || !udata->connectorRegs
+        || !atomic_snapshot_init(&udata->coeffs, sizeof(GainEnvelopeCoeffs)))
+    {
+        return luaL_error(L, "out of memory");
+    }
+    setCoeffs(atomic_snapshot_current(&udata->coeffs), &udata->params, info.sampleRate);
+    udata->env.gain = 1;
+
+    const char* processorName = lua_pushfstring(L, "%s: %p", AUDIO_DUCKER_CLASS_NAME, udata);   /* -> udata, name */
+
+    auproc_con_reg* conRegs = udata->connectorRegs;
+
+    const auproc_con_reg inConReg  = {AUPROC_AUDIO, AUPROC_IN,  NULL};
+    const auproc_con_reg outConReg = {AUPROC_AUDIO, AUPROC_OUT, NULL};
+
+    for (int i = 0; i < n; ++i) {
+        conRegs[i]     = inConReg;
+        conRegs[n + i] = outConReg;
+    }
+    conRegs[2 * n] = inConReg;
+
+    auproc_con_reg_err regError = {0};
+    auproc_processor* proc = capi->registerProcessor(L, firstConArg, conCount, engine, processorName, udata,
+                                                         processCallback, NULL, engineClosedCallback, engineReleasedCallback,
+                                                         conRegs, &regError);
+    lua_pop(L, 1); /* -> udata */
+
+    if (!proc)
+    {
+        if (regError.conIndex >= 0)
+        {
+            int  errArg = firstConArg + regError.conIndex;
+            bool isOut  = (outConArg <= errArg && errArg < outConArg + n);
+
+            if (regError.errorType == AUPROC_REG_ERR_CONNCTOR_INVALID)
+            {
+                return luaL_argerror(L, errArg, "invalid connector object");
+            }
+            if (   regError.errorType == AUPROC_REG_ERR_ENGINE_MISMATCH)
+            {
+                const char* msg = lua_pushfstring(L, "connector belongs to other %s",
+                                                     capi->engine_category_name);
+                return luaL_argerror(L, errArg, msg);
+            }
+            if (regError.errorType == AUPROC_REG_ERR_ARG_INVALID
+             || regError.errorType == AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE)
+            {
+                if (!isOut) {
+                    return luaL_argerror(L, errArg, "expected AUDIO IN connector");
+                } else {
+                    return luaL_argerror(L, errArg, "expected AUDIO OUT connector");
+                }
+            }
+            if (regError.errorType == AUPROC_REG_ERR_WRONG_DIRECTION)
+            {
+                if (!isOut) {
+                    return luaL_argerror(L, errArg, "given connector is not readable");
+                } else {
+                    return luaL_argerror(L, errArg, "given connector is not writable");
+                }
+            }
+        }
+        return luaL_error(L, "cannot register processor (err=%d)", regError.errorType);
+    }
+
+    udata->processor    = proc;
+    udata->activated    = false;
+    udata->auprocCapi   = capi;
+    udata->auprocEngine = engine;
+
+    for (int i = 0; i < n; ++i) {
+        udata->channels[i].inConnector  = conRegs[i].connector;
+        udata->channels[i].inMethods    = conRegs[i].audioMethods;
+        udata->channels[i].outConnector = conRegs[n + i].connector;
+        udata->channels[i].outMethods   = conRegs[n + i].audioMethods;
+    }
+    udata->sideConnector = conRegs[2 * n].connector;
+    udata->sideMethods   = conRegs[2 * n].audioMethods;
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioDucker_release(lua_State* L)
+{
+    AudioDuckerUserData* udata = luaL_checkudata(L, 1, AUDIO_DUCKER_CLASS_NAME);
+    udata->closed    = true;
+    udata->activated = false;
+    if (udata->auprocCapi) {
+        udata->auprocCapi->unregisterProcessor(L, udata->auprocEngine, udata->processor);
+        udata->processor   = NULL;
+        udata->auprocCapi   = NULL;
+        udata->auprocEngine = NULL;
+    }
+    if (udata->connectorRegs) {
+        free(udata->connectorRegs);
+        udata->connectorRegs = NULL;
+    }
+    if (udata->channels) {
+        free(udata->channels);
+        udata->channels     = NULL;
+        udata->channelCount = 0;
+    }
+    atomic_snapshot_free(&udata->coeffs);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioDucker_toString(lua_State* L)
+{
+    AudioDuckerUserData* udata = luaL_checkudata(L, 1, AUDIO_DUCKER_CLASS_NAME);
+
+    lua_pushfstring(L, "%s: %p", AUDIO_DUCKER_CLASS_NAME, udata);
+
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioDucker_activate(lua_State* L)
+{
+    AudioDuckerUserData* udata = checkAudioDuckerUdata(L, 1);
+    if (!udata->activated) {
+        udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = true;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioDucker_deactivate(lua_State* L)
+{
+    AudioDuckerUserData* udata = checkAudioDuckerUdata(L, 1);
+    if (udata->activated) {
+        udata->auprocCapi->deactivateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = false;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioDucker_set(lua_State* L)
+{
+    AudioDuckerUserData* udata = checkAudioDuckerUdata(L, 1);
+
+    DuckerParams p = udata->params;
+    checkParams(L, 2, &p);
+    udata->params = p;
+
+    GainEnvelopeCoeffs* slot = atomic_snapshot_begin(&udata->coeffs);
+    setCoeffs(slot, &p, udata->sampleRate);
+    atomic_snapshot_publish(&udata->coeffs, slot);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static const luaL_Reg AudioDuckerMethods[] =
+{
+    { "activate",    AudioDucker_activate },
+    { "deactivate",  AudioDucker_deactivate },
+    { "set",         AudioDucker_set },
+    { "close",       AudioDucker_release },
+    { NULL,          NULL } /* sentinel */
+};
+
+static const luaL_Reg AudioDuckerMetaMethods[] =
+{
+    { "__tostring", AudioDucker_toString },
+    { "__gc",       AudioDucker_release  },
+
+    { NULL,       NULL } /* sentinel */
+};
+
+static const luaL_Reg ModuleFunctions[] =
+{
+    { "new_audio_ducker", AudioDucker_new },
+    { NULL,               NULL } /* sentinel */
+};
+
+/* ============================================================================================ */
+
+static void setupAudioDuckerMeta(lua_State* L)
+{                                                          /* -> meta */
+    lua_pushstring(L, AUDIO_DUCKER_CLASS_NAME);            /* -> meta, className */
+    lua_setfield(L, -2, "__metatable");                    /* -> meta */
+
+    luaL_setfuncs(L, AudioDuckerMetaMethods, 0);           /* -> meta */
+
+    lua_newtable(L);                                       /* -> meta, AudioDuckerClass */
+    luaL_setfuncs(L, AudioDuckerMethods, 0);               /* -> meta, AudioDuckerClass */
+    lua_setfield (L, -2, "__index");                       /* -> meta */
+}
+
+
+/* ============================================================================================ */
+
+int auproc_audio_ducker_init_module(lua_State* L, int module)
+{
+    if (luaL_newmetatable(L, AUDIO_DUCKER_CLASS_NAME)) {
+        setupAudioDuckerMeta(L);
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, module);
+        luaL_setfuncs(L, ModuleFunctions, 0);
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+/* ============================================================================================ */
@@ -0,0 +1,825 @@
+#include "audio_envelope.h"
+#include "simd_util.h"
+
+#define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
+#include "auproc_capi.h"
+
+#define SENDER_CAPI_IMPLEMENT_GET_CAPI 1
+#include "sender_capi.h"
+
+/* ============================================================================================ */
+
+static const char* const AUDIO_ENVELOPE_CLASS_NAME = "auproc.audio_envelope";
+
+static const char* ERROR_INVALID_AUDIO_ENVELOPE = "invalid auproc.audio_envelope";
+
+/* ============================================================================================ */
+
+#define CHUNK_FRAMES  256
+#define CURVE_BLOCK    16
+
+typedef struct Breakpoint           Breakpoint;
+typedef struct EnvelopeCommand      EnvelopeCommand;
+typedef struct ChannelConnection    ChannelConnection;
+typedef struct AudioEnvelopeUserData AudioEnvelopeUserData;
+
+struct Breakpoint
+{
+    double  frame;   /* time of the breakpoint in frames */
+    float   value;
+    float   curve;   /* shape of the segment to the next breakpoint, 0 is linear */
+};
+
+/**
+ * Commands of one control message, parsed in the realtime thread.
+ */
+struct EnvelopeCommand
+{
+    bool    start;
+    bool    stop;
+    bool    locate;
+    bool    loop;
+    double  locateFrame;
+    double  loopStart;
+    double  loopEnd;
+};
+
+struct ChannelConnection
+{
+    auproc_connector*       inConnector;
+    const auproc_audiometh* inMethods;
+    auproc_connector*       outConnector;
+    const auproc_audiometh* outMethods;
+    const float*            inBuf;
+    float*                  outBuf;
+};
+
+struct AudioEnvelopeUserData
+{
+    const char*        className;
+    auproc_processor*  processor;
+
+    bool               closed;
+    bool               activated;
+
+    const auproc_capi*  auprocCapi;
+    auproc_engine*      auprocEngine;
+    uint32_t            sampleRate;
+
+    auproc_con_reg*     connectorRegs;
+    ChannelConnection*  channels;
+    int                 channelCount;
+    bool                gainMode;
+
+    const sender_capi* senderCapi;
+    sender_object*     sender;
+    sender_reader*     senderReader;
+
+    bool               hasPending;
+    uint32_t           pendingTime;
+    EnvelopeCommand    pending;
+
+    Breakpoint*        points;
+    size_t             pointCount;
+
+    size_t             cursor;   /* index of the first breakpoint after pos */
+    double             pos;      /* envelope time in frames */
+    bool               playing;
+    bool               looping;
+    double             loopStart;
+    double             loopEnd;
+};
+
+/* ============================================================================================ */
+
+static void setupAudioEnvelopeMeta(lua_State* L);
+
+static int pushAudioEnvelopeMeta(lua_State* L)
+{
+    if (luaL_newmetatable(L, AUDIO_ENVELOPE_CLASS_NAME)) {
+        setupAudioEnvelopeMeta(L);
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static AudioEnvelopeUserData* checkAudioEnvelopeUdata(lua_State* L, int arg)
+{
+    AudioEnvelopeUserData* udata = luaL_checkudata(L, arg, AUDIO_ENVELOPE_CLASS_NAME);
+    if (udata->auprocCapi) {
+        udata->auprocCapi->checkEngineIsNotClosed(L, udata->auprocEngine);
+    }
+    if (udata->closed) {
+        luaL_error(L, ERROR_INVALID_AUDIO_ENVELOPE);
+        return NULL;
+    }
+    return udata;
+}
+
+/* ============================================================================================ */
+
+static void locate(AudioEnvelopeUserData* udata, double frame)
+{
+    const Breakpoint* points = udata->points;
+    size_t lo = 0;
+    size_t hi = udata->pointCount;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (points[mid].frame <= frame) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    udata->cursor = lo;
+    udata->pos    = frame;
+}
+
+/* ============================================================================================ */
+
+static float valueAt(const AudioEnvelopeUserData* udata)
+{
+    const Breakpoint* points = udata->points;
+    const size_t      i      = udata->cursor;
+
+    if (i == 0) {
+        return points[0].value;
+    }
+    if (i == udata->pointCount) {
+        return points[i - 1].value;
+    }
+    const Breakpoint* p0 = points + i - 1;
+    const Breakpoint* p1 = points + i;
+    const double      x  = (udata->pos - p0->frame) / (p1->frame - p0->frame);
+    const double      dv = p1->value - p0->value;
+    if (p0->curve == 0) {
+        return p0->value + dv * x;
+    } else {
+        return p0->value + dv * (1 - exp(p0->curve * x)) / (1 - exp(p0->curve));
+    }
+}
+
+/* ============================================================================================ */
+
+static void fillValue(float* restrict env, uint32_t n, float v)
+{
+    for (uint32_t k = 0; k < n; ++k) {
+        env[k] = v;
+    }
+}
+
+/**
+ * Renders n frames of the segment that ends at the breakpoint under the cursor.
+ * The caller guarantees that the n frames do not cross this breakpoint.
+ */
+static void renderSegment(const AudioEnvelopeUserData* udata, float* restrict env, uint32_t n)
+{
+    const Breakpoint* p0  = udata->points + udata->cursor - 1;
+    const Breakpoint* p1  = udata->points + udata->cursor;
+    const double      len = p1->frame - p0->frame;
+    const double      x0  = (udata->pos - p0->frame) / len;
+    const double      dx  = 1 / len;
+    const double      dv  = p1->value - p0->value;
+
+    if (p0->curve == 0)
+    {
+        const float a   = p0->value + dv * x0;
+        const float b   = dv * dx;
+        const Vec4  av  = vec4_set1(a);
+        const Vec4  bv  = vec4_set1(b);
+        const Vec4  inc = vec4_set1(VEC4_WIDTH);
+        Vec4        kv  = vec4_ramp(0, 1);
+        uint32_t    k   = 0;
+        for (; k + VEC4_WIDTH <= n; k += VEC4_WIDTH) {
+            vec4_store(env + k, vec4_madd(bv, kv, av));
+            kv = vec4_add(kv, inc);
+        }
+        for (; k < n; ++k) {
+            env[k] = a + b * (float)k;
+        }
+    }
+    else
+    {
+        /* v(x) = base - scale * exp(curve * x) */
+        const double scale = dv / (1 - exp(p0->curve));
+        const float  base  = p0->value + scale;
+        const double g     = exp(p0->curve * dx);
+        float        gpow[CURVE_BLOCK];
+        double       gp = 1;
+        for (int j = 0; j < CURVE_BLOCK; ++j) {
+            gpow[j] = gp;
+            gp *= g;
+        }
+        double   e = scale * exp(p0->curve * x0);
+        uint32_t k = 0;
+        const Vec4 basev = vec4_set1(base);
+        for (; k + CURVE_BLOCK <= n; k += CURVE_BLOCK) {
+            const Vec4 sv = vec4_set1(e);
+            for (int j = 0; j < CURVE_BLOCK; j += VEC4_WIDTH) {
+                vec4_store(env + k + j, vec4_sub(basev, vec4_mul(sv, vec4_load(gpow + j))));
+            }
+            e *= gp;
+        }
+        const float s = e;
+        for (uint32_t j = 0; k + j < n; ++j) {
+            env[k + j] = base - s * gpow[j];
+        }
+    }
+}
+
+/* ============================================================================================ */
+
+static void renderEnvelope(AudioEnvelopeUserData* udata, float* env, uint32_t n)
+{
+    const Breakpoint* points = udata->points;
+    const size_t      count  = udata->pointCount;
+
+    while (n > 0)
+    {
+        if (!udata->playing) {
+            fillValue(env, n, valueAt(udata));
+            return;
+        }
+        double limit = -1;
+        if (udata->cursor < count) {
+            limit = points[udata->cursor].frame;
+        }
+        bool wrap = false;
+        if (udata->looping && udata->pos < udata->loopEnd && (limit < 0 || udata->loopEnd <= limit)) {
+            limit = udata->loopEnd;
+            wrap  = true;
+        }
+        uint32_t m = n;
+        if (limit >= 0) {
+            double d = ceil(limit - udata->pos);
+            if (d < m) {
+                m = (uint32_t)d;
+            }
+        }
+        if (udata->cursor == 0 || udata->cursor == count) {
+            fillValue(env, m, valueAt(udata));
+        } else {
+            renderSegment(udata, env, m);
+        }
+        env += m;
+        n   -= m;
+        udata->pos += m;
+        if (wrap && udata->pos >= udata->loopEnd) {
+            locate(udata, udata->loopStart + (udata->pos - udata->loopEnd));
+        } else {
+            while (udata->cursor < count && points[udata->cursor].frame <= udata->pos) {
+                udata->cursor += 1;
+            }
+        }
+    }
+}
+
+/* ============================================================================================ */
+
+static void render(AudioEnvelopeUserData* udata, uint32_t begin, uint32_t end)
+{
+    ChannelConnection* channels = udata->channels;
+    const int          n        = udata->channelCount;
+
+    while (begin < end)
+    {
+        uint32_t m = end - begin;
+        if (m > CHUNK_FRAMES) {
+            m = CHUNK_FRAMES;
+        }
+        if (!udata->gainMode) {
+            renderEnvelope(udata, channels[0].outBuf + begin, m);
+        }
+        else {
+            float env[CHUNK_FRAMES];
+            renderEnvelope(udata, env, m);
+            for (int ch = 0; ch < n; ++ch) {
+                const float* restrict in  = channels[ch].inBuf;
+                float* restrict       out = channels[ch].outBuf + begin;
+                if (in) {
+                    in += begin;
+                    uint32_t k = 0;
+                    for (; k + VEC4_WIDTH <= m; k += VEC4_WIDTH) {
+                        vec4_store(out + k, vec4_mul(vec4_load(in + k), vec4_load(env + k)));
+                    }
+                    for (; k < m; ++k) {
+                        out[k] = in[k] * env[k];
+                    }
+                }
+            }
+        }
+        begin += m;
+    }
+}
+
+/* ============================================================================================ */
+
+static bool isCommand(const sender_capi_value* value, const char* name)
+{
+    size_t len = strlen(name);
+    return    value->type == SENDER_CAPI_TYPE_STRING
+           && value->strVal.len == len
+           && memcmp(value->strVal.ptr, name, len) == 0;
+}
+
+static bool nextNumber(const sender_capi* senderCapi, sender_reader* reader, lua_Number* value)
+{
+    sender_capi_value senderValue;
+    senderCapi->nextValueFromReader(reader, &senderValue);
+    if (senderValue.type == SENDER_CAPI_TYPE_INTEGER) {
+        *value = senderValue.intVal;
+        return true;
+    } else if (senderValue.type == SENDER_CAPI_TYPE_NUMBER) {
+        *value = senderValue.numVal;
+        return true;
+    }
+    return false;
+}
+
+static bool readCommand(AudioEnvelopeUserData* udata, uint32_t f0, uint32_t* time, EnvelopeCommand* cmd)
+{
+    const sender_capi* senderCapi = udata->senderCapi;
+    sender_reader*     reader     = udata->senderReader;
+    const double       sr         = udata->sampleRate;
+    sender_capi_value  value;
+
+    memset(cmd, 0, sizeof(EnvelopeCommand));
+    *time = f0;
+
+    senderCapi->nextValueFromReader(reader, &value);
+    if (value.type == SENDER_CAPI_TYPE_INTEGER) {
+        *time = value.intVal;
+        senderCapi->nextValueFromReader(reader, &value);
+    }
+    if (value.type == SENDER_CAPI_TYPE_NONE) {
+        return false;
+    }
+    while (value.type != SENDER_CAPI_TYPE_NONE)
+    {
+        lua_Number v1, v2;
+        if (isCommand(&value, "start")) {
+            cmd->start = true;
+            cmd->stop  = false;
+        }
+        else if (isCommand(&value, "stop")) {
+            cmd->stop  = true;
+            cmd->start = false;
+        }
+        else if (isCommand(&value, "locate") && nextNumber(senderCapi, reader, &v1)) {
+            cmd->locate      = true;
+            cmd->locateFrame = (v1 > 0) ? v1 * sr : 0;
+        }
+        else if (   isCommand(&value, "loop") && nextNumber(senderCapi, reader, &v1)
+                                              && nextNumber(senderCapi, reader, &v2)) {
+            cmd->loop      = true;
+            cmd->loopStart = (v1 > 0) ? v1 * sr : 0;
+            cmd->loopEnd   = v2 * sr;
+        }
+        else {
+            return false;
+        }
+        senderCapi->nextValueFromReader(reader, &value);
+    }
+    return true;
+}
+
+static void applyCommand(AudioEnvelopeUserData* udata, const EnvelopeCommand* cmd)
+{
+    if (cmd->loop) {
+        udata->loopStart = cmd->loopStart;
+        udata->loopEnd   = cmd->loopEnd;
+        udata->looping   = (cmd->loopEnd > cmd->loopStart);
+    }
+    if (cmd->locate) {
+        locate(udata, cmd->locateFrame);
+    }
+    if (cmd->stop) {
+        udata->playing = false;
+    }
+    if (cmd->start) {
+        udata->playing = true;
+    }
+}
+
+/* ============================================================================================ */
+
+static int processCallback(uint32_t nframes, void* processorData)
+{
+    AudioEnvelopeUserData* udata    = (AudioEnvelopeUserData*) processorData;
+    ChannelConnection*     channels = udata->channels;
+    const int              n        = udata->channelCount;
+    const auproc_capi*     capi     = udata->auprocCapi;
+
+    uint32_t f0 = capi->getProcessBeginFrameTime(udata->auprocEngine);
+
+    for (int ch = 0; ch < n; ++ch) {
+        ChannelConnection* c = channels + ch;
+        c->outBuf = c->outMethods->getAudioBuffer(c->outConnector, nframes);
+        if (udata->gainMode) {
+            if (auproc_is_silent(capi, c->inMethods, c->inConnector)) {
+                c->inBuf = NULL;
+                memset(c->outBuf, 0, sizeof(float) * nframes);
+                auproc_set_silent(capi, c->outMethods, c->outConnector, true);
+            } else {
+                c->inBuf = c->inMethods->getAudioBuffer(c->inConnector, nframes);
+            }
+        }
+    }
+    uint32_t pos = 0;
+    while (pos < nframes) {
+        if (!udata->hasPending && udata->sender) {
+            const sender_capi* senderCapi = udata->senderCapi;
+            sender_reader*     reader     = udata->senderReader;
+
+            int rc = senderCapi->nextMessageFromSender(udata->sender, reader,
+                                                       true /* nonblock */, 0 /* timeout */,
+                                                       NULL /* errorHandler */, NULL /* errorHandlerData */);
+            if (rc == 0) {
+                udata->hasPending = readCommand(udata, f0 + pos, &udata->pendingTime, &udata->pending);
+                senderCapi->clearReader(reader);
+                continue;
+            }
+        }
+        uint32_t end = nframes;
+        if (udata->hasPending) {
+            int32_t offset = udata->pendingTime - f0;
+            if (offset <= (int32_t)pos) {
+                applyCommand(udata, &udata->pending);
+                udata->hasPending = false;
+                continue;
+            }
+            if (offset < (int32_t)nframes) {
+                end = offset;
+            }
+        }
+        render(udata, pos, end);
+        pos = end;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static void engineClosedCallback(void* processorData)
+{
+    AudioEnvelopeUserData* udata = (AudioEnvelopeUserData*) processorData;
+
+    udata->closed    = true;
+    udata->activated = false;
+}
+
+static void engineReleasedCallback(void* processorData)
+{
+    AudioEnvelopeUserData* udata = (AudioEnvelopeUserData*) processorData;
+
+    udata->closed       = true;
+    udata->activated    = false;
+    udata->auprocCapi    = NULL;
+    udata->auprocEngine  = NULL;
+}
+
+/* ============================================================================================ */
+
+static bool getNumberAt(lua_State* L, int index, int i, double* value)
+{
+    lua_rawgeti(L, index, i);
+    bool ok = lua_isnumber(L, -1);
+    if (ok) {
+        *value = lua_tonumber(L, -1);
+    }
+    lua_pop(L, 1);
+    return ok;
+}
+
+static void checkPoints(lua_State* L, int arg, AudioEnvelopeUserData* udata)
+{
+    luaL_checktype(L, arg, LUA_TTABLE);
+    size_t count = lua_rawlen(L, arg);
+    if (count == 0) {
+        luaL_argerror(L, arg, "expected at least one breakpoint");
+    }
+    udata->points = calloc(count, sizeof(Breakpoint));
+    if (!udata->points) {
+        luaL_error(L, "out of memory");
+    }
+    udata->pointCount = count;
+
+    double lastTime = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        lua_rawgeti(L, arg, i + 1);                         /* -> point */
+        if (!lua_istable(L, -1)) {
+            luaL_argerror(L, arg, lua_pushfstring(L, "breakpoint %d: expected table", (int)(i + 1)));
+        }
+        int    p = lua_gettop(L);
+        double time = 0, value = 0, curve = 0;
+        if (!getNumberAt(L, p, 1, &time) || time < 0 || time < lastTime) {
+            luaL_argerror(L, arg, lua_pushfstring(L, "breakpoint %d: invalid time", (int)(i + 1)));
+        }
+        if (!getNumberAt(L, p, 2, &value)) {
+            luaL_argerror(L, arg, lua_pushfstring(L, "breakpoint %d: invalid value", (int)(i + 1)));
+        }
+        lua_rawgeti(L, p, 3);                               /* -> point, curve */
+        if (!lua_isnil(L, -1)) {
+            if (!lua_isnumber(L, -1)) {
+                luaL_argerror(L, arg, lua_pushfstring(L, "breakpoint %d: invalid curve", (int)(i + 1)));
+            }
+            curve = lua_tonumber(L, -1);
+        }
+        lua_pop(L, 2);                                      /* -> */
+
+        udata->points[i].frame = time * udata->sampleRate;
+        udata->points[i].value = value;
+        udata->points[i].curve = (fabs(curve) < 0.001) ? 0 : curve;
+        lastTime = time;
+    }
+}
+
+/* ============================================================================================ */
+
+static int AudioEnvelope_new(lua_State* L)
+{
+    const int firstArg = 1;
+    const int lastArg  = lua_gettop(L);
+
+    AudioEnvelopeUserData* udata = lua_newuserdata(L, sizeof(AudioEnvelopeUserData));
+    memset(udata, 0, sizeof(AudioEnvelopeUserData));
+    udata->className = AUDIO_ENVELOPE_CLASS_NAME;
+    pushAudioEnvelopeMeta(L);                             /* -> udata, meta */
+    lua_setmetatable(L, -2);                              /* -> udata */
+    int versionError = 0;
+    const auproc_capi* capi = auproc_get_capi(L, firstArg, &versionError);
+    auproc_engine* engine = NULL;
+    auproc_info    info   = {0};
+    if (capi) {
+        engine = capi->getEngine(L, firstArg, &info);
+    }
+    if (!capi || !engine) {
+        if (versionError) {
+            return luaL_argerror(L, firstArg, "auproc capi version mismatch");
+        } else {
+            return luaL_argerror(L, firstArg, "expected connector object");
+        }
+    }
+    if (info.sampleRate == 0) {
+        return luaL_argerror(L, firstArg, "cannot determine sample rate");
+    }
+    const int firstConArg = (capi->getObjectType(L, firstArg) == AUPROC_TENGINE) ? firstArg + 1 : firstArg;
+    int lastConArg = lastArg;
+    for (int i = firstConArg; i <= lastArg; ++i) {
+        if (!capi->getConnectorType(L, i)) {
+            lastConArg = i - 1;
+            break;
+        }
+    }
+    const int conCount = lastConArg - firstConArg + 1;
+    const int pointArg = lastConArg + 1;
+    const int sndrArg  = lastConArg + 2;
+
+    if (conCount < 1 || (conCount > 1 && conCount % 2 != 0)) {
+        return luaL_argerror(L, firstConArg, "expected one output connector object or same number "
+                                             "of input and output connector objects");
+    }
+    const bool gainMode  = (conCount > 1);
+    const int  n         = gainMode ? conCount / 2 : 1;
+    const int  outConArg = gainMode ? firstConArg + n : firstConArg;
+
+    udata->sampleRate = info.sampleRate;
+    checkPoints(L, pointArg, udata);
+    locate(udata, 0);
+
+    if (!lua_isnoneornil(L, sndrArg))
+    {
+        int errReason = 0;
+        const sender_capi* senderCapi = sender_get_capi(L, sndrArg, &errReason);
+        sender_object*     sender     = senderCapi ? senderCapi->toSender(L, sndrArg) : NULL;
+
+        if (!senderCapi || !sender) {
+            if (errReason == 1) {
+                return luaL_argerror(L, sndrArg, "sender capi version mismatch");
+            } else {
+                return luaL_argerror(L, sndrArg, "expected object with sender capi");
+            }
+        }
+        udata->senderCapi = senderCapi;
+        udata->sender     = sender;
+        senderCapi->retainSender(sender);
+
+        udata->senderReader = senderCapi->newReader(16 * 1024, 1);
+        if (!udata->senderReader) {
+            return luaL_error(L, "out of memory");
+        }
+    }
+    udata->gainMode      = gainMode;
+    udata->channelCount  = n;
+    udata->channels      = calloc(n, sizeof(ChannelConnection));
+    udata->connectorRegs = calloc(conCount, sizeof(auproc_con_reg));
+    if (!udata->channels || !udata->connectorRegs) {
+        return luaL_error(L, "out of memory");
+    }
+    const char* processorName = lua_pushfstring(L, "%s: %p", AUDIO_ENVELOPE_CLASS_NAME, udata);   /* -> udata, name */
+
+    auproc_con_reg* conRegs = udata->connectorRegs;
+
+    const auproc_con_reg inConReg  = {AUPROC_AUDIO, AUPROC_IN,  NULL};
+    const auproc_con_reg outConReg = {AUPROC_AUDIO, AUPROC_OUT, NULL};
+
+    if (gainMode) {
+        for (int i = 0; i < n; ++i) {
+            conRegs[i]     = inConReg;
+            conRegs[n + i] = outConReg;
+        }
+    } else {
+        conRegs[0] = outConReg;
+    }
+    auproc_con_reg_err regError = {0};
+    auproc_processor* proc = capi->registerProcessor(L, firstConArg, conCount, engine, processorName, udata,
+                                                         processCallback, NULL, engineClosedCallback, engineReleasedCallback,
+                                                         conRegs, &regError);
+    lua_pop(L, 1); /* -> udata */
+
+    if (!proc)
+    {
+        if (regError.conIndex >= 0)
+        {
+            int errArg = firstConArg + regError.conIndex;
+
+            if (regError.errorType == AUPROC_REG_ERR_CONNCTOR_INVALID)
+            {
+                return luaL_argerror(L, errArg, "invalid connector object");
+            }
+            if (   regError.errorType == AUPROC_REG_ERR_ENGINE_MISMATCH)
+            {
+                const char* msg = lua_pushfstring(L, "connector belongs to other %s",
+                                                     capi->engine_category_name);
+                return luaL_argerror(L, errArg, msg);
+            }
+            if (regError.errorType == AUPROC_REG_ERR_ARG_INVALID
+             || regError.errorType == AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE)
+            {
+                if (errArg < outConArg) {
+                    return luaL_argerror(L, errArg, "expected AUDIO IN connector");
+                } else {
+                    return luaL_argerror(L, errArg, "expected AUDIO OUT connector");
+                }
+            }
+            if (regError.errorType == AUPROC_REG_ERR_WRONG_DIRECTION)
+            {
+                if (errArg < outConArg) {
+                    return luaL_argerror(L, errArg, "given connector is not readable");
+                } else {
+                    return luaL_argerror(L, errArg, "given connector is not writable");
+                }
+            }
+        }
+        return luaL_error(L, "cannot register processor (err=%d)", regError.errorType);
+    }
+
+    udata->processor    = proc;
+    udata->activated    = false;
+    udata->auprocCapi   = capi;
+    udata->auprocEngine = engine;
+
+    for (int i = 0; i < n; ++i) {
+        if (gainMode) {
+            udata->channels[i].inConnector  = conRegs[i].connector;
+            udata->channels[i].inMethods    = conRegs[i].audioMethods;
+            udata->channels[i].outConnector = conRegs[n + i].connector;
+            udata->channels[i].outMethods   = conRegs[n + i].audioMethods;
+        } else {
+            udata->channels[i].outConnector = conRegs[i].connector;
+            udata->channels[i].outMethods   = conRegs[i].audioMethods;
+        }
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioEnvelope_release(lua_State* L)
+{
+    AudioEnvelopeUserData* udata = luaL_checkudata(L, 1, AUDIO_ENVELOPE_CLASS_NAME);
+    udata->closed    = true;
+    udata->activated = false;
+    if (udata->auprocCapi) {
+        udata->auprocCapi->unregisterProcessor(L, udata->auprocEngine, udata->processor);
+        udata->processor   = NULL;
+        udata->auprocCapi   = NULL;
+        udata->auprocEngine = NULL;
+    }
+    if (udata->sender) {
+        if (udata->senderReader) {
+            udata->senderCapi->freeReader(udata->senderReader);
+            udata->senderReader = NULL;
+        }
+        udata->senderCapi->releaseSender(udata->sender);
+        udata->sender     = NULL;
+        udata->senderCapi = NULL;
+    }
+    if (udata->points) {
+        free(udata->points);
+        udata->points = NULL;
+    }
+    if (udata->channels) {
+        free(udata->channels);
+        udata->channels = NULL;
+    }
+    if (udata->connectorRegs) {
+        free(udata->connectorRegs);
+        udata->connectorRegs = NULL;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioEnvelope_toString(lua_State* L)
+{
+    AudioEnvelopeUserData* udata = luaL_checkudata(L, 1, AUDIO_ENVELOPE_CLASS_NAME);
+
+    lua_pushfstring(L, "%s: %p", AUDIO_ENVELOPE_CLASS_NAME, udata);
+
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioEnvelope_activate(lua_State* L)
+{
+    AudioEnvelopeUserData* udata = checkAudioEnvelopeUdata(L, 1);
+    if (!udata->activated) {
+        udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = true;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioEnvelope_deactivate(lua_State* L)
+{
+    AudioEnvelopeUserData* udata = checkAudioEnvelopeUdata(L, 1);
+    if (udata->activated) {
+        udata->auprocCapi->deactivateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = false;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static const luaL_Reg AudioEnvelopeMethods[] =
+{
+    { "activate",    AudioEnvelope_activate },
+    { "deactivate",  AudioEnvelope_deactivate },
+    { "close",       AudioEnvelope_release },
+    { NULL,          NULL } /* sentinel */
+};
+
+static const luaL_Reg AudioEnvelopeMetaMethods[] =
+{
+    { "__tostring", AudioEnvelope_toString },
+    { "__gc",       AudioEnvelope_release  },
+
+    { NULL,       NULL } /* sentinel */
+};
+
+static const luaL_Reg ModuleFunctions[] =
+{
+    { "new_audio_envelope", AudioEnvelope_new },
+    { NULL,                 NULL } /* sentinel */
+};
+
+/* ============================================================================================ */
+
+static void setupAudioEnvelopeMeta(lua_State* L)
+{                                                          /* -> meta */
+    lua_pushstring(L, AUDIO_ENVELOPE_CLASS_NAME);          /* -> meta, className */
+    lua_setfield(L, -2, "__metatable");                    /* -> meta */
+
+    luaL_setfuncs(L, AudioEnvelopeMetaMethods, 0);         /* -> meta */
+
+    lua_newtable(L);                                       /* -> meta, AudioEnvelopeClass */
+    luaL_setfuncs(L, AudioEnvelopeMethods, 0);             /* -> meta, AudioEnvelopeClass */
+    lua_setfield (L, -2, "__index");                       /* -> meta */
+}
+
+
+/* ============================================================================================ */
+
+int auproc_audio_envelope_init_module(lua_State* L, int module)
+{
+    if (luaL_newmetatable(L, AUDIO_ENVELOPE_CLASS_NAME)) {
+        setupAudioEnvelopeMeta(L);
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, module);
+        luaL_setfuncs(L, ModuleFunctions, 0);
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+/* ============================================================================================ */
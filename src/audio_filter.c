@@ -0,0 +1,719 @@
+#include "audio_filter.h"
+#include "async_util.h"
+#include "simd_util.h"
+
+#define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
+#include "auproc_capi.h"
+
+#define SENDER_CAPI_IMPLEMENT_GET_CAPI 1
+#include "sender_capi.h"
+
+/* ============================================================================================ */
+
+static const char* const AUDIO_FILTER_CLASS_NAME = "auproc.audio_filter";
+
+static const char* ERROR_INVALID_AUDIO_FILTER = "invalid auproc.audio_filter";
+
+/* ============================================================================================ */
+
+#define MAX_STAGES    8
+#define BLOCK_FRAMES  64
+#define LANE_WIDTH    VEC4_WIDTH
+
+typedef struct FilterCoeffs        FilterCoeffs;
+typedef struct ChannelConnection   ChannelConnection;
+typedef struct AudioFilterUserData AudioFilterUserData;
+
+/**
+ * Normalized biquad coefficients of the cascaded filter stages. The same
+ * coefficients are used for all channels.
+ */
+struct FilterCoeffs
+{
+    int   stageCount;
+    float b0[MAX_STAGES];
+    float b1[MAX_STAGES];
+    float b2[MAX_STAGES];
+    float a1[MAX_STAGES];
+    float a2[MAX_STAGES];
+};
+
+struct ChannelConnection
+{
+    auproc_connector*       inConnector;
+    const auproc_audiometh* inMethods;
+    auproc_connector*       outConnector;
+    const auproc_audiometh* outMethods;
+    float*                  inBuf;
+    float*                  outBuf;
+};
+
+struct AudioFilterUserData
+{
+    const char*        className;
+    auproc_processor*  processor;
+
+    bool               closed;
+    bool               activated;
+
+    const auproc_capi*  auprocCapi;
+    auproc_engine*      auprocEngine;
+    uint32_t            sampleRate;
+
+    auproc_con_reg*     connectorRegs;
+    ChannelConnection*  channels;
+    int                 channelCount;
+
+    const sender_capi* senderCapi;
+    sender_object*     sender;
+    sender_reader*     senderReader;
+
+    AtomicSnapshot     coeffs;
+    int                activeStages;
+
+    /* Filter state and work buffer are laid out structure of arrays, i.e.
+     * the values of all channels (padded to a multiple of LANE_WIDTH) are
+     * adjacent, so that four channels are filtered together as one Vec4. */
+    int                lanes;
+    float*             state1;     /* [MAX_STAGES][lanes] */
+    float*             state2;     /* [MAX_STAGES][lanes] */
+    float*             work;       /* [BLOCK_FRAMES][lanes] */
+};
+
+/* ============================================================================================ */
+
+static void setupAudioFilterMeta(lua_State* L);
+
+static int pushAudioFilterMeta(lua_State* L)
+{
+    if (luaL_newmetatable(L, AUDIO_FILTER_CLASS_NAME)) {
+        setupAudioFilterMeta(L);
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static AudioFilterUserData* checkAudioFilterUdata(lua_State* L, int arg)
+{
+    AudioFilterUserData* udata = luaL_checkudata(L, arg, AUDIO_FILTER_CLASS_NAME);
+    if (udata->auprocCapi) {
+        udata->auprocCapi->checkEngineIsNotClosed(L, udata->auprocEngine);
+    }
+    if (udata->closed) {
+        luaL_error(L, ERROR_INVALID_AUDIO_FILTER);
+        return NULL;
+    }
+    return udata;
+}
+
+/* ============================================================================================ */
+
+enum FilterType
+{
+    LOWPASS, HIGHPASS, BANDPASS, NOTCH, ALLPASS, PEAK, LOWSHELF, HIGHSHELF
+};
+
+static const char* const FILTER_TYPES[] =
+{
+    "lowpass", "highpass", "bandpass", "notch", "allpass", "peak", "lowshelf", "highshelf", NULL
+};
+
+static int filterType(const char* name, size_t len)
+{
+    for (int i = 0; FILTER_TYPES[i]; ++i) {
+        if (strlen(FILTER_TYPES[i]) == len && memcmp(FILTER_TYPES[i], name, len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static inline bool hasGain(int type)
+{
+    return type == PEAK || type == LOWSHELF || type == HIGHSHELF;
+}
+
+/**
+ * Computes the coefficients of one stage (see Robert Bristow-Johnson's 
+ * "Audio EQ Cookbook"). Returns false for invalid parameters.
+ */
+static bool setStage(FilterCoeffs* c, int stage, int type, double freq, double q, double gain,
+                     double sampleRate)
+{
+    if (!(0 < freq && freq < sampleRate / 2 && q > 0)) {
+        return false;
+    }
+    double w0    = 2 * M_PI * freq / sampleRate;
+    double cosw  = cos(w0);
+    double alpha = sin(w0) / (2 * q);
+    double A     = pow(10, gain / 40);
+    double sq    = 2 * sqrt(A) * alpha;
+    double b0, b1, b2, a0, a1, a2;
+
+    switch (type) {
+        case LOWPASS:   b0 = (1 - cosw) / 2;  b1 = 1 - cosw;      b2 = (1 - cosw) / 2;
+                        a0 = 1 + alpha;       a1 = -2 * cosw;     a2 = 1 - alpha;
+                        break;
+        case HIGHPASS:  b0 = (1 + cosw) / 2;  b1 = -(1 + cosw);   b2 = (1 + cosw) / 2;
+                        a0 = 1 + alpha;       a1 = -2 * cosw;     a2 = 1 - alpha;
+                        break;
+        case BANDPASS:  b0 = alpha;           b1 = 0;             b2 = -alpha;
+                        a0 = 1 + alpha;       a1 = -2 * cosw;     a2 = 1 - alpha;
+                        break;
+        case NOTCH:     b0 = 1;               b1 = -2 * cosw;     b2 = 1;
+                        a0 = 1 + alpha;       a1 = -2 * cosw;     a2 = 1 - alpha;
+                        break;
+        case ALLPASS:   b0 = 1 - alpha;       b1 = -2 * cosw;     b2 = 1 + alpha;
+                        a0 = 1 + alpha;       a1 = -2 * cosw;     a2 = 1 - alpha;
+                        break;
+        case PEAK:      b0 = 1 + alpha * A;   b1 = -2 * cosw;     b2 = 1 - alpha * A;
+                        a0 = 1 + alpha / A;   a1 = -2 * cosw;     a2 = 1 - alpha / A;
+                        break;
+        case LOWSHELF:  b0 =      A * ((A + 1) - (A - 1) * cosw + sq);
+                        b1 =  2 * A * ((A - 1) - (A + 1) * cosw);
+                        b2 =      A * ((A + 1) - (A - 1) * cosw - sq);
+                        a0 =           (A + 1) + (A - 1) * cosw + sq;
+                        a1 =     -2 * ((A - 1) + (A + 1) * cosw);
+                        a2 =           (A + 1) + (A - 1) * cosw - sq;
+                        break;
+        case HIGHSHELF: b0 =      A * ((A + 1) + (A - 1) * cosw + sq);
+                        b1 = -2 * A * ((A - 1) + (A + 1) * cosw);
+                        b2 =      A * ((A + 1) + (A - 1) * cosw - sq);
+                        a0 =           (A + 1) - (A - 1) * cosw + sq;
+                        a1 =      2 * ((A - 1) - (A + 1) * cosw);
+                        a2 =           (A + 1) - (A - 1) * cosw - sq;
+                        break;
+        default:        return false;
+    }
+    c->b0[stage] = b0 / a0;
+    c->b1[stage] = b1 / a0;
+    c->b2[stage] = b2 / a0;
+    c->a1[stage] = a1 / a0;
+    c->a2[stage] = a2 / a0;
+    return true;
+}
+
+/* ============================================================================================ */
+
+static bool nextNumber(const sender_capi* senderCapi, sender_reader* reader, lua_Number* value)
+{
+    sender_capi_value senderValue;
+    senderCapi->nextValueFromReader(reader, &senderValue);
+    if (senderValue.type == SENDER_CAPI_TYPE_INTEGER) {
+        *value = senderValue.intVal;
+        return true;
+    } else if (senderValue.type == SENDER_CAPI_TYPE_NUMBER) {
+        *value = senderValue.numVal;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Reads the filter stages of a control message. Returns false if the
+ * message is invalid.
+ */
+static bool readStages(AudioFilterUserData* udata, FilterCoeffs* c)
+{
+    const sender_capi* senderCapi = udata->senderCapi;
+    sender_reader*     reader     = udata->senderReader;
+    sender_capi_value  senderValue;
+
+    c->stageCount = 0;
+    while (true) {
+        senderCapi->nextValueFromReader(reader, &senderValue);
+        if (senderValue.type == SENDER_CAPI_TYPE_NONE) {
+            return true;
+        }
+        if (senderValue.type != SENDER_CAPI_TYPE_STRING || c->stageCount >= MAX_STAGES) {
+            return false;
+        }
+        int type = filterType(senderValue.strVal.ptr, senderValue.strVal.len);
+        lua_Number freq, q, gain = 0;
+        if (   type < 0
+            || !nextNumber(senderCapi, reader, &freq)
+            || !nextNumber(senderCapi, reader, &q)
+            || (hasGain(type) && !nextNumber(senderCapi, reader, &gain))
+            || !setStage(c, c->stageCount, type, freq, q, gain, udata->sampleRate))
+        {
+            return false;
+        }
+        c->stageCount += 1;
+    }
+}
+
+/* ============================================================================================ */
+
+static void filterBlock(const FilterCoeffs* c, int stageCount, int lanes, uint32_t nframes,
+                        float* restrict work, float* restrict state1, float* restrict state2)
+{
+    for (int s = 0; s < stageCount; ++s) {
+        const Vec4 b0 = vec4_set1(c->b0[s]);
+        const Vec4 b1 = vec4_set1(c->b1[s]);
+        const Vec4 b2 = vec4_set1(c->b2[s]);
+        const Vec4 a1 = vec4_set1(-c->a1[s]);
+        const Vec4 a2 = vec4_set1(-c->a2[s]);
+        for (int ch = 0; ch < lanes; ch += LANE_WIDTH) {
+            Vec4 s1 = vec4_load(state1 + s * lanes + ch);
+            Vec4 s2 = vec4_load(state2 + s * lanes + ch);
+            for (uint32_t i = 0; i < nframes; ++i) {
+                float* x   = work + i * lanes + ch;
+                Vec4   in  = vec4_load(x);
+                Vec4   out = vec4_madd(b0, in, s1);
+                s1 = vec4_madd(a1, out, vec4_madd(b1, in, s2));
+                s2 = vec4_madd(a2, out, vec4_mul(b2, in));
+                vec4_store(x, out);
+            }
+            vec4_store(state1 + s * lanes + ch, s1);
+            vec4_store(state2 + s * lanes + ch, s2);
+        }
+    }
+}
+
+/**
+ * Returns true if the filter state has decayed, i.e. silent input gives
+ * silent output.
+ */
+static bool isStateSilent(const AudioFilterUserData* udata, int stageCount)
+{
+    const int    count  = stageCount * udata->lanes;
+    const float* state1 = udata->state1;
+    const float* state2 = udata->state2;
+    float        max    = 0;
+    for (int i = 0; i < count; ++i) {
+        float a = fabsf(state1[i]);
+        float b = fabsf(state2[i]);
+        max = (a > max) ? a : max;
+        max = (b > max) ? b : max;
+    }
+    return max < 1e-9f;
+}
+
+static int processCallback(uint32_t nframes, void* processorData)
+{
+    AudioFilterUserData* udata    = (AudioFilterUserData*) processorData;
+    ChannelConnection*   channels = udata->channels;
+    const int            n        = udata->channelCount;
+    const int            lanes    = udata->lanes;
+
+    atomic_snapshot_update(&udata->coeffs);
+    FilterCoeffs* coeffs = atomic_snapshot_current(&udata->coeffs);
+
+    if (udata->sender)
+    {
+        const sender_capi*   senderCapi = udata->senderCapi;
+        sender_reader*       reader     = udata->senderReader;
+
+    nextMsg:;
+        int rc = senderCapi->nextMessageFromSender(udata->sender, reader,
+                                                   true /* nonblock */, 0 /* timeout */,
+                                                   NULL /* errorHandler */, NULL /* errorHandlerData */);
+        if (rc == 0) {
+            FilterCoeffs c;
+            if (readStages(udata, &c)) {
+                *coeffs = c;
+            }
+            senderCapi->clearReader(reader);
+            goto nextMsg;
+        }
+    }
+    const int stageCount = coeffs->stageCount;
+    if (stageCount > udata->activeStages) {
+        /* stages that were not used before start with a clean state */
+        for (int s = udata->activeStages; s < stageCount; ++s) {
+            memset(udata->state1 + s * lanes, 0, sizeof(float) * lanes);
+            memset(udata->state2 + s * lanes, 0, sizeof(float) * lanes);
+        }
+    }
+    udata->activeStages = stageCount;
+
+    const auproc_capi* capi      = udata->auprocCapi;
+    bool               allSilent = true;
+    for (int ch = 0; ch < n && allSilent; ++ch) {
+        allSilent = auproc_is_silent(capi, channels[ch].inMethods, channels[ch].inConnector);
+    }
+    if (allSilent && isStateSilent(udata, stageCount)) {
+        memset(udata->state1, 0, sizeof(float) * MAX_STAGES * lanes);
+        memset(udata->state2, 0, sizeof(float) * MAX_STAGES * lanes);
+        for (int ch = 0; ch < n; ++ch) {
+            float* out = channels[ch].outMethods->getAudioBuffer(channels[ch].outConnector, nframes);
+            memset(out, 0, sizeof(float) * nframes);
+            auproc_set_silent(capi, channels[ch].outMethods, channels[ch].outConnector, true);
+        }
+        return 0;
+    }
+
+    float* work = udata->work;
+
+    for (int ch = 0; ch < n; ++ch) {
+        channels[ch].inBuf  = channels[ch].inMethods ->getAudioBuffer(channels[ch].inConnector,  nframes);
+        channels[ch].outBuf = channels[ch].outMethods->getAudioBuffer(channels[ch].outConnector, nframes);
+    }
+
+    for (uint32_t f0 = 0; f0 < nframes; f0 += BLOCK_FRAMES)
+    {
+        uint32_t m = (nframes - f0 < BLOCK_FRAMES) ? nframes - f0 : BLOCK_FRAMES;
+
+        for (int ch = 0; ch < n; ++ch) {
+            const float* in = channels[ch].inBuf + f0;
+            for (uint32_t i = 0; i < m; ++i) {
+                work[i * lanes + ch] = in[i];
+            }
+        }
+        filterBlock(coeffs, stageCount, lanes, m, work, udata->state1, udata->state2);
+
+        for (int ch = 0; ch < n; ++ch) {
+            float* out = channels[ch].outBuf + f0;
+            for (uint32_t i = 0; i < m; ++i) {
+                out[i] = work[i * lanes + ch];
+            }
+        }
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static void engineClosedCallback(void* processorData)
+{
+    AudioFilterUserData* udata = (AudioFilterUserData*) processorData;
+
+    udata->closed    = true;
+    udata->activated = false;
+}
+
+static void engineReleasedCallback(void* processorData)
+{
+    AudioFilterUserData* udata = (AudioFilterUserData*) processorData;
+
+    udata->closed       = true;
+    udata->activated    = false;
+    udata->auprocCapi    = NULL;
+    udata->auprocEngine  = NULL;
+}
+
+/* ============================================================================================ */
+
+static int AudioFilter_new(lua_State* L)
+{
+    const int firstArg = 1;
+    const int lastArg  = lua_gettop(L);
+
+    AudioFilterUserData* udata = lua_newuserdata(L, sizeof(AudioFilterUserData));
+    memset(udata, 0, sizeof(AudioFilterUserData));
+    udata->className = AUDIO_FILTER_CLASS_NAME;
+    pushAudioFilterMeta(L);                               /* -> udata, meta */
+    lua_setmetatable(L, -2);                              /* -> udata */
+    int versionError = 0;
+    const auproc_capi* capi = auproc_get_capi(L, firstArg, &versionError);
+    auproc_engine* engine = NULL;
+    auproc_info    info   = {0};
+    if (capi) {
+        engine = capi->getEngine(L, firstArg, &info);
+    }
+    if (!capi || !engine) {
+        if (versionError) {
+            return luaL_argerror(L, firstArg, "auproc capi version mismatch");
+        } else {
+            return luaL_argerror(L, firstArg, "expected connector object");
+        }
+    }
+    if (info.sampleRate == 0) {
+        return luaL_argerror(L, firstArg, "cannot determine sample rate");
+    }
+    const int firstConArg = (capi->getObjectType(L, firstArg) == AUPROC_TENGINE) ? firstArg + 1 : firstArg;
+    int lastConArg = lastArg;
+    for (int i = firstConArg; i <= lastArg; ++i) {
+        if (!capi->getConnectorType(L, i)) {
+            lastConArg = i - 1;
+            break;
+        }
+    }
+    const int conCount  = lastConArg - firstConArg + 1;
+    const int senderArg = lastConArg + 1;
+
+    if (conCount < 2 || conCount % 2 != 0) {
+        return luaL_argerror(L, firstConArg, "expected same number of input and output connector objects");
+    }
+    const int n        = conCount / 2;
+    const int outConArg = firstConArg + n;
+
+    if (senderArg <= lastArg)
+    {
+        int errReason = 0;
+        const sender_capi* senderCapi = sender_get_capi(L, senderArg, &errReason);
+        sender_object*     sender     = senderCapi ? senderCapi->toSender(L, senderArg) : NULL;
+
+        if (!senderCapi || !sender) {
+            if (errReason == 1) {
+                return luaL_argerror(L, senderArg, "sender capi version mismatch");
+            } else {
+                return luaL_argerror(L, senderArg, "expected sender capi object");
+            }
+        }
+
+        udata->senderCapi = senderCapi;
+        udata->sender     = sender;
+        senderCapi->retainSender(sender);
+
+        udata->senderReader = senderCapi->newReader(16 * 1024, 1);
+        if (!udata->senderReader) {
+            return luaL_error(L, "out of memory");
+        }
+    }
+    udata->sampleRate   = info.sampleRate;
+    udata->channelCount = n;
+    udata->lanes        = (n + LANE_WIDTH - 1) / LANE_WIDTH * LANE_WIDTH;
+    udata->channels      = calloc(n, sizeof(ChannelConnection));
+    udata->connectorRegs = calloc(conCount, sizeof(auproc_con_reg));
+    udata->state1        = calloc(MAX_STAGES * udata->lanes, sizeof(float));
+    udata->state2        = calloc(MAX_STAGES * udata->lanes, sizeof(float));
+    udata->work          = calloc(BLOCK_FRAMES * udata->lanes, sizeof(float));
+    if (   !udata->channels || !udata->connectorRegs
+        || !udata->state1   || !udata->state2 || !udata->work
+        || !atomic_snapshot_init(&udata->coeffs, sizeof(FilterCoeffs)))
+    {
+        return luaL_error(L, "out of memory");
+    }
+    const char* processorName = lua_pushfstring(L, "%s: %p", AUDIO_FILTER_CLASS_NAME, udata);   /* -> udata, name */
+
+    auproc_con_reg* conRegs = udata->connectorRegs;
+
+    const auproc_con_reg inConReg  = {AUPROC_AUDIO, AUPROC_IN,  NULL};
+    const auproc_con_reg outConReg = {AUPROC_AUDIO, AUPROC_OUT, NULL};
+
+    for (int i = 0; i < n; ++i) {
+        conRegs[i]     = inConReg;
+        conRegs[n + i] = outConReg;
+    }
+
+    auproc_con_reg_err regError = {0};
+    auproc_processor* proc = capi->registerProcessor(L, firstConArg, conCount, engine, processorName, udata,
+                                                         processCallback, NULL, engineClosedCallback, engineReleasedCallback,
+                                                         conRegs, &regError);
+    lua_pop(L, 1); /* -> udata */
+
+    if (!proc)
+    {
+        if (regError.conIndex >= 0)
+        {
+            int errArg = firstConArg + regError.conIndex;
+
+            if (regError.errorType == AUPROC_REG_ERR_CONNCTOR_INVALID)
+            {
+                return luaL_argerror(L, errArg, "invalid connector object");
+            }
+            if (   regError.errorType == AUPROC_REG_ERR_ENGINE_MISMATCH)
+            {
+                const char* msg = lua_pushfstring(L, "connector belongs to other %s",
+                                                     capi->engine_category_name);
+                return luaL_argerror(L, errArg, msg);
+            }
+            if (regError.errorType == AUPROC_REG_ERR_ARG_INVALID
+             || regError.errorType == AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE)
+            {
+                if (errArg < outConArg) {
+                    return luaL_argerror(L, errArg, "expected AUDIO IN connector");
+                } else {
+                    return luaL_argerror(L, errArg, "expected AUDIO OUT connector");
+                }
+            }
+            if (regError.errorType == AUPROC_REG_ERR_WRONG_DIRECTION)
+            {
+                if (errArg < outConArg) {
+                    return luaL_argerror(L, errArg, "given connector is not readable");
+                } else {
+                    return luaL_argerror(L, errArg, "given connector is not writable");
+                }
+            }
+        }
+        return luaL_error(L, "cannot register processor (err=%d)", regError.errorType);
+    }
+
+    udata->processor    = proc;
+    udata->activated    = false;
+    udata->auprocCapi   = capi;
+    udata->auprocEngine = engine;
+
+    for (int i = 0; i < n; ++i) {
+        udata->channels[i].inConnector  = conRegs[i].connector;
+        udata->channels[i].inMethods    = conRegs[i].audioMethods;
+        udata->channels[i].outConnector = conRegs[n + i].connector;
+        udata->channels[i].outMethods   = conRegs[n + i].audioMethods;
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioFilter_release(lua_State* L)
+{
+    AudioFilterUserData* udata = luaL_checkudata(L, 1, AUDIO_FILTER_CLASS_NAME);
+    udata->closed    = true;
+    udata->activated = false;
+    if (udata->auprocCapi) {
+        udata->auprocCapi->unregisterProcessor(L, udata->auprocEngine, udata->processor);
+        udata->processor   = NULL;
+        udata->auprocCapi   = NULL;
+        udata->auprocEngine = NULL;
+    }
+    if (udata->sender) {
+        if (udata->senderReader) {
+            udata->senderCapi->freeReader(udata->senderReader);
+            udata->senderReader = NULL;
+        }
+        udata->senderCapi->releaseSender(udata->sender);
+        udata->sender     = NULL;
+        udata->senderCapi = NULL;
+    }
+    if (udata->connectorRegs) {
+        free(udata->connectorRegs);
+        udata->connectorRegs = NULL;
+    }
+    if (udata->channels) {
+        free(udata->channels);
+        udata->channels     = NULL;
+        udata->channelCount = 0;
+    }
+    if (udata->state1) {
+        free(udata->state1);
+        udata->state1 = NULL;
+    }
+    if (udata->state2) {
+        free(udata->state2);
+        udata->state2 = NULL;
+    }
+    if (udata->work) {
+        free(udata->work);
+        udata->work = NULL;
+    }
+    atomic_snapshot_free(&udata->coeffs);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioFilter_toString(lua_State* L)
+{
+    AudioFilterUserData* udata = luaL_checkudata(L, 1, AUDIO_FILTER_CLASS_NAME);
+
+    lua_pushfstring(L, "%s: %p", AUDIO_FILTER_CLASS_NAME, udata);
+
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioFilter_activate(lua_State* L)
+{
+    AudioFilterUserData* udata = checkAudioFilterUdata(L, 1);
+    if (!udata->activated) {
+        udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = true;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioFilter_deactivate(lua_State* L)
+{
+    AudioFilterUserData* udata = checkAudioFilterUdata(L, 1);
+    if (udata->activated) {
+        udata->auprocCapi->deactivateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = false;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioFilter_set(lua_State* L)
+{
+    AudioFilterUserData* udata = checkAudioFilterUdata(L, 1);
+    const int lastArg = lua_gettop(L);
+
+    FilterCoeffs c;
+    c.stageCount = 0;
+    int arg = 2;
+    while (arg <= lastArg) {
+        luaL_argcheck(L, c.stageCount < MAX_STAGES, arg, "too many filter stages");
+        size_t      len;
+        const char* name = luaL_checklstring(L, arg, &len);
+        int         type = filterType(name, len);
+        if (type < 0) {
+            return luaL_argerror(L, arg, lua_pushfstring(L, "invalid filter type '%s'", name));
+        }
+        lua_Number freq = luaL_checknumber(L, arg + 1);
+        lua_Number q    = luaL_checknumber(L, arg + 2);
+        lua_Number gain = hasGain(type) ? luaL_checknumber(L, arg + 3) : 0;
+        if (!setStage(&c, c.stageCount, type, freq, q, gain, udata->sampleRate)) {
+            return luaL_argerror(L, arg, "invalid filter parameters");
+        }
+        c.stageCount += 1;
+        arg += hasGain(type) ? 4 : 3;
+    }
+    FilterCoeffs* slot = atomic_snapshot_begin(&udata->coeffs);
+    *slot = c;
+    atomic_snapshot_publish(&udata->coeffs, slot);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static const luaL_Reg AudioFilterMethods[] =
+{
+    { "activate",    AudioFilter_activate },
+    { "deactivate",  AudioFilter_deactivate },
+    { "set",         AudioFilter_set },
+    { "close",       AudioFilter_release },
+    { NULL,          NULL } /* sentinel */
+};
+
+static const luaL_Reg AudioFilterMetaMethods[] =
+{
+    { "__tostring", AudioFilter_toString },
+    { "__gc",       AudioFilter_release  },
+
+    { NULL,       NULL } /* sentinel */
+};
+
+static const luaL_Reg ModuleFunctions[] =
+{
+    { "new_audio_filter", AudioFilter_new },
+    { NULL,               NULL } /* sentinel */
+};
+
+/* ============================================================================================ */
+
+static void setupAudioFilterMeta(lua_State* L)
+{                                                          /* -> meta */
+    lua_pushstring(L, AUDIO_FILTER_CLASS_NAME);            /* -> meta, className */
+    lua_setfield(L, -2, "__metatable");                    /* -> meta */
+
+    luaL_setfuncs(L, AudioFilterMetaMethods, 0);           /* -> meta */
+
+    lua_newtable(L);                                       /* -> meta, AudioFilterClass */
+    luaL_setfuncs(L, AudioFilterMethods, 0);               /* -> meta, AudioFilterClass */
+    lua_setfield (L, -2, "__index");                       /* -> meta */
+}
+
+
+/* ============================================================================================ */
+
+int auproc_audio_filter_init_module(lua_State* L, int module)
+{
+    if (luaL_newmetatable(L, AUDIO_FILTER_CLASS_NAME)) {
+        setupAudioFilterMeta(L);
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, module);
+        luaL_setfuncs(L, ModuleFunctions, 0);
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+/* ============================================================================================ */
@@ -0,0 +1,532 @@
+#include "audio_follower.h"
+
+#define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
+#include "auproc_capi.h"
+
+#define RECEIVER_CAPI_IMPLEMENT_GET_CAPI 1
+#include "receiver_capi.h"
+
+/* ============================================================================================ */
+
+static const char* const AUDIO_FOLLOWER_CLASS_NAME = "auproc.audio_follower";
+
+static const char* ERROR_INVALID_AUDIO_FOLLOWER = "invalid auproc.audio_follower";
+
+/* ============================================================================================ */
+
+#define SILENCE_LEVEL  1e-6f   /* envelope below -120 dB is set to zero for silent input */
+
+typedef struct AudioFollowerUserData AudioFollowerUserData;
+
+struct AudioFollowerUserData
+{
+    const char*        className;
+    auproc_processor*  processor;
+
+    bool               closed;
+    bool               activated;
+
+    const auproc_capi*  auprocCapi;
+    auproc_engine*      auprocEngine;
+
+    auproc_connector*       inConnector;
+    const auproc_audiometh* inMethods;
+    auproc_connector*       outConnector;
+    const auproc_audiometh* outMethods;
+    auproc_connector*       midiConnector;
+    const auproc_midimeth*  midiMethods;
+
+    const receiver_capi* receiverCapi;
+    receiver_object*     receiver;
+    receiver_writer*     receiverWriter;
+
+    bool               rms;
+    bool               decibel;
+    float              attackCoeff;
+    float              releaseCoeff;
+    float              windowCoeff;
+    uint32_t           intervalFrames;
+    unsigned char      ccStatus;
+    unsigned char      ccNumber;
+
+    float              env;
+    float              meanSquare;
+    uint32_t           intervalCount;
+    int                lastCcValue;
+};
+
+/* ============================================================================================ */
+
+static void setupAudioFollowerMeta(lua_State* L);
+
+static int pushAudioFollowerMeta(lua_State* L)
+{
+    if (luaL_newmetatable(L, AUDIO_FOLLOWER_CLASS_NAME)) {
+        setupAudioFollowerMeta(L);
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static AudioFollowerUserData* checkAudioFollowerUdata(lua_State* L, int arg)
+{
+    AudioFollowerUserData* udata = luaL_checkudata(L, arg, AUDIO_FOLLOWER_CLASS_NAME);
+    if (udata->auprocCapi) {
+        udata->auprocCapi->checkEngineIsNotClosed(L, udata->auprocEngine);
+    }
+    if (udata->closed) {
+        luaL_error(L, ERROR_INVALID_AUDIO_FOLLOWER);
+        return NULL;
+    }
+    return udata;
+}
+
+/* ============================================================================================ */
+
+static void follow(AudioFollowerUserData* udata, const float* in, float* out, uint32_t n)
+{
+    const float a   = udata->attackCoeff;
+    const float r   = udata->releaseCoeff;
+    const float w   = udata->windowCoeff;
+    float       env = udata->env;
+
+    if (udata->rms) {
+        float ms = udata->meanSquare;
+        for (uint32_t i = 0; i < n; ++i) {
+            float x2 = in ? in[i] * in[i] : 0;
+            ms += w * (x2 - ms);
+            float x = sqrtf(ms);
+            env += ((x > env) ? a : r) * (x - env);
+            if (out) {
+                out[i] = env;
+            }
+        }
+        udata->meanSquare = ms;
+    } else {
+        for (uint32_t i = 0; i < n; ++i) {
+            float x = in ? fabsf(in[i]) : 0;
+            env += ((x > env) ? a : r) * (x - env);
+            if (out) {
+                out[i] = env;
+            }
+        }
+    }
+    udata->env = env;
+}
+
+static void sendLevel(AudioFollowerUserData* udata, auproc_midibuf* midiBuf, uint32_t t, uint32_t frameTime)
+{
+    const float level = udata->env;
+
+    if (midiBuf) {
+        int v = (int)(127 * level + 0.5f);
+        v = (v > 127) ? 127 : v;
+        if (v != udata->lastCcValue) {
+            unsigned char* data = udata->midiMethods->reserveMidiEvent(midiBuf, t, 3);
+            if (data) {
+                data[0] = udata->ccStatus;
+                data[1] = udata->ccNumber;
+                data[2] = v;
+                udata->lastCcValue = v;
+            }
+        }
+    }
+    if (udata->receiver) {
+        const receiver_capi* receiverCapi = udata->receiverCapi;
+        receiver_writer*     writer       = udata->receiverWriter;
+
+        lua_Number value = level;
+        if (udata->decibel) {
+            value = 20 * log10(level > 1e-10f ? level : 1e-10f);
+        }
+        int rc = receiverCapi->addIntegerToWriter(writer, frameTime);
+        if (rc == 0) rc = receiverCapi->addNumberToWriter(writer, value);
+        if (rc == 0) {
+            rc = receiverCapi->msgToReceiver(udata->receiver, writer, false /* clear */, true /* nonblock */,
+                                             NULL /* error handler */, NULL /* error handler data */);
+        }
+        if (rc != 0) {
+            receiverCapi->clearWriter(writer);
+        }
+    }
+}
+
+/* ============================================================================================ */
+
+static int processCallback(uint32_t nframes, void* processorData)
+{
+    AudioFollowerUserData* udata = (AudioFollowerUserData*) processorData;
+    const auproc_capi*     capi  = udata->auprocCapi;
+
+    uint32_t f0 = capi->getProcessBeginFrameTime(udata->auprocEngine);
+
+    const float* in = NULL;
+    if (!auproc_is_silent(capi, udata->inMethods, udata->inConnector)) {
+        in = udata->inMethods->getAudioBuffer(udata->inConnector, nframes);
+    }
+    float* out = NULL;
+    if (udata->outConnector) {
+        out = udata->outMethods->getAudioBuffer(udata->outConnector, nframes);
+    }
+    auproc_midibuf* midiBuf = NULL;
+    if (udata->midiConnector) {
+        midiBuf = udata->midiMethods->getMidiBuffer(udata->midiConnector, nframes);
+        udata->midiMethods->clearBuffer(midiBuf);
+    }
+    if (!in && udata->env < SILENCE_LEVEL && udata->meanSquare < SILENCE_LEVEL * SILENCE_LEVEL) {
+        /* envelope has decayed for silent input */
+        udata->env        = 0;
+        udata->meanSquare = 0;
+        if (out) {
+            memset(out, 0, sizeof(float) * nframes);
+            auproc_set_silent(capi, udata->outMethods, udata->outConnector, true);
+        }
+        if (!midiBuf && !udata->receiver) {
+            return 0;
+        }
+    }
+    uint32_t i = 0;
+    while (i < nframes) {
+        uint32_t m = udata->intervalFrames - udata->intervalCount;
+        if (m > nframes - i) {
+            m = nframes - i;
+        }
+        if (in || udata->env != 0 || udata->meanSquare != 0) {
+            follow(udata, in ? in + i : NULL, out ? out + i : NULL, m);
+        }
+        i                    += m;
+        udata->intervalCount += m;
+        if (udata->intervalCount == udata->intervalFrames) {
+            sendLevel(udata, midiBuf, i - 1, f0 + i - 1);
+            udata->intervalCount = 0;
+        }
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static void engineClosedCallback(void* processorData)
+{
+    AudioFollowerUserData* udata = (AudioFollowerUserData*) processorData;
+
+    udata->closed    = true;
+    udata->activated = false;
+}
+
+static void engineReleasedCallback(void* processorData)
+{
+    AudioFollowerUserData* udata = (AudioFollowerUserData*) processorData;
+
+    udata->closed       = true;
+    udata->activated    = false;
+    udata->auprocCapi    = NULL;
+    udata->auprocEngine  = NULL;
+}
+
+/* ============================================================================================ */
+
+static int AudioFollower_new(lua_State* L)
+{
+    const int conArg  = 1;
+    const int lastArg = lua_gettop(L);
+
+    AudioFollowerUserData* udata = lua_newuserdata(L, sizeof(AudioFollowerUserData));
+    memset(udata, 0, sizeof(AudioFollowerUserData));
+    udata->className = AUDIO_FOLLOWER_CLASS_NAME;
+    pushAudioFollowerMeta(L);                             /* -> udata, meta */
+    lua_setmetatable(L, -2);                              /* -> udata */
+    int versionError = 0;
+    const auproc_capi* capi = auproc_get_capi(L, conArg, &versionError);
+    auproc_engine* engine = NULL;
+    auproc_info    info   = {0};
+    if (capi) {
+        engine = capi->getEngine(L, conArg, &info);
+    }
+    if (!capi || !engine) {
+        if (versionError) {
+            return luaL_argerror(L, conArg, "auproc capi version mismatch");
+        } else {
+            return luaL_argerror(L, conArg, "expected connector object");
+        }
+    }
+    if (info.sampleRate == 0) {
+        return luaL_argerror(L, conArg, "cannot determine sample rate");
+    }
+    auproc_con_reg conRegs[3] = { {AUPROC_AUDIO, AUPROC_IN, NULL} };
+    int conCount = 1;
+    int audioIdx = 0;
+    int midiIdx  = 0;
+    int arg      = conArg + 1;
+    if (arg <= lastArg && capi->getConnectorType(L, arg) == AUPROC_AUDIO) {
+        audioIdx = conCount;
+        conRegs[conCount++] = (auproc_con_reg){AUPROC_AUDIO, AUPROC_OUT, NULL};
+        arg += 1;
+    }
+    if (arg <= lastArg && capi->getConnectorType(L, arg) == AUPROC_MIDI) {
+        midiIdx = conCount;
+        conRegs[conCount++] = (auproc_con_reg){AUPROC_MIDI, AUPROC_OUT, NULL};
+        arg += 1;
+    }
+    int recvArg = arg;
+    int optArg  = arg + 1;
+    if (recvArg <= lastArg && lua_type(L, recvArg) == LUA_TTABLE) {
+        optArg  = recvArg;
+        recvArg = 0;
+    }
+    if (recvArg && !lua_isnoneornil(L, recvArg))
+    {
+        int errReason = 0;
+        const receiver_capi* receiverCapi = receiver_get_capi(L, recvArg, &errReason);
+        receiver_object*     receiver     = receiverCapi ? receiverCapi->toReceiver(L, recvArg) : NULL;
+
+        if (!receiverCapi || !receiver) {
+            if (errReason == 1) {
+                return luaL_argerror(L, recvArg, "receiver capi version mismatch");
+            } else {
+                return luaL_argerror(L, recvArg, "expected object with receiver capi");
+            }
+        }
+        udata->receiverCapi = receiverCapi;
+        udata->receiver     = receiver;
+        receiverCapi->retainReceiver(receiver);
+
+        udata->receiverWriter = receiverCapi->newWriter(16 * 1024, 1);
+        if (!udata->receiverWriter) {
+            return luaL_error(L, "out of memory");
+        }
+    }
+    if (conCount == 1 && !udata->receiver) {
+        return luaL_argerror(L, conArg + 1, "expected AUDIO OUT connector, MIDI OUT connector or receiver object");
+    }
+
+    const char* mode       = "peak";
+    lua_Number  attack     = 0.01;
+    lua_Number  release    = 0.1;
+    lua_Number  window     = 0.01;
+    lua_Number  interval   = 0.01;
+    lua_Number  channel    = 1;
+    lua_Number  controller = 1;
+
+    if (optArg <= lastArg && !lua_isnil(L, optArg)) {
+        luaL_checktype(L, optArg, LUA_TTABLE);
+        attack     = auproc_util_opt_number_field(L, optArg, "attack",     attack);
+        release    = auproc_util_opt_number_field(L, optArg, "release",    release);
+        window     = auproc_util_opt_number_field(L, optArg, "window",     window);
+        interval   = auproc_util_opt_number_field(L, optArg, "interval",   interval);
+        channel    = auproc_util_opt_number_field(L, optArg, "channel",    channel);
+        controller = auproc_util_opt_number_field(L, optArg, "controller", controller);
+        lua_getfield(L, optArg, "mode");                  /* -> udata, mode */
+        if (!lua_isnil(L, -1)) {
+            mode = lua_tostring(L, -1);
+            luaL_argcheck(L, mode, optArg, "string expected for field 'mode'");
+        }
+        lua_getfield(L, optArg, "db");                    /* -> udata, mode, db */
+        udata->decibel = lua_toboolean(L, -1);
+        lua_pop(L, 2);                                    /* -> udata */
+    }
+    if (strcmp(mode, "peak") == 0) {
+        udata->rms = false;
+    } else if (strcmp(mode, "rms") == 0) {
+        udata->rms = true;
+    } else {
+        return luaL_argerror(L, optArg, lua_pushfstring(L, "invalid mode '%s'", mode));
+    }
+    luaL_argcheck(L, attack >= 0,   optArg, "invalid value for field 'attack'");
+    luaL_argcheck(L, release >= 0,  optArg, "invalid value for field 'release'");
+    luaL_argcheck(L, window >= 0,   optArg, "invalid value for field 'window'");
+    luaL_argcheck(L, interval > 0 && interval * info.sampleRate >= 1,
+                                    optArg, "invalid value for field 'interval'");
+    luaL_argcheck(L, channel >= 1 && channel <= 16,      optArg, "invalid value for field 'channel'");
+    luaL_argcheck(L, controller >= 0 && controller <= 127, optArg, "invalid value for field 'controller'");
+
+    /* follow() uses the step form y += (1 - c) * (x - y) of the smoothing filter */
+    udata->attackCoeff    = 1 - auproc_util_time_coeff(attack,  info.sampleRate);
+    udata->releaseCoeff   = 1 - auproc_util_time_coeff(release, info.sampleRate);
+    udata->windowCoeff    = 1 - auproc_util_time_coeff(window,  info.sampleRate);
+    udata->intervalFrames = (uint32_t)(interval * info.sampleRate + 0.5);
+    udata->ccStatus       = 0xB0 | ((int)channel - 1);
+    udata->ccNumber       = (unsigned char)controller;
+    udata->lastCcValue    = -1;
+
+    const char* processorName = lua_pushfstring(L, "%s: %p", AUDIO_FOLLOWER_CLASS_NAME, udata);   /* -> udata, name */
+
+    auproc_con_reg_err regError = {0};
+    auproc_processor* proc = capi->registerProcessor(L, conArg, conCount, engine, processorName, udata,
+                                                         processCallback, NULL, engineClosedCallback, engineReleasedCallback,
+                                                         conRegs, &regError);
+    lua_pop(L, 1); /* -> udata */
+
+    if (!proc)
+    {
+        if (regError.conIndex >= 0)
+        {
+            int errArg = conArg + regError.conIndex;
+
+            if (regError.errorType == AUPROC_REG_ERR_CONNCTOR_INVALID)
+            {
+                return luaL_argerror(L, errArg, "invalid connector object");
+            }
+            if (   regError.errorType == AUPROC_REG_ERR_ENGINE_MISMATCH)
+            {
+                const char* msg = lua_pushfstring(L, "connector belongs to other %s",
+                                                     capi->engine_category_name);
+                return luaL_argerror(L, errArg, msg);
+            }
+            if (regError.errorType == AUPROC_REG_ERR_ARG_INVALID
+             || regError.errorType == AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE)
+            {
+                if (errArg == conArg) {
+                    return luaL_argerror(L, errArg, "expected AUDIO IN connector");
+                } else if (regError.conIndex == midiIdx) {
+                    return luaL_argerror(L, errArg, "expected MIDI OUT connector");
+                } else {
+                    return luaL_argerror(L, errArg, "expected AUDIO OUT connector");
+                }
+            }
+            if (regError.errorType == AUPROC_REG_ERR_WRONG_DIRECTION)
+            {
+                if (errArg == conArg) {
+                    return luaL_argerror(L, errArg, "given connector is not readable");
+                } else {
+                    return luaL_argerror(L, errArg, "given connector is not writable");
+                }
+            }
+        }
+        return luaL_error(L, "cannot register processor (err=%d)", regError.errorType);
+    }
+
+    udata->processor    = proc;
+    udata->activated    = false;
+    udata->auprocCapi   = capi;
+    udata->auprocEngine = engine;
+    udata->inConnector  = conRegs[0].connector;
+    udata->inMethods    = conRegs[0].audioMethods;
+    if (audioIdx) {
+        udata->outConnector = conRegs[audioIdx].connector;
+        udata->outMethods   = conRegs[audioIdx].audioMethods;
+    }
+    if (midiIdx) {
+        udata->midiConnector = conRegs[midiIdx].connector;
+        udata->midiMethods   = conRegs[midiIdx].midiMethods;
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioFollower_release(lua_State* L)
+{
+    AudioFollowerUserData* udata = luaL_checkudata(L, 1, AUDIO_FOLLOWER_CLASS_NAME);
+    udata->closed    = true;
+    udata->activated = false;
+    if (udata->auprocCapi) {
+        udata->auprocCapi->unregisterProcessor(L, udata->auprocEngine, udata->processor);
+        udata->processor   = NULL;
+        udata->auprocCapi   = NULL;
+        udata->auprocEngine = NULL;
+    }
+    if (udata->receiver) {
+        if (udata->receiverWriter) {
+            udata->receiverCapi->freeWriter(udata->receiverWriter);
+            udata->receiverWriter = NULL;
+        }
+        udata->receiverCapi->releaseReceiver(udata->receiver);
+        udata->receiver     = NULL;
+        udata->receiverCapi = NULL;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioFollower_toString(lua_State* L)
+{
+    AudioFollowerUserData* udata = luaL_checkudata(L, 1, AUDIO_FOLLOWER_CLASS_NAME);
+
+    lua_pushfstring(L, "%s: %p", AUDIO_FOLLOWER_CLASS_NAME, udata);
+
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioFollower_activate(lua_State* L)
+{
+    AudioFollowerUserData* udata = checkAudioFollowerUdata(L, 1);
+    if (!udata->activated) {
+        udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = true;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioFollower_deactivate(lua_State* L)
+{
+    AudioFollowerUserData* udata = checkAudioFollowerUdata(L, 1);
+    if (udata->activated) {
+        udata->auprocCapi->deactivateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = false;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static const luaL_Reg AudioFollowerMethods[] =
+{
+    { "activate",    AudioFollower_activate },
+    { "deactivate",  AudioFollower_deactivate },
+    { "close",       AudioFollower_release },
+    { NULL,          NULL } /* sentinel */
+};
+
+static const luaL_Reg AudioFollowerMetaMethods[] =
+{
+    { "__tostring", AudioFollower_toString },
+    { "__gc",       AudioFollower_release  },
+
+    { NULL,       NULL } /* sentinel */
+};
+
+static const luaL_Reg ModuleFunctions[] =
+{
+    { "new_audio_follower", AudioFollower_new },
+    { NULL,                 NULL } /* sentinel */
+};
+
+/* ============================================================================================ */
+
+static void setupAudioFollowerMeta(lua_State* L)
+{                                                          /* -> meta */
+    lua_pushstring(L, AUDIO_FOLLOWER_CLASS_NAME);          /* -> meta, className */
+    lua_setfield(L, -2, "__metatable");                    /* -> meta */
+
+    luaL_setfuncs(L, AudioFollowerMetaMethods, 0);         /* -> meta */
+
+    lua_newtable(L);                                       /* -> meta, AudioFollowerClass */
+    luaL_setfuncs(L, AudioFollowerMethods, 0);             /* -> meta, AudioFollowerClass */
+    lua_setfield (L, -2, "__index");                       /* -> meta */
+}
+
+
+/* ============================================================================================ */
+
+int auproc_audio_follower_init_module(lua_State* L, int module)
+{
+    if (luaL_newmetatable(L, AUDIO_FOLLOWER_CLASS_NAME)) {
+        setupAudioFollowerMeta(L);
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, module);
+        luaL_setfuncs(L, ModuleFunctions, 0);
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+/* ============================================================================================ */
@@ -0,0 +1,8 @@
+#ifndef AUPROC_AUDIO_FOLLOWER_H
+#define AUPROC_AUDIO_FOLLOWER_H
+
+#include "util.h"
+
+int auproc_audio_follower_init_module(lua_State* L, int module);
+
+#endif // AUPROC_AUDIO_FOLLOWER_H
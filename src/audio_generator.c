@@ -0,0 +1,738 @@
+#include "audio_generator.h"
+
+#define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
+#include "auproc_capi.h"
+
+#define SENDER_CAPI_IMPLEMENT_GET_CAPI 1
+#include "sender_capi.h"
+
+/* ============================================================================================ */
+
+static const char* const AUDIO_GENERATOR_CLASS_NAME = "auproc.audio_generator";
+
+static const char* ERROR_INVALID_AUDIO_GENERATOR = "invalid auproc.audio_generator";
+
+/* ============================================================================================ */
+
+#define SINE_TABLE_SIZE 4096
+
+typedef struct GenSettings            GenSettings;
+typedef struct OutputConnection       OutputConnection;
+typedef struct AudioGeneratorUserData AudioGeneratorUserData;
+
+enum Waveform
+{
+    SINE, SAW, SQUARE, WHITE, PINK, IMPULSE, SWEEP
+};
+
+static const char* const WAVEFORMS[] =
+{
+    "sine", "saw", "square", "white", "pink", "impulse", "sweep", NULL
+};
+
+enum SettingFlags
+{
+    SET_WAVEFORM = 1, SET_FREQ = 2, SET_AMP = 4, SET_FREQ2 = 8, SET_DURATION = 16
+};
+
+/**
+ * Settings that are changed by a control message, flags denotes 
+ * the changed fields.
+ */
+struct GenSettings
+{
+    int     flags;
+    int     waveform;
+    double  freq;
+    double  amp;
+    double  freq2;
+    double  duration;
+};
+
+struct OutputConnection
+{
+    auproc_connector*       connector;
+    const auproc_audiometh* methods;
+    float*                  buf;
+};
+
+struct AudioGeneratorUserData
+{
+    const char*        className;
+    auproc_processor*  processor;
+
+    bool               closed;
+    bool               activated;
+
+    const auproc_capi*  auprocCapi;
+    auproc_engine*      auprocEngine;
+    uint32_t            sampleRate;
+
+    auproc_con_reg*     connectorRegs;
+    OutputConnection*   outputs;
+    int                 outputCount;
+
+    const sender_capi* senderCapi;
+    sender_object*     sender;
+    sender_reader*     senderReader;
+
+    bool               hasPending;
+    uint32_t           pendingTime;
+    GenSettings        pending;
+
+    GenSettings        settings;
+    double             phase;
+    double             sweepTime;        /* in seconds */
+    bool               impulseOnce;
+    uint32_t           noiseState;
+    float              pink[7];
+
+    float              sineTable[SINE_TABLE_SIZE + 1];
+};
+
+/* ============================================================================================ */
+
+static void setupAudioGeneratorMeta(lua_State* L);
+
+static int pushAudioGeneratorMeta(lua_State* L)
+{
+    if (luaL_newmetatable(L, AUDIO_GENERATOR_CLASS_NAME)) {
+        setupAudioGeneratorMeta(L);
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static AudioGeneratorUserData* checkAudioGeneratorUdata(lua_State* L, int arg)
+{
+    AudioGeneratorUserData* udata = luaL_checkudata(L, arg, AUDIO_GENERATOR_CLASS_NAME);
+    if (udata->auprocCapi) {
+        udata->auprocCapi->checkEngineIsNotClosed(L, udata->auprocEngine);
+    }
+    if (udata->closed) {
+        luaL_error(L, ERROR_INVALID_AUDIO_GENERATOR);
+        return NULL;
+    }
+    return udata;
+}
+
+/* ============================================================================================ */
+
+static int waveform(const char* name, size_t len)
+{
+    for (int i = 0; WAVEFORMS[i]; ++i) {
+        if (strlen(WAVEFORMS[i]) == len && memcmp(WAVEFORMS[i], name, len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Sets one field given by key, returns false for an invalid key or value.
+ */
+static bool setNumber(GenSettings* s, const char* key, size_t len, double value)
+{
+    if (len == 4 && memcmp(key, "freq", 4) == 0 && value >= 0) {
+        s->freq = value;
+        s->flags |= SET_FREQ;
+    } else if (len == 3 && memcmp(key, "amp", 3) == 0) {
+        s->amp = value;
+        s->flags |= SET_AMP;
+    } else if (len == 5 && memcmp(key, "freq2", 5) == 0 && value >= 0) {
+        s->freq2 = value;
+        s->flags |= SET_FREQ2;
+    } else if (len == 8 && memcmp(key, "duration", 8) == 0 && value > 0) {
+        s->duration = value;
+        s->flags |= SET_DURATION;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool setString(GenSettings* s, const char* key, size_t len, const char* value, size_t valueLen)
+{
+    if (len == 8 && memcmp(key, "waveform", 8) == 0) {
+        s->waveform = waveform(value, valueLen);
+        s->flags |= SET_WAVEFORM;
+        return s->waveform >= 0;
+    }
+    return false;
+}
+
+/**
+ * Reads a control message: optional frame time followed by key value pairs.
+ * Returns false if the message is invalid.
+ */
+static bool readSettings(AudioGeneratorUserData* udata, uint32_t f0, uint32_t* time, GenSettings* s)
+{
+    const sender_capi* senderCapi = udata->senderCapi;
+    sender_reader*     reader     = udata->senderReader;
+    sender_capi_value  key;
+    sender_capi_value  value;
+
+    memset(s, 0, sizeof(GenSettings));
+    *time = f0;
+
+    senderCapi->nextValueFromReader(reader, &key);
+    if (key.type == SENDER_CAPI_TYPE_INTEGER) {
+        *time = key.intVal;
+        senderCapi->nextValueFromReader(reader, &key);
+    }
+    while (key.type != SENDER_CAPI_TYPE_NONE) {
+        if (key.type != SENDER_CAPI_TYPE_STRING) {
+            return false;
+        }
+        senderCapi->nextValueFromReader(reader, &value);
+        bool ok;
+        if (value.type == SENDER_CAPI_TYPE_INTEGER) {
+            ok = setNumber(s, key.strVal.ptr, key.strVal.len, value.intVal);
+        } else if (value.type == SENDER_CAPI_TYPE_NUMBER) {
+            ok = setNumber(s, key.strVal.ptr, key.strVal.len, value.numVal);
+        } else if (value.type == SENDER_CAPI_TYPE_STRING) {
+            ok = setString(s, key.strVal.ptr, key.strVal.len, value.strVal.ptr, value.strVal.len);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            return false;
+        }
+        senderCapi->nextValueFromReader(reader, &key);
+    }
+    return true;
+}
+
+static void applySettings(AudioGeneratorUserData* udata, const GenSettings* s)
+{
+    GenSettings* cur = &udata->settings;
+
+    if (s->flags & SET_WAVEFORM) cur->waveform = s->waveform;
+    if (s->flags & SET_FREQ)     cur->freq     = s->freq;
+    if (s->flags & SET_AMP)      cur->amp      = s->amp;
+    if (s->flags & SET_FREQ2)    cur->freq2    = s->freq2;
+    if (s->flags & SET_DURATION) cur->duration = s->duration;
+
+    if (s->flags & (SET_WAVEFORM|SET_FREQ|SET_FREQ2|SET_DURATION)) {
+        udata->sweepTime = 0;
+    }
+    if (cur->waveform == IMPULSE && (s->flags & (SET_WAVEFORM|SET_FREQ))) {
+        udata->phase       = 0;
+        udata->impulseOnce = (cur->freq == 0);
+    }
+}
+
+/* ============================================================================================ */
+
+/**
+ * Correction for band-limited saw and square waves (polynomial band-limited step).
+ */
+static inline float polyBlep(double t, double dt)
+{
+    if (t < dt) {
+        t /= dt;
+        return t + t - t * t - 1;
+    } else if (t > 1 - dt) {
+        t = (t - 1) / dt;
+        return t * t + t + t + 1;
+    }
+    return 0;
+}
+
+static inline float nextNoise(AudioGeneratorUserData* udata)
+{
+    uint32_t x = udata->noiseState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    udata->noiseState = x;
+    return (int32_t)x * (1.0f / 2147483648.0f);
+}
+
+/**
+ * The waveform loops are scalar: the sine reads the wavetable at arbitrary
+ * positions, the noise generator and the pink filter are recurrences, the
+ * band-limited saw and square need a branch at each step and the sweep
+ * calls exp and sin for each frame.
+ */
+static void generate(AudioGeneratorUserData* udata, float* out, uint32_t n)
+{
+    const GenSettings* s   = &udata->settings;
+    const float        amp = s->amp;
+    const double       dt  = s->freq / udata->sampleRate;
+    double             phase = udata->phase;
+
+    switch (s->waveform) {
+        case SINE: {
+            const float* table = udata->sineTable;
+            for (uint32_t i = 0; i < n; ++i) {
+                double   p    = phase * SINE_TABLE_SIZE;
+                uint32_t k    = (uint32_t) p;
+                float    frac = p - k;
+                out[i] = amp * (table[k] + frac * (table[k + 1] - table[k]));
+                phase += dt;
+                phase -= (uint32_t) phase;
+            }
+            break;
+        }
+        case SAW: {
+            for (uint32_t i = 0; i < n; ++i) {
+                out[i] = amp * (2 * phase - 1 - polyBlep(phase, dt));
+                phase += dt;
+                phase -= (uint32_t) phase;
+            }
+            break;
+        }
+        case SQUARE: {
+            for (uint32_t i = 0; i < n; ++i) {
+                double p2 = phase + 0.5;
+                p2 -= (uint32_t) p2;
+                out[i] = amp * ((phase < 0.5 ? 1 : -1) + polyBlep(phase, dt) - polyBlep(p2, dt));
+                phase += dt;
+                phase -= (uint32_t) phase;
+            }
+            break;
+        }
+        case WHITE: {
+            for (uint32_t i = 0; i < n; ++i) {
+                out[i] = amp * nextNoise(udata);
+            }
+            break;
+        }
+        case PINK: {
+            /* Paul Kellett's refined pink noise filter */
+            float* b = udata->pink;
+            for (uint32_t i = 0; i < n; ++i) {
+                float w = nextNoise(udata);
+                b[0] = 0.99886f * b[0] + w * 0.0555179f;
+                b[1] = 0.99332f * b[1] + w * 0.0750759f;
+                b[2] = 0.96900f * b[2] + w * 0.1538520f;
+                b[3] = 0.86650f * b[3] + w * 0.3104856f;
+                b[4] = 0.55000f * b[4] + w * 0.5329522f;
+                b[5] = -0.7616f * b[5] - w * 0.0168980f;
+                out[i] = amp * 0.11f * (b[0] + b[1] + b[2] + b[3] + b[4] + b[5] + b[6] + w * 0.5362f);
+                b[6] = w * 0.115926f;
+            }
+            break;
+        }
+        case IMPULSE: {
+            memset(out, 0, sizeof(float) * n);
+            if (udata->impulseOnce) {
+                if (n > 0) {
+                    out[0] = amp;
+                    udata->impulseOnce = false;
+                }
+            } else if (dt > 0) {
+                /* an impulse is emitted at the frame where the phase wraps around, the
+                 * remainder is kept, so that the period is correct on average */
+                for (uint32_t i = 0; i < n; ++i) {
+                    if (phase < dt) {
+                        out[i] = amp;
+                    }
+                    phase += dt;
+                    phase -= (uint32_t) phase;
+                }
+            }
+            break;
+        }
+        case SWEEP: {
+            const double f1 = s->freq  > 0 ? s->freq  : 20;
+            const double f2 = s->freq2 > 0 ? s->freq2 : udata->sampleRate / 2.0;
+            const double T  = s->duration;
+            const double k  = log(f2 / f1) / T;
+            double       t  = udata->sweepTime;
+            for (uint32_t i = 0; i < n; ++i) {
+                out[i] = amp * sin(2 * M_PI * phase);
+                phase += f1 * exp(k * t) / udata->sampleRate;
+                phase -= (uint32_t) phase;
+                t += 1.0 / udata->sampleRate;
+                if (t >= T) {
+                    t = 0;
+                }
+            }
+            udata->sweepTime = t;
+            break;
+        }
+    }
+    udata->phase = phase;
+}
+
+/* ============================================================================================ */
+
+static int processCallback(uint32_t nframes, void* processorData)
+{
+    AudioGeneratorUserData* udata   = (AudioGeneratorUserData*) processorData;
+    OutputConnection*       outputs = udata->outputs;
+    const int               n       = udata->outputCount;
+
+    uint32_t f0 = udata->auprocCapi->getProcessBeginFrameTime(udata->auprocEngine);
+
+    for (int i = 0; i < n; ++i) {
+        outputs[i].buf = outputs[i].methods->getAudioBuffer(outputs[i].connector, nframes);
+    }
+    float*   out    = outputs[0].buf;
+    uint32_t pos    = 0;
+    bool     silent = true;
+
+    while (pos < nframes) {
+        if (!udata->hasPending && udata->sender) {
+            const sender_capi* senderCapi = udata->senderCapi;
+            sender_reader*     reader     = udata->senderReader;
+
+            int rc = senderCapi->nextMessageFromSender(udata->sender, reader,
+                                                       true /* nonblock */, 0 /* timeout */,
+                                                       NULL /* errorHandler */, NULL /* errorHandlerData */);
+            if (rc == 0) {
+                udata->hasPending = readSettings(udata, f0 + pos, &udata->pendingTime, &udata->pending);
+                senderCapi->clearReader(reader);
+                continue;
+            }
+        }
+        uint32_t end = nframes;
+        if (udata->hasPending) {
+            int32_t offset = udata->pendingTime - f0;
+            if (offset <= (int32_t)pos) {
+                applySettings(udata, &udata->pending);
+                udata->hasPending = false;
+                continue;
+            }
+            if (offset < (int32_t)nframes) {
+                end = offset;
+            }
+        }
+        if (udata->settings.amp != 0) {
+            silent = false;
+        }
+        generate(udata, out + pos, end - pos);
+        pos = end;
+    }
+    for (int i = 1; i < n; ++i) {
+        memcpy(outputs[i].buf, out, sizeof(float) * nframes);
+    }
+    if (silent) {
+        for (int i = 0; i < n; ++i) {
+            auproc_set_silent(udata->auprocCapi, outputs[i].methods, outputs[i].connector, true);
+        }
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static void engineClosedCallback(void* processorData)
+{
+    AudioGeneratorUserData* udata = (AudioGeneratorUserData*) processorData;
+
+    udata->closed    = true;
+    udata->activated = false;
+}
+
+static void engineReleasedCallback(void* processorData)
+{
+    AudioGeneratorUserData* udata = (AudioGeneratorUserData*) processorData;
+
+    udata->closed       = true;
+    udata->activated    = false;
+    udata->auprocCapi    = NULL;
+    udata->auprocEngine  = NULL;
+}
+
+/* ============================================================================================ */
+
+static void checkSettings(lua_State* L, int arg, GenSettings* s)
+{
+    luaL_checktype(L, arg, LUA_TTABLE);
+    memset(s, 0, sizeof(GenSettings));
+
+    lua_pushnil(L);                                       /* -> key */
+    while (lua_next(L, arg)) {                            /* -> key, value */
+        if (lua_type(L, -2) != LUA_TSTRING) {
+            luaL_argerror(L, arg, "string keys expected");
+        }
+        size_t      len;
+        const char* key = lua_tolstring(L, -2, &len);
+        bool        ok;
+        if (lua_type(L, -1) == LUA_TNUMBER) {
+            ok = setNumber(s, key, len, lua_tonumber(L, -1));
+        } else if (lua_type(L, -1) == LUA_TSTRING) {
+            size_t      valueLen;
+            const char* value = lua_tolstring(L, -1, &valueLen);
+            ok = setString(s, key, len, value, valueLen);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            luaL_argerror(L, arg, lua_pushfstring(L, "invalid value for field '%s'", key));
+        }
+        lua_pop(L, 1);                                    /* -> key */
+    }
+}
+
+static int AudioGenerator_new(lua_State* L)
+{
+    const int firstArg = 1;
+    const int lastArg  = lua_gettop(L);
+
+    AudioGeneratorUserData* udata = lua_newuserdata(L, sizeof(AudioGeneratorUserData));
+    memset(udata, 0, sizeof(AudioGeneratorUserData));
+    udata->className = AUDIO_GENERATOR_CLASS_NAME;
+    pushAudioGeneratorMeta(L);                            /* -> udata, meta */
+    lua_setmetatable(L, -2);                              /* -> udata */
+    int versionError = 0;
+    const auproc_capi* capi = auproc_get_capi(L, firstArg, &versionError);
+    auproc_engine* engine = NULL;
+    auproc_info    info   = {0};
+    if (capi) {
+        engine = capi->getEngine(L, firstArg, &info);
+    }
+    if (!capi || !engine) {
+        if (versionError) {
+            return luaL_argerror(L, firstArg, "auproc capi version mismatch");
+        } else {
+            return luaL_argerror(L, firstArg, "expected connector object");
+        }
+    }
+    if (info.sampleRate == 0) {
+        return luaL_argerror(L, firstArg, "cannot determine sample rate");
+    }
+    const int firstConArg = (capi->getObjectType(L, firstArg) == AUPROC_TENGINE) ? firstArg + 1 : firstArg;
+    int lastConArg = lastArg;
+    for (int i = firstConArg; i <= lastArg; ++i) {
+        if (!capi->getConnectorType(L, i)) {
+            lastConArg = i - 1;
+            break;
+        }
+    }
+    const int n = lastConArg - firstConArg + 1;
+    if (n < 1) {
+        return luaL_argerror(L, firstConArg, "expected connector object");
+    }
+    udata->sampleRate        = info.sampleRate;
+    udata->noiseState        = 0x12345678;
+    udata->settings.waveform = SINE;
+    udata->settings.freq     = 440;
+    udata->settings.amp      = 0;
+    udata->settings.freq2    = info.sampleRate / 2.0;
+    udata->settings.duration = 10;
+    for (int i = 0; i <= SINE_TABLE_SIZE; ++i) {
+        udata->sineTable[i] = sin(2 * M_PI * i / SINE_TABLE_SIZE);
+    }
+    int arg = lastConArg + 1;
+    if (arg <= lastArg && !lua_istable(L, arg))
+    {
+        int errReason = 0;
+        const sender_capi* senderCapi = sender_get_capi(L, arg, &errReason);
+        sender_object*     sender     = senderCapi ? senderCapi->toSender(L, arg) : NULL;
+
+        if (!senderCapi || !sender) {
+            if (errReason == 1) {
+                return luaL_argerror(L, arg, "sender capi version mismatch");
+            } else {
+                return luaL_argerror(L, arg, "expected sender capi object");
+            }
+        }
+
+        udata->senderCapi = senderCapi;
+        udata->sender     = sender;
+        senderCapi->retainSender(sender);
+
+        udata->senderReader = senderCapi->newReader(16 * 1024, 1);
+        if (!udata->senderReader) {
+            return luaL_error(L, "out of memory");
+        }
+        arg += 1;
+    }
+    if (arg <= lastArg) {
+        GenSettings s;
+        checkSettings(L, arg, &s);
+        applySettings(udata, &s);
+    }
+    udata->outputCount   = n;
+    udata->outputs       = calloc(n, sizeof(OutputConnection));
+    udata->connectorRegs = calloc(n, sizeof(auproc_con_reg));
+    if (!udata->outputs || !udata->connectorRegs) {
+        return luaL_error(L, "out of memory");
+    }
+    const char* processorName = lua_pushfstring(L, "%s: %p", AUDIO_GENERATOR_CLASS_NAME, udata);   /* -> udata, name */
+
+    auproc_con_reg* conRegs = udata->connectorRegs;
+
+    const auproc_con_reg outConReg = {AUPROC_AUDIO, AUPROC_OUT, NULL};
+
+    for (int i = 0; i < n; ++i) {
+        conRegs[i] = outConReg;
+    }
+
+    auproc_con_reg_err regError = {0};
+    auproc_processor* proc = capi->registerProcessor(L, firstConArg, n, engine, processorName, udata,
+                                                         processCallback, NULL, engineClosedCallback, engineReleasedCallback,
+                                                         conRegs, &regError);
+    lua_pop(L, 1); /* -> udata */
+
+    if (!proc)
+    {
+        if (regError.conIndex >= 0)
+        {
+            int errArg = firstConArg + regError.conIndex;
+
+            if (regError.errorType == AUPROC_REG_ERR_CONNCTOR_INVALID)
+            {
+                return luaL_argerror(L, errArg, "invalid connector object");
+            }
+            if (   regError.errorType == AUPROC_REG_ERR_ENGINE_MISMATCH)
+            {
+                const char* msg = lua_pushfstring(L, "connector belongs to other %s",
+                                                     capi->engine_category_name);
+                return luaL_argerror(L, errArg, msg);
+            }
+            if (regError.errorType == AUPROC_REG_ERR_ARG_INVALID
+             || regError.errorType == AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE)
+            {
+                return luaL_argerror(L, errArg, "expected AUDIO OUT connector");
+            }
+            if (regError.errorType == AUPROC_REG_ERR_WRONG_DIRECTION)
+            {
+                return luaL_argerror(L, errArg, "given connector is not writable");
+            }
+        }
+        return luaL_error(L, "cannot register processor (err=%d)", regError.errorType);
+    }
+
+    udata->processor    = proc;
+    udata->activated    = false;
+    udata->auprocCapi   = capi;
+    udata->auprocEngine = engine;
+
+    for (int i = 0; i < n; ++i) {
+        udata->outputs[i].connector = conRegs[i].connector;
+        udata->outputs[i].methods   = conRegs[i].audioMethods;
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioGenerator_release(lua_State* L)
+{
+    AudioGeneratorUserData* udata = luaL_checkudata(L, 1, AUDIO_GENERATOR_CLASS_NAME);
+    udata->closed    = true;
+    udata->activated = false;
+    if (udata->auprocCapi) {
+        udata->auprocCapi->unregisterProcessor(L, udata->auprocEngine, udata->processor);
+        udata->processor   = NULL;
+        udata->auprocCapi   = NULL;
+        udata->auprocEngine = NULL;
+    }
+    if (udata->sender) {
+        if (udata->senderReader) {
+            udata->senderCapi->freeReader(udata->senderReader);
+            udata->senderReader = NULL;
+        }
+        udata->senderCapi->releaseSender(udata->sender);
+        udata->sender     = NULL;
+        udata->senderCapi = NULL;
+    }
+    if (udata->connectorRegs) {
+        free(udata->connectorRegs);
+        udata->connectorRegs = NULL;
+    }
+    if (udata->outputs) {
+        free(udata->outputs);
+        udata->outputs     = NULL;
+        udata->outputCount = 0;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioGenerator_toString(lua_State* L)
+{
+    AudioGeneratorUserData* udata = luaL_checkudata(L, 1, AUDIO_GENERATOR_CLASS_NAME);
+
+    lua_pushfstring(L, "%s: %p", AUDIO_GENERATOR_CLASS_NAME, udata);
+
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioGenerator_activate(lua_State* L)
+{
+    AudioGeneratorUserData* udata = checkAudioGeneratorUdata(L, 1);
+    if (!udata->activated) {
+        udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = true;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioGenerator_deactivate(lua_State* L)
+{
+    AudioGeneratorUserData* udata = checkAudioGeneratorUdata(L, 1);
+    if (udata->activated) {
+        udata->auprocCapi->deactivateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = false;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static const luaL_Reg AudioGeneratorMethods[] =
+{
+    { "activate",    AudioGenerator_activate },
+    { "deactivate",  AudioGenerator_deactivate },
+    { "close",       AudioGenerator_release },
+    { NULL,          NULL } /* sentinel */
+};
+
+static const luaL_Reg AudioGeneratorMetaMethods[] =
+{
+    { "__tostring", AudioGenerator_toString },
+    { "__gc",       AudioGenerator_release  },
+
+    { NULL,       NULL } /* sentinel */
+};
+
+static const luaL_Reg ModuleFunctions[] =
+{
+    { "new_audio_generator", AudioGenerator_new },
+    { NULL,                  NULL } /* sentinel */
+};
+
+/* ============================================================================================ */
+
+static void setupAudioGeneratorMeta(lua_State* L)
+{                                                          /* -> meta */
+    lua_pushstring(L, AUDIO_GENERATOR_CLASS_NAME);         /* -> meta, className */
+    lua_setfield(L, -2, "__metatable");                    /* -> meta */
+
+    luaL_setfuncs(L, AudioGeneratorMetaMethods, 0);        /* -> meta */
+
+    lua_newtable(L);                                       /* -> meta, AudioGeneratorClass */
+    luaL_setfuncs(L, AudioGeneratorMethods, 0);            /* -> meta, AudioGeneratorClass */
+    lua_setfield (L, -2, "__index");                       /* -> meta */
+}
+
+
+/* ============================================================================================ */
+
+int auproc_audio_generator_init_module(lua_State* L, int module)
+{
+    if (luaL_newmetatable(L, AUDIO_GENERATOR_CLASS_NAME)) {
+        setupAudioGeneratorMeta(L);
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, module);
+        luaL_setfuncs(L, ModuleFunctions, 0);
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+/* ============================================================================================ */
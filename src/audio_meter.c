@@ -0,0 +1,669 @@
+#include "audio_meter.h"
+#include "async_util.h"
+#include "simd_util.h"
+
+#define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
+#include "auproc_capi.h"
+
+#define RECEIVER_CAPI_IMPLEMENT_GET_CAPI 1
+#include "receiver_capi.h"
+
+/* ============================================================================================ */
+
+static const char* const AUDIO_METER_CLASS_NAME = "auproc.audio_meter";
+
+static const char* ERROR_INVALID_AUDIO_METER = "invalid auproc.audio_meter";
+
+/* ============================================================================================ */
+
+#define SUBBLOCKS_MOMENTARY   4       /* 400 ms */
+#define SUBBLOCKS_SHORT_TERM  30      /* 3 s */
+#define OVERSAMPLING          4       /* == VEC4_WIDTH, all phases are one Vec4 */
+#define TRUE_PEAK_TAPS        12      /* per phase */
+
+typedef struct MeterValues        MeterValues;
+typedef struct ChannelState       ChannelState;
+typedef struct AudioMeterUserData AudioMeterUserData;
+
+/**
+ * Published values, followed by peak, rms and true peak for each channel.
+ */
+struct MeterValues
+{
+    uint32_t frameTime;
+    float    momentary;
+    float    shortTerm;
+    float    channels[];
+};
+
+/**
+ * Measurement state of one channel. The sums of the last subblocks
+ * are kept in rings of SUBBLOCKS_SHORT_TERM entries.
+ */
+struct ChannelState
+{
+    auproc_connector*       connector;
+    const auproc_audiometh* methods;
+
+    double   pre[4];                                   /* K-weighting filter states */
+    double   rlb[4];
+    float    history[2 * TRUE_PEAK_TAPS];
+    uint32_t historyPos;
+
+    float    peak;                                     /* current subblock */
+    float    truePeak;
+    double   sum;
+    double   weightedSum;
+
+    float    peakHold;                                 /* since last readout */
+    float    truePeakHold;
+    double   sums[SUBBLOCKS_SHORT_TERM];
+    double   weightedSums[SUBBLOCKS_SHORT_TERM];
+};
+
+struct AudioMeterUserData
+{
+    const char*        className;
+    auproc_processor*  processor;
+
+    bool               closed;
+    bool               activated;
+
+    const auproc_capi*  auprocCapi;
+    auproc_engine*      auprocEngine;
+
+    ChannelState*       channels;
+    int                 channelCount;
+    auproc_con_reg*     connectorRegs;
+
+    const receiver_capi* receiverCapi;
+    receiver_object*     receiver;
+    receiver_writer*     receiverWriter;
+    int                  interval;          /* in subblocks */
+    int                  intervalCount;
+
+    double   preB[3], preA[3];                         /* K-weighting coefficients */
+    double   rlbB[3], rlbA[3];
+    float    truePeakTable[TRUE_PEAK_TAPS][OVERSAMPLING];      /* tap k of all phases */
+
+    uint32_t subblockFrames;
+    uint32_t subblockFill;
+    int      subblockPos;
+    int      subblockCount;
+
+    AtomicSnapshot  values;
+    AtomicCounter   resetRequested;
+};
+
+/* ============================================================================================ */
+
+static void setupAudioMeterMeta(lua_State* L);
+
+static int pushAudioMeterMeta(lua_State* L)
+{
+    if (luaL_newmetatable(L, AUDIO_METER_CLASS_NAME)) {
+        setupAudioMeterMeta(L);
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static AudioMeterUserData* checkAudioMeterUdata(lua_State* L, int arg)
+{
+    AudioMeterUserData* udata = luaL_checkudata(L, arg, AUDIO_METER_CLASS_NAME);
+    if (udata->auprocCapi) {
+        udata->auprocCapi->checkEngineIsNotClosed(L, udata->auprocEngine);
+    }
+    if (udata->closed) {
+        luaL_error(L, ERROR_INVALID_AUDIO_METER);
+        return NULL;
+    }
+    return udata;
+}
+
+/* ============================================================================================ */
+
+/**
+ * K-weighting filter of ITU-R BS.1770: high shelf pre-filter and RLB 
+ * high pass filter, see also libebur128.
+ */
+static void setupKWeighting(AudioMeterUserData* udata, double sampleRate)
+{
+    double f0 = 1681.974450955533;
+    double G  = 3.999843853973347;
+    double Q  = 0.7071752369554196;
+    double K  = tan(M_PI * f0 / sampleRate);
+    double Vh = pow(10.0, G / 20.0);
+    double Vb = pow(Vh, 0.4996667741545416);
+    double a0 = 1.0 + K / Q + K * K;
+
+    udata->preB[0] = (Vh + Vb * K / Q + K * K) / a0;
+    udata->preB[1] = 2.0 * (K * K - Vh) / a0;
+    udata->preB[2] = (Vh - Vb * K / Q + K * K) / a0;
+    udata->preA[1] = 2.0 * (K * K - 1.0) / a0;
+    udata->preA[2] = (1.0 - K / Q + K * K) / a0;
+
+    f0 = 38.13547087602444;
+    Q  = 0.5003270373238773;
+    K  = tan(M_PI * f0 / sampleRate);
+    a0 = 1.0 + K / Q + K * K;
+
+    udata->rlbB[0] =  1.0;
+    udata->rlbB[1] = -2.0;
+    udata->rlbB[2] =  1.0;
+    udata->rlbA[1] = 2.0 * (K * K - 1.0) / a0;
+    udata->rlbA[2] = (1.0 - K / Q + K * K) / a0;
+}
+
+/**
+ * Polyphase interpolation filter for true peak measurement: windowed sinc
+ * with OVERSAMPLING * TRUE_PEAK_TAPS coefficients.
+ */
+static void setupTruePeak(AudioMeterUserData* udata)
+{
+    const int    n      = OVERSAMPLING * TRUE_PEAK_TAPS;
+    const double center = (n - 1) / 2.0;
+    for (int m = 0; m < n; ++m) {
+        double x = (m - center) / OVERSAMPLING;
+        double s = (x == 0) ? 1 : sin(M_PI * x) / (M_PI * x);
+        double w = 0.42 - 0.5 * cos(2 * M_PI * (m + 0.5) / n) + 0.08 * cos(4 * M_PI * (m + 0.5) / n);
+        udata->truePeakTable[m / OVERSAMPLING][m % OVERSAMPLING] = s * w;
+    }
+}
+
+static inline double biquad(double* s, const double* b, const double* a, double x)
+{
+    double y = b[0] * x + s[0];
+    s[0] = b[1] * x - a[1] * y + s[1];
+    s[1] = b[2] * x - a[2] * y;
+    return y;
+}
+
+static void measure(AudioMeterUserData* udata, ChannelState* ch, const float* in, uint32_t n)
+{
+    float  peak        = ch->peak;
+    double sum         = 0;
+    double weightedSum = 0;
+
+    Vec4     vpeak = vec4_set1(peak);
+    Vec4     vsum  = vec4_set1(0);
+    uint32_t i     = 0;
+    for (; i + VEC4_WIDTH <= n; i += VEC4_WIDTH) {
+        Vec4 x = vec4_load(in + i);
+        vpeak = vec4_max(vpeak, vec4_abs(x));
+        vsum  = vec4_madd(x, x, vsum);
+    }
+    peak = vec4_hmax(vpeak);
+    sum  = vec4_hsum(vsum);
+    for (; i < n; ++i) {
+        float a = fabsf(in[i]);
+        peak = (a > peak) ? a : peak;
+        sum += in[i] * in[i];
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+        double y = biquad(ch->pre, udata->preB, udata->preA, in[i]);
+        double z = biquad(ch->rlb, udata->rlbB, udata->rlbA, y);
+        weightedSum += z * z;
+    }
+    Vec4 vtruePeak = vec4_set1(ch->truePeak);
+    for (uint32_t i = 0; i < n; ++i) {
+        ch->history[ch->historyPos]                  = in[i];
+        ch->history[ch->historyPos + TRUE_PEAK_TAPS] = in[i];
+        ch->historyPos = (ch->historyPos + 1 < TRUE_PEAK_TAPS) ? ch->historyPos + 1 : 0;
+
+        /* history + historyPos are the last samples, oldest first */
+        const float* x = ch->history + ch->historyPos;
+        Vec4         y = vec4_set1(0);
+        for (int k = 0; k < TRUE_PEAK_TAPS; ++k) {
+            y = vec4_madd(vec4_set1(x[TRUE_PEAK_TAPS - 1 - k]), vec4_load(udata->truePeakTable[k]), y);
+        }
+        vtruePeak = vec4_max(vtruePeak, vec4_abs(y));
+    }
+    float truePeak = vec4_hmax(vtruePeak);
+    ch->peak         = peak;
+    ch->truePeak     = (truePeak > peak) ? truePeak : peak;
+    ch->sum         += sum;
+    ch->weightedSum += weightedSum;
+}
+
+static float loudness(double meanSquare)
+{
+    return (meanSquare > 0) ? -0.691 + 10 * log10(meanSquare) : -HUGE_VAL;
+}
+
+static void sendValues(AudioMeterUserData* udata, MeterValues* v)
+{
+    const receiver_capi* receiverCapi = udata->receiverCapi;
+    receiver_writer*     writer       = udata->receiverWriter;
+
+    int rc = receiverCapi->addIntegerToWriter(writer, v->frameTime);
+    if (rc == 0) rc = receiverCapi->addNumberToWriter(writer, v->momentary);
+    if (rc == 0) rc = receiverCapi->addNumberToWriter(writer, v->shortTerm);
+    for (int i = 0; rc == 0 && i < 3 * udata->channelCount; ++i) {
+        rc = receiverCapi->addNumberToWriter(writer, v->channels[i]);
+    }
+    if (rc == 0) {
+        rc = receiverCapi->msgToReceiver(udata->receiver, writer, false /* clear */, true /* nonblock */,
+                                         NULL /* error handler */, NULL /* error handler data */);
+    }
+    if (rc != 0) {
+        receiverCapi->clearWriter(writer);
+    }
+}
+
+static void finishSubblock(AudioMeterUserData* udata, uint32_t frameTime)
+{
+    const int n   = udata->channelCount;
+    const int pos = udata->subblockPos;
+
+    bool reset = false;
+    if (udata->receiver) {
+        if (++udata->intervalCount >= udata->interval) {
+            udata->intervalCount = 0;
+            reset = true;
+        }
+    } else {
+        reset = atomic_swap(&udata->resetRequested, false);
+    }
+    if (udata->subblockCount < SUBBLOCKS_SHORT_TERM) {
+        udata->subblockCount += 1;
+    }
+    MeterValues* v = atomic_snapshot_begin(&udata->values);
+
+    double momentary = 0;
+    double shortTerm = 0;
+    for (int c = 0; c < n; ++c) {
+        ChannelState* ch = udata->channels + c;
+        ch->sums[pos]         = ch->sum;
+        ch->weightedSums[pos] = ch->weightedSum;
+        ch->peakHold          = (ch->peak     > ch->peakHold)     ? ch->peak     : ch->peakHold;
+        ch->truePeakHold      = (ch->truePeak > ch->truePeakHold) ? ch->truePeak : ch->truePeakHold;
+
+        double sum = 0;
+        for (int j = 0; j < SUBBLOCKS_SHORT_TERM; ++j) {
+            int k = (pos - j + SUBBLOCKS_SHORT_TERM) % SUBBLOCKS_SHORT_TERM;
+            if (j < SUBBLOCKS_MOMENTARY) {
+                momentary += ch->weightedSums[k];
+                sum       += ch->sums[k];
+            }
+            shortTerm += ch->weightedSums[k];
+        }
+        if (v) {
+            v->channels[3 * c]     = ch->peakHold;
+            v->channels[3 * c + 1] = sqrt(sum / (SUBBLOCKS_MOMENTARY * udata->subblockFrames));
+            v->channels[3 * c + 2] = ch->truePeakHold;
+        }
+        if (reset) {
+            /* the current subblock may not be read out, it also starts the new hold */
+            ch->peakHold     = ch->peak;
+            ch->truePeakHold = ch->truePeak;
+        }
+        ch->peak        = 0;
+        ch->truePeak    = 0;
+        ch->sum         = 0;
+        ch->weightedSum = 0;
+    }
+    if (v) {
+        v->frameTime = frameTime;
+        v->momentary = loudness(momentary / (SUBBLOCKS_MOMENTARY  * udata->subblockFrames));
+        v->shortTerm = loudness(shortTerm / (SUBBLOCKS_SHORT_TERM * udata->subblockFrames));
+        atomic_snapshot_publish(&udata->values, v);
+        if (udata->receiver && reset) {
+            sendValues(udata, v);
+        }
+    }
+    udata->subblockPos = (pos + 1) % SUBBLOCKS_SHORT_TERM;
+}
+
+static int processCallback(uint32_t nframes, void* processorData)
+{
+    AudioMeterUserData* udata    = (AudioMeterUserData*) processorData;
+    ChannelState*       channels = udata->channels;
+    const int           n        = udata->channelCount;
+
+    uint32_t f0 = udata->auprocCapi->getProcessBeginFrameTime(udata->auprocEngine);
+    uint32_t i  = 0;
+
+    while (i < nframes) {
+        uint32_t m = udata->subblockFrames - udata->subblockFill;
+        if (m > nframes - i) {
+            m = nframes - i;
+        }
+        for (int c = 0; c < n; ++c) {
+            const float* in = channels[c].methods->getAudioBuffer(channels[c].connector, nframes);
+            measure(udata, channels + c, in + i, m);
+        }
+        i                   += m;
+        udata->subblockFill += m;
+        if (udata->subblockFill == udata->subblockFrames) {
+            finishSubblock(udata, f0 + i);
+            udata->subblockFill = 0;
+        }
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static void engineClosedCallback(void* processorData)
+{
+    AudioMeterUserData* udata = (AudioMeterUserData*) processorData;
+
+    udata->closed    = true;
+    udata->activated = false;
+}
+
+static void engineReleasedCallback(void* processorData)
+{
+    AudioMeterUserData* udata = (AudioMeterUserData*) processorData;
+
+    udata->closed       = true;
+    udata->activated    = false;
+    udata->auprocCapi    = NULL;
+    udata->auprocEngine  = NULL;
+}
+
+/* ============================================================================================ */
+
+static int AudioMeter_new(lua_State* L)
+{
+    const int firstArg = 1;
+    const int lastArg  = lua_gettop(L);
+
+    AudioMeterUserData* udata = lua_newuserdata(L, sizeof(AudioMeterUserData));
+    memset(udata, 0, sizeof(AudioMeterUserData));
+    udata->className = AUDIO_METER_CLASS_NAME;
+    pushAudioMeterMeta(L);                                /* -> udata, meta */
+    lua_setmetatable(L, -2);                              /* -> udata */
+    int versionError = 0;
+    const auproc_capi* capi = auproc_get_capi(L, firstArg, &versionError);
+    auproc_engine* engine = NULL;
+    auproc_info    info   = {0};
+    if (capi) {
+        engine = capi->getEngine(L, firstArg, &info);
+    }
+    if (!capi || !engine) {
+        if (versionError) {
+            return luaL_argerror(L, firstArg, "auproc capi version mismatch");
+        } else {
+            return luaL_argerror(L, firstArg, "expected connector object");
+        }
+    }
+    if (info.sampleRate == 0) {
+        return luaL_argerror(L, firstArg, "cannot determine sample rate");
+    }
+    const int firstConArg = (capi->getObjectType(L, firstArg) == AUPROC_TENGINE) ? firstArg + 1 : firstArg;
+    int lastConArg = lastArg;
+    for (int i = firstConArg; i <= lastArg; ++i) {
+        if (!capi->getConnectorType(L, i)) {
+            lastConArg = i - 1;
+            break;
+        }
+    }
+    const int n           = lastConArg - firstConArg + 1;
+    const int recvArg     = lastConArg + 1;
+    const int intervalArg = lastConArg + 2;
+
+    if (n < 1) {
+        return luaL_argerror(L, firstConArg, "expected connector object");
+    }
+    if (recvArg <= lastArg)
+    {
+        int errReason = 0;
+        const receiver_capi* receiverCapi = receiver_get_capi(L, recvArg, &errReason);
+        receiver_object*     receiver     = receiverCapi ? receiverCapi->toReceiver(L, recvArg) : NULL;
+
+        if (!receiverCapi || !receiver) {
+            if (errReason == 1) {
+                return luaL_argerror(L, recvArg, "receiver capi version mismatch");
+            } else {
+                return luaL_argerror(L, recvArg, "expected object with receiver capi");
+            }
+        }
+        udata->receiverCapi = receiverCapi;
+        udata->receiver     = receiver;
+        receiverCapi->retainReceiver(receiver);
+
+        udata->receiverWriter = receiverCapi->newWriter(16 * 1024, 1);
+        if (!udata->receiverWriter) {
+            return luaL_error(L, "out of memory");
+        }
+        lua_Number interval = luaL_optnumber(L, intervalArg, 0.1);
+        luaL_argcheck(L, interval > 0, intervalArg, "positive interval expected");
+        udata->interval = (int)(interval * 10 + 0.5);
+        if (udata->interval < 1) {
+            udata->interval = 1;
+        }
+    }
+    udata->channelCount   = n;
+    udata->subblockFrames = info.sampleRate / 10;
+    setupKWeighting(udata, info.sampleRate);
+    setupTruePeak(udata);
+
+    udata->channels      = calloc(n, sizeof(ChannelState));
+    udata->connectorRegs = calloc(n, sizeof(auproc_con_reg));
+    if (   !udata->channels || !udata->connectorRegs
+        || !atomic_snapshot_init(&udata->values, sizeof(MeterValues) + 3 * n * sizeof(float)))
+    {
+        return luaL_error(L, "out of memory");
+    }
+    {
+        MeterValues* v = atomic_snapshot_current(&udata->values);
+        v->momentary = -HUGE_VAL;
+        v->shortTerm = -HUGE_VAL;
+    }
+    const char* processorName = lua_pushfstring(L, "%s: %p", AUDIO_METER_CLASS_NAME, udata);   /* -> udata, name */
+
+    auproc_con_reg* conRegs = udata->connectorRegs;
+
+    const auproc_con_reg inConReg = {AUPROC_AUDIO, AUPROC_IN, NULL};
+
+    for (int i = 0; i < n; ++i) {
+        conRegs[i] = inConReg;
+    }
+
+    auproc_con_reg_err regError = {0};
+    auproc_processor* proc = capi->registerProcessor(L, firstConArg, n, engine, processorName, udata,
+                                                         processCallback, NULL, engineClosedCallback, engineReleasedCallback,
+                                                         conRegs, &regError);
+    lua_pop(L, 1); /* -> udata */
+
+    if (!proc)
+    {
+        if (regError.conIndex >= 0)
+        {
+            int errArg = firstConArg + regError.conIndex;
+
+            if (regError.errorType == AUPROC_REG_ERR_CONNCTOR_INVALID)
+            {
+                return luaL_argerror(L, errArg, "invalid connector object");
+            }
+            if (   regError.errorType == AUPROC_REG_ERR_ENGINE_MISMATCH)
+            {
+                const char* msg = lua_pushfstring(L, "connector belongs to other %s",
+                                                     capi->engine_category_name);
+                return luaL_argerror(L, errArg, msg);
+            }
+            if (regError.errorType == AUPROC_REG_ERR_ARG_INVALID
+             || regError.errorType == AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE)
+            {
+                return luaL_argerror(L, errArg, "expected AUDIO IN connector");
+            }
+            if (regError.errorType == AUPROC_REG_ERR_WRONG_DIRECTION)
+            {
+                return luaL_argerror(L, errArg, "given connector is not readable");
+            }
+        }
+        return luaL_error(L, "cannot register processor (err=%d)", regError.errorType);
+    }
+
+    udata->processor    = proc;
+    udata->activated    = false;
+    udata->auprocCapi   = capi;
+    udata->auprocEngine = engine;
+
+    for (int i = 0; i < n; ++i) {
+        udata->channels[i].connector = conRegs[i].connector;
+        udata->channels[i].methods   = conRegs[i].audioMethods;
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioMeter_release(lua_State* L)
+{
+    AudioMeterUserData* udata = luaL_checkudata(L, 1, AUDIO_METER_CLASS_NAME);
+    udata->closed    = true;
+    udata->activated = false;
+    if (udata->auprocCapi) {
+        udata->auprocCapi->unregisterProcessor(L, udata->auprocEngine, udata->processor);
+        udata->processor   = NULL;
+        udata->auprocCapi   = NULL;
+        udata->auprocEngine = NULL;
+    }
+    if (udata->receiver) {
+        if (udata->receiverWriter) {
+            udata->receiverCapi->freeWriter(udata->receiverWriter);
+            udata->receiverWriter = NULL;
+        }
+        udata->receiverCapi->releaseReceiver(udata->receiver);
+        udata->receiver     = NULL;
+        udata->receiverCapi = NULL;
+    }
+    if (udata->connectorRegs) {
+        free(udata->connectorRegs);
+        udata->connectorRegs = NULL;
+    }
+    if (udata->channels) {
+        free(udata->channels);
+        udata->channels     = NULL;
+        udata->channelCount = 0;
+    }
+    atomic_snapshot_free(&udata->values);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioMeter_toString(lua_State* L)
+{
+    AudioMeterUserData* udata = luaL_checkudata(L, 1, AUDIO_METER_CLASS_NAME);
+
+    lua_pushfstring(L, "%s: %p", AUDIO_METER_CLASS_NAME, udata);
+
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioMeter_activate(lua_State* L)
+{
+    AudioMeterUserData* udata = checkAudioMeterUdata(L, 1);
+    if (!udata->activated) {
+        udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = true;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioMeter_deactivate(lua_State* L)
+{
+    AudioMeterUserData* udata = checkAudioMeterUdata(L, 1);
+    if (udata->activated) {
+        udata->auprocCapi->deactivateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = false;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioMeter_values(lua_State* L)
+{
+    AudioMeterUserData* udata = checkAudioMeterUdata(L, 1);
+
+    atomic_snapshot_update(&udata->values);
+    MeterValues* v = atomic_snapshot_current(&udata->values);
+
+    lua_createtable(L, udata->channelCount, 3);          /* -> values */
+    lua_pushinteger(L, v->frameTime);                    /* -> values, frameTime */
+    lua_setfield(L, -2, "frameTime");                    /* -> values */
+    lua_pushnumber(L, v->momentary);                     /* -> values, momentary */
+    lua_setfield(L, -2, "momentary");                    /* -> values */
+    lua_pushnumber(L, v->shortTerm);                     /* -> values, shortTerm */
+    lua_setfield(L, -2, "shortTerm");                    /* -> values */
+    for (int c = 0; c < udata->channelCount; ++c) {
+        lua_createtable(L, 0, 3);                        /* -> values, channel */
+        lua_pushnumber(L, v->channels[3 * c]);           /* -> values, channel, peak */
+        lua_setfield(L, -2, "peak");                     /* -> values, channel */
+        lua_pushnumber(L, v->channels[3 * c + 1]);       /* -> values, channel, rms */
+        lua_setfield(L, -2, "rms");                      /* -> values, channel */
+        lua_pushnumber(L, v->channels[3 * c + 2]);       /* -> values, channel, truePeak */
+        lua_setfield(L, -2, "truePeak");                 /* -> values, channel */
+        lua_rawseti(L, -2, c + 1);                       /* -> values */
+    }
+    atomic_set(&udata->resetRequested, true);
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static const luaL_Reg AudioMeterMethods[] =
+{
+    { "activate",    AudioMeter_activate },
+    { "deactivate",  AudioMeter_deactivate },
+    { "values",      AudioMeter_values },
+    { "close",       AudioMeter_release },
+    { NULL,          NULL } /* sentinel */
+};
+
+static const luaL_Reg AudioMeterMetaMethods[] =
+{
+    { "__tostring", AudioMeter_toString },
+    { "__gc",       AudioMeter_release  },
+
+    { NULL,       NULL } /* sentinel */
+};
+
+static const luaL_Reg ModuleFunctions[] =
+{
+    { "new_audio_meter", AudioMeter_new },
+    { NULL,              NULL } /* sentinel */
+};
+
+/* ============================================================================================ */
+
+static void setupAudioMeterMeta(lua_State* L)
+{                                                          /* -> meta */
+    lua_pushstring(L, AUDIO_METER_CLASS_NAME);             /* -> meta, className */
+    lua_setfield(L, -2, "__metatable");                    /* -> meta */
+
+    luaL_setfuncs(L, AudioMeterMetaMethods, 0);            /* -> meta */
+
+    lua_newtable(L);                                       /* -> meta, AudioMeterClass */
+    luaL_setfuncs(L, AudioMeterMethods, 0);                /* -> meta, AudioMeterClass */
+    lua_setfield (L, -2, "__index");                       /* -> meta */
+}
+
+
+/* ============================================================================================ */
+
+int auproc_audio_meter_init_module(lua_State* L, int module)
+{
+    if (luaL_newmetatable(L, AUDIO_METER_CLASS_NAME)) {
+        setupAudioMeterMeta(L);
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, module);
+        luaL_setfuncs(L, ModuleFunctions, 0);
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+/* ============================================================================================ */
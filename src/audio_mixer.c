@@ -1,4 +1,5 @@
 #include "audio_mixer.h"
+#include "async_util.h"
 
 #define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
 #include "auproc_capi.h"
@@ -14,7 +15,11 @@ static const char* ERROR_INVALID_AUDIO_MIXER = "invalid auproc.audio_mixer";
 
 /* ============================================================================================ */
 
+#define MAX_CC_MAPPINGS 32
+
 typedef struct InputConnection InputConnection;
+typedef struct CcMapping CcMapping;
+typedef struct CcMap CcMap;
 typedef struct AudioMixerUserData AudioMixerUserData;
 
 struct InputConnection 
@@ -22,6 +27,31 @@ struct InputConnection
     auproc_connector*       connector;
     const auproc_audiometh* methods;
     float                   factor;
+    float*                  buffer;
+    bool                    silent;
+};
+
+/**
+ * Assignment of a MIDI controller to an input with the amplification
+ * factor for each controller value.
+ */
+struct CcMapping
+{
+    unsigned char           channel;
+    unsigned char           controller;
+    int                     input;
+    float                   curve[128];
+};
+
+/**
+ * All controller assignments, built by the Lua thread and handed over
+ * to the process callback as a whole.
+ */
+struct CcMap
+{
+    unsigned char           index[16][128];    /* mapping index + 1, 0 if not assigned */
+    int                     count;
+    CcMapping               mappings[MAX_CC_MAPPINGS];
 };
 
 struct AudioMixerUserData
@@ -34,6 +64,8 @@ struct AudioMixerUserData
     int                     inpConnectionsCount;
     auproc_connector*       outConnector;
     const auproc_audiometh* outMethods;
+    auproc_connector*       midiInConnector;
+    const auproc_midimeth*  midiInMethods;
 
     bool               closed;
     bool               activated;
@@ -44,6 +76,9 @@ struct AudioMixerUserData
     const sender_capi*   senderCapi;
     sender_object*       sender;
     sender_reader*       senderReader;
+
+    CcMap                ccMap;                /* only used by the Lua thread */
+    AtomicSnapshot       ccMaps;
 };
 
 /* ============================================================================================ */
@@ -75,6 +110,46 @@ static AudioMixerUserData* checkAudioMixerUdata(lua_State* L, int arg)
 
 /* ============================================================================================ */
 
+static void setCurve(float* curve, lua_Number exponent, lua_Number maxFactor)
+{
+    curve[0] = 0;
+    for (int v = 1; v < 128; ++v) {
+        curve[v] = maxFactor * pow(v / 127.0, exponent);
+    }
+}
+
+/* ============================================================================================ */
+
+static void mixFrames(InputConnection* inputs, int n, float* outBuf, uint32_t begin, uint32_t end)
+{
+    float* outputEnd = outBuf + end;
+    bool   first     = true;
+
+    for (int i = 0; i < n; ++i) {
+        if (inputs[i].silent) {
+            continue;
+        }
+        float   factor   = inputs[i].factor;
+        float*  input    = inputs[i].buffer + begin;
+        float*  output   = outBuf + begin;
+        if (first) {
+            while (output < outputEnd) {
+                *(output++) = *(input++) * factor;
+            }
+            first = false;
+        } else {
+            while (output < outputEnd) {
+                *(output++) += *(input++) * factor;
+            }
+        }
+    }
+    if (first) {
+        memset(outBuf + begin, 0, sizeof(float) * (end - begin));
+    }
+}
+
+/* ============================================================================================ */
+
 static int processCallback(uint32_t nframes, void* processorData)
 {
     AudioMixerUserData* udata  = (AudioMixerUserData*) processorData;
@@ -115,7 +190,7 @@ static int processCallback(uint32_t nframes, void* processorData)
                         hasValue = true;
                         factor = senderValue.numVal;
                     }
-                    if (hasValue) {
+                    if (hasValue && 1 <= inputIndex && inputIndex <= n) {
                         inputs[inputIndex - 1].factor = factor;
                         goto nextValues;
                     }
@@ -125,28 +200,53 @@ static int processCallback(uint32_t nframes, void* processorData)
         }
     }
     {
-        const auproc_capi*      capi       = udata->auprocCapi;
         const auproc_audiometh* outMethods = udata->outMethods;
             
-        float* outBuf    = outMethods->getAudioBuffer(udata->outConnector, nframes);
-        float* outputEnd = outBuf + nframes;
-        {
-            float   factor   = inputs[0].factor;
-            float*  firstIn  = inputs[0].methods->getAudioBuffer(inputs[0].connector, nframes);
-            float*  output   = outBuf;
-            while (output < outputEnd) {
-                *(output++) = *(firstIn++) * factor;
+        float* outBuf = outMethods->getAudioBuffer(udata->outConnector, nframes);
+
+        const auproc_capi* capi      = udata->auprocCapi;
+        bool               allSilent = true;
+
+        for (int i = 0; i < n; ++i) {
+            inputs[i].silent = auproc_is_silent(capi, inputs[i].methods, inputs[i].connector);
+            if (!inputs[i].silent) {
+                inputs[i].buffer = inputs[i].methods->getAudioBuffer(inputs[i].connector, nframes);
+                allSilent = false;
             }
-            
         }
-        for (int i = 1; i < n; ++i) {
-            float   factor   = inputs[i].factor;
-            float*  input    = inputs[i].methods->getAudioBuffer(inputs[i].connector, nframes);
-            float*  output   = outBuf;
-            while (output < outputEnd) {
-                *(output++) += *(input++) * factor;
+        uint32_t pos = 0;
+        if (udata->midiInConnector) 
+        {
+            atomic_snapshot_update(&udata->ccMaps);
+            const CcMap* ccMap = atomic_snapshot_current(&udata->ccMaps);
+
+            const auproc_midimeth* midiMethods = udata->midiInMethods;
+            auproc_midibuf*        midiBuf     = midiMethods->getMidiBuffer(udata->midiInConnector, nframes);
+            uint32_t               eventCount  = midiMethods->getEventCount(midiBuf);
+            auproc_midi_event      event;
+
+            for (uint32_t e = 0; e < eventCount; ++e) {
+                midiMethods->getMidiEvent(&event, midiBuf, e);
+                if (event.size >= 3 && (event.buffer[0] & 0xF0) == 0xB0) {
+                    int i = ccMap->index[event.buffer[0] & 0x0F][event.buffer[1] & 0x7F];
+                    if (i > 0) {
+                        const CcMapping* m = ccMap->mappings + (i - 1);
+                        uint32_t t = (event.time < nframes) ? event.time : nframes;
+                        if (t > pos) {
+                            mixFrames(inputs, n, outBuf, pos, t);
+                            pos = t;
+                        }
+                        inputs[m->input].factor = m->curve[event.buffer[2] & 0x7F];
+                    }
+                }
             }
         }
+        if (pos < nframes) {
+            mixFrames(inputs, n, outBuf, pos, nframes);
+        }
+        if (allSilent) {
+            auproc_set_silent(capi, outMethods, udata->outConnector, true);
+        }
     }
     return 0;
 }
@@ -204,10 +304,11 @@ static int AudioMixer_new(lua_State* L)
             break;
         }
     }
-    const int outConArg = lastConArg;
-    const int senderArg = lastConArg + 1;
+    const int midiConArg = (capi->getConnectorType(L, lastConArg) == AUPROC_MIDI) ? lastConArg : 0;
+    const int outConArg  = midiConArg ? lastConArg - 1 : lastConArg;
+    const int senderArg  = lastConArg + 1;
 
-    if (firstConArg + 1 > lastConArg) {
+    if (firstConArg + 1 > outConArg) {
         luaL_argerror(L, firstConArg, "expected at least two auproc connector objects");
     } 
 
@@ -234,29 +335,37 @@ static int AudioMixer_new(lua_State* L)
             return luaL_error(L, "out of memory");
         }
     }
+    if (!atomic_snapshot_init(&udata->ccMaps, sizeof(CcMap))) {
+        return luaL_error(L, "out of memory");
+    }
     const char* processorName = lua_pushfstring(L, "%s: %p", AUDIO_MIXER_CLASS_NAME, udata);   /* -> udata, name */
 
     const int conCount = lastConArg - firstConArg + 1;
+    const int inpCount = outConArg  - firstConArg;
     auproc_con_reg*  conRegs        = malloc(sizeof(auproc_con_reg)  * conCount);
-    InputConnection* inpConnections = malloc(sizeof(InputConnection) * (conCount - 1));
+    InputConnection* inpConnections = malloc(sizeof(InputConnection) * inpCount);
     if (!conRegs || !inpConnections) {
         if (conRegs)        free(conRegs);
         if (inpConnections) free(inpConnections);
         return luaL_error(L, "out of memory");
     }
     memset(conRegs,        0, sizeof(auproc_con_reg)  * conCount);
-    memset(inpConnections, 0, sizeof(InputConnection) * (conCount - 1));
+    memset(inpConnections, 0, sizeof(InputConnection) * inpCount);
     udata->connectorRegs       = conRegs;
     udata->inpConnections      = inpConnections;
-    udata->inpConnectionsCount = conCount - 1;
+    udata->inpConnectionsCount = inpCount;
 
-    const auproc_con_reg inConReg  = {AUPROC_AUDIO, AUPROC_IN,  NULL};
-    const auproc_con_reg outConReg = {AUPROC_AUDIO, AUPROC_OUT, NULL};
+    const auproc_con_reg inConReg   = {AUPROC_AUDIO, AUPROC_IN,  NULL};
+    const auproc_con_reg outConReg  = {AUPROC_AUDIO, AUPROC_OUT, NULL};
+    const auproc_con_reg midiConReg = {AUPROC_MIDI,  AUPROC_IN,  NULL};
     
-    for (int i = 0; i < conCount - 1; ++i) {
+    for (int i = 0; i < inpCount; ++i) {
         conRegs[i] = inConReg;
     }
-    conRegs[conCount - 1] = outConReg;
+    conRegs[inpCount] = outConReg;
+    if (midiConArg) {
+        conRegs[inpCount + 1] = midiConReg;
+    }
     
     auproc_con_reg_err regError = {0};
     auproc_processor* proc = capi->registerProcessor(L, firstConArg, conCount, engine, processorName, udata, 
@@ -283,20 +392,22 @@ static int AudioMixer_new(lua_State* L)
             if (regError.errorType == AUPROC_REG_ERR_ARG_INVALID
              || regError.errorType == AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE)
             {
-                if (errArg < lastConArg) {
+                if (errArg < outConArg) {
                     return luaL_argerror(L, errArg, "expected AUDIO IN connector");
                 } 
-                if (errArg == lastConArg) {
+                if (errArg == outConArg) {
                     return luaL_argerror(L, errArg, "expected AUDIO OUT connector");
                 }
+                if (errArg == midiConArg) {
+                    return luaL_argerror(L, errArg, "expected MIDI IN connector");
+                }
             }
             if (regError.errorType == AUPROC_REG_ERR_WRONG_DIRECTION)
             {
-                if (errArg < lastConArg) {
-                    return luaL_argerror(L, errArg, "given connector is not readable");
-                } 
-                if (errArg == lastConArg) {
+                if (errArg == outConArg) {
                     return luaL_argerror(L, errArg, "given connector is not writable");
+                } else {
+                    return luaL_argerror(L, errArg, "given connector is not readable");
                 }
             }
         }
@@ -308,14 +419,17 @@ static int AudioMixer_new(lua_State* L)
     udata->auprocCapi   = capi;
     udata->auprocEngine = engine;
     
-    for (int i = 0; i < conCount - 1; ++i) {
+    for (int i = 0; i < inpCount; ++i) {
         udata->inpConnections[i].connector = conRegs[i].connector;
         udata->inpConnections[i].factor    = 1.0;
         udata->inpConnections[i].methods   = conRegs[i].audioMethods;
     }
-    udata->outConnector = conRegs[conCount - 1].connector;
-    udata->outMethods   = conRegs[conCount - 1].audioMethods;
-
+    udata->outConnector = conRegs[inpCount].connector;
+    udata->outMethods   = conRegs[inpCount].audioMethods;
+    if (midiConArg) {
+        udata->midiInConnector = conRegs[inpCount + 1].connector;
+        udata->midiInMethods   = conRegs[inpCount + 1].midiMethods;
+    }
     return 1;
 }
 
@@ -350,6 +464,7 @@ static int AudioMixer_release(lua_State* L)
         udata->inpConnections = NULL;
         udata->inpConnectionsCount = 0;
     }
+    atomic_snapshot_free(&udata->ccMaps);
     return 0;
 }
 
@@ -390,8 +505,61 @@ static int AudioMixer_deactivate(lua_State* L)
 
 /* ============================================================================================ */
 
+/**
+ * Assigns a MIDI controller to an input or removes the assignment if
+ * input is 0. The control curve is computed here and the whole map is 
+ * handed over to the process callback.
+ */
+static int AudioMixer_mapController(lua_State* L)
+{
+    AudioMixerUserData* udata      = checkAudioMixerUdata(L, 1);
+    lua_Integer         input      = luaL_checkinteger(L, 2);
+    lua_Integer         channel    = luaL_checkinteger(L, 3);
+    lua_Integer         controller = luaL_checkinteger(L, 4);
+    lua_Number          exponent   = luaL_optnumber(L, 5, 1.0);
+    lua_Number          maxFactor  = luaL_optnumber(L, 6, 1.0);
+
+    luaL_argcheck(L, 0 <= input && input <= udata->inpConnectionsCount, 2, "invalid input number");
+    luaL_argcheck(L, 1 <= channel && channel <= 16,                     3, "invalid channel");
+    luaL_argcheck(L, 0 <= controller && controller <= 127,              4, "invalid controller number");
+
+    CcMap* map = &udata->ccMap;
+    int    i   = map->index[channel - 1][controller] - 1;
+
+    if (input == 0) {
+        if (i >= 0) {
+            map->index[channel - 1][controller] = 0;
+            map->count -= 1;
+            if (i < map->count) {
+                CcMapping* m = map->mappings + i;
+                *m = map->mappings[map->count];
+                map->index[m->channel][m->controller] = i + 1;
+            }
+        }
+    } else {
+        if (i < 0) {
+            if (map->count >= MAX_CC_MAPPINGS) {
+                return luaL_error(L, "too many controller assignments (max. %d)", MAX_CC_MAPPINGS);
+            }
+            i = map->count++;
+            map->index[channel - 1][controller] = i + 1;
+            map->mappings[i].channel    = channel - 1;
+            map->mappings[i].controller = controller;
+        }
+        map->mappings[i].input = input - 1;
+        setCurve(map->mappings[i].curve, exponent, maxFactor);
+    }
+    CcMap* slot = atomic_snapshot_begin(&udata->ccMaps);
+    memcpy(slot, map, sizeof(CcMap));
+    atomic_snapshot_publish(&udata->ccMaps, slot);
+    return 0;
+}
+
+/* ============================================================================================ */
+
 static const luaL_Reg AudioMixerMethods[] = 
 {
+    { "mapController", AudioMixer_mapController },
     { "activate",    AudioMixer_activate },
     { "deactivate",  AudioMixer_deactivate },
     { "close",       AudioMixer_release },
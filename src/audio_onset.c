@@ -0,0 +1,761 @@
+#include "audio_onset.h"
+#include "async_util.h"
+#include "fft.h"
+
+#define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
+#include "auproc_capi.h"
+
+#define RECEIVER_CAPI_IMPLEMENT_GET_CAPI 1
+#include "receiver_capi.h"
+
+/* ============================================================================================ */
+
+static const char* const AUDIO_ONSET_CLASS_NAME = "auproc.audio_onset";
+
+static const char* ERROR_INVALID_AUDIO_ONSET = "invalid auproc.audio_onset";
+
+/* ============================================================================================ */
+
+#define WORKER_SLEEP_MILLIS 2
+#define EVENT_RING_SIZE    64     /* power of two */
+#define HISTORY_SIZE        8     /* number of previous detection values for the adaptive threshold */
+#define ADAPTIVE_RATIO    1.5     /* onset must exceed the mean of the history by this factor */
+#define REFINE_BLOCK       16
+#define REFINE_LEVEL      0.1     /* start of transient relative to its peak */
+
+typedef struct TimeStamp           TimeStamp;
+typedef struct OnsetEvent          OnsetEvent;
+typedef struct AudioOnsetUserData  AudioOnsetUserData;
+
+/**
+ * Frame time that belongs to a sample count of the ring buffer.
+ */
+struct TimeStamp
+{
+    uint32_t sampleCount;
+    uint32_t frameTime;
+};
+
+/**
+ * Onset passed from the worker thread to the realtime thread.
+ */
+struct OnsetEvent
+{
+    uint32_t  frameTime;
+    int       velocity;
+};
+
+struct AudioOnsetUserData
+{
+    const char*        className;
+    auproc_processor*  processor;
+
+    bool               closed;
+    bool               activated;
+
+    const auproc_capi*  auprocCapi;
+    auproc_engine*      auprocEngine;
+    uint32_t            sampleRate;
+
+    auproc_connector*       audioInConnector;
+    const auproc_audiometh* audioMethods;
+    auproc_connector*       midiOutConnector;
+    const auproc_midimeth*  midiMethods;
+
+    SampleRing         ring;
+    AtomicSnapshot     timeStamps;
+    AtomicCounter      stopRequested;
+    AsyncThread        thread;
+
+    OnsetEvent         events[EVENT_RING_SIZE];
+    AtomicCounter      eventWriteCount;
+    AtomicCounter      eventReadCount;
+
+    /* the following members are only used by the realtime thread */
+
+    unsigned char      status;          /* note on status byte incl. channel */
+    unsigned char      note;
+    uint32_t           latency;         /* in frames */
+    uint32_t           noteFrames;
+    bool               noteOn;
+    uint32_t           noteOffTime;
+
+    /* the following members are only used by the worker thread */
+
+    const receiver_capi* receiverCapi;
+    receiver_object*     receiver;
+    receiver_writer*     receiverWriter;
+
+    bool               spectral;
+    FftPlan*           fftPlan;
+    uint32_t           size;
+    uint32_t           hop;
+    float              threshold;       /* linear */
+    uint32_t           minInterval;     /* in samples */
+
+    float*             window;
+    float*             frame;
+    float*             re;
+    float*             im;
+    float*             prevPower;       /* [size/2 + 1] */
+    float              prevEnergy;
+    float              scale;
+
+    float              history[HISTORY_SIZE];
+    int                historyPos;
+    float              odfPrev;
+    float              odfCand;
+    bool               hasCand;
+
+    uint32_t           fill;
+    uint32_t           consumed;
+    uint32_t           lastOnset;       /* sample count */
+    bool               hasOnset;
+};
+
+/* ============================================================================================ */
+
+static void setupAudioOnsetMeta(lua_State* L);
+
+static int pushAudioOnsetMeta(lua_State* L)
+{
+    if (luaL_newmetatable(L, AUDIO_ONSET_CLASS_NAME)) {
+        setupAudioOnsetMeta(L);
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static AudioOnsetUserData* checkAudioOnsetUdata(lua_State* L, int arg)
+{
+    AudioOnsetUserData* udata = luaL_checkudata(L, arg, AUDIO_ONSET_CLASS_NAME);
+    if (udata->auprocCapi) {
+        udata->auprocCapi->checkEngineIsNotClosed(L, udata->auprocEngine);
+    }
+    if (udata->closed) {
+        luaL_error(L, ERROR_INVALID_AUDIO_ONSET);
+        return NULL;
+    }
+    return udata;
+}
+
+/* ============================================================================================ */
+
+static void emitNote(AudioOnsetUserData* udata, auproc_midibuf* outBuf, uint32_t t, bool on, int velocity)
+{
+    unsigned char* data = udata->midiMethods->reserveMidiEvent(outBuf, t, 3);
+    if (data) {
+        data[0] = on ? udata->status : (udata->status & 0x0F) | 0x80;
+        data[1] = udata->note;
+        data[2] = on ? velocity : 0;
+    }
+}
+
+static void noteOffUntil(AudioOnsetUserData* udata, auproc_midibuf* outBuf, uint32_t f0, int32_t end)
+{
+    if (udata->noteOn) {
+        int32_t t = udata->noteOffTime - f0;
+        if (t < end) {
+            emitNote(udata, outBuf, (t > 0) ? t : 0, false, 0);
+            udata->noteOn = false;
+        }
+    }
+}
+
+static int processCallback(uint32_t nframes, void* processorData)
+{
+    AudioOnsetUserData* udata      = (AudioOnsetUserData*) processorData;
+    const auproc_capi*  auprocCapi = udata->auprocCapi;
+
+    uint32_t f0 = auprocCapi->getProcessBeginFrameTime(udata->auprocEngine);
+    uint32_t written;
+
+    if (auproc_is_silent(auprocCapi, udata->audioMethods, udata->audioInConnector)) {
+        written = sample_ring_write_zeros(&udata->ring, nframes);
+    } else {
+        float* inBuf = udata->audioMethods->getAudioBuffer(udata->audioInConnector, nframes);
+        written = sample_ring_write(&udata->ring, inBuf, nframes);
+    }
+    TimeStamp* ts = atomic_snapshot_begin(&udata->timeStamps);
+    if (ts) {
+        ts->sampleCount = atomic_get(&udata->ring.writeCount);
+        ts->frameTime   = f0 + written;
+        atomic_snapshot_publish(&udata->timeStamps, ts);
+    }
+
+    if (udata->midiOutConnector)
+    {
+        auproc_midibuf* outBuf = udata->midiMethods->getMidiBuffer(udata->midiOutConnector, nframes);
+        udata->midiMethods->clearBuffer(outBuf);
+
+        uint32_t r = atomic_get(&udata->eventReadCount);
+        uint32_t w = atomic_get(&udata->eventWriteCount);
+        while (r != w) {
+            const OnsetEvent* e = udata->events + (r & (EVENT_RING_SIZE - 1));
+            int32_t t = e->frameTime + udata->latency - f0;
+            if (t >= (int32_t)nframes) {
+                break;
+            }
+            if (t < 0) {
+                t = 0; /* too late, latency is too small */
+            }
+            noteOffUntil(udata, outBuf, f0, t);
+            if (udata->noteOn) {
+                emitNote(udata, outBuf, t, false, 0); /* retriggered before note off */
+            }
+            emitNote(udata, outBuf, t, true, e->velocity);
+            udata->noteOn      = true;
+            udata->noteOffTime = f0 + t + udata->noteFrames;
+            r += 1;
+        }
+        atomic_set(&udata->eventReadCount, r);
+        noteOffUntil(udata, outBuf, f0, nframes);
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+/**
+ * Detection function: increase of the RMS level since the previous hop,
+ * computed from the spectral power flux or from the signal energy.
+ */
+static float detectionValue(AudioOnsetUserData* udata)
+{
+    const uint32_t size  = udata->size;
+    const float*   frame = udata->frame;
+
+    if (udata->spectral)
+    {
+        float* re = udata->re;
+        float* im = udata->im;
+
+        /* real FFT: even and odd values are packed into a half size complex FFT */
+        for (uint32_t i = 0; i < size / 2; ++i) {
+            re[i] = frame[2 * i]     * udata->window[2 * i];
+            im[i] = frame[2 * i + 1] * udata->window[2 * i + 1];
+        }
+        auproc_fft_real_forward(udata->fftPlan, re, im);
+
+        float* restrict prev = udata->prevPower;
+        float           flux = 0;
+        for (uint32_t i = 0; i <= size / 2; ++i) {
+            float p = re[i] * re[i] + im[i] * im[i];
+            float d = p - prev[i];
+            flux   += (d > 0) ? d : 0;
+            prev[i] = p;
+        }
+        return sqrtf(flux * udata->scale);
+    }
+    else
+    {
+        const float* restrict x = frame + size - udata->hop;
+        float energy = 0;
+        for (uint32_t i = 0; i < udata->hop; ++i) {
+            energy += x[i] * x[i];
+        }
+        energy *= udata->scale;
+        float d = energy - udata->prevEnergy;
+        udata->prevEnergy = energy;
+        return (d > 0) ? sqrtf(d) : 0;
+    }
+}
+
+/**
+ * Finds the start of the strongest transient in the hop that ends at the
+ * frame index end, i.e. the first sample before its peak that exceeds
+ * REFINE_LEVEL of the peak. The start is not searched before begin.
+ * Returns the index in the frame and the peak value.
+ */
+static uint32_t findTransient(AudioOnsetUserData* udata, uint32_t begin, uint32_t end, float* peak)
+{
+    const float* x    = udata->frame;
+    uint32_t     from = (end - udata->hop > begin) ? end - udata->hop : begin;
+    uint32_t     p    = from;
+    float        m    = 0;
+    for (uint32_t i = from; i < end; ++i) {
+        float a = fabsf(x[i]);
+        if (a > m) {
+            m = a;
+            p = i;
+        }
+    }
+    const float level = REFINE_LEVEL * m;
+    uint32_t    i     = p;
+    while (i > begin) {
+        uint32_t j = (i >= begin + REFINE_BLOCK) ? i - REFINE_BLOCK : begin;
+        float    b = 0;
+        for (uint32_t k = j; k < i; ++k) {
+            float a = fabsf(x[k]);
+            b = (a > b) ? a : b;
+        }
+        if (b < level) {
+            break;
+        }
+        i = j;
+    }
+    while (i < p && fabsf(x[i]) < level) {
+        i += 1;
+    }
+    *peak = m;
+    return i;
+}
+
+static void sendOnset(AudioOnsetUserData* udata, uint32_t frameTime, float peak, int velocity)
+{
+    if (udata->midiOutConnector) {
+        uint32_t w = atomic_get(&udata->eventWriteCount);
+        uint32_t r = atomic_get(&udata->eventReadCount);
+        if (w - r < EVENT_RING_SIZE) {
+            OnsetEvent* e = udata->events + (w & (EVENT_RING_SIZE - 1));
+            e->frameTime = frameTime;
+            e->velocity  = velocity;
+            atomic_set(&udata->eventWriteCount, w + 1);
+        }
+    }
+    if (udata->receiver) {
+        const receiver_capi* receiverCapi = udata->receiverCapi;
+        receiver_writer*     writer       = udata->receiverWriter;
+
+        int rc = receiverCapi->addIntegerToWriter(writer, frameTime);
+        if (rc == 0) rc = receiverCapi->addNumberToWriter(writer, peak);
+        if (rc == 0) rc = receiverCapi->addIntegerToWriter(writer, velocity);
+        if (rc == 0) {
+            rc = receiverCapi->msgToReceiver(udata->receiver, writer, false /* clear */, true /* nonblock */,
+                                             NULL /* error handler */, NULL /* error handler data */);
+        }
+        if (rc != 0) {
+            receiverCapi->clearWriter(writer);
+        }
+    }
+}
+
+static void analyzeFrame(AudioOnsetUserData* udata)
+{
+    const float odf = detectionValue(udata);
+
+    if (udata->hasCand && odf <= udata->odfCand)
+    {
+        /* sample count of the first sample in the current frame */
+        uint32_t frameStart = udata->consumed - udata->fill;
+        uint32_t begin      = 0;
+        bool     accept     = true;
+
+        /* end of the hop that raised the detection value of the previous 
+         * frame: its last hop for the energy, the hop at the center of its
+         * window for the spectral flux */
+        const uint32_t hop = udata->hop;
+        const uint32_t end = udata->spectral ? udata->size / 2 - hop / 2 : udata->size - hop;
+
+        if (udata->hasOnset) {
+            int32_t d = udata->lastOnset + udata->minInterval - frameStart;
+            if (d >= (int32_t)end) {
+                accept = false;
+            } else if (d > 0) {
+                begin = d;
+            }
+        }
+        if (accept) {
+            float    peak;
+            uint32_t onset = frameStart + findTransient(udata, begin, end, &peak);
+
+            atomic_snapshot_update(&udata->timeStamps);
+            TimeStamp* ts        = atomic_snapshot_current(&udata->timeStamps);
+            uint32_t   frameTime = ts->frameTime - (ts->sampleCount - onset);
+
+            double db       = 20 * log10(peak > 1e-6f ? peak : 1e-6f);
+            int    velocity = (int)(127 * (1 + db / 60) + 0.5);
+            velocity = (velocity < 1) ? 1 : (velocity > 127) ? 127 : velocity;
+
+            sendOnset(udata, frameTime, peak, velocity);
+            udata->lastOnset = onset;
+            udata->hasOnset  = true;
+        }
+    }
+    float mean = 0;
+    for (int i = 0; i < HISTORY_SIZE; ++i) {
+        mean += udata->history[i];
+    }
+    mean /= HISTORY_SIZE;
+
+    udata->hasCand = (   odf >= udata->threshold
+                      && odf >  udata->odfPrev
+                      && odf >= ADAPTIVE_RATIO * mean);
+    udata->odfCand = odf;
+    udata->odfPrev = odf;
+    udata->history[udata->historyPos] = odf;
+    udata->historyPos = (udata->historyPos + 1) % HISTORY_SIZE;
+}
+
+static void workerThread(void* arg)
+{
+    AudioOnsetUserData* udata = (AudioOnsetUserData*) arg;
+
+    while (!atomic_get(&udata->stopRequested)) {
+        while (true) {
+            uint32_t n = sample_ring_read(&udata->ring, udata->frame + udata->fill, udata->size - udata->fill);
+            udata->fill     += n;
+            udata->consumed += n;
+            if (udata->fill < udata->size) {
+                break;
+            }
+            analyzeFrame(udata);
+            udata->fill -= udata->hop;
+            memmove(udata->frame, udata->frame + udata->hop, sizeof(float) * udata->fill);
+        }
+        async_sleep_millis(WORKER_SLEEP_MILLIS);
+    }
+}
+
+/* ============================================================================================ */
+
+static void engineClosedCallback(void* processorData)
+{
+    AudioOnsetUserData* udata = (AudioOnsetUserData*) processorData;
+
+    udata->closed    = true;
+    udata->activated = false;
+}
+
+static void engineReleasedCallback(void* processorData)
+{
+    AudioOnsetUserData* udata = (AudioOnsetUserData*) processorData;
+
+    udata->closed       = true;
+    udata->activated    = false;
+    udata->auprocCapi    = NULL;
+    udata->auprocEngine  = NULL;
+}
+
+/* ============================================================================================ */
+
+static int AudioOnset_new(lua_State* L)
+{
+    const int conArg  = 1;
+    const int lastArg = lua_gettop(L);
+
+    AudioOnsetUserData* udata = lua_newuserdata(L, sizeof(AudioOnsetUserData));
+    memset(udata, 0, sizeof(AudioOnsetUserData));
+    udata->className = AUDIO_ONSET_CLASS_NAME;
+    pushAudioOnsetMeta(L);                                /* -> udata, meta */
+    lua_setmetatable(L, -2);                              /* -> udata */
+    int versionError = 0;
+    const auproc_capi* capi = auproc_get_capi(L, conArg, &versionError);
+    auproc_engine* engine = NULL;
+    auproc_info    info   = {0};
+    if (capi) {
+        engine = capi->getEngine(L, conArg, &info);
+    }
+    if (!capi || !engine) {
+        if (versionError) {
+            return luaL_argerror(L, conArg, "auproc capi version mismatch");
+        } else {
+            return luaL_argerror(L, conArg, "expected connector object");
+        }
+    }
+    if (info.sampleRate == 0) {
+        return luaL_argerror(L, conArg, "cannot determine sample rate");
+    }
+    udata->sampleRate = info.sampleRate;
+
+    const int conCount = (lastArg >= conArg + 1 && capi->getConnectorType(L, conArg + 1)) ? 2 : 1;
+    int       recvArg  = conArg + conCount;
+    int       optArg   = recvArg + 1;
+
+    if (recvArg <= lastArg && lua_type(L, recvArg) == LUA_TTABLE) {
+        optArg  = recvArg;
+        recvArg = 0;
+    }
+    if (recvArg && !lua_isnoneornil(L, recvArg))
+    {
+        int errReason = 0;
+        const receiver_capi* receiverCapi = receiver_get_capi(L, recvArg, &errReason);
+        receiver_object*     receiver     = receiverCapi ? receiverCapi->toReceiver(L, recvArg) : NULL;
+
+        if (!receiverCapi || !receiver) {
+            if (errReason == 1) {
+                return luaL_argerror(L, recvArg, "receiver capi version mismatch");
+            } else {
+                return luaL_argerror(L, recvArg, "expected object with receiver capi");
+            }
+        }
+        udata->receiverCapi = receiverCapi;
+        udata->receiver     = receiver;
+        receiverCapi->retainReceiver(receiver);
+
+        udata->receiverWriter = receiverCapi->newWriter(16 * 1024, 1);
+        if (!udata->receiverWriter) {
+            return luaL_error(L, "out of memory");
+        }
+    }
+    if (conCount == 1 && !udata->receiver) {
+        return luaL_argerror(L, conArg + 1, "expected MIDI OUT connector or receiver object");
+    }
+
+    const char* method      = "flux";
+    lua_Number  size        = 1024;
+    lua_Number  threshold   = -40;
+    lua_Number  minInterval = 0.05;
+    lua_Number  latency     = 0.05;
+    lua_Number  note        = 36;
+    lua_Number  channel     = 10;
+
+    if (optArg <= lastArg && !lua_isnil(L, optArg)) {
+        luaL_checktype(L, optArg, LUA_TTABLE);
+        size        = auproc_util_opt_number_field(L, optArg, "size",        size);
+        threshold   = auproc_util_opt_number_field(L, optArg, "threshold",   threshold);
+        minInterval = auproc_util_opt_number_field(L, optArg, "minInterval", minInterval);
+        latency     = auproc_util_opt_number_field(L, optArg, "latency",     latency);
+        note        = auproc_util_opt_number_field(L, optArg, "note",        note);
+        channel     = auproc_util_opt_number_field(L, optArg, "channel",     channel);
+        lua_getfield(L, optArg, "method");                /* -> udata, method */
+        if (!lua_isnil(L, -1)) {
+            method = lua_tostring(L, -1);
+            luaL_argcheck(L, method, optArg, "string expected for field 'method'");
+        }
+        lua_pop(L, 1);                                    /* -> udata */
+    }
+    if (strcmp(method, "flux") == 0) {
+        udata->spectral = true;
+    } else if (strcmp(method, "energy") == 0) {
+        udata->spectral = false;
+    } else {
+        return luaL_argerror(L, optArg, lua_pushfstring(L, "invalid method '%s'", method));
+    }
+    luaL_argcheck(L, auproc_fft_is_valid_size(size) && size >= 64,
+                                                 optArg, "power of two >= 64 expected for field 'size'");
+    luaL_argcheck(L, minInterval >= 0,          optArg, "invalid value for field 'minInterval'");
+    luaL_argcheck(L, latency >= 0,              optArg, "invalid value for field 'latency'");
+    luaL_argcheck(L, note >= 0 && note <= 127,  optArg, "invalid value for field 'note'");
+    luaL_argcheck(L, channel >= 1 && channel <= 16, optArg, "invalid value for field 'channel'");
+
+    udata->size        = size;
+    udata->hop         = udata->size / 4;
+    udata->threshold   = pow(10, threshold / 20);
+    udata->minInterval = minInterval * udata->sampleRate;
+    udata->latency     = latency * udata->sampleRate;
+    udata->noteFrames  = udata->sampleRate / 100;
+    udata->note        = (unsigned char)note;
+    udata->status      = 0x90 | ((int)channel - 1);
+
+    udata->frame = malloc(sizeof(float) * udata->size);
+    if (   !udata->frame
+        || !sample_ring_init(&udata->ring, 4 * udata->size + udata->sampleRate / 2)
+        || !atomic_snapshot_init(&udata->timeStamps, sizeof(TimeStamp)))
+    {
+        return luaL_error(L, "out of memory");
+    }
+    if (udata->spectral) {
+        udata->fftPlan   = auproc_fft_new(udata->size / 2);
+        udata->window    = malloc(sizeof(float) * udata->size);
+        udata->re        = malloc(sizeof(float) * udata->size);
+        udata->im        = malloc(sizeof(float) * udata->size);
+        udata->prevPower = calloc(udata->size / 2 + 1, sizeof(float));
+        if (!udata->fftPlan || !udata->window || !udata->re || !udata->im || !udata->prevPower) {
+            return luaL_error(L, "out of memory");
+        }
+        auproc_fft_window(udata->window, udata->size, "hann");
+        double sum = 0;
+        for (uint32_t i = 0; i < udata->size; ++i) {
+            sum += udata->window[i] * udata->window[i];
+        }
+        /* power of the spectrum half as mean square of the windowed signal */
+        udata->scale = 2 / (udata->size * sum);
+    } else {
+        udata->scale = 1.0f / udata->hop;
+    }
+    const char* processorName = lua_pushfstring(L, "%s: %p", AUDIO_ONSET_CLASS_NAME, udata);   /* -> udata, name */
+
+    auproc_con_reg conRegs[2] = { {AUPROC_AUDIO, AUPROC_IN,  NULL},
+                                  {AUPROC_MIDI,  AUPROC_OUT, NULL} };
+    auproc_con_reg_err regError = {0};
+    auproc_processor* proc = capi->registerProcessor(L, conArg, conCount, engine, processorName, udata,
+                                                         processCallback, NULL, engineClosedCallback, engineReleasedCallback,
+                                                         conRegs, &regError);
+    lua_pop(L, 1); /* -> udata */
+
+    if (!proc)
+    {
+        if (regError.conIndex >= 0)
+        {
+            int errArg = conArg + regError.conIndex;
+
+            if (regError.errorType == AUPROC_REG_ERR_CONNCTOR_INVALID)
+            {
+                return luaL_argerror(L, errArg, "invalid connector object");
+            }
+            if (   regError.errorType == AUPROC_REG_ERR_ENGINE_MISMATCH)
+            {
+                const char* msg = lua_pushfstring(L, "connector belongs to other %s",
+                                                     capi->engine_category_name);
+                return luaL_argerror(L, errArg, msg);
+            }
+            if (regError.errorType == AUPROC_REG_ERR_ARG_INVALID
+             || regError.errorType == AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE)
+            {
+                if (errArg == conArg) {
+                    return luaL_argerror(L, errArg, "expected AUDIO IN connector");
+                } else {
+                    return luaL_argerror(L, errArg, "expected MIDI OUT connector");
+                }
+            }
+            if (regError.errorType == AUPROC_REG_ERR_WRONG_DIRECTION)
+            {
+                if (errArg == conArg) {
+                    return luaL_argerror(L, errArg, "given connector is not readable");
+                } else {
+                    return luaL_argerror(L, errArg, "given connector is not writable");
+                }
+            }
+        }
+        return luaL_error(L, "cannot register processor (err=%d)", regError.errorType);
+    }
+    udata->processor        = proc;
+    udata->activated        = false;
+    udata->auprocCapi       = capi;
+    udata->auprocEngine     = engine;
+    udata->audioInConnector = conRegs[0].connector;
+    udata->audioMethods     = conRegs[0].audioMethods;
+    if (conCount == 2) {
+        udata->midiOutConnector = conRegs[1].connector;
+        udata->midiMethods      = conRegs[1].midiMethods;
+    }
+
+    if (!async_thread_start(&udata->thread, workerThread, udata)) {
+        return luaL_error(L, "cannot start worker thread");
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioOnset_release(lua_State* L)
+{
+    AudioOnsetUserData* udata = luaL_checkudata(L, 1, AUDIO_ONSET_CLASS_NAME);
+    udata->closed    = true;
+    udata->activated = false;
+    if (udata->auprocCapi) {
+        udata->auprocCapi->unregisterProcessor(L, udata->auprocEngine, udata->processor);
+        udata->processor   = NULL;
+        udata->auprocCapi   = NULL;
+        udata->auprocEngine = NULL;
+    }
+    if (udata->thread.started) {
+        atomic_set(&udata->stopRequested, true);
+        async_thread_join(&udata->thread);
+    }
+    if (udata->receiver) {
+        if (udata->receiverWriter) {
+            udata->receiverCapi->freeWriter(udata->receiverWriter);
+            udata->receiverWriter = NULL;
+        }
+        udata->receiverCapi->releaseReceiver(udata->receiver);
+        udata->receiver     = NULL;
+        udata->receiverCapi = NULL;
+    }
+    if (udata->fftPlan) {
+        auproc_fft_free(udata->fftPlan);
+        udata->fftPlan = NULL;
+    }
+    if (udata->window)    { free(udata->window);    udata->window    = NULL; }
+    if (udata->frame)     { free(udata->frame);     udata->frame     = NULL; }
+    if (udata->re)        { free(udata->re);        udata->re        = NULL; }
+    if (udata->im)        { free(udata->im);        udata->im        = NULL; }
+    if (udata->prevPower) { free(udata->prevPower); udata->prevPower = NULL; }
+    sample_ring_free(&udata->ring);
+    atomic_snapshot_free(&udata->timeStamps);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioOnset_toString(lua_State* L)
+{
+    AudioOnsetUserData* udata = luaL_checkudata(L, 1, AUDIO_ONSET_CLASS_NAME);
+
+    lua_pushfstring(L, "%s: %p", AUDIO_ONSET_CLASS_NAME, udata);
+
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioOnset_activate(lua_State* L)
+{
+    AudioOnsetUserData* udata = checkAudioOnsetUdata(L, 1);
+    if (!udata->activated) {
+        udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = true;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioOnset_deactivate(lua_State* L)
+{
+    AudioOnsetUserData* udata = checkAudioOnsetUdata(L, 1);
+    if (udata->activated) {
+        udata->auprocCapi->deactivateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = false;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static const luaL_Reg AudioOnsetMethods[] =
+{
+    { "activate",    AudioOnset_activate },
+    { "deactivate",  AudioOnset_deactivate },
+    { "close",       AudioOnset_release },
+    { NULL,          NULL } /* sentinel */
+};
+
+static const luaL_Reg AudioOnsetMetaMethods[] =
+{
+    { "__tostring", AudioOnset_toString },
+    { "__gc",       AudioOnset_release  },
+
+    { NULL,       NULL } /* sentinel */
+};
+
+static const luaL_Reg ModuleFunctions[] =
+{
+    { "new_audio_onset", AudioOnset_new },
+    { NULL,              NULL } /* sentinel */
+};
+
+/* ============================================================================================ */
+
+static void setupAudioOnsetMeta(lua_State* L)
+{                                                          /* -> meta */
+    lua_pushstring(L, AUDIO_ONSET_CLASS_NAME);             /* -> meta, className */
+    lua_setfield(L, -2, "__metatable");                    /* -> meta */
+
+    luaL_setfuncs(L, AudioOnsetMetaMethods, 0);            /* -> meta */
+
+    lua_newtable(L);                                       /* -> meta, AudioOnsetClass */
+    luaL_setfuncs(L, AudioOnsetMethods, 0);                /* -> meta, AudioOnsetClass */
+    lua_setfield (L, -2, "__index");                       /* -> meta */
+}
+
+
+/* ============================================================================================ */
+
+int auproc_audio_onset_init_module(lua_State* L, int module)
+{
+    if (luaL_newmetatable(L, AUDIO_ONSET_CLASS_NAME)) {
+        setupAudioOnsetMeta(L);
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, module);
+        luaL_setfuncs(L, ModuleFunctions, 0);
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+/* ============================================================================================ */
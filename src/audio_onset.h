@@ -0,0 +1,8 @@
+#ifndef AUPROC_AUDIO_ONSET_H
+#define AUPROC_AUDIO_ONSET_H
+
+#include "util.h"
+
+int auproc_audio_onset_init_module(lua_State* L, int module);
+
+#endif // AUPROC_AUDIO_ONSET_H
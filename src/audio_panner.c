@@ -0,0 +1,798 @@
+#include "audio_panner.h"
+#include "async_util.h"
+#include "simd_util.h"
+
+#define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
+#include "auproc_capi.h"
+
+#define SENDER_CAPI_IMPLEMENT_GET_CAPI 1
+#include "sender_capi.h"
+
+/* ============================================================================================ */
+
+static const char* const AUDIO_PANNER_CLASS_NAME = "auproc.audio_panner";
+
+static const char* ERROR_INVALID_AUDIO_PANNER = "invalid auproc.audio_panner";
+
+/* ============================================================================================ */
+
+#define PAN_TABLE_SIZE  1024
+#define RAMP_FRAMES     64
+#define MAX_OUTPUTS     64
+
+typedef struct VbapPair             VbapPair;
+typedef struct InputConnection      InputConnection;
+typedef struct OutputConnection     OutputConnection;
+typedef struct AudioPannerUserData  AudioPannerUserData;
+
+enum PanLaw
+{
+    CONSTANT_POWER, MINUS_4_5_DB, LINEAR
+};
+
+static const char* const PAN_LAWS[] =
+{
+    "constant", "-4.5dB", "linear", NULL
+};
+
+/**
+ * Pair of adjacent loudspeakers with the inverted matrix of their
+ * direction vectors for 2D vector base amplitude panning.
+ */
+struct VbapPair
+{
+    int    out1;
+    int    out2;
+    float  inv[4];
+};
+
+struct InputConnection
+{
+    auproc_connector*       connector;
+    const auproc_audiometh* methods;
+    float*                  buf;
+    float*                  gain;      /* [outputCount] */
+    float*                  target;    /* [outputCount] */
+    float*                  step;      /* [outputCount] */
+    uint32_t                rampLeft;
+};
+
+struct OutputConnection
+{
+    auproc_connector*       connector;
+    const auproc_audiometh* methods;
+    float*                  buf;
+};
+
+struct AudioPannerUserData
+{
+    const char*        className;
+    auproc_processor*  processor;
+
+    bool               closed;
+    bool               activated;
+
+    const auproc_capi*  auprocCapi;
+    auproc_engine*      auprocEngine;
+
+    auproc_con_reg*     connectorRegs;
+    InputConnection*    inputs;
+    int                 inputCount;
+    OutputConnection*   outputs;
+    int                 outputCount;
+    float*              gainMemory;
+
+    const sender_capi* senderCapi;
+    sender_object*     sender;
+    sender_reader*     senderReader;
+
+    AtomicSnapshot     positions;      /* float[inputCount] */
+
+    bool               hasPending;
+    uint32_t           pendingTime;
+    float*             pendingPositions;
+
+    int                law;
+    float              panTable[PAN_TABLE_SIZE + 1][2];
+    VbapPair*          pairs;
+    int                pairCount;
+};
+
+/* ============================================================================================ */
+
+static void setupAudioPannerMeta(lua_State* L);
+
+static int pushAudioPannerMeta(lua_State* L)
+{
+    if (luaL_newmetatable(L, AUDIO_PANNER_CLASS_NAME)) {
+        setupAudioPannerMeta(L);
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static AudioPannerUserData* checkAudioPannerUdata(lua_State* L, int arg)
+{
+    AudioPannerUserData* udata = luaL_checkudata(L, arg, AUDIO_PANNER_CLASS_NAME);
+    if (udata->auprocCapi) {
+        udata->auprocCapi->checkEngineIsNotClosed(L, udata->auprocEngine);
+    }
+    if (udata->closed) {
+        luaL_error(L, ERROR_INVALID_AUDIO_PANNER);
+        return NULL;
+    }
+    return udata;
+}
+
+/* ============================================================================================ */
+
+static void setupPanTable(AudioPannerUserData* udata)
+{
+    for (int i = 0; i <= PAN_TABLE_SIZE; ++i) {
+        double x     = (double) i / PAN_TABLE_SIZE;
+        double theta = x * M_PI / 2;
+        double l, r;
+        switch (udata->law) {
+            case CONSTANT_POWER: l = cos(theta);                    r = sin(theta);               break;
+            case MINUS_4_5_DB:   l = sqrt((1 - x) * cos(theta));    r = sqrt(x * sin(theta));     break;
+            default:             l = 1 - x;                         r = x;                        break;
+        }
+        udata->panTable[i][0] = l;
+        udata->panTable[i][1] = r;
+    }
+}
+
+/**
+ * Sets up the loudspeaker pairs for the given azimuth angles in degrees.
+ * Returns false if the angles are not valid.
+ */
+static bool setupVbapPairs(AudioPannerUserData* udata, const double* angles)
+{
+    const int m = udata->outputCount;
+    int       sorted[MAX_OUTPUTS];
+
+    for (int i = 0; i < m; ++i) {
+        sorted[i] = i;
+    }
+    for (int i = 1; i < m; ++i) {
+        for (int j = i; j > 0 && angles[sorted[j]] < angles[sorted[j - 1]]; --j) {
+            int t = sorted[j]; sorted[j] = sorted[j - 1]; sorted[j - 1] = t;
+        }
+    }
+    udata->pairCount = 0;
+    for (int i = 0; i < m; ++i) {
+        int    o1 = sorted[i];
+        int    o2 = sorted[(i + 1) % m];
+        double a1 = angles[o1] * M_PI / 180;
+        double a2 = angles[o2] * M_PI / 180;
+        double d  = angles[o2] - angles[o1];
+        if (i == m - 1) {
+            d += 360;
+        }
+        if (d <= 0 || d >= 180) {
+            continue;
+        }
+        double det = cos(a1) * sin(a2) - sin(a1) * cos(a2);
+        VbapPair* p = udata->pairs + udata->pairCount++;
+        p->out1   = o1;
+        p->out2   = o2;
+        p->inv[0] =  sin(a2) / det;
+        p->inv[1] = -sin(a1) / det;
+        p->inv[2] = -cos(a2) / det;
+        p->inv[3] =  cos(a1) / det;
+    }
+    return udata->pairCount > 0;
+}
+
+/**
+ * Computes the output gains for a pan position: for two outputs the position
+ * is in [-1, 1], for more outputs the position is the azimuth in degrees.
+ */
+static void computeGains(AudioPannerUserData* udata, float position, float* gains)
+{
+    const int m = udata->outputCount;
+    if (m == 2) {
+        float x = (position + 1) / 2;
+        x = (x < 0) ? 0 : (x > 1) ? 1 : x;
+        float    p    = x * PAN_TABLE_SIZE;
+        uint32_t k    = (uint32_t) p;
+        float    frac = p - k;
+        if (k >= PAN_TABLE_SIZE) {
+            k    = PAN_TABLE_SIZE - 1;
+            frac = 1;
+        }
+        const float (*t)[2] = udata->panTable;
+        gains[0] = t[k][0] + frac * (t[k + 1][0] - t[k][0]);
+        gains[1] = t[k][1] + frac * (t[k + 1][1] - t[k][1]);
+        return;
+    }
+    for (int i = 0; i < m; ++i) {
+        gains[i] = 0;
+    }
+    const float x = cosf(position * (float)M_PI / 180);
+    const float y = sinf(position * (float)M_PI / 180);
+    float best  = -HUGE_VALF;
+    int   bestP = 0;
+    float bestG1 = 0, bestG2 = 0;
+    for (int i = 0; i < udata->pairCount; ++i) {
+        const VbapPair* p  = udata->pairs + i;
+        float           g1 = x * p->inv[0] + y * p->inv[2];
+        float           g2 = x * p->inv[1] + y * p->inv[3];
+        float           mn = (g1 < g2) ? g1 : g2;
+        if (mn > best) {
+            best   = mn;
+            bestP  = i;
+            bestG1 = (g1 > 0) ? g1 : 0;
+            bestG2 = (g2 > 0) ? g2 : 0;
+        }
+    }
+    float norm = sqrtf(bestG1 * bestG1 + bestG2 * bestG2);
+    if (norm > 0) {
+        gains[udata->pairs[bestP].out1] = bestG1 / norm;
+        gains[udata->pairs[bestP].out2] = bestG2 / norm;
+    }
+}
+
+/**
+ * Sets a new pan position for the input, the gains are ramped to the
+ * new values within RAMP_FRAMES frames.
+ */
+static void setPosition(AudioPannerUserData* udata, InputConnection* input, float position)
+{
+    const int m = udata->outputCount;
+    computeGains(udata, position, input->target);
+    for (int o = 0; o < m; ++o) {
+        input->step[o] = (input->target[o] - input->gain[o]) / RAMP_FRAMES;
+    }
+    input->rampLeft = RAMP_FRAMES;
+}
+
+/* ============================================================================================ */
+
+/**
+ * Reads a control message: optional frame time followed by the positions
+ * of all inputs. Returns false if the message is invalid.
+ */
+static bool readPositions(AudioPannerUserData* udata, uint32_t f0, uint32_t* time, float* positions)
+{
+    const sender_capi* senderCapi = udata->senderCapi;
+    sender_reader*     reader     = udata->senderReader;
+    sender_capi_value  value;
+
+    *time = f0;
+
+    senderCapi->nextValueFromReader(reader, &value);
+    if (value.type == SENDER_CAPI_TYPE_INTEGER) {
+        *time = value.intVal;
+        senderCapi->nextValueFromReader(reader, &value);
+    }
+    for (int i = 0; i < udata->inputCount; ++i) {
+        if (value.type == SENDER_CAPI_TYPE_INTEGER) {
+            positions[i] = value.intVal;
+        } else if (value.type == SENDER_CAPI_TYPE_NUMBER) {
+            positions[i] = value.numVal;
+        } else {
+            return false;
+        }
+        senderCapi->nextValueFromReader(reader, &value);
+    }
+    return value.type == SENDER_CAPI_TYPE_NONE;
+}
+
+/* ============================================================================================ */
+
+static void panFrames(AudioPannerUserData* udata, uint32_t begin, uint32_t end)
+{
+    OutputConnection* outputs = udata->outputs;
+    const int         m       = udata->outputCount;
+
+    for (int i = 0; i < udata->inputCount; ++i) {
+        InputConnection* input = udata->inputs + i;
+        uint32_t         f     = begin;
+        while (f < end) {
+            const float* restrict in = input->buf ? input->buf + f : NULL;
+            if (input->rampLeft > 0) {
+                uint32_t n = (input->rampLeft < end - f) ? input->rampLeft : end - f;
+                for (int o = 0; o < m; ++o) {
+                    const float g  = input->gain[o];
+                    const float st = input->step[o];
+                    if (in) {
+                        vec4_mix_ramp(outputs[o].buf + f, in, n, g + st, st);
+                    }
+                    input->gain[o] = g + st * n;
+                }
+                input->rampLeft -= n;
+                if (input->rampLeft == 0) {
+                    memcpy(input->gain, input->target, sizeof(float) * m);
+                }
+                f += n;
+            } else {
+                if (in) {
+                    const uint32_t n = end - f;
+                    for (int o = 0; o < m; ++o) {
+                        const float g = input->gain[o];
+                        if (g != 0) {
+                            vec4_mix_gain(outputs[o].buf + f, in, n, g);
+                        }
+                    }
+                }
+                f = end;
+            }
+        }
+    }
+}
+
+static int processCallback(uint32_t nframes, void* processorData)
+{
+    AudioPannerUserData* udata   = (AudioPannerUserData*) processorData;
+    InputConnection*     inputs  = udata->inputs;
+    OutputConnection*    outputs = udata->outputs;
+    const int            n       = udata->inputCount;
+    const int            m       = udata->outputCount;
+    const auproc_capi*   capi    = udata->auprocCapi;
+
+    uint32_t f0 = capi->getProcessBeginFrameTime(udata->auprocEngine);
+
+    if (atomic_snapshot_update(&udata->positions)) {
+        const float* positions = atomic_snapshot_current(&udata->positions);
+        for (int i = 0; i < n; ++i) {
+            setPosition(udata, inputs + i, positions[i]);
+        }
+    }
+    bool allSilent = true;
+    for (int i = 0; i < n; ++i) {
+        if (auproc_is_silent(capi, inputs[i].methods, inputs[i].connector)) {
+            inputs[i].buf = NULL;
+        } else {
+            inputs[i].buf = inputs[i].methods->getAudioBuffer(inputs[i].connector, nframes);
+            allSilent = false;
+        }
+    }
+    for (int o = 0; o < m; ++o) {
+        outputs[o].buf = outputs[o].methods->getAudioBuffer(outputs[o].connector, nframes);
+        memset(outputs[o].buf, 0, sizeof(float) * nframes);
+    }
+    uint32_t pos = 0;
+    while (pos < nframes) {
+        if (!udata->hasPending && udata->sender) {
+            const sender_capi* senderCapi = udata->senderCapi;
+            sender_reader*     reader     = udata->senderReader;
+
+            int rc = senderCapi->nextMessageFromSender(udata->sender, reader,
+                                                       true /* nonblock */, 0 /* timeout */,
+                                                       NULL /* errorHandler */, NULL /* errorHandlerData */);
+            if (rc == 0) {
+                udata->hasPending = readPositions(udata, f0 + pos, &udata->pendingTime, udata->pendingPositions);
+                senderCapi->clearReader(reader);
+                continue;
+            }
+        }
+        uint32_t end = nframes;
+        if (udata->hasPending) {
+            int32_t offset = udata->pendingTime - f0;
+            if (offset <= (int32_t)pos) {
+                for (int i = 0; i < n; ++i) {
+                    setPosition(udata, inputs + i, udata->pendingPositions[i]);
+                }
+                udata->hasPending = false;
+                continue;
+            }
+            if (offset < (int32_t)nframes) {
+                end = offset;
+            }
+        }
+        panFrames(udata, pos, end);
+        pos = end;
+    }
+    if (allSilent) {
+        for (int o = 0; o < m; ++o) {
+            auproc_set_silent(capi, outputs[o].methods, outputs[o].connector, true);
+        }
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static void engineClosedCallback(void* processorData)
+{
+    AudioPannerUserData* udata = (AudioPannerUserData*) processorData;
+
+    udata->closed    = true;
+    udata->activated = false;
+}
+
+static void engineReleasedCallback(void* processorData)
+{
+    AudioPannerUserData* udata = (AudioPannerUserData*) processorData;
+
+    udata->closed       = true;
+    udata->activated    = false;
+    udata->auprocCapi    = NULL;
+    udata->auprocEngine  = NULL;
+}
+
+/* ============================================================================================ */
+
+static int AudioPanner_new(lua_State* L)
+{
+    const int firstArg = 1;
+    const int lastArg  = lua_gettop(L);
+
+    AudioPannerUserData* udata = lua_newuserdata(L, sizeof(AudioPannerUserData));
+    memset(udata, 0, sizeof(AudioPannerUserData));
+    udata->className = AUDIO_PANNER_CLASS_NAME;
+    pushAudioPannerMeta(L);                               /* -> udata, meta */
+    lua_setmetatable(L, -2);                              /* -> udata */
+    int versionError = 0;
+    const auproc_capi* capi = auproc_get_capi(L, firstArg, &versionError);
+    auproc_engine* engine = NULL;
+    if (capi) {
+        engine = capi->getEngine(L, firstArg, NULL);
+    }
+    if (!capi || !engine) {
+        if (versionError) {
+            return luaL_argerror(L, firstArg, "auproc capi version mismatch");
+        } else {
+            return luaL_argerror(L, firstArg, "expected connector object");
+        }
+    }
+    const int firstConArg = (capi->getObjectType(L, firstArg) == AUPROC_TENGINE) ? firstArg + 1 : firstArg;
+    int lastConArg = lastArg;
+    for (int i = firstConArg; i <= lastArg; ++i) {
+        if (!capi->getConnectorType(L, i)) {
+            lastConArg = i - 1;
+            break;
+        }
+    }
+    const int conCount = lastConArg - firstConArg + 1;
+    int       arg      = lastConArg + 1;
+
+    if (arg <= lastArg && !lua_istable(L, arg))
+    {
+        int errReason = 0;
+        const sender_capi* senderCapi = sender_get_capi(L, arg, &errReason);
+        sender_object*     sender     = senderCapi ? senderCapi->toSender(L, arg) : NULL;
+
+        if (!senderCapi || !sender) {
+            if (errReason == 1) {
+                return luaL_argerror(L, arg, "sender capi version mismatch");
+            } else {
+                return luaL_argerror(L, arg, "expected sender capi object");
+            }
+        }
+
+        udata->senderCapi = senderCapi;
+        udata->sender     = sender;
+        senderCapi->retainSender(sender);
+
+        udata->senderReader = senderCapi->newReader(16 * 1024, 1);
+        if (!udata->senderReader) {
+            return luaL_error(L, "out of memory");
+        }
+        arg += 1;
+    }
+    const int optArg = arg;
+    int       m      = 2;
+    if (optArg <= lastArg) {
+        luaL_checktype(L, optArg, LUA_TTABLE);
+        lua_getfield(L, optArg, "outputs");               /* -> udata, outputs */
+        if (!lua_isnil(L, -1)) {
+            if (!lua_isinteger(L, -1)) {
+                return luaL_argerror(L, optArg, "integer expected for field 'outputs'");
+            }
+            m = lua_tointeger(L, -1);
+        }
+        lua_pop(L, 1);                                    /* -> udata */
+        lua_getfield(L, optArg, "law");                   /* -> udata, law */
+        if (!lua_isnil(L, -1)) {
+            if (lua_type(L, -1) != LUA_TSTRING) {
+                return luaL_argerror(L, optArg, "string expected for field 'law'");
+            }
+            udata->law = -1;
+            for (int i = 0; PAN_LAWS[i]; ++i) {
+                if (strcmp(PAN_LAWS[i], lua_tostring(L, -1)) == 0) {
+                    udata->law = i;
+                }
+            }
+            if (udata->law < 0) {
+                return luaL_argerror(L, optArg, lua_pushfstring(L, "invalid pan law '%s'", lua_tostring(L, -1)));
+            }
+        }
+        lua_pop(L, 1);                                    /* -> udata */
+    }
+    if (m < 2 || m > MAX_OUTPUTS || conCount - m < 1) {
+        return luaL_argerror(L, firstConArg, "expected at least one input and two output connector objects");
+    }
+    const int n         = conCount - m;
+    const int outConArg = firstConArg + n;
+
+    udata->inputCount  = n;
+    udata->outputCount = m;
+    udata->inputs           = calloc(n, sizeof(InputConnection));
+    udata->outputs          = calloc(m, sizeof(OutputConnection));
+    udata->connectorRegs    = calloc(conCount, sizeof(auproc_con_reg));
+    udata->gainMemory       = calloc(3 * n * m, sizeof(float));
+    udata->pendingPositions = calloc(n, sizeof(float));
+    udata->pairs            = calloc(m, sizeof(VbapPair));
+    if (   !udata->inputs || !udata->outputs || !udata->connectorRegs
+        || !udata->gainMemory || !udata->pendingPositions || !udata->pairs
+        || !atomic_snapshot_init(&udata->positions, n * sizeof(float)))
+    {
+        return luaL_error(L, "out of memory");
+    }
+    if (m == 2) {
+        setupPanTable(udata);
+    } else {
+        double angles[MAX_OUTPUTS];
+        for (int o = 0; o < m; ++o) {
+            angles[o] = o * 360.0 / m;
+        }
+        if (optArg <= lastArg) {
+            lua_getfield(L, optArg, "angles");            /* -> udata, angles */
+            if (!lua_isnil(L, -1)) {
+                if (!lua_istable(L, -1) || luaL_len(L, -1) != m) {
+                    return luaL_argerror(L, optArg, "field 'angles' must be a table with an angle for each output");
+                }
+                for (int o = 0; o < m; ++o) {
+                    lua_rawgeti(L, -1, o + 1);            /* -> udata, angles, angle */
+                    if (!lua_isnumber(L, -1)) {
+                        return luaL_argerror(L, optArg, "field 'angles' must contain numbers");
+                    }
+                    angles[o] = fmod(lua_tonumber(L, -1), 360);
+                    if (angles[o] < 0) {
+                        angles[o] += 360;
+                    }
+                    lua_pop(L, 1);                        /* -> udata, angles */
+                }
+            }
+            lua_pop(L, 1);                                /* -> udata */
+        }
+        if (!setupVbapPairs(udata, angles)) {
+            return luaL_argerror(L, optArg, "invalid loudspeaker angles");
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        InputConnection* input = udata->inputs + i;
+        input->gain   = udata->gainMemory + (3 * i)     * m;
+        input->target = udata->gainMemory + (3 * i + 1) * m;
+        input->step   = udata->gainMemory + (3 * i + 2) * m;
+        computeGains(udata, 0, input->gain);
+        memcpy(input->target, input->gain, sizeof(float) * m);
+    }
+    const char* processorName = lua_pushfstring(L, "%s: %p", AUDIO_PANNER_CLASS_NAME, udata);   /* -> udata, name */
+
+    auproc_con_reg* conRegs = udata->connectorRegs;
+
+    const auproc_con_reg inConReg  = {AUPROC_AUDIO, AUPROC_IN,  NULL};
+    const auproc_con_reg outConReg = {AUPROC_AUDIO, AUPROC_OUT, NULL};
+
+    for (int i = 0; i < n; ++i) {
+        conRegs[i] = inConReg;
+    }
+    for (int o = 0; o < m; ++o) {
+        conRegs[n + o] = outConReg;
+    }
+
+    auproc_con_reg_err regError = {0};
+    auproc_processor* proc = capi->registerProcessor(L, firstConArg, conCount, engine, processorName, udata,
+                                                         processCallback, NULL, engineClosedCallback, engineReleasedCallback,
+                                                         conRegs, &regError);
+    lua_pop(L, 1); /* -> udata */
+
+    if (!proc)
+    {
+        if (regError.conIndex >= 0)
+        {
+            int errArg = firstConArg + regError.conIndex;
+
+            if (regError.errorType == AUPROC_REG_ERR_CONNCTOR_INVALID)
+            {
+                return luaL_argerror(L, errArg, "invalid connector object");
+            }
+            if (   regError.errorType == AUPROC_REG_ERR_ENGINE_MISMATCH)
+            {
+                const char* msg = lua_pushfstring(L, "connector belongs to other %s",
+                                                     capi->engine_category_name);
+                return luaL_argerror(L, errArg, msg);
+            }
+            if (regError.errorType == AUPROC_REG_ERR_ARG_INVALID
+             || regError.errorType == AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE)
+            {
+                if (errArg < outConArg) {
+                    return luaL_argerror(L, errArg, "expected AUDIO IN connector");
+                } else {
+                    return luaL_argerror(L, errArg, "expected AUDIO OUT connector");
+                }
+            }
+            if (regError.errorType == AUPROC_REG_ERR_WRONG_DIRECTION)
+            {
+                if (errArg < outConArg) {
+                    return luaL_argerror(L, errArg, "given connector is not readable");
+                } else {
+                    return luaL_argerror(L, errArg, "given connector is not writable");
+                }
+            }
+        }
+        return luaL_error(L, "cannot register processor (err=%d)", regError.errorType);
+    }
+
+    udata->processor    = proc;
+    udata->activated    = false;
+    udata->auprocCapi   = capi;
+    udata->auprocEngine = engine;
+
+    for (int i = 0; i < n; ++i) {
+        udata->inputs[i].connector = conRegs[i].connector;
+        udata->inputs[i].methods   = conRegs[i].audioMethods;
+    }
+    for (int o = 0; o < m; ++o) {
+        udata->outputs[o].connector = conRegs[n + o].connector;
+        udata->outputs[o].methods   = conRegs[n + o].audioMethods;
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioPanner_release(lua_State* L)
+{
+    AudioPannerUserData* udata = luaL_checkudata(L, 1, AUDIO_PANNER_CLASS_NAME);
+    udata->closed    = true;
+    udata->activated = false;
+    if (udata->auprocCapi) {
+        udata->auprocCapi->unregisterProcessor(L, udata->auprocEngine, udata->processor);
+        udata->processor   = NULL;
+        udata->auprocCapi   = NULL;
+        udata->auprocEngine = NULL;
+    }
+    if (udata->sender) {
+        if (udata->senderReader) {
+            udata->senderCapi->freeReader(udata->senderReader);
+            udata->senderReader = NULL;
+        }
+        udata->senderCapi->releaseSender(udata->sender);
+        udata->sender     = NULL;
+        udata->senderCapi = NULL;
+    }
+    if (udata->connectorRegs) {
+        free(udata->connectorRegs);
+        udata->connectorRegs = NULL;
+    }
+    if (udata->inputs) {
+        free(udata->inputs);
+        udata->inputs     = NULL;
+        udata->inputCount = 0;
+    }
+    if (udata->outputs) {
+        free(udata->outputs);
+        udata->outputs     = NULL;
+        udata->outputCount = 0;
+    }
+    if (udata->gainMemory) {
+        free(udata->gainMemory);
+        udata->gainMemory = NULL;
+    }
+    if (udata->pendingPositions) {
+        free(udata->pendingPositions);
+        udata->pendingPositions = NULL;
+    }
+    if (udata->pairs) {
+        free(udata->pairs);
+        udata->pairs = NULL;
+    }
+    atomic_snapshot_free(&udata->positions);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioPanner_toString(lua_State* L)
+{
+    AudioPannerUserData* udata = luaL_checkudata(L, 1, AUDIO_PANNER_CLASS_NAME);
+
+    lua_pushfstring(L, "%s: %p", AUDIO_PANNER_CLASS_NAME, udata);
+
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioPanner_activate(lua_State* L)
+{
+    AudioPannerUserData* udata = checkAudioPannerUdata(L, 1);
+    if (!udata->activated) {
+        udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = true;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioPanner_deactivate(lua_State* L)
+{
+    AudioPannerUserData* udata = checkAudioPannerUdata(L, 1);
+    if (udata->activated) {
+        udata->auprocCapi->deactivateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = false;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioPanner_set(lua_State* L)
+{
+    AudioPannerUserData* udata = checkAudioPannerUdata(L, 1);
+    const int n = udata->inputCount;
+
+    for (int i = 0; i < n; ++i) {
+        luaL_checknumber(L, 2 + i);
+    }
+    float* slot = atomic_snapshot_begin(&udata->positions);
+    for (int i = 0; i < n; ++i) {
+        slot[i] = lua_tonumber(L, 2 + i);
+    }
+    atomic_snapshot_publish(&udata->positions, slot);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static const luaL_Reg AudioPannerMethods[] =
+{
+    { "activate",    AudioPanner_activate },
+    { "deactivate",  AudioPanner_deactivate },
+    { "set",         AudioPanner_set },
+    { "close",       AudioPanner_release },
+    { NULL,          NULL } /* sentinel */
+};
+
+static const luaL_Reg AudioPannerMetaMethods[] =
+{
+    { "__tostring", AudioPanner_toString },
+    { "__gc",       AudioPanner_release  },
+
+    { NULL,       NULL } /* sentinel */
+};
+
+static const luaL_Reg ModuleFunctions[] =
+{
+    { "new_audio_panner", AudioPanner_new },
+    { NULL,               NULL } /* sentinel */
+};
+
+/* ============================================================================================ */
+
+static void setupAudioPannerMeta(lua_State* L)
+{                                                          /* -> meta */
+    lua_pushstring(L, AUDIO_PANNER_CLASS_NAME);            /* -> meta, className */
+    lua_setfield(L, -2, "__metatable");                    /* -> meta */
+
+    luaL_setfuncs(L, AudioPannerMetaMethods, 0);           /* -> meta */
+
+    lua_newtable(L);                                       /* -> meta, AudioPannerClass */
+    luaL_setfuncs(L, AudioPannerMethods, 0);               /* -> meta, AudioPannerClass */
+    lua_setfield (L, -2, "__index");                       /* -> meta */
+}
+
+
+/* ============================================================================================ */
+
+int auproc_audio_panner_init_module(lua_State* L, int module)
+{
+    if (luaL_newmetatable(L, AUDIO_PANNER_CLASS_NAME)) {
+        setupAudioPannerMeta(L);
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, module);
+        luaL_setfuncs(L, ModuleFunctions, 0);
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+/* ============================================================================================ */
@@ -1,4 +1,5 @@
 #include "audio_receiver.h"
+#include "simd_util.h"
 
 #define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
 #include "auproc_capi.h"
@@ -33,6 +34,13 @@ struct AudioReceiverUserData
     const receiver_capi* receiverCapi;
     receiver_object*     receiver;
     receiver_writer*     receiverWriter;
+
+    uint32_t             bucketFrames;     /* 0: sample data is sent unreduced */
+    bool                 bucketRms;
+    uint32_t             bucketFill;
+    float                bucketMin;
+    float                bucketMax;
+    float                bucketSum;
 };
 
 /* ============================================================================================ */
@@ -67,6 +75,96 @@ static AudioReceiverUserData* checkAudioReceiverUdata(lua_State* L, int arg)
 
 /* ============================================================================================ */
 
+/**
+ * Reduces the sample data to (min, max[, rms]) tuples for each bucket of 
+ * bucketFrames frames. The tuples of all buckets that are completed in
+ * this process cycle are sent in one message. The sample data is not read 
+ * if the input is silent.
+ */
+static void processReduced(AudioReceiverUserData* udata, const float* inBuf, bool silent, 
+                           uint32_t t0, uint32_t nframes)
+{
+    const receiver_capi* receiverCapi = udata->receiverCapi;
+    receiver_writer*     writer       = udata->receiverWriter;
+
+    const uint32_t bucketFrames = udata->bucketFrames;
+    const uint32_t tupleSize    = udata->bucketRms ? 3 : 2;
+    const uint32_t completed    = (udata->bucketFill + nframes) / bucketFrames;
+
+    float* data = NULL;
+    if (completed > 0) {
+        int rc = receiverCapi->addIntegerToWriter(writer, t0 - udata->bucketFill);
+        if (rc == 0) {
+            data = receiverCapi->addArrayToWriter(writer, RECEIVER_FLOAT, completed * tupleSize);
+        }
+    }
+    uint32_t i = 0;
+    uint32_t b = 0;
+    while (i < nframes) {
+        uint32_t m = bucketFrames - udata->bucketFill;
+        if (m > nframes - i) {
+            m = nframes - i;
+        }
+        float min = 0;
+        float max = 0;
+        float sum = 0;
+        if (!silent) {
+            /* four partial results per Vec4, combined after the loop */
+            const float* in   = inBuf + i;
+            Vec4         vmin = vec4_set1(in[0]);
+            Vec4         vmax = vmin;
+            Vec4         vsum = vec4_set1(0);
+            uint32_t     j    = 0;
+            for (; j + VEC4_WIDTH <= m; j += VEC4_WIDTH) {
+                Vec4 x = vec4_load(in + j);
+                vmin = vec4_min(x, vmin);
+                vmax = vec4_max(x, vmax);
+                vsum = vec4_madd(x, x, vsum);
+            }
+            min = vec4_hmin(vmin);
+            max = vec4_hmax(vmax);
+            sum = vec4_hsum(vsum);
+            for (; j < m; ++j) {
+                min  = (in[j] < min) ? in[j] : min;
+                max  = (in[j] > max) ? in[j] : max;
+                sum += in[j] * in[j];
+            }
+        }
+        if (udata->bucketFill == 0) {
+            udata->bucketMin = min;
+            udata->bucketMax = max;
+            udata->bucketSum = sum;
+        } else {
+            udata->bucketMin  = (min < udata->bucketMin) ? min : udata->bucketMin;
+            udata->bucketMax  = (max > udata->bucketMax) ? max : udata->bucketMax;
+            udata->bucketSum += sum;
+        }
+        udata->bucketFill += m;
+        i                 += m;
+        if (udata->bucketFill == bucketFrames) {
+            if (data) {
+                data[b * tupleSize]     = udata->bucketMin;
+                data[b * tupleSize + 1] = udata->bucketMax;
+                if (udata->bucketRms) {
+                    data[b * tupleSize + 2] = sqrtf(udata->bucketSum / bucketFrames);
+                }
+            }
+            b += 1;
+            udata->bucketFill = 0;
+        }
+    }
+    if (completed > 0) {
+        int rc = -1;
+        if (data) {
+            rc = receiverCapi->msgToReceiver(udata->receiver, writer, false /* clear */, false /* nonblock */, 
+                                             NULL /* error handler */, NULL /* error handler data */);
+        }
+        if (!data || rc != 0) {
+            receiverCapi->clearWriter(writer);
+        }
+    }
+}
+
 static int processCallback(uint32_t nframes, void* processorData)
 {
     AudioReceiverUserData* udata        = (AudioReceiverUserData*) processorData;
@@ -74,21 +172,29 @@ static int processCallback(uint32_t nframes, void* processorData)
     auproc_engine*        auprocEngine = udata->auprocEngine;
 
     const auproc_audiometh* methods = udata->audioMethods;
-    float*                  inBuf   = methods->getAudioBuffer(udata->audioInConnector, nframes);
+    const bool              silent  = auproc_is_silent(auprocCapi, methods, udata->audioInConnector);
+    float*                  inBuf   = silent ? NULL : methods->getAudioBuffer(udata->audioInConnector, nframes);
     
     const receiver_capi* receiverCapi = udata->receiverCapi;
     receiver_object*     receiver     = udata->receiver;
     receiver_writer*     writer       = udata->receiverWriter;
 
     uint32_t t0 = auprocCapi->getProcessBeginFrameTime(auprocEngine);
-    if (receiver) {
+    if (receiver && udata->bucketFrames > 0) {
+        processReduced(udata, inBuf, silent, t0, nframes);
+    }
+    else if (receiver) {
         int rc = receiverCapi->addIntegerToWriter(writer, t0);
         unsigned char* data = NULL;
         if (rc == 0) {
             data = receiverCapi->addArrayToWriter(writer, RECEIVER_FLOAT, nframes);
         }
         if (data) {
-            memcpy(data, inBuf, nframes * sizeof(float));
+            if (silent) {
+                memset(data, 0, nframes * sizeof(float));
+            } else {
+                memcpy(data, inBuf, nframes * sizeof(float));
+            }
             rc = receiverCapi->msgToReceiver(receiver, writer, false /* clear */, false /* nonblock */, 
                                              NULL /* error handler */, NULL /* error handler data */);
         }
@@ -126,11 +232,14 @@ static int AudioReceiver_new(lua_State* L)
 {
     const int conArg = 1;
     const int recvArg = 2;
+    const int bucketArg = 3;
+    const int rmsArg = 4;
+    lua_settop(L, rmsArg);                                  /* -> args */
     AudioReceiverUserData* udata = lua_newuserdata(L, sizeof(AudioReceiverUserData));
     memset(udata, 0, sizeof(AudioReceiverUserData));
     udata->className = AUDIO_RECEIVER_CLASS_NAME;
-    pushAudioReceiverMeta(L);                                /* -> udata, meta */
-    lua_setmetatable(L, -2);                                /* -> udata */
+    pushAudioReceiverMeta(L);                                /* -> args, udata, meta */
+    lua_setmetatable(L, -2);                                /* -> args, udata */
     int versionError = 0;
     const auproc_capi* capi = auproc_get_capi(L, conArg, &versionError);
     auproc_engine* engine = NULL;
@@ -166,14 +275,20 @@ static int AudioReceiver_new(lua_State* L)
     if (!udata->receiverWriter) {
         return luaL_error(L, "out of memory");
     }
-    const char* processorName = lua_pushfstring(L, "%s: %p", AUDIO_RECEIVER_CLASS_NAME, udata);   /* -> udata, name */
+    if (!lua_isnoneornil(L, bucketArg)) {
+        lua_Integer bucketFrames = luaL_checkinteger(L, bucketArg);
+        luaL_argcheck(L, bucketFrames >= 1 && bucketFrames <= 0x1000000, bucketArg, "invalid number of frames");
+        udata->bucketFrames = bucketFrames;
+        udata->bucketRms    = lua_toboolean(L, rmsArg);
+    }
+    const char* processorName = lua_pushfstring(L, "%s: %p", AUDIO_RECEIVER_CLASS_NAME, udata);   /* -> args, udata, name */
     
     auproc_con_reg conReg = {AUPROC_AUDIO, AUPROC_IN, NULL};
     auproc_con_reg_err regError = {0};
     auproc_processor* proc = capi->registerProcessor(L, conArg, 1, engine, processorName, udata, 
                                                          processCallback, NULL, engineClosedCallback, engineReleasedCallback,
                                                          &conReg, &regError);
-    lua_pop(L, 1); /* -> udata */
+    lua_pop(L, 1); /* -> args, udata */
 
     if (!proc)
     {
@@ -0,0 +1,952 @@
+#include "audio_sampler.h"
+#include "async_util.h"
+#include "simd_util.h"
+
+#define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
+#include "auproc_capi.h"
+
+/* ============================================================================================ */
+
+static const char* const AUDIO_SAMPLER_CLASS_NAME = "auproc.audio_sampler";
+
+static const char* ERROR_INVALID_AUDIO_SAMPLER = "invalid auproc.audio_sampler";
+
+/* ============================================================================================ */
+
+#define MAX_OUTPUTS    8
+#define MAX_VOICES     256
+#define MAX_CHANNELS   MAX_OUTPUTS
+#define BLOCK_FRAMES   64
+
+typedef struct Sample              Sample;
+typedef struct Zone                Zone;
+typedef struct KeyMap              KeyMap;
+typedef struct Voice               Voice;
+typedef struct AudioSamplerUserData AudioSamplerUserData;
+
+/**
+ * Sample data in planar layout: channel c starts at data + c * stride. Each
+ * channel is followed by zero frames for the interpolation of the last frame.
+ * A sample that is no longer mapped to a note is freed by freeUnusedSamples
+ * when the process callback has no way to play it any more.
+ */
+struct Sample
+{
+    Sample*        next;
+    AtomicCounter  voices;      /* number of voices playing this sample */
+    int            unmapped;    /* first key map generation without this sample, 0 if mapped */
+    uint32_t       frames;
+    uint32_t       stride;
+    int            channels;
+    double         rate;
+    float          data[];
+};
+
+struct Zone
+{
+    Sample*       sample;
+    double        root;
+    float         gain;
+    uint32_t      releaseFrames;
+    bool          oneshot;
+};
+
+struct KeyMap
+{
+    int  generation;
+    Zone zones[128];
+};
+
+struct Voice
+{
+    Sample*       sample;
+    double        pos;
+    double        step;
+    float         amp;
+    float         releaseDelta;
+    uint32_t      releaseFrames;
+    uint32_t      releaseLeft;
+    uint32_t      age;
+    unsigned char note;
+    unsigned char channel;
+    bool          active;
+    bool          releasing;
+    bool          oneshot;
+};
+
+struct AudioSamplerUserData
+{
+    const char*        className;
+    auproc_processor*  processor;
+
+    bool               closed;
+    bool               activated;
+
+    const auproc_capi*  auprocCapi;
+    auproc_engine*      auprocEngine;
+    uint32_t            sampleRate;
+
+    auproc_connector*       midiConnector;
+    const auproc_midimeth*  midiMethods;
+    auproc_connector*       outConnectors[MAX_OUTPUTS];
+    const auproc_audiometh* outMethods[MAX_OUTPUTS];
+    float*                  outBufs[MAX_OUTPUTS];
+    int                     outCount;
+
+    int                channel;        /* MIDI channel 0-15 or -1 for all channels */
+
+    Sample*            samples;
+    KeyMap             keyMap;         /* master copy of the Lua side */
+    AtomicSnapshot     keyMaps;
+    AtomicCounter      usedGeneration; /* generation of the key map used by the process callback */
+
+    Voice*             voices;
+    int                voiceCount;
+    uint32_t           voiceAge;
+
+    int32_t            idx[BLOCK_FRAMES];
+    float              frac[BLOCK_FRAMES];
+    float              gain[BLOCK_FRAMES];
+};
+
+/* ============================================================================================ */
+
+static void setupAudioSamplerMeta(lua_State* L);
+
+static int pushAudioSamplerMeta(lua_State* L)
+{
+    if (luaL_newmetatable(L, AUDIO_SAMPLER_CLASS_NAME)) {
+        setupAudioSamplerMeta(L);
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static AudioSamplerUserData* checkAudioSamplerUdata(lua_State* L, int arg)
+{
+    AudioSamplerUserData* udata = luaL_checkudata(L, arg, AUDIO_SAMPLER_CLASS_NAME);
+    if (udata->auprocCapi) {
+        udata->auprocCapi->checkEngineIsNotClosed(L, udata->auprocEngine);
+    }
+    if (udata->closed) {
+        luaL_error(L, ERROR_INVALID_AUDIO_SAMPLER);
+        return NULL;
+    }
+    return udata;
+}
+
+/* ============================================================================================ */
+
+static Sample* newSample(int channels, uint32_t frames, double rate)
+{
+    uint32_t stride = frames + 2;
+    Sample*  s      = calloc(1, sizeof(Sample) + sizeof(float) * channels * stride);
+    if (s) {
+        s->frames   = frames;
+        s->stride   = stride;
+        s->channels = channels;
+        s->rate     = rate;
+    }
+    return s;
+}
+
+/* ============================================================================================ */
+
+static void stopVoice(Voice* v)
+{
+    atomic_dec(&v->sample->voices);
+    v->active = false;
+}
+
+static void startRelease(Voice* v)
+{
+    if (v->releaseFrames > 0) {
+        v->releasing    = true;
+        v->releaseLeft  = v->releaseFrames;
+        v->releaseDelta = v->amp / v->releaseFrames;
+    } else {
+        stopVoice(v);
+    }
+}
+
+/**
+ * Returns a free voice or steals a voice: the quietest releasing voice or,
+ * if no voice is releasing, the oldest voice.
+ */
+static Voice* allocVoice(AudioSamplerUserData* udata)
+{
+    Voice* rslt = NULL;
+    for (int i = 0; i < udata->voiceCount; ++i) {
+        Voice* v = &udata->voices[i];
+        if (!v->active) {
+            return v;
+        }
+        if (!rslt) {
+            rslt = v;
+        } else if (v->releasing) {
+            if (!rslt->releasing || v->amp < rslt->amp) {
+                rslt = v;
+            }
+        } else if (!rslt->releasing && v->age - rslt->age > UINT32_MAX / 2) {
+            rslt = v; /* v is older than rslt, age counter may wrap around */
+        }
+    }
+    return rslt;
+}
+
+static void noteOn(AudioSamplerUserData* udata, const KeyMap* keyMap, int channel, int note, int velocity)
+{
+    const Zone* zone = &keyMap->zones[note];
+    if (!zone->sample) {
+        return;
+    }
+    for (int i = 0; i < udata->voiceCount; ++i) {
+        Voice* v = &udata->voices[i];
+        if (v->active && !v->releasing && !v->oneshot && v->note == note && v->channel == channel) {
+            startRelease(v);
+        }
+    }
+    Voice* v = allocVoice(udata);
+    if (v->active) {
+        stopVoice(v);
+    }
+    atomic_inc(&zone->sample->voices);
+
+    v->sample        = zone->sample;
+    v->pos           = 0;
+    v->step          = zone->sample->rate / udata->sampleRate * exp2((note - zone->root) / 12.0);
+    v->amp           = zone->gain * velocity / 127.0f;
+    v->releaseFrames = zone->releaseFrames;
+    v->releaseLeft   = 0;
+    v->releaseDelta  = 0;
+    v->age           = udata->voiceAge++;
+    v->note          = note;
+    v->channel       = channel;
+    v->oneshot       = zone->oneshot;
+    v->releasing     = false;
+    v->active        = true;
+}
+
+static void noteOff(AudioSamplerUserData* udata, int channel, int note)
+{
+    for (int i = 0; i < udata->voiceCount; ++i) {
+        Voice* v = &udata->voices[i];
+        if (v->active && !v->releasing && !v->oneshot && v->note == note && v->channel == channel) {
+            startRelease(v);
+        }
+    }
+}
+
+static void allNotesOff(AudioSamplerUserData* udata, int channel, bool immediately)
+{
+    for (int i = 0; i < udata->voiceCount; ++i) {
+        Voice* v = &udata->voices[i];
+        if (v->active && v->channel == channel) {
+            if (immediately) {
+                stopVoice(v);
+            } else if (!v->releasing && !v->oneshot) {
+                startRelease(v);
+            }
+        }
+    }
+}
+
+/* ============================================================================================ */
+
+/**
+ * Adds the voice to the outputs from frame begin to end. If the voice plays
+ * at the original rate from an integer position, the sample frames are mixed
+ * with Vec4 operations. Otherwise the sample positions, interpolation factors
+ * and gains are computed once per block for all output channels and the
+ * interpolated frames are read one by one.
+ */
+static void renderVoice(AudioSamplerUserData* udata, Voice* v, uint32_t begin, uint32_t end)
+{
+    const Sample*    sample = v->sample;
+    int32_t* restrict idx   = udata->idx;
+    float*   restrict frac  = udata->frac;
+    float*   restrict gain  = udata->gain;
+
+    while (begin < end && v->active)
+    {
+        uint32_t n    = (end - begin < BLOCK_FRAMES) ? end - begin : BLOCK_FRAMES;
+        double   left = ceil((sample->frames - v->pos) / v->step);
+        uint32_t m    = (left < n) ? (uint32_t)left : n;
+        float    dAmp = 0;
+        if (v->releasing) {
+            m    = (v->releaseLeft < m) ? v->releaseLeft : m;
+            dAmp = -v->releaseDelta;
+        }
+        const float  amp  = v->amp;
+        const double pos  = v->pos;
+        const double step = v->step;
+        const bool   contiguous = (step == 1.0 && pos == (int32_t)pos);
+
+        if (contiguous) {
+            for (int o = 0; o < udata->outCount; ++o) {
+                const float* s = sample->data + (o % sample->channels) * sample->stride;
+                vec4_mix_ramp(udata->outBufs[o] + begin, s + (int32_t)pos, m, amp, dAmp);
+            }
+        } else {
+            for (uint32_t i = 0; i < m; ++i) {
+                double p = pos + i * step;
+                idx[i]  = (int32_t)p;
+                frac[i] = p - idx[i];
+                gain[i] = amp + i * dAmp;
+            }
+            for (int o = 0; o < udata->outCount; ++o) {
+                const float* restrict s   = sample->data + (o % sample->channels) * sample->stride;
+                float*       restrict out = udata->outBufs[o] + begin;
+                for (uint32_t i = 0; i < m; ++i) {
+                    float a = s[idx[i]];
+                    float b = s[idx[i] + 1];
+                    out[i] += gain[i] * (a + frac[i] * (b - a));
+                }
+            }
+        }
+        v->pos += m * step;
+        v->amp += m * dAmp;
+        begin  += m;
+        if (v->releasing) {
+            v->releaseLeft -= m;
+        }
+        if (m < n || v->pos >= sample->frames || (v->releasing && v->releaseLeft == 0)) {
+            stopVoice(v);
+        }
+    }
+}
+
+static void renderVoices(AudioSamplerUserData* udata, uint32_t begin, uint32_t end)
+{
+    for (int i = 0; i < udata->voiceCount; ++i) {
+        if (udata->voices[i].active) {
+            renderVoice(udata, &udata->voices[i], begin, end);
+        }
+    }
+}
+
+/* ============================================================================================ */
+
+static int processCallback(uint32_t nframes, void* processorData)
+{
+    AudioSamplerUserData* udata = (AudioSamplerUserData*) processorData;
+    const auproc_capi*    capi  = udata->auprocCapi;
+    const int             n     = udata->outCount;
+
+    bool          keyMapChanged = atomic_snapshot_update(&udata->keyMaps);
+    const KeyMap* keyMap        = atomic_snapshot_current(&udata->keyMaps);
+    if (keyMapChanged) {
+        atomic_set(&udata->usedGeneration, keyMap->generation);
+    }
+
+    bool sounding = false;
+    for (int i = 0; i < udata->voiceCount; ++i) {
+        if (udata->voices[i].active) {
+            sounding = true;
+            break;
+        }
+    }
+    for (int o = 0; o < n; ++o) {
+        udata->outBufs[o] = udata->outMethods[o]->getAudioBuffer(udata->outConnectors[o], nframes);
+        memset(udata->outBufs[o], 0, sizeof(float) * nframes);
+    }
+
+    const auproc_midimeth* midiMethods = udata->midiMethods;
+    auproc_midibuf*        midiBuf     = midiMethods->getMidiBuffer(udata->midiConnector, nframes);
+    uint32_t               eventCount  = midiMethods->getEventCount(midiBuf);
+    auproc_midi_event      event;
+    uint32_t               pos = 0;
+
+    for (uint32_t e = 0; e < eventCount; ++e) {
+        midiMethods->getMidiEvent(&event, midiBuf, e);
+        if (event.size < 3) {
+            continue;
+        }
+        int status  = event.buffer[0] & 0xF0;
+        int channel = event.buffer[0] & 0x0F;
+        int data1   = event.buffer[1] & 0x7F;
+        int data2   = event.buffer[2] & 0x7F;
+        if ((status != 0x90 && status != 0x80 && status != 0xB0)
+         || (udata->channel >= 0 && channel != udata->channel))
+        {
+            continue;
+        }
+        uint32_t t = (event.time < nframes) ? event.time : nframes;
+        if (t > pos) {
+            if (sounding) {
+                renderVoices(udata, pos, t);
+            }
+            pos = t;
+        }
+        if (status == 0x90 && data2 > 0) {
+            noteOn(udata, keyMap, channel, data1, data2);
+            sounding = true;
+        }
+        else if (status == 0x90 || status == 0x80) {
+            noteOff(udata, channel, data1);
+        }
+        else if (data1 == 120 || data1 == 123) {
+            allNotesOff(udata, channel, data1 == 120);   /* all sound off, all notes off */
+        }
+    }
+    if (pos < nframes && sounding) {
+        renderVoices(udata, pos, nframes);
+    }
+    if (!sounding) {
+        for (int o = 0; o < n; ++o) {
+            auproc_set_silent(capi, udata->outMethods[o], udata->outConnectors[o], true);
+        }
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static void engineClosedCallback(void* processorData)
+{
+    AudioSamplerUserData* udata = (AudioSamplerUserData*) processorData;
+
+    udata->closed    = true;
+    udata->activated = false;
+}
+
+static void engineReleasedCallback(void* processorData)
+{
+    AudioSamplerUserData* udata = (AudioSamplerUserData*) processorData;
+
+    udata->closed       = true;
+    udata->activated    = false;
+    udata->auprocCapi    = NULL;
+    udata->auprocEngine  = NULL;
+}
+
+/* ============================================================================================ */
+
+static int AudioSampler_new(lua_State* L)
+{
+    const int firstArg = 1;
+    const int lastArg  = lua_gettop(L);
+
+    AudioSamplerUserData* udata = lua_newuserdata(L, sizeof(AudioSamplerUserData));
+    memset(udata, 0, sizeof(AudioSamplerUserData));
+    udata->className = AUDIO_SAMPLER_CLASS_NAME;
+    pushAudioSamplerMeta(L);                              /* -> udata, meta */
+    lua_setmetatable(L, -2);                              /* -> udata */
+    int versionError = 0;
+    const auproc_capi* capi = auproc_get_capi(L, firstArg, &versionError);
+    auproc_engine* engine = NULL;
+    auproc_info    info   = {0};
+    if (capi) {
+        engine = capi->getEngine(L, firstArg, &info);
+    }
+    if (!capi || !engine) {
+        if (versionError) {
+            return luaL_argerror(L, firstArg, "auproc capi version mismatch");
+        } else {
+            return luaL_argerror(L, firstArg, "expected connector object");
+        }
+    }
+    if (info.sampleRate == 0) {
+        return luaL_argerror(L, firstArg, "cannot determine sample rate");
+    }
+    const int firstConArg = (capi->getObjectType(L, firstArg) == AUPROC_TENGINE) ? firstArg + 1 : firstArg;
+    int lastConArg = lastArg;
+    for (int i = firstConArg; i <= lastArg; ++i) {
+        if (!capi->getConnectorType(L, i)) {
+            lastConArg = i - 1;
+            break;
+        }
+    }
+    const int conCount = lastConArg - firstConArg + 1;
+    const int optArg   = lastConArg + 1;
+    const int n        = conCount - 1;
+
+    if (n < 1 || n > MAX_OUTPUTS) {
+        return luaL_argerror(L, firstConArg, "expected one MIDI IN connector object and "
+                                             "1 to 8 AUDIO OUT connector objects");
+    }
+    lua_Number voices  = 16;
+    lua_Number channel = 0;
+
+    if (optArg <= lastArg && !lua_isnil(L, optArg)) {
+        luaL_checktype(L, optArg, LUA_TTABLE);
+        voices  = auproc_util_opt_number_field(L, optArg, "voices",  voices);
+        channel = auproc_util_opt_number_field(L, optArg, "channel", channel);
+    }
+    luaL_argcheck(L, voices >= 1 && voices <= MAX_VOICES, optArg, "invalid value for field 'voices'");
+    luaL_argcheck(L, channel >= 0 && channel <= 16,       optArg, "invalid value for field 'channel'");
+
+    udata->sampleRate = info.sampleRate;
+    udata->outCount   = n;
+    udata->channel    = (int)channel - 1;
+    udata->voiceCount = (int)voices;
+    udata->voices     = calloc(udata->voiceCount, sizeof(Voice));
+    if (!udata->voices || !atomic_snapshot_init(&udata->keyMaps, sizeof(KeyMap))) {
+        return luaL_error(L, "out of memory");
+    }
+
+    const char* processorName = lua_pushfstring(L, "%s: %p", AUDIO_SAMPLER_CLASS_NAME, udata);   /* -> udata, name */
+
+    auproc_con_reg conRegs[1 + MAX_OUTPUTS];
+    conRegs[0] = (auproc_con_reg){AUPROC_MIDI, AUPROC_IN, NULL};
+    for (int o = 0; o < n; ++o) {
+        conRegs[1 + o] = (auproc_con_reg){AUPROC_AUDIO, AUPROC_OUT, NULL};
+    }
+    auproc_con_reg_err regError = {0};
+    auproc_processor* proc = capi->registerProcessor(L, firstConArg, conCount, engine, processorName, udata,
+                                                         processCallback, NULL, engineClosedCallback, engineReleasedCallback,
+                                                         conRegs, &regError);
+    lua_pop(L, 1); /* -> udata */
+
+    if (!proc)
+    {
+        if (regError.conIndex >= 0)
+        {
+            int errArg = firstConArg + regError.conIndex;
+
+            if (regError.errorType == AUPROC_REG_ERR_CONNCTOR_INVALID)
+            {
+                return luaL_argerror(L, errArg, "invalid connector object");
+            }
+            if (   regError.errorType == AUPROC_REG_ERR_ENGINE_MISMATCH)
+            {
+                const char* msg = lua_pushfstring(L, "connector belongs to other %s",
+                                                     capi->engine_category_name);
+                return luaL_argerror(L, errArg, msg);
+            }
+            if (regError.errorType == AUPROC_REG_ERR_ARG_INVALID
+             || regError.errorType == AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE)
+            {
+                if (errArg == firstConArg) {
+                    return luaL_argerror(L, errArg, "expected MIDI IN connector");
+                } else {
+                    return luaL_argerror(L, errArg, "expected AUDIO OUT connector");
+                }
+            }
+            if (regError.errorType == AUPROC_REG_ERR_WRONG_DIRECTION)
+            {
+                if (errArg == firstConArg) {
+                    return luaL_argerror(L, errArg, "given connector is not readable");
+                } else {
+                    return luaL_argerror(L, errArg, "given connector is not writable");
+                }
+            }
+        }
+        return luaL_error(L, "cannot register processor (err=%d)", regError.errorType);
+    }
+
+    udata->processor     = proc;
+    udata->activated     = false;
+    udata->auprocCapi    = capi;
+    udata->auprocEngine  = engine;
+    udata->midiConnector = conRegs[0].connector;
+    udata->midiMethods   = conRegs[0].midiMethods;
+
+    for (int o = 0; o < n; ++o) {
+        udata->outConnectors[o] = conRegs[1 + o].connector;
+        udata->outMethods[o]    = conRegs[1 + o].audioMethods;
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int AudioSampler_release(lua_State* L)
+{
+    AudioSamplerUserData* udata = luaL_checkudata(L, 1, AUDIO_SAMPLER_CLASS_NAME);
+    udata->closed    = true;
+    udata->activated = false;
+    if (udata->auprocCapi) {
+        udata->auprocCapi->unregisterProcessor(L, udata->auprocEngine, udata->processor);
+        udata->processor   = NULL;
+        udata->auprocCapi   = NULL;
+        udata->auprocEngine = NULL;
+    }
+    while (udata->samples) {
+        Sample* s = udata->samples;
+        udata->samples = s->next;
+        free(s);
+    }
+    if (udata->voices) {
+        free(udata->voices);
+        udata->voices = NULL;
+    }
+    udata->voiceCount = 0;
+    atomic_snapshot_free(&udata->keyMaps);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioSampler_toString(lua_State* L)
+{
+    AudioSamplerUserData* udata = luaL_checkudata(L, 1, AUDIO_SAMPLER_CLASS_NAME);
+
+    lua_pushfstring(L, "%s: %p", AUDIO_SAMPLER_CLASS_NAME, udata);
+
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static uint32_t readUInt(const unsigned char* p, int n)
+{
+    uint32_t rslt = 0;
+    for (int i = n - 1; i >= 0; --i) {
+        rslt = (rslt << 8) | p[i];
+    }
+    return rslt;
+}
+
+static float readSample(const unsigned char* p, int bits, bool isFloat)
+{
+    if (isFloat) {
+        uint32_t u = readUInt(p, 4);
+        float    f;
+        memcpy(&f, &u, sizeof(float));
+        return f;
+    }
+    switch (bits) {
+        case 8:  return (p[0] - 128) / 128.0f;
+        case 16: return (int16_t)readUInt(p, 2) / 32768.0f;
+        case 24: return ((int32_t)(readUInt(p, 3) << 8) >> 8) / 8388608.0f;
+        default: return (int32_t)readUInt(p, 4) / 2147483648.0f;
+    }
+}
+
+/**
+ * Loads a WAV file with 8, 16, 24 or 32 bit integer or 32 bit float samples.
+ */
+static Sample* loadWavFile(lua_State* L, const char* fileName)
+{
+    /* the file is never open while a Lua error can be raised */
+    FILE* file = fopen(fileName, "rb");
+    if (!file) {
+        luaL_error(L, "cannot open file '%s': %s", fileName, strerror(errno));
+        return NULL;
+    }
+    long pos = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        pos = ftell(file);
+    }
+    fclose(file);
+    if (pos <= 0) {
+        luaL_error(L, "cannot read file '%s'", fileName);
+        return NULL;
+    }
+    size_t         fileSize = pos;
+    unsigned char* fileData = lua_newuserdata(L, fileSize);       /* -> fileData */
+    file = fopen(fileName, "rb");
+    if (file) {
+        if (fread(fileData, 1, fileSize, file) != fileSize) {
+            fileData = NULL;
+        }
+        fclose(file);
+    } else {
+        fileData = NULL;
+    }
+    if (!fileData) {
+        luaL_error(L, "cannot read file '%s'", fileName);
+        return NULL;
+    }
+    if (fileSize < 12 || memcmp(fileData, "RIFF", 4) != 0 || memcmp(fileData + 8, "WAVE", 4) != 0) {
+        luaL_error(L, "invalid wav file '%s'", fileName);
+        return NULL;
+    }
+    const unsigned char* p       = fileData + 12;
+    const unsigned char* end     = fileData + fileSize;
+    const unsigned char* fmt     = NULL;
+    uint32_t             fmtLen  = 0;
+    const unsigned char* data    = NULL;
+    uint32_t             dataLen = 0;
+
+    while (end - p >= 8) {
+        uint32_t len = readUInt(p + 4, 4);
+        if (len > (size_t)(end - p) - 8) {
+            len = (end - p) - 8;
+        }
+        if (memcmp(p, "fmt ", 4) == 0 && len >= 16) {
+            fmt    = p + 8;
+            fmtLen = len;
+        }
+        else if (memcmp(p, "data", 4) == 0) {
+            data    = p + 8;
+            dataLen = len;
+        }
+        p += 8 + len + (len & 1);
+    }
+    if (!fmt || !data) {
+        luaL_error(L, "invalid wav file '%s'", fileName);
+        return NULL;
+    }
+    int      format   = readUInt(fmt +  0, 2);
+    int      channels = readUInt(fmt +  2, 2);
+    uint32_t rate     = readUInt(fmt +  4, 4);
+    int      bits     = readUInt(fmt + 14, 2);
+    if (format == 0xFFFE && fmtLen >= 26) {
+        format = readUInt(fmt + 24, 2); /* WAVE_FORMAT_EXTENSIBLE: sub format */
+    }
+    bool isFloat = (format == 3);
+    if (   (format != 1 && format != 3) || (isFloat && bits != 32)
+        || (bits != 8 && bits != 16 && bits != 24 && bits != 32)
+        || channels < 1 || channels > MAX_CHANNELS || rate == 0)
+    {
+        luaL_error(L, "unsupported wav file format in '%s'", fileName);
+        return NULL;
+    }
+    int      frameSize = channels * bits / 8;
+    uint32_t frames    = dataLen / frameSize;
+
+    Sample* s = newSample(channels, frames, rate);
+    if (!s) {
+        luaL_error(L, "out of memory");
+        return NULL;
+    }
+    for (uint32_t i = 0; i < frames; ++i) {
+        for (int c = 0; c < channels; ++c) {
+            s->data[c * s->stride + i] = readSample(data + i * frameSize + c * bits / 8, bits, isFloat);
+        }
+    }
+    lua_pop(L, 1);                                                /* -> */
+    return s;
+}
+
+/**
+ * Loads sample data from a table of numbers or from a table with one table
+ * of numbers for each channel.
+ */
+static Sample* loadTable(lua_State* L, int arg, double rate)
+{
+    lua_rawgeti(L, arg, 1);                                       /* -> first */
+    bool multi = lua_istable(L, -1);
+    lua_pop(L, 1);                                                /* -> */
+
+    int         channels = multi ? luaL_len(L, arg) : 1;
+    lua_Integer frames   = multi ? -1 : luaL_len(L, arg);
+
+    luaL_argcheck(L, channels >= 1 && channels <= MAX_CHANNELS, arg, "invalid number of channels");
+    for (int c = 0; c < channels; ++c) {
+        if (multi) {
+            lua_rawgeti(L, arg, c + 1);                           /* -> channel */
+            if (!lua_istable(L, -1)) {
+                luaL_argerror(L, arg, "table of numbers expected for each channel");
+            }
+            if (frames < 0) {
+                frames = luaL_len(L, -1);
+            } else if (luaL_len(L, -1) != frames) {
+                luaL_argerror(L, arg, "channels must have the same length");
+            }
+        } else {
+            lua_pushvalue(L, arg);                                /* -> channel */
+        }
+        for (lua_Integer i = 1; i <= frames; ++i) {
+            lua_rawgeti(L, -1, i);                                /* -> channel, value */
+            if (!lua_isnumber(L, -1)) {
+                luaL_argerror(L, arg, "table of numbers expected");
+            }
+            lua_pop(L, 1);                                        /* -> channel */
+        }
+        lua_pop(L, 1);                                            /* -> */
+    }
+    luaL_argcheck(L, frames < UINT32_MAX, arg, "sample is too long");
+
+    Sample* s = newSample(channels, frames, rate);
+    if (!s) {
+        luaL_error(L, "out of memory");
+        return NULL;
+    }
+    for (int c = 0; c < channels; ++c) {
+        if (multi) {
+            lua_rawgeti(L, arg, c + 1);                           /* -> channel */
+        } else {
+            lua_pushvalue(L, arg);                                /* -> channel */
+        }
+        for (lua_Integer i = 1; i <= frames; ++i) {
+            lua_rawgeti(L, -1, i);                                /* -> channel, value */
+            s->data[c * s->stride + i - 1] = lua_tonumber(L, -1);
+            lua_pop(L, 1);                                        /* -> channel */
+        }
+        lua_pop(L, 1);                                            /* -> */
+    }
+    return s;
+}
+
+static bool isMapped(const KeyMap* keyMap, const Sample* s)
+{
+    for (int note = 0; note < 128; ++note) {
+        if (keyMap->zones[note].sample == s) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Frees the samples that the process callback cannot play any more: the
+ * sample is not mapped in the key map that the process callback uses and no
+ * voice is playing it. The usedGeneration is read before the voice counters,
+ * so that voices started with an older key map are counted.
+ */
+static void freeUnusedSamples(AudioSamplerUserData* udata)
+{
+    const int used = atomic_get(&udata->usedGeneration);
+    Sample**  ps   = &udata->samples;
+    while (*ps) {
+        Sample* s = *ps;
+        if (!s->unmapped && !isMapped(&udata->keyMap, s)) {
+            s->unmapped = udata->keyMap.generation;
+        }
+        if (s->unmapped && used >= s->unmapped && atomic_get(&s->voices) == 0) {
+            *ps = s->next;
+            free(s);
+        } else {
+            ps = &s->next;
+        }
+    }
+}
+
+static int AudioSampler_load(lua_State* L)
+{
+    AudioSamplerUserData* udata = checkAudioSamplerUdata(L, 1);
+    const int arg    = 2;
+    const int optArg = 3;
+
+    lua_Number root    = 60;
+    lua_Number low     = 0;
+    lua_Number high    = 127;
+    lua_Number gain    = 1.0;
+    lua_Number release = 0.01;
+    lua_Number rate    = udata->sampleRate;
+    bool       oneshot = false;
+
+    if (!lua_isnoneornil(L, optArg)) {
+        luaL_checktype(L, optArg, LUA_TTABLE);
+        root    = auproc_util_opt_number_field(L, optArg, "root",    root);
+        low     = auproc_util_opt_number_field(L, optArg, "low",     low);
+        high    = auproc_util_opt_number_field(L, optArg, "high",    high);
+        gain    = auproc_util_opt_number_field(L, optArg, "gain",    gain);
+        release = auproc_util_opt_number_field(L, optArg, "release", release);
+        rate    = auproc_util_opt_number_field(L, optArg, "rate",    rate);
+        lua_getfield(L, optArg, "oneshot");               /* -> oneshot */
+        oneshot = lua_toboolean(L, -1);
+        lua_pop(L, 1);                                    /* -> */
+    }
+    luaL_argcheck(L, root >= 0 && root <= 127,        optArg, "invalid value for field 'root'");
+    luaL_argcheck(L, low  >= 0 && low  <= 127,        optArg, "invalid value for field 'low'");
+    luaL_argcheck(L, high >= low && high <= 127,      optArg, "invalid value for field 'high'");
+    luaL_argcheck(L, gain >= 0,                       optArg, "invalid value for field 'gain'");
+    luaL_argcheck(L, release >= 0 && release <= 3600, optArg, "invalid value for field 'release'");
+    luaL_argcheck(L, rate > 0,                        optArg, "invalid value for field 'rate'");
+
+    Sample* s = NULL;
+    if (lua_type(L, arg) == LUA_TSTRING) {
+        s = loadWavFile(L, lua_tostring(L, arg));
+    }
+    else if (lua_istable(L, arg)) {
+        s = loadTable(L, arg, rate);
+    }
+    else {
+        return luaL_argerror(L, arg, "file name or table expected");
+    }
+    s->next = udata->samples;
+    udata->samples = s;
+
+    for (int note = low; note <= high; ++note) {
+        Zone* zone = &udata->keyMap.zones[note];
+        zone->sample        = s;
+        zone->root          = root;
+        zone->gain          = gain;
+        zone->releaseFrames = (uint32_t)(release * udata->sampleRate + 0.5);
+        zone->oneshot       = oneshot;
+    }
+    udata->keyMap.generation += 1;
+    KeyMap* slot = atomic_snapshot_begin(&udata->keyMaps);
+    memcpy(slot, &udata->keyMap, sizeof(KeyMap));
+    atomic_snapshot_publish(&udata->keyMaps, slot);
+
+    freeUnusedSamples(udata);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioSampler_activate(lua_State* L)
+{
+    AudioSamplerUserData* udata = checkAudioSamplerUdata(L, 1);
+    if (!udata->activated) {
+        udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = true;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int AudioSampler_deactivate(lua_State* L)
+{
+    AudioSamplerUserData* udata = checkAudioSamplerUdata(L, 1);
+    if (udata->activated) {
+        udata->auprocCapi->deactivateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = false;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static const luaL_Reg AudioSamplerMethods[] =
+{
+    { "load",        AudioSampler_load },
+    { "activate",    AudioSampler_activate },
+    { "deactivate",  AudioSampler_deactivate },
+    { "close",       AudioSampler_release },
+    { NULL,          NULL } /* sentinel */
+};
+
+static const luaL_Reg AudioSamplerMetaMethods[] =
+{
+    { "__tostring", AudioSampler_toString },
+    { "__gc",       AudioSampler_release  },
+
+    { NULL,       NULL } /* sentinel */
+};
+
+static const luaL_Reg ModuleFunctions[] =
+{
+    { "new_audio_sampler", AudioSampler_new },
+    { NULL,                NULL } /* sentinel */
+};
+
+/* ============================================================================================ */
+
+static void setupAudioSamplerMeta(lua_State* L)
+{                                                          /* -> meta */
+    lua_pushstring(L, AUDIO_SAMPLER_CLASS_NAME);           /* -> meta, className */
+    lua_setfield(L, -2, "__metatable");                    /* -> meta */
+
+    luaL_setfuncs(L, AudioSamplerMetaMethods, 0);          /* -> meta */
+
+    lua_newtable(L);                                       /* -> meta, AudioSamplerClass */
+    luaL_setfuncs(L, AudioSamplerMethods, 0);              /* -> meta, AudioSamplerClass */
+    lua_setfield (L, -2, "__index");                       /* -> meta */
+}
+
+
+/* ============================================================================================ */
+
+int auproc_audio_sampler_init_module(lua_State* L, int module)
+{
+    if (luaL_newmetatable(L, AUDIO_SAMPLER_CLASS_NAME)) {
+        setupAudioSamplerMeta(L);
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, module);
+        luaL_setfuncs(L, ModuleFunctions, 0);
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+/* ============================================================================================ */
@@ -1,4 +1,5 @@
 #include "audio_sender.h"
+#include "resampler.h"
 
 #define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
 #include "auproc_capi.h"
@@ -14,6 +15,8 @@ static const char* ERROR_INVALID_AUDIO_SENDER = "invalid auproc.audio_sender";
 
 /* ============================================================================================ */
 
+#define RESAMPLER_TAPS 32
+
 typedef struct AudioSenderUserData AudioSenderUserData;
 
 struct AudioSenderUserData
@@ -38,6 +41,11 @@ struct AudioSenderUserData
     uint32_t           eventStartFrame;
     uint32_t           eventEndFrame;
     const float*       eventData;
+    uint32_t           eventRemaining;
+
+    bool               resampling;
+    Resampler          resampler;
+    uint32_t           idleFrames;    /* zero frames fed since the last chunk, up to RESAMPLER_TAPS */
     
     float* uuu;
 };
@@ -71,25 +79,16 @@ static AudioSenderUserData* checkAudioSenderUdata(lua_State* L, int arg)
 
 /* ============================================================================================ */
 
-static int processCallback(uint32_t nframes, void* processorData)
+/**
+ * Reads the next sample data chunk from the sender if there is no 
+ * current chunk.
+ */
+static void readNextEvent(AudioSenderUserData* udata, uint32_t f0)
 {
-    AudioSenderUserData*    udata      = (AudioSenderUserData*) processorData;
-    const auproc_capi*      auprocCapi = udata->auprocCapi;
-    const auproc_audiometh* methods    = udata->audioMethods;
-    
-    float*  outBuf  = methods->getAudioBuffer(udata->audioOutConnector, nframes);
-    udata->uuu = outBuf;
-    
-    memset(outBuf, 0, sizeof(float) * nframes);
-    
     const sender_capi* senderCapi = udata->senderCapi;
     sender_object*     sender     = udata->sender;
     sender_reader*     reader     = udata->senderReader;
 
-    uint32_t f0 = auprocCapi->getProcessBeginFrameTime(udata->auprocEngine);
-    uint32_t f1 = f0 + nframes;
-
-nextEvent:
     if (!udata->hasNextEvent) {
         int rc = senderCapi->nextMessageFromSender(sender, reader,
                                                    false /* nonblock */, 0 /* timeout */,
@@ -118,12 +117,102 @@ nextEvent:
                     udata->eventStartFrame = t;
                     udata->eventEndFrame   = udata->eventStartFrame + senderValue.arrayVal.elementCount;
                     udata->eventData       = senderValue.arrayVal.data;
+                    udata->eventRemaining  = senderValue.arrayVal.elementCount;
                 } else {
                     senderCapi->clearReader(reader);
                 }
             }
         }
     }
+}
+
+/**
+ * Sample data chunks are resampled as one continuous stream. If no chunk 
+ * is due, the resampler is fed with silence. If a chunk becomes due while
+ * the stream is idle and its start frame has already passed, the expired
+ * frames are skipped like in the direct path. Returns true if the output
+ * is silent.
+ */
+static bool processResampled(AudioSenderUserData* udata, float* outBuf, uint32_t f0, uint32_t nframes)
+{
+    Resampler* rs       = &udata->resampler;
+    bool       silent   = (udata->idleFrames >= RESAMPLER_TAPS);
+    uint32_t   produced = 0;
+
+    while (produced < nframes) {
+        uint32_t t = f0 + produced;
+        readNextEvent(udata, t);
+
+        if (udata->hasNextEvent && (int32_t)(udata->eventStartFrame - t) <= 0) {
+            if (udata->idleFrames > 0) {
+                double expired = (double)(t - udata->eventStartFrame) * rs->step;
+                if (expired >= udata->eventRemaining) {
+                    udata->senderCapi->clearReader(udata->senderReader);
+                    udata->hasNextEvent = false;
+                    continue;
+                }
+                udata->eventData      += (uint32_t)expired;
+                udata->eventRemaining -= (uint32_t)expired;
+                udata->idleFrames      = 0;
+            }
+            uint32_t used = 0;
+            produced += auproc_resampler_process(rs, udata->eventData, udata->eventRemaining, &used,
+                                                 outBuf + produced, nframes - produced);
+            udata->eventData      += used;
+            udata->eventRemaining -= used;
+            if (udata->eventRemaining == 0) {
+                udata->senderCapi->clearReader(udata->senderReader);
+                udata->hasNextEvent = false;
+            }
+            silent = false;
+        } else {
+            uint32_t e = nframes;
+            if (udata->hasNextEvent && udata->eventStartFrame - f0 < nframes) {
+                e = udata->eventStartFrame - f0;
+            }
+            while (produced < e) {
+                uint32_t used = 0;
+                produced += auproc_resampler_process(rs, NULL, RESAMPLER_TAPS, &used,
+                                                     outBuf + produced, e - produced);
+                if (udata->idleFrames < RESAMPLER_TAPS) {
+                    udata->idleFrames += used;
+                }
+            }
+        }
+    }
+    return silent;
+}
+
+/* ============================================================================================ */
+
+static int processCallback(uint32_t nframes, void* processorData)
+{
+    AudioSenderUserData*    udata      = (AudioSenderUserData*) processorData;
+    const auproc_capi*      auprocCapi = udata->auprocCapi;
+    const auproc_audiometh* methods    = udata->audioMethods;
+    
+    float*  outBuf  = methods->getAudioBuffer(udata->audioOutConnector, nframes);
+    udata->uuu = outBuf;
+    
+    memset(outBuf, 0, sizeof(float) * nframes);
+    
+    const sender_capi* senderCapi = udata->senderCapi;
+    sender_object*     sender     = udata->sender;
+    sender_reader*     reader     = udata->senderReader;
+
+    uint32_t f0 = auprocCapi->getProcessBeginFrameTime(udata->auprocEngine);
+    uint32_t f1 = f0 + nframes;
+    bool     silent = true;
+
+    if (udata->resampling) {
+        if (processResampled(udata, outBuf, f0, nframes)) {
+            auproc_set_silent(auprocCapi, methods, udata->audioOutConnector, true);
+        }
+        return 0;
+    }
+
+nextEvent:
+    readNextEvent(udata, f0);
 
     if (udata->hasNextEvent) {
         uint32_t s  = udata->eventStartFrame;
@@ -138,6 +227,7 @@ nextEvent:
             }
             if (e > s) {
                 memcpy(outBuf + (s - f0), udata->eventData, (e - s) * sizeof(float));
+                silent = false;
             }
             if (e < udata->eventEndFrame) {
                 udata->eventData += (e - s);
@@ -153,6 +243,9 @@ nextEvent:
             }
         }
     }
+    if (silent) {
+        auproc_set_silent(auprocCapi, methods, udata->audioOutConnector, true);
+    }
     return 0;
 }
 
@@ -182,6 +275,7 @@ static int AudioSender_new(lua_State* L)
 {
     const int conArg  = 1;
     const int sndrArg = 2;
+    const int rateArg = 3;
     AudioSenderUserData* udata = lua_newuserdata(L, sizeof(AudioSenderUserData));
     memset(udata, 0, sizeof(AudioSenderUserData));
     udata->className = AUDIO_SENDER_CLASS_NAME;
@@ -190,8 +284,9 @@ static int AudioSender_new(lua_State* L)
     int versionError = 0;
     const auproc_capi* capi = auproc_get_capi(L, conArg, &versionError);
     auproc_engine* engine = NULL;
+    auproc_info    info   = {0};
     if (capi) {
-        engine = capi->getEngine(L, conArg, NULL);
+        engine = capi->getEngine(L, conArg, &info);
     }
     if (!capi || !engine) {
         if (versionError) {
@@ -222,6 +317,20 @@ static int AudioSender_new(lua_State* L)
     if (!udata->senderReader) {
         return luaL_error(L, "out of memory");
     }
+    if (!lua_isnoneornil(L, rateArg)) {
+        lua_Number sampleRate = luaL_checknumber(L, rateArg);
+        luaL_argcheck(L, sampleRate > 0, rateArg, "positive sample rate expected");
+        if (info.sampleRate == 0) {
+            return luaL_argerror(L, conArg, "cannot determine sample rate");
+        }
+        if (sampleRate != info.sampleRate) {
+            if (!auproc_resampler_init(&udata->resampler, sampleRate, info.sampleRate, RESAMPLER_TAPS)) {
+                return luaL_error(L, "out of memory");
+            }
+            udata->resampling = true;
+            udata->idleFrames = RESAMPLER_TAPS;
+        }
+    }
     const char* processorName = lua_pushfstring(L, "%s: %p", AUDIO_SENDER_CLASS_NAME, udata);   /* -> udata, name */
     
     auproc_con_reg conReg = {AUPROC_AUDIO, AUPROC_OUT, NULL};
@@ -284,6 +393,10 @@ static int AudioSender_release(lua_State* L)
         udata->sender     = NULL;
         udata->senderCapi = NULL;
     }
+    if (udata->resampling) {
+        auproc_resampler_free(&udata->resampler);
+        udata->resampling = false;
+    }
     return 0;
 }
 
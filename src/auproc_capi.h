@@ -4,8 +4,17 @@
 #define AUPROC_CAPI_ID_STRING     "_capi_auproc"
 
 #define AUPROC_CAPI_VERSION_MAJOR  0
-#define AUPROC_CAPI_VERSION_MINOR  0
-#define AUPROC_CAPI_VERSION_PATCH  1
+#define AUPROC_CAPI_VERSION_MINOR  1
+#define AUPROC_CAPI_VERSION_PATCH  0
+
+/**
+ * Minimal minor version accepted by auproc_get_capi(). Version 0.1 only 
+ * adds the optional silence methods to auproc_audiometh, implementations
+ * of version 0.0 are therefore still accepted, see auproc_is_silent().
+ */
+#ifndef AUPROC_CAPI_REQUIRED_VERSION_MINOR
+#  define AUPROC_CAPI_REQUIRED_VERSION_MINOR 0
+#endif
 
 #ifndef AUPROC_CAPI_IMPLEMENT_SET_CAPI
 #  define AUPROC_CAPI_IMPLEMENT_SET_CAPI 0
@@ -131,6 +140,27 @@ struct auproc_audiometh
      * pointer is only valid until the call to processCallback returns.
      */
     float* (*getAudioBuffer)(auproc_connector* connector, uint32_t nframes);
+
+    /**
+     * Since version 0.1, may be NULL. Use auproc_is_silent() for calling.
+     *
+     * Returns true if the buffer of an AUDIO IN connector was marked as silent
+     * in the current process cycle by the processor writing into it, i.e. the
+     * buffer contains only zeros and the caller may skip reading it. This 
+     * function should only be called within the processCallback.
+     */
+    int (*isSilent)(auproc_connector* connector);
+
+    /**
+     * Since version 0.1, may be NULL. Use auproc_set_silent() for calling.
+     *
+     * Marks the buffer of an AUDIO OUT connector as silent for the current 
+     * process cycle. The caller must nevertheless fill the buffer with zeros,
+     * since the buffer may be read by consumers that do not query the silence 
+     * flag. The flag is reset by the engine at the beginning of each process
+     * cycle. This function should only be called within the processCallback.
+     */
+    void (*setSilent)(auproc_connector* connector, int silent);
 };
 
 
@@ -494,6 +524,29 @@ static int auproc_set_capi(lua_State* L, int index, const auproc_capi* capi)
 }
 #endif /* AUPROC_CAPI_IMPLEMENT_SET_CAPI */
 
+/**
+ * Returns true if the buffer of the AUDIO IN connector was marked as silent
+ * in the current process cycle. Returns false if the engine does not 
+ * implement the silence flag.
+ */
+static inline int auproc_is_silent(const auproc_capi* capi, const auproc_audiometh* methods,
+                                    auproc_connector* connector)
+{
+    return capi->version_minor >= 1 && methods->isSilent && methods->isSilent(connector);
+}
+
+/**
+ * Marks the buffer of the AUDIO OUT connector as silent for the current process
+ * cycle, if supported by the engine. The buffer must contain only zeros.
+ */
+static inline void auproc_set_silent(const auproc_capi* capi, const auproc_audiometh* methods,
+                                     auproc_connector* connector, int silent)
+{
+    if (capi->version_minor >= 1 && methods->setSilent) {
+        methods->setSilent(connector, silent);
+    }
+}
+
 #if AUPROC_CAPI_IMPLEMENT_GET_CAPI
 /**
  * Gives the associated Auproc C API for the object at the given stack index.
@@ -511,7 +564,7 @@ static const auproc_capi* auproc_get_capi(lua_State* L, int index, int* versionE
             const auproc_capi* capi = (const auproc_capi*) *udata;           /* -> _capi */
             while (capi) {
                 if (   capi->version_major == AUPROC_CAPI_VERSION_MAJOR
-                    && capi->version_minor >= AUPROC_CAPI_VERSION_MINOR)
+                    && capi->version_minor >= AUPROC_CAPI_REQUIRED_VERSION_MINOR)
                 {                                                            /* -> _capi */
                     lua_pop(L, 1);                                           /* -> */
                     return capi;
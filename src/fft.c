@@ -0,0 +1,203 @@
+#include "fft.h"
+
+/* ============================================================================================ */
+
+FftPlan* auproc_fft_new(uint32_t size)
+{
+    FftPlan* plan = calloc(1, sizeof(FftPlan));
+    if (!plan) {
+        return NULL;
+    }
+    plan->size       = size;
+    plan->bitReverse = malloc(sizeof(uint32_t) * size);
+    plan->cosTable     = malloc(sizeof(float) * (size / 2 + 1));
+    plan->sinTable     = malloc(sizeof(float) * (size / 2 + 1));
+    plan->realCosTable = malloc(sizeof(float) * (size / 2 + 1));
+    plan->realSinTable = malloc(sizeof(float) * (size / 2 + 1));
+    if (   !plan->bitReverse || !plan->cosTable || !plan->sinTable
+        || !plan->realCosTable || !plan->realSinTable)
+    {
+        auproc_fft_free(plan);
+        return NULL;
+    }
+    int bits = 0;
+    while ((1u << bits) < size) {
+        ++bits;
+    }
+    for (uint32_t i = 0; i < size; ++i) {
+        uint32_t r = 0;
+        for (int b = 0; b < bits; ++b) {
+            if (i & (1u << b)) {
+                r |= 1u << (bits - 1 - b);
+            }
+        }
+        plan->bitReverse[i] = r;
+    }
+    for (uint32_t i = 0; i < size / 2; ++i) {
+        plan->cosTable[i] = cos(2 * M_PI * i / size);
+        plan->sinTable[i] = sin(2 * M_PI * i / size);
+    }
+    for (uint32_t i = 0; i <= size / 2; ++i) {
+        plan->realCosTable[i] = cos(M_PI * i / size);
+        plan->realSinTable[i] = sin(M_PI * i / size);
+    }
+    return plan;
+}
+
+/* ============================================================================================ */
+
+void auproc_fft_free(FftPlan* plan)
+{
+    if (plan) {
+        if (plan->bitReverse)   free(plan->bitReverse);
+        if (plan->cosTable)     free(plan->cosTable);
+        if (plan->sinTable)     free(plan->sinTable);
+        if (plan->realCosTable) free(plan->realCosTable);
+        if (plan->realSinTable) free(plan->realSinTable);
+        free(plan);
+    }
+}
+
+/* ============================================================================================ */
+
+static void transform(const FftPlan* plan, float* re, float* im, float sign)
+{
+    const uint32_t n = plan->size;
+
+    for (uint32_t i = 0; i < n; ++i) {
+        uint32_t j = plan->bitReverse[i];
+        if (i < j) {
+            float t;
+            t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+    for (uint32_t len = 2; len <= n; len <<= 1) {
+        uint32_t half = len / 2;
+        uint32_t step = n / len;
+        for (uint32_t i = 0; i < n; i += len) {
+            for (uint32_t k = 0; k < half; ++k) {
+                float wr =        plan->cosTable[k * step];
+                float wi = sign * plan->sinTable[k * step];
+                uint32_t a = i + k;
+                uint32_t b = a + half;
+                float xr = re[b] * wr - im[b] * wi;
+                float xi = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - xr;
+                im[b] = im[a] - xi;
+                re[a] += xr;
+                im[a] += xi;
+            }
+        }
+    }
+}
+
+void auproc_fft_forward(const FftPlan* plan, float* re, float* im)
+{
+    transform(plan, re, im, -1);
+}
+
+void auproc_fft_inverse(const FftPlan* plan, float* re, float* im)
+{
+    transform(plan, re, im, 1);
+
+    const float scale = 1.0f / plan->size;
+    for (uint32_t i = 0; i < plan->size; ++i) {
+        re[i] *= scale;
+        im[i] *= scale;
+    }
+}
+
+/* ============================================================================================ */
+
+/**
+ * The packed values z[k] = x[2k] + i*x[2k+1] are transformed with the half
+ * size complex FFT. The spectrum X of x is obtained from the spectra of the
+ * even and odd values: Fe[k] = (Z[k] + conj(Z[n-k])) / 2, 
+ * Fo[k] = (Z[k] - conj(Z[n-k])) / 2i and X[k] = Fe[k] + W^k * Fo[k] with
+ * W = exp(-i*pi/n). Bins k and n-k are computed together.
+ */
+void auproc_fft_real_forward(const FftPlan* plan, float* re, float* im)
+{
+    const uint32_t n = plan->size;
+
+    transform(plan, re, im, -1);
+
+    float r0 = re[0];
+    float i0 = im[0];
+    re[0] = r0 + i0;
+    im[0] = 0;
+    re[n] = r0 - i0;
+    im[n] = 0;
+
+    for (uint32_t k = 1; k <= n / 2; ++k) {
+        uint32_t j      = n - k;
+        float    evenRe = (re[k] + re[j]) / 2;
+        float    evenIm = (im[k] - im[j]) / 2;
+        float    oddRe  = (im[k] + im[j]) / 2;
+        float    oddIm  = (re[j] - re[k]) / 2;
+        float    wr     =  plan->realCosTable[k];
+        float    wi     = -plan->realSinTable[k];
+        float    tr     = wr * oddRe - wi * oddIm;
+        float    ti     = wr * oddIm + wi * oddRe;
+        re[k] = evenRe + tr;
+        im[k] = evenIm + ti;
+        re[j] = evenRe - tr;
+        im[j] = ti - evenIm;
+    }
+}
+
+/**
+ * Reverses auproc_fft_real_forward: Z[k] = Fe[k] + i*Fo[k] with 
+ * Fe[k] = (X[k] + conj(X[n-k])) / 2 and Fo[k] = (X[k] - conj(X[n-k])) / (2 * W^k),
+ * the inverse half size complex FFT of Z gives the packed values.
+ */
+void auproc_fft_real_inverse(const FftPlan* plan, float* re, float* im)
+{
+    const uint32_t n = plan->size;
+
+    float r0 = re[0];
+    float rn = re[n];
+    re[0] = (r0 + rn) / 2;
+    im[0] = (r0 - rn) / 2;
+
+    for (uint32_t k = 1; k <= n / 2; ++k) {
+        uint32_t j      = n - k;
+        float    evenRe = (re[k] + re[j]) / 2;
+        float    evenIm = (im[k] - im[j]) / 2;
+        float    dRe    = (re[k] - re[j]) / 2;
+        float    dIm    = (im[k] + im[j]) / 2;
+        float    wr     = plan->realCosTable[k];
+        float    wi     = plan->realSinTable[k];
+        float    oddRe  = wr * dRe - wi * dIm;
+        float    oddIm  = wr * dIm + wi * dRe;
+        re[k] = evenRe - oddIm;
+        im[k] = evenIm + oddRe;
+        re[j] = evenRe + oddIm;
+        im[j] = oddRe - evenIm;
+    }
+    auproc_fft_inverse(plan, re, im);
+}
+
+/* ============================================================================================ */
+
+bool auproc_fft_window(float* w, uint32_t n, const char* name)
+{
+    for (uint32_t i = 0; i < n; ++i) {
+        double x = 2 * M_PI * i / n;
+        if (strcmp(name, "hann") == 0) {
+            w[i] = 0.5 - 0.5 * cos(x);
+        } else if (strcmp(name, "hamming") == 0) {
+            w[i] = 0.54 - 0.46 * cos(x);
+        } else if (strcmp(name, "blackman") == 0) {
+            w[i] = 0.42 - 0.5 * cos(x) + 0.08 * cos(2 * x);
+        } else if (strcmp(name, "rect") == 0) {
+            w[i] = 1;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* ============================================================================================ */
@@ -0,0 +1,67 @@
+#ifndef AUPROC_FFT_H
+#define AUPROC_FFT_H
+
+#include "util.h"
+
+typedef struct FftPlan FftPlan;
+
+/**
+ * Precomputed tables for an in-place radix-2 complex FFT. The plan may be 
+ * used concurrently by several threads. Creating and freeing a plan 
+ * allocates memory and must not be done in the realtime thread.
+ */
+struct FftPlan
+{
+    uint32_t  size;
+    uint32_t* bitReverse;
+    float*    cosTable;
+    float*    sinTable;
+    float*    realCosTable;  /* twiddle factors for auproc_fft_real_forward */
+    float*    realSinTable;
+};
+
+/**
+ * size - must be a power of two.
+ */
+FftPlan* auproc_fft_new(uint32_t size);
+
+void auproc_fft_free(FftPlan* plan);
+
+/**
+ * Forward transform of plan->size complex values, re and im are 
+ * transformed in place.
+ */
+void auproc_fft_forward(const FftPlan* plan, float* re, float* im);
+
+/**
+ * Inverse transform including the scaling by 1/size.
+ */
+void auproc_fft_inverse(const FftPlan* plan, float* re, float* im);
+
+/**
+ * Forward transform of 2 * plan->size real values x[0..2*size-1]. On input
+ * the values are packed into the complex values, i.e. re[k] = x[2*k] and 
+ * im[k] = x[2*k+1]. On output re[k] and im[k] contain the spectrum bins 
+ * k = 0..size, i.e. re and im must have plan->size + 1 elements.
+ */
+void auproc_fft_real_forward(const FftPlan* plan, float* re, float* im);
+
+/**
+ * Inverse of auproc_fft_real_forward including the scaling: on input re and im
+ * contain the spectrum bins 0..plan->size of 2 * plan->size real values, on 
+ * output the real values are packed, i.e. x[2*k] = re[k] and x[2*k+1] = im[k].
+ */
+void auproc_fft_real_inverse(const FftPlan* plan, float* re, float* im);
+
+/**
+ * Fills w with n values of the window function with the given name: 
+ * "hann", "hamming", "blackman" or "rect". Returns false for an unknown name.
+ */
+bool auproc_fft_window(float* w, uint32_t n, const char* name);
+
+static inline bool auproc_fft_is_valid_size(lua_Integer size)
+{
+    return size >= 2 && size <= (1 << 24) && (size & (size - 1)) == 0;
+}
+
+#endif // AUPROC_FFT_H
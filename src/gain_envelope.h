@@ -0,0 +1,105 @@
+#ifndef AUPROC_GAIN_ENVELOPE_H
+#define AUPROC_GAIN_ENVELOPE_H
+
+#include "util.h"
+
+/* -------------------------------------------------------------------------------------------- */
+
+typedef struct GainEnvelope        GainEnvelope;
+typedef struct GainEnvelopeCoeffs  GainEnvelopeCoeffs;
+
+/**
+ * Level triggered gain envelope with hysteresis and hold time. Used by
+ * the audio gate and the audio ducker.
+ *
+ * The envelope opens if the detector level reaches openLevel and stays
+ * open while the level is above closeLevel and for holdFrames afterwards.
+ * The gain ramps towards openGain while the envelope is open and towards
+ * closedGain otherwise.
+ */
+struct GainEnvelope
+{
+    bool      open;
+    uint32_t  holdCounter;
+    float     gain;
+};
+
+/**
+ * Each ramp is a one-pole smoothing with pole coeff (1 for none) followed
+ * by a linear step (0 for none) that is limited to the target gain.
+ */
+struct GainEnvelopeCoeffs
+{
+    float     openLevel;
+    float     closeLevel;
+    uint32_t  holdFrames;
+    float     openGain;
+    float     closedGain;
+    float     attackCoeff;
+    float     attackStep;
+    float     releaseCoeff;
+    float     releaseStep;
+};
+
+/**
+ * Sets det[i] to the maximum of det[i] and the absolute value of in[i].
+ */
+static inline void gain_envelope_peak(float* restrict det, const float* restrict in, uint32_t m)
+{
+    for (uint32_t i = 0; i < m; ++i) {
+        float a = fabsf(in[i]);
+        det[i] = (a > det[i]) ? a : det[i];
+    }
+}
+
+static inline float gain_envelope_ramp(float g, float target, float coeff, float step)
+{
+    g = coeff * g + (1 - coeff) * target;
+    if (g < target) {
+        g += step;
+        g = (g < target) ? g : target;
+    } else {
+        g -= step;
+        g = (g > target) ? g : target;
+    }
+    return g;
+}
+
+/**
+ * Computes the gains for the detector levels det[0..m-1].
+ * Returns the maximal gain.
+ */
+static inline float gain_envelope_compute(GainEnvelope* env, const GainEnvelopeCoeffs* c,
+                                          const float* det, float* gains, uint32_t m)
+{
+    float g   = env->gain;
+    float max = 0;
+
+    for (uint32_t i = 0; i < m; ++i) {
+        if (det[i] >= c->openLevel) {
+            env->open        = true;
+            env->holdCounter = c->holdFrames;
+        } else if (env->open && det[i] >= c->closeLevel) {
+            env->holdCounter = c->holdFrames;
+        } else if (env->open) {
+            if (env->holdCounter > 0) {
+                env->holdCounter -= 1;
+            } else {
+                env->open = false;
+            }
+        }
+        if (env->open) {
+            g = gain_envelope_ramp(g, c->openGain,   c->attackCoeff,  c->attackStep);
+        } else {
+            g = gain_envelope_ramp(g, c->closedGain, c->releaseCoeff, c->releaseStep);
+        }
+        gains[i] = g;
+        max = (g > max) ? g : max;
+    }
+    env->gain = g;
+    return max;
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+#endif /* AUPROC_GAIN_ENVELOPE_H */
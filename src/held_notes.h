@@ -0,0 +1,167 @@
+#ifndef AUPROC_HELD_NOTES_H
+#define AUPROC_HELD_NOTES_H
+
+#include "util.h"
+#include "auproc_capi.h"
+#include "async_util.h"
+
+/* -------------------------------------------------------------------------------------------- */
+
+typedef struct HeldNotes HeldNotes;
+
+/**
+ * Bitset of the notes that are currently held, one bit per channel and note.
+ * Used by midi processors for emitting exactly the needed note off events
+ * if notes would otherwise be stuck.
+ */
+struct HeldNotes
+{
+    uint32_t bits[16][4];
+};
+
+/**
+ * Updates the held notes for a midi event that is emitted on the given
+ * channel.
+ */
+static inline void held_notes_update(HeldNotes* held, int channel, const unsigned char* bytes, size_t size)
+{
+    if (size >= 3) {
+        int      type = bytes[0] & 0xF0;
+        int      note = bytes[1] & 0x7F;
+        uint32_t mask = ((uint32_t)1) << (note & 31);
+        if (type == 0x90 && bytes[2] > 0) {
+            held->bits[channel][note >> 5] |= mask;
+        } else if (type == 0x80 || type == 0x90) {
+            held->bits[channel][note >> 5] &= ~mask;
+        }
+    }
+}
+
+/**
+ * Emits note off events on outChannel for all notes held on the given
+ * channel and clears them.
+ */
+static inline void held_notes_release_channel(HeldNotes* held, int channel, int outChannel,
+                                              const auproc_midimeth* methods, auproc_midibuf* outBuf,
+                                              uint32_t t)
+{
+    for (int i = 0; i < 4; ++i) {
+        uint32_t bits = held->bits[channel][i];
+        for (int b = 0; bits != 0; ++b, bits >>= 1) {
+            if (bits & 1) {
+                unsigned char* data = methods->reserveMidiEvent(outBuf, t, 3);
+                if (data) {
+                    data[0] = 0x80 | outChannel;
+                    data[1] = i * 32 + b;
+                    data[2] = 0;
+                }
+            }
+        }
+        held->bits[channel][i] = 0;
+    }
+}
+
+/**
+ * Emits note off events for all held notes and clears them.
+ */
+static inline void held_notes_release(HeldNotes* held, const auproc_midimeth* methods,
+                                      auproc_midibuf* outBuf, uint32_t t)
+{
+    for (int c = 0; c < 16; ++c) {
+        held_notes_release_channel(held, c, c, methods, outBuf, t);
+    }
+}
+
+/*
+ * States for releasing held notes when a processor is deactivated or closed.
+ * The state is set by the Lua thread and advanced by the process callback.
+ * A deactivated processor stays active in the engine in the states
+ * HELD_NOTES_RELEASE and HELD_NOTES_RELEASED, so that the notes are released
+ * in the next process cycle without blocking the Lua thread.
+ */
+#define HELD_NOTES_RUNNING          0
+#define HELD_NOTES_RELEASE          1 /* release notes, then stay silent */
+#define HELD_NOTES_RELEASED         2 /* silent until next activation */
+#define HELD_NOTES_RELEASE_AND_RUN  3 /* release notes, then continue */
+
+/**
+ * Maximal time in milliseconds that a processor's close method waits
+ * for the process callback to release the held notes, e.g. if the engine
+ * is not running.
+ */
+#define HELD_NOTES_RELEASE_TIMEOUT 100
+
+/**
+ * Called by the deactivate method instead of deactivating the processor in
+ * the engine. The process callback releases the held notes in the next
+ * cycle and stays silent afterwards.
+ */
+static inline void held_notes_deactivated(AtomicCounter* state)
+{
+    atomic_set(state, HELD_NOTES_RELEASE);
+}
+
+/**
+ * Called by the activate method. If the notes have not been released since
+ * the last deactivation, they are released in the next cycle before the
+ * processor continues.
+ */
+static inline void held_notes_activated(AtomicCounter* state)
+{
+    int s = atomic_get(state);
+    if (s == HELD_NOTES_RELEASE || s == HELD_NOTES_RELEASE_AND_RUN) {
+        atomic_set(state, HELD_NOTES_RELEASE_AND_RUN);
+    } else {
+        atomic_set(state, HELD_NOTES_RUNNING);
+    }
+}
+
+/**
+ * Called by the close method while the processor is still registered and
+ * active in the engine. Waits until the process callback has emitted the
+ * note off events, this is the only case in which the Lua thread waits.
+ */
+static inline void held_notes_closing(AtomicCounter* state)
+{
+    if (atomic_get(state) != HELD_NOTES_RELEASED) {
+        atomic_set(state, HELD_NOTES_RELEASE);
+        for (int i = 0; i < HELD_NOTES_RELEASE_TIMEOUT && atomic_get(state) == HELD_NOTES_RELEASE; ++i) {
+            async_sleep_millis(1);
+        }
+    }
+}
+
+/**
+ * Called at the beginning of the process callback. Sets *release if the 
+ * held notes are to be released in this cycle. Returns false if the
+ * processor should not emit any other events. The state transitions are
+ * compare-and-swap operations, so that a release request set concurrently
+ * by the Lua thread is never overwritten.
+ */
+static inline bool held_notes_check_state(AtomicCounter* state, bool* release)
+{
+    for (;;) {
+        int s = atomic_get(state);
+        *release = (s == HELD_NOTES_RELEASE || s == HELD_NOTES_RELEASE_AND_RUN);
+        if (s == HELD_NOTES_RELEASED) {
+            return false;
+        }
+        if (s == HELD_NOTES_RELEASE) {
+            if (atomic_compare_swap(state, HELD_NOTES_RELEASE, HELD_NOTES_RELEASED)) {
+                return false;
+            }
+        }
+        else if (s == HELD_NOTES_RELEASE_AND_RUN) {
+            if (atomic_compare_swap(state, HELD_NOTES_RELEASE_AND_RUN, HELD_NOTES_RUNNING)) {
+                return true;
+            }
+        }
+        else {
+            return true;
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+#endif /* AUPROC_HELD_NOTES_H */
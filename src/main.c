@@ -3,10 +3,32 @@
 #include "midi_sender.h"
 #include "midi_receiver.h"
 #include "midi_mixer.h"
+#include "midi_filter.h"
+#include "midi_thinner.h"
+#include "midi_pattern.h"
+#include "midi_player.h"
+#include "midi_file.h"
+#include "midi_recorder.h"
 
 #include "audio_sender.h"
 #include "audio_receiver.h"
 #include "audio_mixer.h"
+#include "audio_filter.h"
+#include "audio_delay.h"
+#include "audio_analyzer.h"
+#include "audio_meter.h"
+#include "audio_generator.h"
+#include "audio_compressor.h"
+#include "audio_gate.h"
+#include "audio_ducker.h"
+#include "audio_panner.h"
+#include "audio_envelope.h"
+#include "audio_detector.h"
+#include "audio_onset.h"
+#include "audio_follower.h"
+#include "audio_crossover.h"
+#include "audio_sampler.h"
+#include "audio_convolver.h"
 
 /* ============================================================================================ */
 
@@ -52,10 +74,32 @@ DLL_PUBLIC int luaopen_auproc(lua_State* L)
     auproc_midi_sender_init_module   (L, module);
     auproc_midi_receiver_init_module (L, module);
     auproc_midi_mixer_init_module    (L, module);
+    auproc_midi_filter_init_module   (L, module);
+    auproc_midi_thinner_init_module  (L, module);
+    auproc_midi_pattern_init_module  (L, module);
+    auproc_midi_player_init_module   (L, module);
+    auproc_midi_file_init_module     (L, module);
+    auproc_midi_recorder_init_module (L, module);
 
     auproc_audio_sender_init_module  (L, module);
     auproc_audio_receiver_init_module(L, module);
     auproc_audio_mixer_init_module   (L, module);
+    auproc_audio_filter_init_module  (L, module);
+    auproc_audio_delay_init_module   (L, module);
+    auproc_audio_analyzer_init_module(L, module);
+    auproc_audio_meter_init_module   (L, module);
+    auproc_audio_generator_init_module(L, module);
+    auproc_audio_compressor_init_module(L, module);
+    auproc_audio_gate_init_module    (L, module);
+    auproc_audio_ducker_init_module  (L, module);
+    auproc_audio_panner_init_module  (L, module);
+    auproc_audio_envelope_init_module(L, module);
+    auproc_audio_detector_init_module(L, module);
+    auproc_audio_onset_init_module   (L, module);
+    auproc_audio_follower_init_module(L, module);
+    auproc_audio_crossover_init_module(L, module);
+    auproc_audio_sampler_init_module (L, module);
+    auproc_audio_convolver_init_module(L, module);
     
     lua_settop(L, module);
     return 1;
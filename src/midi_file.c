@@ -0,0 +1,447 @@
+#include "midi_file.h"
+#include "midi_pattern.h"
+
+/* ============================================================================================ */
+
+typedef struct SmfTempo SmfTempo;
+typedef struct SmfScan  SmfScan;
+
+struct SmfTempo
+{
+    uint64_t tick;
+    size_t   order;
+    uint32_t microsPerQuarter;
+};
+
+/**
+ * State for scanning the tracks of a standard midi file. The tracks are scanned
+ * twice: the first pass only counts events, data bytes and tempo changes,
+ * the second pass fills the preallocated pattern and tempo arrays.
+ */
+struct SmfScan
+{
+    size_t       eventCount;
+    size_t       dataSize;
+    size_t       tempoCount;
+    MidiPattern* pattern;
+    SmfTempo*    tempos;
+};
+
+/* ============================================================================================ */
+
+static uint32_t readUInt(const unsigned char* p, int n)
+{
+    uint32_t v = 0;
+    for (int i = 0; i < n; ++i) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static bool readVarLen(const unsigned char** pp, const unsigned char* end, uint32_t* value)
+{
+    const unsigned char* p = *pp;
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) {
+        if (p >= end) {
+            return false;
+        }
+        unsigned char b = *p++;
+        v = (v << 7) | (b & 0x7F);
+        if (!(b & 0x80)) {
+            *pp    = p;
+            *value = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* ============================================================================================ */
+
+static void addEvent(SmfScan* scan, uint64_t tick, unsigned char prefix,
+                     const unsigned char* bytes, size_t size)
+{
+    size_t total = size + (prefix ? 1 : 0);
+    if (scan->pattern) {
+        MidiPatternEvent* e = scan->pattern->events + scan->eventCount;
+        unsigned char*    d = scan->pattern->data   + scan->dataSize;
+        e->time   = tick;
+        e->offset = scan->dataSize;
+        e->size   = total;
+        if (prefix) {
+            *(d++) = prefix;
+        }
+        memcpy(d, bytes, size);
+    }
+    scan->eventCount += 1;
+    scan->dataSize   += total;
+}
+
+static const char* scanTrack(SmfScan* scan, const unsigned char* p, const unsigned char* end)
+{
+    uint64_t      tick    = 0;
+    unsigned char running = 0;
+
+    while (p < end)
+    {
+        uint32_t delta;
+        if (!readVarLen(&p, end, &delta) || p >= end) {
+            return "invalid delta time";
+        }
+        tick += delta;
+        unsigned char status = *p;
+        if (status & 0x80) {
+            p += 1;
+        } else if (running) {
+            status = running;
+        } else {
+            return "missing status byte";
+        }
+        if (status == 0xFF)
+        {
+            running = 0;
+            if (p >= end) {
+                return "invalid meta event";
+            }
+            unsigned char type = *p++;
+            uint32_t      len;
+            if (!readVarLen(&p, end, &len) || len > (size_t)(end - p)) {
+                return "invalid meta event";
+            }
+            if (type == 0x51 && len == 3) {
+                if (scan->tempos) {
+                    scan->tempos[scan->tempoCount].tick             = tick;
+                    scan->tempos[scan->tempoCount].order            = scan->tempoCount;
+                    scan->tempos[scan->tempoCount].microsPerQuarter = readUInt(p, 3);
+                }
+                scan->tempoCount += 1;
+            }
+            else if (type == 0x2F) {
+                break; /* end of track */
+            }
+            p += len;
+        }
+        else if (status == 0xF0 || status == 0xF7)
+        {
+            running = 0;
+            uint32_t len;
+            if (!readVarLen(&p, end, &len) || len > (size_t)(end - p)) {
+                return "invalid sysex event";
+            }
+            if (status == 0xF0 || len > 0) {
+                addEvent(scan, tick, (status == 0xF0) ? 0xF0 : 0, p, len);
+            }
+            p += len;
+        }
+        else if (status < 0xF0)
+        {
+            running = status;
+            size_t n = ((status & 0xE0) == 0xC0) ? 1 : 2;
+            if (n > (size_t)(end - p)) {
+                return "invalid channel event";
+            }
+            addEvent(scan, tick, status, p, n);
+            p += n;
+        }
+        else {
+            return "invalid status byte";
+        }
+    }
+    return NULL;
+}
+
+static const char* scanTracks(SmfScan* scan, const unsigned char* p, const unsigned char* end, int trackCount)
+{
+    for (int i = 0; i < trackCount && p < end; ++i)
+    {
+        if (end - p < 8) {
+            return "invalid chunk header";
+        }
+        uint32_t len = readUInt(p + 4, 4);
+        if (len > (size_t)(end - p - 8)) {
+            return "invalid chunk length";
+        }
+        if (memcmp(p, "MTrk", 4) == 0) {
+            const char* err = scanTrack(scan, p + 8, p + 8 + len);
+            if (err) {
+                return err;
+            }
+        } else {
+            --i; /* skip unknown chunk */
+        }
+        p += 8 + len;
+    }
+    return NULL;
+}
+
+/* ============================================================================================ */
+
+static int compareTempos(const void* a, const void* b)
+{
+    const SmfTempo* t1 = (const SmfTempo*) a;
+    const SmfTempo* t2 = (const SmfTempo*) b;
+    if (t1->tick < t2->tick) return -1;
+    if (t1->tick > t2->tick) return  1;
+    if (t1->order < t2->order) return -1;
+    if (t1->order > t2->order) return  1;
+    return 0;
+}
+
+/**
+ * Converts the event times from file ticks to ticks at the constant tempo
+ * of the pattern by applying the tempo map. The events must be sorted.
+ */
+static void applyTempoMap(MidiPattern* pattern, int division, SmfTempo* tempos, size_t tempoCount)
+{
+    MidiPatternEvent* events = pattern->events;
+    const size_t      n      = pattern->eventCount;
+
+    if (division & 0x8000) {
+        int    fps            = -(signed char)(division >> 8);
+        double ticksPerSecond = ((fps == 29) ? 29.97 : fps) * (division & 0xFF);
+        double factor         = pattern->ppq * pattern->tempo / 60.0 / ticksPerSecond;
+        for (size_t i = 0; i < n; ++i) {
+            events[i].time *= factor;
+        }
+        return;
+    }
+
+    qsort(tempos, tempoCount, sizeof(SmfTempo), compareTempos);
+
+    double   ticksPerSecond   = pattern->ppq * pattern->tempo / 60.0;
+    double   seconds          = 0;
+    uint64_t lastTick         = 0;
+    double   secondsPerTick   = 0.5 / division;
+    size_t   t                = 0;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint64_t tick = (uint64_t) events[i].time;
+        while (t < tempoCount && tempos[t].tick <= tick) {
+            seconds       += (tempos[t].tick - lastTick) * secondsPerTick;
+            lastTick       = tempos[t].tick;
+            secondsPerTick = tempos[t].microsPerQuarter / (1e6 * division);
+            t += 1;
+        }
+        events[i].time = (seconds + (tick - lastTick) * secondsPerTick) * ticksPerSecond;
+    }
+}
+
+/* ============================================================================================ */
+
+static int MidiFile_load(lua_State* L)
+{
+    const char* fileName = luaL_checkstring(L, 1);
+
+    FILE* file = fopen(fileName, "rb");
+    if (!file) {
+        return luaL_error(L, "cannot open file '%s': %s", fileName, strerror(errno));
+    }
+    size_t fileSize = 0;
+    unsigned char* fileData = NULL;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        long pos = ftell(file);
+        if (pos > 0 && fseek(file, 0, SEEK_SET) == 0) {
+            fileSize = pos;
+            fileData = lua_newuserdata(L, fileSize);              /* -> fileData */
+            if (fread(fileData, 1, fileSize, file) != fileSize) {
+                fileData = NULL;
+            }
+        }
+    }
+    fclose(file);
+    if (!fileData) {
+        return luaL_error(L, "cannot read file '%s'", fileName);
+    }
+    const unsigned char* p   = fileData;
+    const unsigned char* end = fileData + fileSize;
+
+    if (fileSize < 14 || memcmp(p, "MThd", 4) != 0 || readUInt(p + 4, 4) < 6
+                      || readUInt(p + 4, 4) > fileSize - 8)
+    {
+        return luaL_error(L, "invalid midi file '%s'", fileName);
+    }
+    int format     = readUInt(p +  8, 2);
+    int trackCount = readUInt(p + 10, 2);
+    int division   = readUInt(p + 12, 2);
+    if (format > 1 || division == 0) {
+        return luaL_error(L, "unsupported midi file format %d in '%s'", format, fileName);
+    }
+    p += 8 + readUInt(p + 4, 4);
+
+    SmfScan scan = {0};
+    const char* err = scanTracks(&scan, p, end, trackCount);
+    if (err) {
+        return luaL_error(L, "invalid midi file '%s': %s", fileName, err);
+    }
+    size_t eventCount = scan.eventCount;
+    size_t dataSize   = scan.dataSize;
+    size_t tempoCount = scan.tempoCount;
+
+    SmfTempo* tempos = lua_newuserdata(L, sizeof(SmfTempo) * (tempoCount + 1)); /* -> fileData, tempos */
+
+    double ppq   = (division & 0x8000) ? 96 : division;
+    double tempo = 120;
+
+    MidiPattern* pattern = auproc_midi_pattern_push_new(L, ppq, tempo, eventCount, dataSize); /* -> fileData, tempos, pattern */
+
+    memset(&scan, 0, sizeof(scan));
+    scan.pattern = pattern;
+    scan.tempos  = tempos;
+    scanTracks(&scan, p, end, trackCount);
+
+    if (!(division & 0x8000)) {
+        for (size_t i = 0; i < tempoCount; ++i) {
+            if (tempos[i].tick == 0 && tempos[i].microsPerQuarter > 0) {
+                pattern->tempo = 60e6 / tempos[i].microsPerQuarter;
+            }
+        }
+    }
+    auproc_midi_pattern_sort(pattern);
+    applyTempoMap(pattern, division, tempos, tempoCount);
+    return 1;
+}
+
+/* ============================================================================================ */
+
+void auproc_smf_track_init(SmfTrack* track)
+{
+    memset(track, 0, sizeof(SmfTrack));
+}
+
+void auproc_smf_track_free(SmfTrack* track)
+{
+    if (track->data) {
+        free(track->data);
+    }
+    memset(track, 0, sizeof(SmfTrack));
+}
+
+static bool reserveTrack(SmfTrack* track, size_t additional)
+{
+    if (track->length + additional > track->capacity) {
+        size_t newCapacity = 2 * track->capacity;
+        if (newCapacity < track->length + additional) {
+            newCapacity = track->length + additional + 4 * 1024;
+        }
+        unsigned char* newData = realloc(track->data, newCapacity);
+        if (!newData) {
+            return false;
+        }
+        track->data     = newData;
+        track->capacity = newCapacity;
+    }
+    return true;
+}
+
+static void writeVarLen(SmfTrack* track, uint32_t value)
+{
+    unsigned char buf[5];
+    int n = 0;
+    do {
+        buf[n++] = value & 0x7F;
+        value >>= 7;
+    } while (value > 0);
+    while (n > 0) {
+        --n;
+        track->data[track->length++] = buf[n] | (n > 0 ? 0x80 : 0);
+    }
+}
+
+static void writeDelta(SmfTrack* track, uint64_t tick)
+{
+    uint64_t delta = (tick > track->lastTick) ? tick - track->lastTick : 0;
+    if (delta > 0x0FFFFFFF) {
+        delta = 0x0FFFFFFF;
+    }
+    writeVarLen(track, (uint32_t)delta);
+    track->lastTick += delta;
+}
+
+bool auproc_smf_track_add_tempo(SmfTrack* track, uint64_t tick, double bpm)
+{
+    if (!reserveTrack(track, 4 + 6)) {
+        return false;
+    }
+    uint32_t micros = (uint32_t)(60e6 / bpm + 0.5);
+    writeDelta(track, tick);
+    unsigned char* d = track->data + track->length;
+    d[0] = 0xFF; d[1] = 0x51; d[2] = 0x03;
+    d[3] = (micros >> 16) & 0xFF; d[4] = (micros >> 8) & 0xFF; d[5] = micros & 0xFF;
+    track->length += 6;
+    return true;
+}
+
+bool auproc_smf_track_add_event(SmfTrack* track, uint64_t tick, const unsigned char* bytes, size_t size)
+{
+    if (size == 0 || size > 0x0FFFFFFF) {
+        return true;
+    }
+    if (!reserveTrack(track, 4 + 1 + 4 + size)) {
+        return false;
+    }
+    writeDelta(track, tick);
+    if (bytes[0] == 0xF0) {
+        track->data[track->length++] = 0xF0;
+        writeVarLen(track, size - 1);
+        memcpy(track->data + track->length, bytes + 1, size - 1);
+        track->length += size - 1;
+    }
+    else if (bytes[0] > 0xF0 || bytes[0] < 0x80) {
+        /* system common and realtime messages are stored as escaped events */
+        track->data[track->length++] = 0xF7;
+        writeVarLen(track, size);
+        memcpy(track->data + track->length, bytes, size);
+        track->length += size;
+    }
+    else {
+        memcpy(track->data + track->length, bytes, size);
+        track->length += size;
+    }
+    return true;
+}
+
+bool auproc_smf_write_file(const char* fileName, int ppq, const SmfTrack* track)
+{
+    static const unsigned char endOfTrack[] = { 0x00, 0xFF, 0x2F, 0x00 };
+    uint32_t trackLength = track->length + sizeof(endOfTrack);
+    unsigned char header[22] = { 'M', 'T', 'h', 'd',  0, 0, 0, 6,  0, 0,  0, 1, 
+                                 (ppq >> 8) & 0x7F, ppq & 0xFF,
+                                 'M', 'T', 'r', 'k',
+                                 (trackLength >> 24) & 0xFF, (trackLength >> 16) & 0xFF,
+                                 (trackLength >>  8) & 0xFF,  trackLength        & 0xFF };
+    FILE* file = fopen(fileName, "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok =    fwrite(header, 1, sizeof(header), file) == sizeof(header)
+              && (track->length == 0 || fwrite(track->data, 1, track->length, file) == track->length)
+              && fwrite(endOfTrack, 1, sizeof(endOfTrack), file) == sizeof(endOfTrack);
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    return ok;
+}
+
+/* ============================================================================================ */
+
+static const luaL_Reg ModuleFunctions[] =
+{
+    { "load_midi_file", MidiFile_load },
+    { NULL,             NULL } /* sentinel */
+};
+
+/* ============================================================================================ */
+
+int auproc_midi_file_init_module(lua_State* L, int module)
+{
+    lua_pushvalue(L, module);
+        luaL_setfuncs(L, ModuleFunctions, 0);
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+/* ============================================================================================ */
+
@@ -0,0 +1,39 @@
+#ifndef AUPROC_MIDI_FILE_H
+#define AUPROC_MIDI_FILE_H
+
+#include "util.h"
+
+typedef struct SmfTrack SmfTrack;
+
+/**
+ * Growable track data for writing a standard midi file. These functions
+ * allocate memory and must not be called in the realtime thread.
+ */
+struct SmfTrack
+{
+    unsigned char* data;
+    size_t         length;
+    size_t         capacity;
+    uint64_t       lastTick;
+};
+
+void auproc_smf_track_init(SmfTrack* track);
+
+void auproc_smf_track_free(SmfTrack* track);
+
+bool auproc_smf_track_add_tempo(SmfTrack* track, uint64_t tick, double bpm);
+
+/**
+ * Adds a midi event. The tick must not be smaller than the tick of the
+ * preceding event.
+ */
+bool auproc_smf_track_add_event(SmfTrack* track, uint64_t tick, const unsigned char* bytes, size_t size);
+
+/**
+ * Writes a standard midi file of type 0 containing the given track.
+ */
+bool auproc_smf_write_file(const char* fileName, int ppq, const SmfTrack* track);
+
+int auproc_midi_file_init_module(lua_State* L, int module);
+
+#endif // AUPROC_MIDI_FILE_H
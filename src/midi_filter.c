@@ -0,0 +1,578 @@
+#include "midi_filter.h"
+
+#define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
+#include "auproc_capi.h"
+
+#define SENDER_CAPI_IMPLEMENT_GET_CAPI 1
+#include "sender_capi.h"
+
+/* ============================================================================================ */
+
+static const char* const MIDI_FILTER_CLASS_NAME = "auproc.midi_filter";
+
+static const char* ERROR_INVALID_MIDI_FILTER = "invalid auproc.midi_filter";
+
+/* ============================================================================================ */
+
+#define FILTER_TABLE_MAGIC "AMF1"
+#define FILTER_DROP        0xFF
+
+typedef struct FilterTable        FilterTable;
+typedef struct MidiFilterUserData MidiFilterUserData;
+
+/**
+ * Precompiled lookup tables. The status table maps each status byte to the
+ * status byte that is written to the output (0 means drop), i.e. pass/drop and
+ * channel remapping are one lookup. The data tables are indexed by the
+ * channel of the incoming event and map data bytes, FILTER_DROP means drop.
+ */
+struct FilterTable
+{
+    char          magic[4];
+    unsigned char status  [256];
+    unsigned char note    [16][128];
+    unsigned char velocity[16][128];
+    unsigned char control [16][128];
+};
+
+struct MidiFilterUserData
+{
+    const char*        className;
+    auproc_processor*  processor;
+
+    bool               closed;
+    bool               activated;
+
+    const auproc_capi*  auprocCapi;
+    auproc_engine*      auprocEngine;
+
+    auproc_connector*      midiInConnector;
+    const auproc_midimeth* midiInMethods;
+    auproc_connector*      midiOutConnector;
+    const auproc_midimeth* midiOutMethods;
+
+    const sender_capi* senderCapi;
+    sender_object*     sender;
+    sender_reader*     senderReader;
+
+    FilterTable        table;
+};
+
+/* ============================================================================================ */
+
+static void setupMidiFilterMeta(lua_State* L);
+
+static int pushMidiFilterMeta(lua_State* L)
+{
+    if (luaL_newmetatable(L, MIDI_FILTER_CLASS_NAME)) {
+        setupMidiFilterMeta(L);
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static MidiFilterUserData* checkMidiFilterUdata(lua_State* L, int arg)
+{
+    MidiFilterUserData* udata = luaL_checkudata(L, arg, MIDI_FILTER_CLASS_NAME);
+    if (udata->auprocCapi) {
+        udata->auprocCapi->checkEngineIsNotClosed(L, udata->auprocEngine);
+    }
+    if (udata->closed) {
+        luaL_error(L, ERROR_INVALID_MIDI_FILTER);
+        return NULL;
+    }
+    return udata;
+}
+
+/* ============================================================================================ */
+
+static void initFilterTable(FilterTable* t)
+{
+    memcpy(t->magic, FILTER_TABLE_MAGIC, sizeof(t->magic));
+    for (int s = 0; s < 256; ++s) {
+        t->status[s] = (s >= 0x80) ? s : 0;
+    }
+    for (int c = 0; c < 16; ++c) {
+        for (int i = 0; i < 128; ++i) {
+            t->note    [c][i] = i;
+            t->velocity[c][i] = i;
+            t->control [c][i] = i;
+        }
+    }
+}
+
+/* ============================================================================================ */
+
+static int processCallback(uint32_t nframes, void* processorData)
+{
+    MidiFilterUserData* udata = (MidiFilterUserData*) processorData;
+    FilterTable*        table = &udata->table;
+
+    if (udata->sender)
+    {
+        const sender_capi*   senderCapi = udata->senderCapi;
+        sender_reader*       reader     = udata->senderReader;
+
+    nextMsg:;
+        int rc = senderCapi->nextMessageFromSender(udata->sender, reader,
+                                                   true /* nonblock */, 0 /* timeout */,
+                                                   NULL /* errorHandler */, NULL /* errorHandlerData */);
+        if (rc == 0) {
+            sender_capi_value  senderValue;
+            senderCapi->nextValueFromReader(reader, &senderValue);
+            const void* data = NULL;
+            size_t      len  = 0;
+            if (senderValue.type == SENDER_CAPI_TYPE_STRING) {
+                data = senderValue.strVal.ptr;
+                len  = senderValue.strVal.len;
+            }
+            else if (   senderValue.type == SENDER_CAPI_TYPE_ARRAY
+                     && (   senderValue.arrayVal.type == SENDER_UCHAR
+                         || senderValue.arrayVal.type == SENDER_SCHAR))
+            {
+                data = senderValue.arrayVal.data;
+                len  = senderValue.arrayVal.elementCount;
+            }
+            if (   data && len == sizeof(FilterTable)
+                && memcmp(data, FILTER_TABLE_MAGIC, sizeof(table->magic)) == 0)
+            {
+                memcpy(table, data, sizeof(FilterTable));
+            }
+            senderCapi->clearReader(reader);
+            goto nextMsg;
+        }
+    }
+    {
+        const auproc_midimeth* inMethods  = udata->midiInMethods;
+        const auproc_midimeth* outMethods = udata->midiOutMethods;
+
+        auproc_midibuf* inBuf  = inMethods->getMidiBuffer(udata->midiInConnector, nframes);
+        auproc_midibuf* outBuf = outMethods->getMidiBuffer(udata->midiOutConnector, nframes);
+
+        outMethods->clearBuffer(outBuf);
+
+        auproc_midi_event event;
+        uint32_t          eventCount = inMethods->getEventCount(inBuf);
+
+        for (uint32_t i = 0; i < eventCount; ++i)
+        {
+            inMethods->getMidiEvent(&event, inBuf, i);
+            if (event.size == 0) {
+                continue;
+            }
+            unsigned char status = table->status[event.buffer[0]];
+            if (status == 0) {
+                continue;
+            }
+            unsigned char d1 = (event.size > 1) ? event.buffer[1] : 0;
+            unsigned char d2 = (event.size > 2) ? event.buffer[2] : 0;
+
+            if (status < 0xF0 && event.size > 1)
+            {
+                int channel = event.buffer[0] & 0x0F;
+                switch (event.buffer[0] & 0xF0) {
+                    case 0x90: if (d2 > 0) {
+                                   d2 = table->velocity[channel][d2 & 0x7F];
+                               }
+                               /* fall through */
+                    case 0x80:
+                    case 0xA0: d1 = table->note[channel][d1 & 0x7F];
+                               break;
+                    case 0xB0: d1 = table->control[channel][d1 & 0x7F];
+                               break;
+                }
+                if (d1 == FILTER_DROP || d2 == FILTER_DROP) {
+                    continue;
+                }
+            }
+            unsigned char* data = outMethods->reserveMidiEvent(outBuf, event.time, event.size);
+            if (data) {
+                memcpy(data, event.buffer, event.size);
+                data[0] = status;
+                if (status < 0xF0) {
+                    if (event.size > 1) data[1] = d1;
+                    if (event.size > 2) data[2] = d2;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static void engineClosedCallback(void* processorData)
+{
+    MidiFilterUserData* udata = (MidiFilterUserData*) processorData;
+
+    udata->closed    = true;
+    udata->activated = false;
+}
+
+static void engineReleasedCallback(void* processorData)
+{
+    MidiFilterUserData* udata = (MidiFilterUserData*) processorData;
+
+    udata->closed       = true;
+    udata->activated    = false;
+    udata->auprocCapi    = NULL;
+    udata->auprocEngine  = NULL;
+}
+
+/* ============================================================================================ */
+
+static int checkRange(lua_State* L, int arg, const char* field, lua_Integer v, lua_Integer min, lua_Integer max)
+{
+    if (v < min || v > max) {
+        const char* msg = lua_pushfstring(L, "value %d out of range %d..%d for field '%s'",
+                                             (int)v, (int)min, (int)max, field);
+        return luaL_argerror(L, arg, msg);
+    }
+    return (int)v;
+}
+
+static int toInteger(lua_State* L, int arg, const char* field, int index)
+{
+    if (!lua_isnumber(L, index)) {
+        const char* msg = lua_pushfstring(L, "integer expected in field '%s'", field);
+        return luaL_argerror(L, arg, msg);
+    }
+    return (int)lua_tointeger(L, index);
+}
+
+/* ============================================================================================ */
+
+static int MidiFilter_table(lua_State* L)
+{
+    const int arg = 1;
+    luaL_checktype(L, arg, LUA_TTABLE);
+
+    FilterTable table;
+    initFilterTable(&table);
+
+    lua_getfield(L, arg, "drop");                                   /* -> drop */
+    if (!lua_isnil(L, -1)) {
+        luaL_argcheck(L, lua_istable(L, -1), arg, "table expected in field 'drop'");
+        lua_Integer n = luaL_len(L, -1);
+        for (lua_Integer i = 1; i <= n; ++i) {
+            lua_rawgeti(L, -1, i);                                  /* -> drop, status */
+            int s = checkRange(L, arg, "drop", toInteger(L, arg, "drop", -1), 0x80, 0xFF);
+            table.status[s] = 0;
+            lua_pop(L, 1);                                          /* -> drop */
+        }
+    }
+    lua_pop(L, 1);                                                  /* -> */
+
+    lua_getfield(L, arg, "channelMap");                             /* -> map */
+    if (!lua_isnil(L, -1)) {
+        luaL_argcheck(L, lua_istable(L, -1), arg, "table expected in field 'channelMap'");
+        for (int c = 0; c < 16; ++c) {
+            lua_rawgeti(L, -1, c + 1);                              /* -> map, toChannel */
+            if (!lua_isnil(L, -1)) {
+                int to = checkRange(L, arg, "channelMap", toInteger(L, arg, "channelMap", -1), 0, 16);
+                for (int t = 0x80; t < 0xF0; t += 0x10) {
+                    if (table.status[t | c] != 0) {
+                        table.status[t | c] = (to > 0) ? (t | (to - 1)) : 0;
+                    }
+                }
+            }
+            lua_pop(L, 1);                                          /* -> map */
+        }
+    }
+    lua_pop(L, 1);                                                  /* -> */
+
+    lua_getfield(L, arg, "transpose");                              /* -> transpose */
+    if (!lua_isnil(L, -1)) {
+        int transpose[16];
+        if (lua_isnumber(L, -1)) {
+            int t = (int)lua_tointeger(L, -1);
+            for (int c = 0; c < 16; ++c) {
+                transpose[c] = t;
+            }
+        } else {
+            luaL_argcheck(L, lua_istable(L, -1), arg, "number or table expected in field 'transpose'");
+            for (int c = 0; c < 16; ++c) {
+                lua_rawgeti(L, -1, c + 1);                          /* -> transpose, t */
+                transpose[c] = lua_isnil(L, -1) ? 0 : toInteger(L, arg, "transpose", -1);
+                lua_pop(L, 1);                                      /* -> transpose */
+            }
+        }
+        for (int c = 0; c < 16; ++c) {
+            for (int i = 0; i < 128; ++i) {
+                int n = i + transpose[c];
+                table.note[c][i] = (0 <= n && n < 128) ? n : FILTER_DROP;
+            }
+        }
+    }
+    lua_pop(L, 1);                                                  /* -> */
+
+    lua_getfield(L, arg, "velocity");                               /* -> velocity */
+    if (!lua_isnil(L, -1)) {
+        unsigned char curve[128];
+        curve[0] = 0;
+        if (lua_isnumber(L, -1)) {
+            lua_Number e = lua_tonumber(L, -1);
+            luaL_argcheck(L, e > 0, arg, "positive exponent expected in field 'velocity'");
+            for (int i = 1; i < 128; ++i) {
+                int v = (int)floor(127 * pow(i / 127.0, e) + 0.5);
+                curve[i] = (v < 1) ? 1 : (v > 127 ? 127 : v);
+            }
+        } else {
+            luaL_argcheck(L, lua_istable(L, -1), arg, "number or table expected in field 'velocity'");
+            for (int i = 1; i < 128; ++i) {
+                lua_rawgeti(L, -1, i);                              /* -> velocity, v */
+                curve[i] = lua_isnil(L, -1) ? i : checkRange(L, arg, "velocity",
+                                                             toInteger(L, arg, "velocity", -1), 1, 127);
+                lua_pop(L, 1);                                      /* -> velocity */
+            }
+        }
+        for (int c = 0; c < 16; ++c) {
+            memcpy(table.velocity[c], curve, sizeof(curve));
+        }
+    }
+    lua_pop(L, 1);                                                  /* -> */
+
+    lua_getfield(L, arg, "controlMap");                             /* -> map */
+    if (!lua_isnil(L, -1)) {
+        luaL_argcheck(L, lua_istable(L, -1), arg, "table expected in field 'controlMap'");
+        for (int i = 0; i < 128; ++i) {
+            lua_rawgeti(L, -1, i);                                  /* -> map, to */
+            if (!lua_isnil(L, -1)) {
+                int to = FILTER_DROP;
+                if (!lua_isboolean(L, -1) || lua_toboolean(L, -1)) {
+                    to = checkRange(L, arg, "controlMap", toInteger(L, arg, "controlMap", -1), -1, 127);
+                    if (to < 0) {
+                        to = FILTER_DROP;
+                    }
+                }
+                for (int c = 0; c < 16; ++c) {
+                    table.control[c][i] = to;
+                }
+            }
+            lua_pop(L, 1);                                          /* -> map */
+        }
+    }
+    lua_pop(L, 1);                                                  /* -> */
+
+    lua_pushlstring(L, (const char*)&table, sizeof(table));
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int MidiFilter_new(lua_State* L)
+{
+    const int inArg   = 1;
+    const int sndrArg = 3;
+    MidiFilterUserData* udata = lua_newuserdata(L, sizeof(MidiFilterUserData));
+    memset(udata, 0, sizeof(MidiFilterUserData));
+    udata->className = MIDI_FILTER_CLASS_NAME;
+    initFilterTable(&udata->table);
+    pushMidiFilterMeta(L);                                /* -> udata, meta */
+    lua_setmetatable(L, -2);                              /* -> udata */
+    int versionError = 0;
+    const auproc_capi* capi = auproc_get_capi(L, inArg, &versionError);
+    auproc_engine* engine = NULL;
+    if (capi) {
+        engine = capi->getEngine(L, inArg, NULL);
+    }
+    if (!capi || !engine) {
+        if (versionError) {
+            return luaL_argerror(L, inArg, "auproc version mismatch");
+        } else {
+            return luaL_argerror(L, inArg, "expected connector object");
+        }
+    }
+
+    if (!lua_isnoneornil(L, sndrArg))
+    {
+        int errReason = 0;
+        const sender_capi* senderCapi = sender_get_capi(L, sndrArg, &errReason);
+        sender_object*     sender     = senderCapi ? senderCapi->toSender(L, sndrArg) : NULL;
+
+        if (!senderCapi || !sender) {
+            if (errReason == 1) {
+                return luaL_argerror(L, sndrArg, "sender capi version mismatch");
+            } else {
+                return luaL_argerror(L, sndrArg, "expected object with sender capi");
+            }
+        }
+        udata->senderCapi = senderCapi;
+        udata->sender     = sender;
+        senderCapi->retainSender(sender);
+
+        udata->senderReader = senderCapi->newReader(16 * 1024, 1);
+        if (!udata->senderReader) {
+            return luaL_error(L, "out of memory");
+        }
+    }
+    const char* processorName = lua_pushfstring(L, "%s: %p", MIDI_FILTER_CLASS_NAME, udata);   /* -> udata, name */
+
+    auproc_con_reg conRegs[2] = {{AUPROC_MIDI, AUPROC_IN,  NULL},
+                                 {AUPROC_MIDI, AUPROC_OUT, NULL}};
+    auproc_con_reg_err regError = {0};
+    auproc_processor* proc = capi->registerProcessor(L, inArg, 2, engine, processorName, udata,
+                                                        processCallback, NULL, engineClosedCallback, engineReleasedCallback,
+                                                        conRegs, &regError);
+    lua_pop(L, 1); /* -> udata */
+
+    if (!proc)
+    {
+        if (regError.conIndex >= 0)
+        {
+            int errArg = inArg + regError.conIndex;
+
+            if (regError.errorType == AUPROC_REG_ERR_CONNCTOR_INVALID)
+            {
+                return luaL_argerror(L, errArg, "invalid connector object");
+            }
+            if (   regError.errorType == AUPROC_REG_ERR_ENGINE_MISMATCH)
+            {
+                const char* msg = lua_pushfstring(L, "connector belongs to other %s",
+                                                     capi->engine_category_name);
+                return luaL_argerror(L, errArg, msg);
+            }
+            if (   regError.errorType == AUPROC_REG_ERR_ARG_INVALID
+                || regError.errorType == AUPROC_REG_ERR_WRONG_DIRECTION
+                || regError.errorType == AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE)
+            {
+                if (errArg == inArg) {
+                    return luaL_argerror(L, errArg, "expected MIDI IN connector");
+                } else {
+                    return luaL_argerror(L, errArg, "expected MIDI OUT connector");
+                }
+            }
+        }
+        return luaL_error(L, "cannot register processor (err=%d)", regError.errorType);
+    }
+
+    udata->processor        = proc;
+    udata->activated        = false;
+    udata->auprocCapi       = capi;
+    udata->auprocEngine     = engine;
+    udata->midiInConnector  = conRegs[0].connector;
+    udata->midiInMethods    = conRegs[0].midiMethods;
+    udata->midiOutConnector = conRegs[1].connector;
+    udata->midiOutMethods   = conRegs[1].midiMethods;
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int MidiFilter_release(lua_State* L)
+{
+    MidiFilterUserData* udata = luaL_checkudata(L, 1, MIDI_FILTER_CLASS_NAME);
+    udata->closed    = true;
+    udata->activated = false;
+    if (udata->auprocCapi) {
+        udata->auprocCapi->unregisterProcessor(L, udata->auprocEngine, udata->processor);
+        udata->processor   = NULL;
+        udata->auprocCapi   = NULL;
+        udata->auprocEngine = NULL;
+    }
+    if (udata->sender) {
+        if (udata->senderReader) {
+            udata->senderCapi->freeReader(udata->senderReader);
+            udata->senderReader = NULL;
+        }
+        udata->senderCapi->releaseSender(udata->sender);
+        udata->sender     = NULL;
+        udata->senderCapi = NULL;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int MidiFilter_toString(lua_State* L)
+{
+    MidiFilterUserData* udata = luaL_checkudata(L, 1, MIDI_FILTER_CLASS_NAME);
+
+    lua_pushfstring(L, "%s: %p", MIDI_FILTER_CLASS_NAME, udata);
+
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int MidiFilter_activate(lua_State* L)
+{
+    MidiFilterUserData* udata = checkMidiFilterUdata(L, 1);
+    if (!udata->activated) {
+        udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = true;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int MidiFilter_deactivate(lua_State* L)
+{
+    MidiFilterUserData* udata = checkMidiFilterUdata(L, 1);
+    if (udata->activated) {
+        udata->auprocCapi->deactivateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = false;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static const luaL_Reg MidiFilterMethods[] =
+{
+    { "activate",    MidiFilter_activate },
+    { "deactivate",  MidiFilter_deactivate },
+    { "close",       MidiFilter_release },
+    { NULL,          NULL } /* sentinel */
+};
+
+static const luaL_Reg MidiFilterMetaMethods[] =
+{
+    { "__tostring", MidiFilter_toString },
+    { "__gc",       MidiFilter_release  },
+
+    { NULL,       NULL } /* sentinel */
+};
+
+static const luaL_Reg ModuleFunctions[] =
+{
+    { "new_midi_filter",   MidiFilter_new   },
+    { "midi_filter_table", MidiFilter_table },
+    { NULL,                NULL } /* sentinel */
+};
+
+/* ============================================================================================ */
+
+static void setupMidiFilterMeta(lua_State* L)
+{                                                          /* -> meta */
+    lua_pushstring(L, MIDI_FILTER_CLASS_NAME);             /* -> meta, className */
+    lua_setfield(L, -2, "__metatable");                    /* -> meta */
+
+    luaL_setfuncs(L, MidiFilterMetaMethods, 0);            /* -> meta */
+
+    lua_newtable(L);                                       /* -> meta, MidiFilterClass */
+    luaL_setfuncs(L, MidiFilterMethods, 0);                /* -> meta, MidiFilterClass */
+    lua_setfield (L, -2, "__index");                       /* -> meta */
+}
+
+
+/* ============================================================================================ */
+
+int auproc_midi_filter_init_module(lua_State* L, int module)
+{
+    if (luaL_newmetatable(L, MIDI_FILTER_CLASS_NAME)) {
+        setupMidiFilterMeta(L);
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, module);
+        luaL_setfuncs(L, ModuleFunctions, 0);
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+/* ============================================================================================ */
+
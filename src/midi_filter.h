@@ -0,0 +1,8 @@
+#ifndef AUPROC_MIDI_FILTER_H
+#define AUPROC_MIDI_FILTER_H
+
+#include "util.h"
+
+int auproc_midi_filter_init_module(lua_State* L, int module);
+
+#endif // AUPROC_MIDI_FILTER_H
@@ -2,6 +2,7 @@
 
 #define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
 #include "auproc_capi.h"
+#include "held_notes.h"
 
 #define SENDER_CAPI_IMPLEMENT_GET_CAPI 1
 #include "sender_capi.h"
@@ -22,6 +23,7 @@ struct InputConnection
     auproc_connector*      connector;
     const auproc_midimeth* methods;
     int                    channelMap[16];
+    HeldNotes              heldNotes;
     
     bool                   finished;
     auproc_midibuf*        inBuf;
@@ -43,6 +45,7 @@ struct MidiMixerUserData
 
     bool               closed;
     bool               activated;
+    bool               processing;       /* active in the engine, may be releasing notes after deactivate */
     
     const auproc_capi*  auprocCapi;
     auproc_engine*      auprocEngine;
@@ -50,6 +53,8 @@ struct MidiMixerUserData
     const sender_capi*   senderCapi;
     sender_object*       sender;
     sender_reader*       senderReader;
+
+    AtomicCounter        releaseState;
 };
 
 /* ============================================================================================ */
@@ -87,6 +92,27 @@ static int processCallback(uint32_t nframes, void* processorData)
     InputConnection*    inputs = udata->inpConnections;
     const int           n      = udata->inpConnectionsCount;
 
+    const auproc_midimeth* outMethods = udata->outMethods;
+    auproc_midibuf*        outBuf     = outMethods->getMidiBuffer(udata->outConnector, nframes);
+
+    outMethods->clearBuffer(outBuf);
+
+    bool releaseNotes;
+    bool running = held_notes_check_state(&udata->releaseState, &releaseNotes);
+    if (releaseNotes) {
+        for (int i = 0; i < n; ++i) {
+            InputConnection* input = inputs + i;
+            for (int c = 0; c < 16; ++c) {
+                if (input->channelMap[c] >= 0) {
+                    held_notes_release_channel(&input->heldNotes, c, input->channelMap[c], 
+                                               outMethods, outBuf, 0);
+                }
+            }
+        }
+    }
+    if (!running) {
+        return 0;
+    }
     if (udata->sender)
     {
         const sender_capi*   senderCapi = udata->senderCapi;
@@ -128,7 +154,13 @@ static int processCallback(uint32_t nframes, void* processorData)
                               &&  0  <= fromChannel && fromChannel < 16
                               &&  -1 <= toChannel && toChannel < 16)
                             {
-                                inputs[inputIndex].channelMap[fromChannel] = toChannel;
+                                InputConnection* input = inputs + inputIndex;
+                                int oldChannel = input->channelMap[fromChannel];
+                                if (oldChannel >= 0 && oldChannel != toChannel) {
+                                    held_notes_release_channel(&input->heldNotes, fromChannel, oldChannel,
+                                                               outMethods, outBuf, 0);
+                                }
+                                input->channelMap[fromChannel] = toChannel;
                                 goto nextValues;
                             }
                         }
@@ -139,13 +171,6 @@ static int processCallback(uint32_t nframes, void* processorData)
         }
     }
     {
-        const auproc_capi*     capi       = udata->auprocCapi;
-            
-        const auproc_midimeth* outMethods = udata->outMethods;
-        auproc_midibuf*        outBuf     = outMethods->getMidiBuffer(udata->outConnector, nframes);
-        
-        outMethods->clearBuffer(outBuf);
-        
         int next = -1;        
         for (int i = 0; i < n; ++i) 
         {
@@ -175,13 +200,14 @@ static int processCallback(uint32_t nframes, void* processorData)
                 auproc_midi_event* event = &input->event;
                 if (event->size > 0) {
                     unsigned char firstByte = event->buffer[0];
-                    int channel = firstByte & 0xF;
-                        channel = input->channelMap[channel];
+                    int inChannel = firstByte & 0xF;
+                    int channel   = input->channelMap[inChannel];
                     if (channel >= 0) {
                         unsigned char* data = outMethods->reserveMidiEvent(outBuf, event->time, event->size);
                         if (data) {
                             data[0] = (firstByte & 0xF0) | (channel & 0xF);
                             memcpy(data + 1, event->buffer + 1, event->size - 1);
+                            held_notes_update(&input->heldNotes, inChannel, event->buffer, event->size);
                         }
                     }
                 }
@@ -218,8 +244,9 @@ static void engineClosedCallback(void* processorData)
 {
     MidiMixerUserData* udata = (MidiMixerUserData*) processorData;
  
-    udata->closed    = true;
-    udata->activated = false;
+    udata->closed     = true;
+    udata->activated  = false;
+    udata->processing = false;
 }
 
 static void engineReleasedCallback(void* processorData)
@@ -228,6 +255,7 @@ static void engineReleasedCallback(void* processorData)
  
     udata->closed       = true;
     udata->activated    = false;
+    udata->processing   = false;
     udata->auprocCapi    = NULL;
     udata->auprocEngine  = NULL;
 }
@@ -387,8 +415,12 @@ static int MidiMixer_new(lua_State* L)
 static int MidiMixer_release(lua_State* L)
 {
     MidiMixerUserData* udata = luaL_checkudata(L, 1, MIDI_MIXER_CLASS_NAME);
+    if (udata->auprocCapi && udata->processing && !udata->closed) {
+        held_notes_closing(&udata->releaseState);
+    }
     udata->closed     = true;
     udata->activated  = false;
+    udata->processing = false;
     if (udata->auprocCapi) {
         udata->auprocCapi->unregisterProcessor(L, udata->auprocEngine, udata->processor);
         udata->processor   = NULL;
@@ -433,7 +465,11 @@ static int MidiMixer_activate(lua_State* L)
 {
     MidiMixerUserData* udata = checkMidiMixerUdata(L, 1);
     if (!udata->activated) {    
-        udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+        held_notes_activated(&udata->releaseState);
+        if (!udata->processing) {
+            udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+            udata->processing = true;
+        }
         udata->activated = true;
     }
     return 0;
@@ -445,7 +481,7 @@ static int MidiMixer_deactivate(lua_State* L)
 {
     MidiMixerUserData* udata = checkMidiMixerUdata(L, 1);
     if (udata->activated) {                                           
-        udata->auprocCapi->deactivateProcessor(L, udata->auprocEngine, udata->processor);
+        held_notes_deactivated(&udata->releaseState);
         udata->activated = false;
     }
     return 0;
@@ -0,0 +1,274 @@
+#include "midi_pattern.h"
+
+/* ============================================================================================ */
+
+static const char* const MIDI_PATTERN_CLASS_NAME = "auproc.midi_pattern";
+
+/* ============================================================================================ */
+
+static void setupMidiPatternMeta(lua_State* L);
+
+static int pushMidiPatternMeta(lua_State* L)
+{
+    if (luaL_newmetatable(L, MIDI_PATTERN_CLASS_NAME)) {
+        setupMidiPatternMeta(L);
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+MidiPattern* auproc_midi_pattern_push_new(lua_State* L, double ppq, double tempo,
+                                          size_t eventCount, size_t dataSize)
+{
+    MidiPattern* udata = lua_newuserdata(L, sizeof(MidiPattern));
+    memset(udata, 0, sizeof(MidiPattern));
+    udata->className = MIDI_PATTERN_CLASS_NAME;
+    pushMidiPatternMeta(L);                                /* -> udata, meta */
+    lua_setmetatable(L, -2);                               /* -> udata */
+
+    udata->ppq   = ppq;
+    udata->tempo = tempo;
+
+    udata->events = malloc(sizeof(MidiPatternEvent) * (eventCount > 0 ? eventCount : 1));
+    udata->data   = malloc(dataSize > 0 ? dataSize : 1);
+    if (!udata->events || !udata->data) {
+        luaL_error(L, "out of memory");
+        return NULL;
+    }
+    udata->eventCount = eventCount;
+    udata->dataSize   = dataSize;
+    return udata;
+}
+
+/* ============================================================================================ */
+
+static int compareEvents(const void* a, const void* b)
+{
+    const MidiPatternEvent* e1 = (const MidiPatternEvent*) a;
+    const MidiPatternEvent* e2 = (const MidiPatternEvent*) b;
+    if (e1->time < e2->time) return -1;
+    if (e1->time > e2->time) return  1;
+    if (e1->offset < e2->offset) return -1;
+    if (e1->offset > e2->offset) return  1;
+    return 0;
+}
+
+void auproc_midi_pattern_sort(MidiPattern* pattern)
+{
+    if (pattern->eventCount > 1) {
+        qsort(pattern->events, pattern->eventCount, sizeof(MidiPatternEvent), compareEvents);
+    }
+}
+
+/* ============================================================================================ */
+
+MidiPattern* auproc_midi_pattern_check(lua_State* L, int arg)
+{
+    return luaL_checkudata(L, arg, MIDI_PATTERN_CLASS_NAME);
+}
+
+/* ============================================================================================ */
+
+static size_t checkEventSize(lua_State* L, int arg, int event, lua_Integer i)
+{
+    if (!lua_istable(L, event)) {
+        const char* msg = lua_pushfstring(L, "table expected for event %d", (int)i);
+        luaL_argerror(L, arg, msg);
+    }
+    lua_rawgeti(L, event, 1);                                   /* -> time */
+    if (!lua_isnumber(L, -1) || lua_tonumber(L, -1) < 0) {
+        const char* msg = lua_pushfstring(L, "non-negative time expected for event %d", (int)i);
+        luaL_argerror(L, arg, msg);
+    }
+    lua_pop(L, 1);                                              /* -> */
+    size_t size;
+    lua_rawgeti(L, event, 2);                                   /* -> bytes */
+    if (lua_type(L, -1) == LUA_TSTRING) {
+        size = lua_rawlen(L, -1);
+    } else {
+        size = (size_t)luaL_len(L, event) - 1;
+    }
+    lua_pop(L, 1);                                              /* -> */
+    if (size == 0) {
+        const char* msg = lua_pushfstring(L, "midi bytes expected for event %d", (int)i);
+        luaL_argerror(L, arg, msg);
+    }
+    return size;
+}
+
+static int MidiPattern_new(lua_State* L)
+{
+    const int arg = 1;
+    luaL_checktype(L, arg, LUA_TTABLE);
+
+    lua_getfield(L, arg, "ppq");                                /* -> ppq */
+    double ppq = luaL_optnumber(L, -1, 96);
+    lua_getfield(L, arg, "tempo");                              /* -> ppq, tempo */
+    double tempo = luaL_optnumber(L, -1, 120);
+    lua_pop(L, 2);                                              /* -> */
+    luaL_argcheck(L, ppq   > 0, arg, "positive value expected for field 'ppq'");
+    luaL_argcheck(L, tempo > 0, arg, "positive value expected for field 'tempo'");
+
+    lua_Integer n = luaL_len(L, arg);
+    size_t dataSize = 0;
+    for (lua_Integer i = 1; i <= n; ++i) {
+        lua_rawgeti(L, arg, i);                                 /* -> event */
+        dataSize += checkEventSize(L, arg, lua_gettop(L), i);
+        lua_pop(L, 1);                                          /* -> */
+    }
+    MidiPattern* pattern = auproc_midi_pattern_push_new(L, ppq, tempo, n, dataSize); /* -> pattern */
+
+    size_t offset = 0;
+    for (lua_Integer i = 1; i <= n; ++i) {
+        lua_rawgeti(L, arg, i);                                 /* -> pattern, event */
+        int event = lua_gettop(L);
+        size_t size = checkEventSize(L, arg, event, i);
+        MidiPatternEvent* e = pattern->events + (i - 1);
+        lua_rawgeti(L, event, 1);                               /* -> pattern, event, time */
+        e->time   = lua_tonumber(L, -1);
+        e->offset = offset;
+        e->size   = size;
+        lua_rawgeti(L, event, 2);                               /* -> pattern, event, time, bytes */
+        if (lua_type(L, -1) == LUA_TSTRING) {
+            memcpy(pattern->data + offset, lua_tostring(L, -1), size);
+        } else {
+            for (size_t j = 0; j < size; ++j) {
+                lua_rawgeti(L, event, 2 + j);                   /* -> pattern, event, time, bytes, b */
+                lua_Integer b = lua_tointeger(L, -1);
+                if (!lua_isnumber(L, -1) || b < 0 || b > 255) {
+                    const char* msg = lua_pushfstring(L, "invalid midi byte for event %d", (int)i);
+                    return luaL_argerror(L, arg, msg);
+                }
+                pattern->data[offset + j] = (unsigned char) b;
+                lua_pop(L, 1);                                  /* -> pattern, event, time, bytes */
+            }
+        }
+        lua_pop(L, 3);                                          /* -> pattern */
+        offset += size;
+    }
+    auproc_midi_pattern_sort(pattern);
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int MidiPattern_release(lua_State* L)
+{
+    MidiPattern* udata = luaL_checkudata(L, 1, MIDI_PATTERN_CLASS_NAME);
+    if (udata->events) {
+        free(udata->events);
+        udata->events     = NULL;
+        udata->eventCount = 0;
+    }
+    if (udata->data) {
+        free(udata->data);
+        udata->data     = NULL;
+        udata->dataSize = 0;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int MidiPattern_toString(lua_State* L)
+{
+    MidiPattern* udata = luaL_checkudata(L, 1, MIDI_PATTERN_CLASS_NAME);
+
+    lua_pushfstring(L, "%s: %p", MIDI_PATTERN_CLASS_NAME, udata);
+
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int MidiPattern_count(lua_State* L)
+{
+    MidiPattern* udata = luaL_checkudata(L, 1, MIDI_PATTERN_CLASS_NAME);
+    lua_pushinteger(L, udata->eventCount);
+    return 1;
+}
+
+static int MidiPattern_ppq(lua_State* L)
+{
+    MidiPattern* udata = luaL_checkudata(L, 1, MIDI_PATTERN_CLASS_NAME);
+    lua_pushnumber(L, udata->ppq);
+    return 1;
+}
+
+static int MidiPattern_tempo(lua_State* L)
+{
+    MidiPattern* udata = luaL_checkudata(L, 1, MIDI_PATTERN_CLASS_NAME);
+    lua_pushnumber(L, udata->tempo);
+    return 1;
+}
+
+static int MidiPattern_duration(lua_State* L)
+{
+    MidiPattern* udata = luaL_checkudata(L, 1, MIDI_PATTERN_CLASS_NAME);
+    if (udata->eventCount > 0) {
+        lua_pushnumber(L, udata->events[udata->eventCount - 1].time);
+    } else {
+        lua_pushnumber(L, 0);
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static const luaL_Reg MidiPatternMethods[] =
+{
+    { "count",       MidiPattern_count },
+    { "ppq",         MidiPattern_ppq },
+    { "tempo",       MidiPattern_tempo },
+    { "duration",    MidiPattern_duration },
+    { NULL,          NULL } /* sentinel */
+};
+
+static const luaL_Reg MidiPatternMetaMethods[] =
+{
+    { "__tostring", MidiPattern_toString },
+    { "__gc",       MidiPattern_release  },
+
+    { NULL,       NULL } /* sentinel */
+};
+
+static const luaL_Reg ModuleFunctions[] =
+{
+    { "new_midi_pattern", MidiPattern_new },
+    { NULL,               NULL } /* sentinel */
+};
+
+/* ============================================================================================ */
+
+static void setupMidiPatternMeta(lua_State* L)
+{                                                          /* -> meta */
+    lua_pushstring(L, MIDI_PATTERN_CLASS_NAME);            /* -> meta, className */
+    lua_setfield(L, -2, "__metatable");                    /* -> meta */
+
+    luaL_setfuncs(L, MidiPatternMetaMethods, 0);           /* -> meta */
+
+    lua_newtable(L);                                       /* -> meta, MidiPatternClass */
+    luaL_setfuncs(L, MidiPatternMethods, 0);               /* -> meta, MidiPatternClass */
+    lua_setfield (L, -2, "__index");                       /* -> meta */
+}
+
+
+/* ============================================================================================ */
+
+int auproc_midi_pattern_init_module(lua_State* L, int module)
+{
+    if (luaL_newmetatable(L, MIDI_PATTERN_CLASS_NAME)) {
+        setupMidiPatternMeta(L);
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, module);
+        luaL_setfuncs(L, ModuleFunctions, 0);
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+/* ============================================================================================ */
+
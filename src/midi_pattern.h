@@ -0,0 +1,49 @@
+#ifndef AUPROC_MIDI_PATTERN_H
+#define AUPROC_MIDI_PATTERN_H
+
+#include "util.h"
+
+typedef struct MidiPatternEvent MidiPatternEvent;
+typedef struct MidiPattern      MidiPattern;
+
+struct MidiPatternEvent
+{
+    double   time;     /* in ticks */
+    uint32_t offset;   /* offset of event bytes in pattern data */
+    uint32_t size;     /* number of event bytes */
+};
+
+/**
+ * Immutable time sorted array of midi events. The event data is not changed 
+ * after construction, so it can be read from the realtime thread without locking 
+ * as long as a reference to the pattern object is held.
+ */
+struct MidiPattern
+{
+    const char*       className;
+    double            ppq;
+    double            tempo;
+    size_t            eventCount;
+    MidiPatternEvent* events;
+    size_t            dataSize;
+    unsigned char*    data;
+};
+
+/**
+ * Pushes a new pattern object with uninitialized event data onto the stack.
+ * Raises a Lua error if memory cannot be allocated. 
+ */
+MidiPattern* auproc_midi_pattern_push_new(lua_State* L, double ppq, double tempo, 
+                                          size_t eventCount, size_t dataSize);
+
+/**
+ * Sorts the pattern events by time. Events with equal time keep the order
+ * of their event bytes in the pattern data.
+ */
+void auproc_midi_pattern_sort(MidiPattern* pattern);
+
+MidiPattern* auproc_midi_pattern_check(lua_State* L, int arg);
+
+int auproc_midi_pattern_init_module(lua_State* L, int module);
+
+#endif // AUPROC_MIDI_PATTERN_H
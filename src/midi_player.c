@@ -0,0 +1,520 @@
+#include "midi_player.h"
+#include "midi_pattern.h"
+
+#define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
+#include "auproc_capi.h"
+#include "held_notes.h"
+
+#define SENDER_CAPI_IMPLEMENT_GET_CAPI 1
+#include "sender_capi.h"
+
+/* ============================================================================================ */
+
+static const char* const MIDI_PLAYER_CLASS_NAME = "auproc.midi_player";
+
+static const char* ERROR_INVALID_MIDI_PLAYER = "invalid auproc.midi_player";
+
+/* ============================================================================================ */
+
+typedef struct MidiPlayerUserData MidiPlayerUserData;
+
+struct MidiPlayerUserData
+{
+    const char*        className;
+    auproc_processor*  processor;
+
+    bool               closed;
+    bool               activated;
+
+    const auproc_capi*  auprocCapi;
+    auproc_engine*      auprocEngine;
+    uint32_t            sampleRate;
+
+    auproc_connector*      midiOutConnector;
+    const auproc_midimeth* midiMethods;
+
+    const sender_capi* senderCapi;
+    sender_object*     sender;
+    sender_reader*     senderReader;
+
+    bool               hasMessage;
+    uint32_t           messageFrame;
+    sender_capi_value  messageValue;
+
+    MidiPattern*       pattern;
+    size_t             cursor;
+    double             tick;
+    double             ticksPerFrame;
+    bool               playing;
+    bool               looping;
+    double             loopStart;
+    double             loopEnd;
+
+    HeldNotes          heldNotes;
+};
+
+/* ============================================================================================ */
+
+static void setupMidiPlayerMeta(lua_State* L);
+
+static int pushMidiPlayerMeta(lua_State* L)
+{
+    if (luaL_newmetatable(L, MIDI_PLAYER_CLASS_NAME)) {
+        setupMidiPlayerMeta(L);
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static MidiPlayerUserData* checkMidiPlayerUdata(lua_State* L, int arg)
+{
+    MidiPlayerUserData* udata = luaL_checkudata(L, arg, MIDI_PLAYER_CLASS_NAME);
+    if (udata->auprocCapi) {
+        udata->auprocCapi->checkEngineIsNotClosed(L, udata->auprocEngine);
+    }
+    if (udata->closed) {
+        luaL_error(L, ERROR_INVALID_MIDI_PLAYER);
+        return NULL;
+    }
+    return udata;
+}
+
+/* ============================================================================================ */
+
+static void setTempo(MidiPlayerUserData* udata, double tempo)
+{
+    udata->ticksPerFrame = tempo * udata->pattern->ppq / (60.0 * udata->sampleRate);
+}
+
+static void locate(MidiPlayerUserData* udata, double tick)
+{
+    const MidiPatternEvent* events = udata->pattern->events;
+    size_t lo = 0;
+    size_t hi = udata->pattern->eventCount;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (events[mid].time < tick) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    udata->cursor = lo;
+    udata->tick   = tick;
+}
+
+/* ============================================================================================ */
+
+static void emitEvent(MidiPlayerUserData* udata, auproc_midibuf* outBuf, uint32_t t,
+                      const unsigned char* bytes, size_t size)
+{
+    unsigned char* data = udata->midiMethods->reserveMidiEvent(outBuf, t, size);
+    if (data) {
+        memcpy(data, bytes, size);
+        held_notes_update(&udata->heldNotes, bytes[0] & 0x0F, bytes, size);
+    }
+}
+
+static void releaseNotes(MidiPlayerUserData* udata, auproc_midibuf* outBuf, uint32_t t)
+{
+    held_notes_release(&udata->heldNotes, udata->midiMethods, outBuf, t);
+}
+
+/* ============================================================================================ */
+
+static void render(MidiPlayerUserData* udata, auproc_midibuf* outBuf, uint32_t begin, uint32_t end)
+{
+    const MidiPattern*      pattern = udata->pattern;
+    const MidiPatternEvent* events  = pattern->events;
+    const double            tpf     = udata->ticksPerFrame;
+
+    while (udata->playing && begin < end)
+    {
+        double tick    = udata->tick;
+        double endTick = tick + (end - begin) * tpf;
+        bool   wrap    = false;
+        if (udata->looping && tick < udata->loopEnd && endTick >= udata->loopEnd) {
+            endTick = udata->loopEnd;
+            wrap    = true;
+        }
+        while (udata->cursor < pattern->eventCount && events[udata->cursor].time < endTick) {
+            const MidiPatternEvent* e = events + udata->cursor++;
+            uint32_t t = begin + (uint32_t)((e->time - tick) / tpf);
+            if (t >= end) {
+                t = end - 1;
+            }
+            emitEvent(udata, outBuf, t, pattern->data + e->offset, e->size);
+        }
+        if (wrap) {
+            uint32_t t = begin + (uint32_t)ceil((endTick - tick) / tpf);
+            if (t > end) {
+                t = end;
+            }
+            releaseNotes(udata, outBuf, (t < end) ? t : end - 1);
+            locate(udata, udata->loopStart);
+            begin = t;
+        } else {
+            udata->tick = endTick;
+            begin = end;
+        }
+    }
+}
+
+/* ============================================================================================ */
+
+static bool isCommand(const sender_capi_value* value, const char* name)
+{
+    size_t len = strlen(name);
+    return    value->type == SENDER_CAPI_TYPE_STRING
+           && value->strVal.len == len
+           && memcmp(value->strVal.ptr, name, len) == 0;
+}
+
+static bool nextNumber(const sender_capi* senderCapi, sender_reader* reader, lua_Number* value)
+{
+    sender_capi_value senderValue;
+    senderCapi->nextValueFromReader(reader, &senderValue);
+    if (senderValue.type == SENDER_CAPI_TYPE_INTEGER) {
+        *value = senderValue.intVal;
+        return true;
+    } else if (senderValue.type == SENDER_CAPI_TYPE_NUMBER) {
+        *value = senderValue.numVal;
+        return true;
+    }
+    return false;
+}
+
+static void applyMessage(MidiPlayerUserData* udata, auproc_midibuf* outBuf, uint32_t t)
+{
+    const sender_capi* senderCapi = udata->senderCapi;
+    sender_reader*     reader     = udata->senderReader;
+    sender_capi_value* value      = &udata->messageValue;
+
+    while (value->type == SENDER_CAPI_TYPE_STRING)
+    {
+        lua_Number v1, v2;
+        if (isCommand(value, "start")) {
+            udata->playing = true;
+        }
+        else if (isCommand(value, "stop")) {
+            udata->playing = false;
+            releaseNotes(udata, outBuf, t);
+        }
+        else if (isCommand(value, "locate") && nextNumber(senderCapi, reader, &v1)) {
+            releaseNotes(udata, outBuf, t);
+            locate(udata, (v1 > 0) ? v1 : 0);
+        }
+        else if (isCommand(value, "tempo") && nextNumber(senderCapi, reader, &v1) && v1 > 0) {
+            setTempo(udata, v1);
+        }
+        else if (   isCommand(value, "loop") && nextNumber(senderCapi, reader, &v1)
+                                             && nextNumber(senderCapi, reader, &v2)) {
+            udata->loopStart = (v1 > 0) ? v1 : 0;
+            udata->loopEnd   = v2;
+            udata->looping   = (v2 > udata->loopStart);
+        }
+        else {
+            break;
+        }
+        senderCapi->nextValueFromReader(reader, value);
+    }
+}
+
+/* ============================================================================================ */
+
+static int processCallback(uint32_t nframes, void* processorData)
+{
+    MidiPlayerUserData*    udata      = (MidiPlayerUserData*) processorData;
+    const auproc_capi*     auprocCapi = udata->auprocCapi;
+    const auproc_midimeth* methods    = udata->midiMethods;
+
+    auproc_midibuf* outBuf = methods->getMidiBuffer(udata->midiOutConnector, nframes);
+    methods->clearBuffer(outBuf);
+
+    uint32_t f0  = auprocCapi->getProcessBeginFrameTime(udata->auprocEngine);
+    uint32_t pos = 0;
+
+    if (udata->sender)
+    {
+        const sender_capi* senderCapi = udata->senderCapi;
+        sender_reader*     reader     = udata->senderReader;
+        sender_capi_value* value      = &udata->messageValue;
+
+    nextMsg:
+        if (!udata->hasMessage) {
+            int rc = senderCapi->nextMessageFromSender(udata->sender, reader,
+                                                       true /* nonblock */, 0 /* timeout */,
+                                                       NULL /* errorHandler */, NULL /* errorHandlerData */);
+            if (rc == 0) {
+                udata->hasMessage   = true;
+                udata->messageFrame = f0;
+                senderCapi->nextValueFromReader(reader, value);
+                if (value->type == SENDER_CAPI_TYPE_INTEGER) {
+                    udata->messageFrame = value->intVal;
+                    senderCapi->nextValueFromReader(reader, value);
+                } else if (value->type == SENDER_CAPI_TYPE_NUMBER) {
+                    udata->messageFrame = value->numVal;
+                    senderCapi->nextValueFromReader(reader, value);
+                }
+            }
+        }
+        if (udata->hasMessage) {
+            int32_t t = (int32_t)(udata->messageFrame - f0);
+            if (t < (int32_t)nframes) {
+                if (t > (int32_t)pos) {
+                    render(udata, outBuf, pos, t);
+                    pos = t;
+                }
+                applyMessage(udata, outBuf, (pos < nframes) ? pos : nframes - 1);
+                senderCapi->clearReader(reader);
+                udata->hasMessage = false;
+                goto nextMsg;
+            }
+        }
+    }
+    render(udata, outBuf, pos, nframes);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static void engineClosedCallback(void* processorData)
+{
+    MidiPlayerUserData* udata = (MidiPlayerUserData*) processorData;
+
+    udata->closed    = true;
+    udata->activated = false;
+}
+
+static void engineReleasedCallback(void* processorData)
+{
+    MidiPlayerUserData* udata = (MidiPlayerUserData*) processorData;
+
+    udata->closed       = true;
+    udata->activated    = false;
+    udata->auprocCapi    = NULL;
+    udata->auprocEngine  = NULL;
+}
+
+/* ============================================================================================ */
+
+static int MidiPlayer_new(lua_State* L)
+{
+    const int conArg  = 1;
+    const int patArg  = 2;
+    const int sndrArg = 3;
+    MidiPlayerUserData* udata = lua_newuserdata(L, sizeof(MidiPlayerUserData));
+    memset(udata, 0, sizeof(MidiPlayerUserData));
+    udata->className = MIDI_PLAYER_CLASS_NAME;
+    pushMidiPlayerMeta(L);                                /* -> udata, meta */
+    lua_setmetatable(L, -2);                              /* -> udata */
+    int versionError = 0;
+    const auproc_capi* capi = auproc_get_capi(L, conArg, &versionError);
+    auproc_engine* engine = NULL;
+    auproc_info    info   = {0};
+    if (capi) {
+        engine = capi->getEngine(L, conArg, &info);
+    }
+    if (!capi || !engine) {
+        if (versionError) {
+            return luaL_argerror(L, conArg, "auproc version mismatch");
+        } else {
+            return luaL_argerror(L, conArg, "expected connector object");
+        }
+    }
+    if (info.sampleRate == 0) {
+        return luaL_argerror(L, conArg, "cannot determine sample rate");
+    }
+    MidiPattern* pattern = auproc_midi_pattern_check(L, patArg);
+
+    lua_newtable(L);                                      /* -> udata, uservalue */
+    lua_pushvalue(L, patArg);                             /* -> udata, uservalue, pattern */
+    lua_rawseti(L, -2, 1);                                /* -> udata, uservalue */
+    lua_setuservalue(L, -2);                              /* -> udata */
+
+    udata->sampleRate = info.sampleRate;
+    udata->pattern    = pattern;
+    setTempo(udata, pattern->tempo);
+    locate(udata, 0);
+
+    if (!lua_isnoneornil(L, sndrArg))
+    {
+        int errReason = 0;
+        const sender_capi* senderCapi = sender_get_capi(L, sndrArg, &errReason);
+        sender_object*     sender     = senderCapi ? senderCapi->toSender(L, sndrArg) : NULL;
+
+        if (!senderCapi || !sender) {
+            if (errReason == 1) {
+                return luaL_argerror(L, sndrArg, "sender capi version mismatch");
+            } else {
+                return luaL_argerror(L, sndrArg, "expected object with sender capi");
+            }
+        }
+        udata->senderCapi = senderCapi;
+        udata->sender     = sender;
+        senderCapi->retainSender(sender);
+
+        udata->senderReader = senderCapi->newReader(16 * 1024, 1);
+        if (!udata->senderReader) {
+            return luaL_error(L, "out of memory");
+        }
+    }
+    const char* processorName = lua_pushfstring(L, "%s: %p", MIDI_PLAYER_CLASS_NAME, udata);   /* -> udata, name */
+
+    auproc_con_reg conReg = {AUPROC_MIDI, AUPROC_OUT, NULL};
+    auproc_con_reg_err regError = {0};
+    auproc_processor* proc = capi->registerProcessor(L, conArg, 1, engine, processorName, udata,
+                                                        processCallback, NULL, engineClosedCallback, engineReleasedCallback,
+                                                        &conReg, &regError);
+    lua_pop(L, 1); /* -> udata */
+
+    if (!proc)
+    {
+        if (regError.errorType == AUPROC_REG_ERR_CONNCTOR_INVALID) {
+            return luaL_argerror(L, conArg, "invalid connector object");
+        }
+        else if (regError.errorType == AUPROC_REG_ERR_ENGINE_MISMATCH)
+        {
+            const char* msg = lua_pushfstring(L, "connector belongs to other %s",
+                                                 capi->engine_category_name);
+            return luaL_argerror(L, conArg, msg);
+        }
+        else if (regError.errorType == AUPROC_REG_ERR_ARG_INVALID
+              || regError.errorType == AUPROC_REG_ERR_WRONG_DIRECTION
+              || regError.errorType == AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE)
+        {
+            return luaL_argerror(L, conArg, "expected MIDI OUT connector");
+        }
+        else {
+            return luaL_error(L, "cannot register processor (err=%d)", regError.errorType);
+        }
+    }
+
+    udata->processor        = proc;
+    udata->activated        = false;
+    udata->auprocCapi       = capi;
+    udata->auprocEngine     = engine;
+    udata->midiOutConnector = conReg.connector;
+    udata->midiMethods      = conReg.midiMethods;
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int MidiPlayer_release(lua_State* L)
+{
+    MidiPlayerUserData* udata = luaL_checkudata(L, 1, MIDI_PLAYER_CLASS_NAME);
+    udata->closed    = true;
+    udata->activated = false;
+    if (udata->auprocCapi) {
+        udata->auprocCapi->unregisterProcessor(L, udata->auprocEngine, udata->processor);
+        udata->processor   = NULL;
+        udata->auprocCapi   = NULL;
+        udata->auprocEngine = NULL;
+    }
+    if (udata->sender) {
+        if (udata->senderReader) {
+            udata->senderCapi->freeReader(udata->senderReader);
+            udata->senderReader = NULL;
+        }
+        udata->senderCapi->releaseSender(udata->sender);
+        udata->sender     = NULL;
+        udata->senderCapi = NULL;
+    }
+    udata->pattern = NULL;
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int MidiPlayer_toString(lua_State* L)
+{
+    MidiPlayerUserData* udata = luaL_checkudata(L, 1, MIDI_PLAYER_CLASS_NAME);
+
+    lua_pushfstring(L, "%s: %p", MIDI_PLAYER_CLASS_NAME, udata);
+
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int MidiPlayer_activate(lua_State* L)
+{
+    MidiPlayerUserData* udata = checkMidiPlayerUdata(L, 1);
+    if (!udata->activated) {
+        udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = true;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int MidiPlayer_deactivate(lua_State* L)
+{
+    MidiPlayerUserData* udata = checkMidiPlayerUdata(L, 1);
+    if (udata->activated) {
+        udata->auprocCapi->deactivateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = false;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static const luaL_Reg MidiPlayerMethods[] =
+{
+    { "activate",    MidiPlayer_activate },
+    { "deactivate",  MidiPlayer_deactivate },
+    { "close",       MidiPlayer_release },
+    { NULL,          NULL } /* sentinel */
+};
+
+static const luaL_Reg MidiPlayerMetaMethods[] =
+{
+    { "__tostring", MidiPlayer_toString },
+    { "__gc",       MidiPlayer_release  },
+
+    { NULL,       NULL } /* sentinel */
+};
+
+static const luaL_Reg ModuleFunctions[] =
+{
+    { "new_midi_player", MidiPlayer_new },
+    { NULL,              NULL } /* sentinel */
+};
+
+/* ============================================================================================ */
+
+static void setupMidiPlayerMeta(lua_State* L)
+{                                                          /* -> meta */
+    lua_pushstring(L, MIDI_PLAYER_CLASS_NAME);             /* -> meta, className */
+    lua_setfield(L, -2, "__metatable");                    /* -> meta */
+
+    luaL_setfuncs(L, MidiPlayerMetaMethods, 0);            /* -> meta */
+
+    lua_newtable(L);                                       /* -> meta, MidiPlayerClass */
+    luaL_setfuncs(L, MidiPlayerMethods, 0);                /* -> meta, MidiPlayerClass */
+    lua_setfield (L, -2, "__index");                       /* -> meta */
+}
+
+
+/* ============================================================================================ */
+
+int auproc_midi_player_init_module(lua_State* L, int module)
+{
+    if (luaL_newmetatable(L, MIDI_PLAYER_CLASS_NAME)) {
+        setupMidiPlayerMeta(L);
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, module);
+        luaL_setfuncs(L, ModuleFunctions, 0);
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+/* ============================================================================================ */
+
@@ -0,0 +1,531 @@
+#include "midi_recorder.h"
+#include "midi_file.h"
+#include "async_util.h"
+
+#define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
+#include "auproc_capi.h"
+
+/* ============================================================================================ */
+
+static const char* const MIDI_RECORDER_CLASS_NAME = "auproc.midi_recorder";
+
+static const char* ERROR_INVALID_MIDI_RECORDER = "invalid auproc.midi_recorder";
+
+/* ============================================================================================ */
+
+/*
+ * Midi events are passed from the realtime thread to the writer thread
+ * through a single producer/single consumer ring buffer of records, each
+ * record consisting of a RecordHeader followed by the midi bytes padded
+ * to a multiple of RECORD_ALIGN. A record with size WRAP_MARKER tells the
+ * reader to continue at the beginning of the ring buffer.
+ */
+typedef struct RecordHeader RecordHeader;
+
+struct RecordHeader
+{
+    uint32_t frameTime;
+    uint32_t size;
+};
+
+#define RECORD_ALIGN  8
+#define WRAP_MARKER   0xFFFFFFFF
+
+#define WRITER_SLEEP_MILLIS 10
+
+/* ============================================================================================ */
+
+typedef struct MidiRecorderUserData MidiRecorderUserData;
+
+struct MidiRecorderUserData
+{
+    const char*        className;
+    auproc_processor*  processor;
+
+    bool               closed;
+    bool               activated;
+
+    const auproc_capi*  auprocCapi;
+    auproc_engine*      auprocEngine;
+    uint32_t            sampleRate;
+
+    auproc_connector*      midiInConnector;
+    const auproc_midimeth* midiMethods;
+
+    unsigned char*     ring;
+    uint32_t           ringCapacity;
+    AtomicCounter      writePos;
+    AtomicCounter      readPos;
+    AtomicCounter      dropped;
+    AtomicCounter      stopRequested;
+    bool               startWritten;
+
+    AsyncThread        thread;
+    const auproc_capi* logCapi;
+    char*              fileName;
+    int                ppq;
+    double             tempo;
+    int                intervalMillis;
+    bool               startRead;
+    uint32_t           lastFrame;
+    uint64_t           frames;
+    SmfTrack           track;
+};
+
+/* ============================================================================================ */
+
+static void setupMidiRecorderMeta(lua_State* L);
+
+static int pushMidiRecorderMeta(lua_State* L)
+{
+    if (luaL_newmetatable(L, MIDI_RECORDER_CLASS_NAME)) {
+        setupMidiRecorderMeta(L);
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static MidiRecorderUserData* checkMidiRecorderUdata(lua_State* L, int arg)
+{
+    MidiRecorderUserData* udata = luaL_checkudata(L, arg, MIDI_RECORDER_CLASS_NAME);
+    if (udata->auprocCapi) {
+        udata->auprocCapi->checkEngineIsNotClosed(L, udata->auprocEngine);
+    }
+    if (udata->closed) {
+        luaL_error(L, ERROR_INVALID_MIDI_RECORDER);
+        return NULL;
+    }
+    return udata;
+}
+
+/* ============================================================================================ */
+
+static inline uint32_t recordLength(uint32_t size)
+{
+    return sizeof(RecordHeader) + ((size + RECORD_ALIGN - 1) & ~(uint32_t)(RECORD_ALIGN - 1));
+}
+
+/*
+ * Called in the realtime thread. The write position is always kept at
+ * least sizeof(RecordHeader) bytes below the end of the ring buffer so
+ * that there is always room for a wrap marker.
+ */
+static bool pushRecord(MidiRecorderUserData* udata, uint32_t frameTime,
+                       const unsigned char* bytes, uint32_t size)
+{
+    uint32_t cap = udata->ringCapacity;
+    uint32_t len = recordLength(size);
+    uint32_t w   = atomic_get(&udata->writePos);
+    uint32_t r   = atomic_get(&udata->readPos);
+
+    if (w >= r) {
+        if (cap - w < len + sizeof(RecordHeader)) {
+            if (r <= len) {
+                return false;
+            }
+            RecordHeader* wrap = (RecordHeader*)(udata->ring + w);
+            wrap->frameTime = frameTime;
+            wrap->size      = WRAP_MARKER;
+            w = 0;
+        }
+    }
+    else if (w + len >= r) {
+        return false;
+    }
+    RecordHeader* h = (RecordHeader*)(udata->ring + w);
+    h->frameTime = frameTime;
+    h->size      = size;
+    if (size > 0) {
+        memcpy(udata->ring + w + sizeof(RecordHeader), bytes, size);
+    }
+    atomic_set(&udata->writePos, w + len);
+    return true;
+}
+
+/* ============================================================================================ */
+
+static int processCallback(uint32_t nframes, void* processorData)
+{
+    MidiRecorderUserData*  udata      = (MidiRecorderUserData*) processorData;
+    const auproc_capi*     auprocCapi = udata->auprocCapi;
+    const auproc_midimeth* methods    = udata->midiMethods;
+
+    uint32_t f0 = auprocCapi->getProcessBeginFrameTime(udata->auprocEngine);
+
+    if (!udata->startWritten) {
+        /* a record without midi bytes marks the beginning of the recording */
+        udata->startWritten = pushRecord(udata, f0, NULL, 0);
+        if (!udata->startWritten) {
+            return 0;
+        }
+    }
+    auproc_midibuf* inBuf = methods->getMidiBuffer(udata->midiInConnector, nframes);
+    uint32_t count = methods->getEventCount(inBuf);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        auproc_midi_event event;
+        if (methods->getMidiEvent(&event, inBuf, i) == 0 && event.size > 0) {
+            if (!pushRecord(udata, f0 + event.time, event.buffer, event.size)) {
+                atomic_inc(&udata->dropped);
+            }
+        }
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+/*
+ * Called in the writer thread. Returns true if new events were appended
+ * to the track.
+ */
+static bool readRecords(MidiRecorderUserData* udata)
+{
+    bool     added = false;
+    uint32_t r     = atomic_get(&udata->readPos);
+    uint32_t w     = atomic_get(&udata->writePos);
+
+    double ticksPerFrame = udata->tempo * udata->ppq / (60.0 * udata->sampleRate);
+
+    while (r != w) {
+        const RecordHeader* h = (const RecordHeader*)(udata->ring + r);
+        if (h->size == WRAP_MARKER) {
+            r = 0;
+            continue;
+        }
+        if (!udata->startRead) {
+            udata->startRead = true;
+            udata->lastFrame = h->frameTime;
+            udata->frames    = 0;
+        } else {
+            int32_t diff = (int32_t)(h->frameTime - udata->lastFrame);
+            if (diff > 0) {
+                udata->frames   += diff;
+                udata->lastFrame = h->frameTime;
+            }
+        }
+        if (h->size > 0) {
+            uint64_t tick = (uint64_t)(udata->frames * ticksPerFrame + 0.5);
+            if (!auproc_smf_track_add_event(&udata->track, tick, udata->ring + r + sizeof(RecordHeader), h->size)) {
+                atomic_inc(&udata->dropped);
+            }
+            added = true;
+        }
+        r += recordLength(h->size);
+        atomic_set(&udata->readPos, r);
+        w = atomic_get(&udata->writePos);
+    }
+    atomic_set(&udata->readPos, r);
+    return added;
+}
+
+static void writerThread(void* arg)
+{
+    MidiRecorderUserData* udata = (MidiRecorderUserData*) arg;
+
+    bool modified = true;
+    int  waited   = udata->intervalMillis;
+
+    while (true) {
+        bool stop = atomic_get(&udata->stopRequested);
+        if (readRecords(udata)) {
+            modified = true;
+        }
+        if (modified && (stop || waited >= udata->intervalMillis)) {
+            if (!auproc_smf_write_file(udata->fileName, udata->ppq, &udata->track)) {
+                udata->logCapi->logError(NULL, "%s: cannot write file '%s'",
+                                         MIDI_RECORDER_CLASS_NAME, udata->fileName);
+            }
+            modified = false;
+            waited   = 0;
+        }
+        if (stop) {
+            break;
+        }
+        async_sleep_millis(WRITER_SLEEP_MILLIS);
+        waited += WRITER_SLEEP_MILLIS;
+    }
+}
+
+/* ============================================================================================ */
+
+static void engineClosedCallback(void* processorData)
+{
+    MidiRecorderUserData* udata = (MidiRecorderUserData*) processorData;
+
+    udata->closed    = true;
+    udata->activated = false;
+}
+
+static void engineReleasedCallback(void* processorData)
+{
+    MidiRecorderUserData* udata = (MidiRecorderUserData*) processorData;
+
+    udata->closed       = true;
+    udata->activated    = false;
+    udata->auprocCapi    = NULL;
+    udata->auprocEngine  = NULL;
+}
+
+/* ============================================================================================ */
+
+static int optIntField(lua_State* L, int arg, const char* name, int def, int min)
+{
+    int rslt = def;
+    lua_getfield(L, arg, name);                           /* -> value */
+    if (!lua_isnil(L, -1)) {
+        if (!lua_isnumber(L, -1) || lua_tonumber(L, -1) < min) {
+            const char* msg = lua_pushfstring(L, "invalid value for field '%s'", name);
+            luaL_argerror(L, arg, msg);
+        }
+        rslt = lua_tonumber(L, -1);
+    }
+    lua_pop(L, 1);                                        /* -> */
+    return rslt;
+}
+
+static int MidiRecorder_new(lua_State* L)
+{
+    const int conArg  = 1;
+    const int fileArg = 2;
+    const int optArg  = 3;
+    MidiRecorderUserData* udata = lua_newuserdata(L, sizeof(MidiRecorderUserData));
+    memset(udata, 0, sizeof(MidiRecorderUserData));
+    udata->className = MIDI_RECORDER_CLASS_NAME;
+    auproc_smf_track_init(&udata->track);
+    pushMidiRecorderMeta(L);                              /* -> udata, meta */
+    lua_setmetatable(L, -2);                              /* -> udata */
+    int versionError = 0;
+    const auproc_capi* capi = auproc_get_capi(L, conArg, &versionError);
+    auproc_engine* engine = NULL;
+    auproc_info    info   = {0};
+    if (capi) {
+        engine = capi->getEngine(L, conArg, &info);
+    }
+    if (!capi || !engine) {
+        if (versionError) {
+            return luaL_argerror(L, conArg, "auproc version mismatch");
+        } else {
+            return luaL_argerror(L, conArg, "expected connector object");
+        }
+    }
+    if (info.sampleRate == 0) {
+        return luaL_argerror(L, conArg, "cannot determine sample rate");
+    }
+    size_t      fileNameLength;
+    const char* fileName = luaL_checklstring(L, fileArg, &fileNameLength);
+
+    udata->ppq            = 960;
+    udata->tempo          = 120;
+    udata->intervalMillis = 1000;
+    udata->ringCapacity   = 64 * 1024;
+
+    if (!lua_isnoneornil(L, optArg)) {
+        luaL_checktype(L, optArg, LUA_TTABLE);
+        udata->ppq = optIntField(L, optArg, "ppq", udata->ppq, 1);
+        luaL_argcheck(L, udata->ppq <= 0x7FFF, optArg, "invalid value for field 'ppq'");
+
+        lua_getfield(L, optArg, "tempo");                 /* -> udata, tempo */
+        udata->tempo = luaL_optnumber(L, -1, udata->tempo);
+        lua_getfield(L, optArg, "interval");              /* -> udata, tempo, interval */
+        double interval = luaL_optnumber(L, -1, udata->intervalMillis / 1000.0);
+        lua_pop(L, 2);                                    /* -> udata */
+        luaL_argcheck(L, udata->tempo > 0, optArg, "positive value expected for field 'tempo'");
+        luaL_argcheck(L, interval > 0,     optArg, "positive value expected for field 'interval'");
+        udata->intervalMillis = interval * 1000;
+
+        udata->ringCapacity = optIntField(L, optArg, "bufferSize", udata->ringCapacity, 1024);
+        luaL_argcheck(L, udata->ringCapacity <= 0x10000000, optArg, "invalid value for field 'bufferSize'");
+        udata->ringCapacity &= ~(uint32_t)(RECORD_ALIGN - 1);
+    }
+    udata->sampleRate = info.sampleRate;
+    udata->logCapi    = capi;
+
+    udata->fileName = malloc(fileNameLength + 1);
+    udata->ring     = malloc(udata->ringCapacity);
+    if (!udata->fileName || !udata->ring) {
+        return luaL_error(L, "out of memory");
+    }
+    memcpy(udata->fileName, fileName, fileNameLength + 1);
+
+    if (!auproc_smf_track_add_tempo(&udata->track, 0, udata->tempo)) {
+        return luaL_error(L, "out of memory");
+    }
+    if (!auproc_smf_write_file(udata->fileName, udata->ppq, &udata->track)) {
+        return luaL_error(L, "cannot write file '%s': %s", udata->fileName, strerror(errno));
+    }
+    const char* processorName = lua_pushfstring(L, "%s: %p", MIDI_RECORDER_CLASS_NAME, udata);   /* -> udata, name */
+
+    auproc_con_reg conReg = {AUPROC_MIDI, AUPROC_IN, NULL};
+    auproc_con_reg_err regError = {0};
+    auproc_processor* proc = capi->registerProcessor(L, conArg, 1, engine, processorName, udata,
+                                                        processCallback, NULL, engineClosedCallback, engineReleasedCallback,
+                                                        &conReg, &regError);
+    lua_pop(L, 1); /* -> udata */
+
+    if (!proc)
+    {
+        if (regError.errorType == AUPROC_REG_ERR_CONNCTOR_INVALID) {
+            return luaL_argerror(L, conArg, "invalid connector object");
+        }
+        else if (regError.errorType == AUPROC_REG_ERR_ENGINE_MISMATCH)
+        {
+            const char* msg = lua_pushfstring(L, "connector belongs to other %s",
+                                                 capi->engine_category_name);
+            return luaL_argerror(L, conArg, msg);
+        }
+        else if (regError.errorType == AUPROC_REG_ERR_ARG_INVALID
+              || regError.errorType == AUPROC_REG_ERR_WRONG_DIRECTION
+              || regError.errorType == AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE)
+        {
+            return luaL_argerror(L, conArg, "expected MIDI IN connector");
+        }
+        else {
+            return luaL_error(L, "cannot register processor (err=%d)", regError.errorType);
+        }
+    }
+
+    udata->processor       = proc;
+    udata->activated       = false;
+    udata->auprocCapi      = capi;
+    udata->auprocEngine    = engine;
+    udata->midiInConnector = conReg.connector;
+    udata->midiMethods     = conReg.midiMethods;
+
+    if (!async_thread_start(&udata->thread, writerThread, udata)) {
+        return luaL_error(L, "cannot start writer thread");
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int MidiRecorder_release(lua_State* L)
+{
+    MidiRecorderUserData* udata = luaL_checkudata(L, 1, MIDI_RECORDER_CLASS_NAME);
+    udata->closed    = true;
+    udata->activated = false;
+    if (udata->auprocCapi) {
+        udata->auprocCapi->unregisterProcessor(L, udata->auprocEngine, udata->processor);
+        udata->processor   = NULL;
+        udata->auprocCapi   = NULL;
+        udata->auprocEngine = NULL;
+    }
+    if (udata->thread.started) {
+        atomic_set(&udata->stopRequested, true);
+        async_thread_join(&udata->thread);
+    }
+    auproc_smf_track_free(&udata->track);
+    if (udata->ring) {
+        free(udata->ring);
+        udata->ring = NULL;
+    }
+    if (udata->fileName) {
+        free(udata->fileName);
+        udata->fileName = NULL;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int MidiRecorder_toString(lua_State* L)
+{
+    MidiRecorderUserData* udata = luaL_checkudata(L, 1, MIDI_RECORDER_CLASS_NAME);
+
+    lua_pushfstring(L, "%s: %p", MIDI_RECORDER_CLASS_NAME, udata);
+
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int MidiRecorder_activate(lua_State* L)
+{
+    MidiRecorderUserData* udata = checkMidiRecorderUdata(L, 1);
+    if (!udata->activated) {
+        udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = true;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int MidiRecorder_deactivate(lua_State* L)
+{
+    MidiRecorderUserData* udata = checkMidiRecorderUdata(L, 1);
+    if (udata->activated) {
+        udata->auprocCapi->deactivateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = false;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int MidiRecorder_dropped(lua_State* L)
+{
+    MidiRecorderUserData* udata = luaL_checkudata(L, 1, MIDI_RECORDER_CLASS_NAME);
+    lua_pushinteger(L, atomic_get(&udata->dropped));
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static const luaL_Reg MidiRecorderMethods[] =
+{
+    { "activate",    MidiRecorder_activate },
+    { "deactivate",  MidiRecorder_deactivate },
+    { "dropped",     MidiRecorder_dropped },
+    { "close",       MidiRecorder_release },
+    { NULL,          NULL } /* sentinel */
+};
+
+static const luaL_Reg MidiRecorderMetaMethods[] =
+{
+    { "__tostring", MidiRecorder_toString },
+    { "__gc",       MidiRecorder_release  },
+
+    { NULL,       NULL } /* sentinel */
+};
+
+static const luaL_Reg ModuleFunctions[] =
+{
+    { "new_midi_recorder", MidiRecorder_new },
+    { NULL,                NULL } /* sentinel */
+};
+
+/* ============================================================================================ */
+
+static void setupMidiRecorderMeta(lua_State* L)
+{                                                          /* -> meta */
+    lua_pushstring(L, MIDI_RECORDER_CLASS_NAME);           /* -> meta, className */
+    lua_setfield(L, -2, "__metatable");                    /* -> meta */
+
+    luaL_setfuncs(L, MidiRecorderMetaMethods, 0);          /* -> meta */
+
+    lua_newtable(L);                                       /* -> meta, MidiRecorderClass */
+    luaL_setfuncs(L, MidiRecorderMethods, 0);              /* -> meta, MidiRecorderClass */
+    lua_setfield (L, -2, "__index");                       /* -> meta */
+}
+
+
+/* ============================================================================================ */
+
+int auproc_midi_recorder_init_module(lua_State* L, int module)
+{
+    if (luaL_newmetatable(L, MIDI_RECORDER_CLASS_NAME)) {
+        setupMidiRecorderMeta(L);
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, module);
+        luaL_setfuncs(L, ModuleFunctions, 0);
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+/* ============================================================================================ */
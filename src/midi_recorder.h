@@ -0,0 +1,8 @@
+#ifndef AUPROC_MIDI_RECORDER_H
+#define AUPROC_MIDI_RECORDER_H
+
+#include "util.h"
+
+int auproc_midi_recorder_init_module(lua_State* L, int module);
+
+#endif // AUPROC_MIDI_RECORDER_H
@@ -2,6 +2,7 @@
 
 #define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
 #include "auproc_capi.h"
+#include "held_notes.h"
 
 #define SENDER_CAPI_IMPLEMENT_GET_CAPI 1
 #include "sender_capi.h"
@@ -23,6 +24,7 @@ struct MidiSenderUserData
 
     bool               closed;
     bool               activated;
+    bool               processing;       /* active in the engine, may be releasing notes after deactivate */
     
     const auproc_capi*  auprocCapi;
     auproc_engine*      auprocEngine;
@@ -40,6 +42,9 @@ struct MidiSenderUserData
 
     const void*        nextEventBytes;
     size_t             nextEventBytesCount;
+
+    HeldNotes          heldNotes;
+    AtomicCounter      releaseState;
 };
 
 /* ============================================================================================ */
@@ -81,6 +86,14 @@ static int processCallback(uint32_t nframes, void* processorData)
     
     methods->clearBuffer(outBuf);
     
+    bool releaseNotes;
+    bool running = held_notes_check_state(&udata->releaseState, &releaseNotes);
+    if (releaseNotes) {
+        held_notes_release(&udata->heldNotes, methods, outBuf, 0);
+    }
+    if (!running) {
+        return 0;
+    }
     const sender_capi* senderCapi  =  udata->senderCapi;
     sender_object*     sender      =  udata->sender;
     sender_reader*     reader      =  udata->senderReader;
@@ -136,6 +149,9 @@ nextEvent:
                 unsigned char* data = methods->reserveMidiEvent(outBuf, f-f0, udata->nextEventBytesCount);
                 if (data) {
                     memcpy(data, udata->nextEventBytes, udata->nextEventBytesCount);
+                    if (udata->nextEventBytesCount > 0) {
+                        held_notes_update(&udata->heldNotes, data[0] & 0x0F, data, udata->nextEventBytesCount);
+                    }
                 }
                 f0 = f;
             }
@@ -153,8 +169,9 @@ static void engineClosedCallback(void* processorData)
 {
     MidiSenderUserData* udata = (MidiSenderUserData*) processorData;
  
-    udata->closed    = true;
-    udata->activated = false;
+    udata->closed     = true;
+    udata->activated  = false;
+    udata->processing = false;
 }
 
 static void engineReleasedCallback(void* processorData)
@@ -163,6 +180,7 @@ static void engineReleasedCallback(void* processorData)
  
     udata->closed       = true;
     udata->activated    = false;
+    udata->processing   = false;
     udata->auprocCapi    = NULL;
     udata->auprocEngine  = NULL;
 }
@@ -258,8 +276,12 @@ static int MidiSender_new(lua_State* L)
 static int MidiSender_release(lua_State* L)
 {
     MidiSenderUserData* udata = luaL_checkudata(L, 1, MIDI_SENDER_CLASS_NAME);
-    udata->closed    = true;
-    udata->activated = false;
+    if (udata->auprocCapi && udata->processing && !udata->closed) {
+        held_notes_closing(&udata->releaseState);
+    }
+    udata->closed     = true;
+    udata->activated  = false;
+    udata->processing = false;
     if (udata->auprocCapi) {
         udata->auprocCapi->unregisterProcessor(L, udata->auprocEngine, udata->processor);
         udata->processor   = NULL;
@@ -295,7 +317,11 @@ static int MidiSender_activate(lua_State* L)
 {
     MidiSenderUserData* udata = checkMidiSenderUdata(L, 1);
     if (!udata->activated) {    
-        udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+        held_notes_activated(&udata->releaseState);
+        if (!udata->processing) {
+            udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+            udata->processing = true;
+        }
         udata->activated = true;
     }
     return 0;
@@ -307,7 +333,7 @@ static int MidiSender_deactivate(lua_State* L)
 {
     MidiSenderUserData* udata = checkMidiSenderUdata(L, 1);
     if (udata->activated) {                                           
-        udata->auprocCapi->deactivateProcessor(L, udata->auprocEngine, udata->processor);
+        held_notes_deactivated(&udata->releaseState);
         udata->activated = false;
     }
     return 0;
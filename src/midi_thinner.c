@@ -0,0 +1,440 @@
+#include "midi_thinner.h"
+
+#define AUPROC_CAPI_IMPLEMENT_GET_CAPI 1
+#include "auproc_capi.h"
+
+/* ============================================================================================ */
+
+static const char* const MIDI_THINNER_CLASS_NAME = "auproc.midi_thinner";
+
+static const char* ERROR_INVALID_MIDI_THINNER = "invalid auproc.midi_thinner";
+
+/* ============================================================================================ */
+
+/*
+ * Each coalescable value has a key: control change (channel, controller),
+ * poly pressure (channel, note), pitch bend (channel) and channel pressure
+ * (channel).
+ */
+#define KEY_CONTROL          0
+#define KEY_POLY_PRESSURE    (KEY_CONTROL       + 16 * 128)
+#define KEY_PITCH_BEND       (KEY_POLY_PRESSURE + 16 * 128)
+#define KEY_CHANNEL_PRESSURE (KEY_PITCH_BEND    + 16)
+#define KEY_COUNT            (KEY_CHANNEL_PRESSURE + 16)
+
+typedef struct KeyState             KeyState;
+typedef struct MidiThinnerUserData  MidiThinnerUserData;
+
+/**
+ * A key is queued after a value was emitted. While the key is queued,
+ * further values are held back and only the latest one is emitted when the
+ * window has elapsed.
+ */
+struct KeyState
+{
+    bool          queued;
+    bool          pending;
+    unsigned char size;
+    unsigned char data[3];
+    uint32_t      deadline;
+};
+
+struct MidiThinnerUserData
+{
+    const char*        className;
+    auproc_processor*  processor;
+
+    bool               closed;
+    bool               activated;
+
+    const auproc_capi*  auprocCapi;
+    auproc_engine*      auprocEngine;
+
+    auproc_connector*      midiInConnector;
+    const auproc_midimeth* midiInMethods;
+    auproc_connector*      midiOutConnector;
+    const auproc_midimeth* midiOutMethods;
+
+    uint32_t           window;
+
+    KeyState           keys[KEY_COUNT];
+
+    /* queued keys ordered by deadline */
+    uint16_t           queue[KEY_COUNT];
+    uint32_t           queueBegin;
+    uint32_t           queueLength;
+};
+
+/* ============================================================================================ */
+
+static void setupMidiThinnerMeta(lua_State* L);
+
+static int pushMidiThinnerMeta(lua_State* L)
+{
+    if (luaL_newmetatable(L, MIDI_THINNER_CLASS_NAME)) {
+        setupMidiThinnerMeta(L);
+    }
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static MidiThinnerUserData* checkMidiThinnerUdata(lua_State* L, int arg)
+{
+    MidiThinnerUserData* udata = luaL_checkudata(L, arg, MIDI_THINNER_CLASS_NAME);
+    if (udata->auprocCapi) {
+        udata->auprocCapi->checkEngineIsNotClosed(L, udata->auprocEngine);
+    }
+    if (udata->closed) {
+        luaL_error(L, ERROR_INVALID_MIDI_THINNER);
+        return NULL;
+    }
+    return udata;
+}
+
+/* ============================================================================================ */
+
+static int eventKey(const unsigned char* bytes, size_t size)
+{
+    int channel = bytes[0] & 0x0F;
+    switch (bytes[0] & 0xF0) {
+        case 0xA0: return (size == 3) ? KEY_POLY_PRESSURE + channel * 128 + (bytes[1] & 0x7F) : -1;
+        case 0xB0: return (size == 3) ? KEY_CONTROL       + channel * 128 + (bytes[1] & 0x7F) : -1;
+        case 0xD0: return (size == 2) ? KEY_CHANNEL_PRESSURE + channel                        : -1;
+        case 0xE0: return (size == 3) ? KEY_PITCH_BEND       + channel                        : -1;
+        default:   return -1;
+    }
+}
+
+static inline int keyChannel(int key)
+{
+    if (key < KEY_PITCH_BEND) {
+        return (key % (16 * 128)) / 128;
+    } else {
+        return (key - KEY_PITCH_BEND) % 16;
+    }
+}
+
+static void emit(MidiThinnerUserData* udata, auproc_midibuf* outBuf, uint32_t t,
+                 const unsigned char* bytes, size_t size)
+{
+    unsigned char* data = udata->midiOutMethods->reserveMidiEvent(outBuf, t, size);
+    if (data) {
+        memcpy(data, bytes, size);
+    }
+}
+
+static void enqueue(MidiThinnerUserData* udata, int key, uint32_t deadline)
+{
+    KeyState* k = udata->keys + key;
+    k->queued   = true;
+    k->deadline = deadline;
+    udata->queue[(udata->queueBegin + udata->queueLength) % KEY_COUNT] = key;
+    udata->queueLength += 1;
+}
+
+/**
+ * Emits the pending values of all queued keys whose deadline is not after
+ * frame time now. Keys without pending value are removed from the queue.
+ */
+static void flushDue(MidiThinnerUserData* udata, auproc_midibuf* outBuf, uint32_t f0, uint32_t now)
+{
+    while (udata->queueLength > 0) {
+        int       key = udata->queue[udata->queueBegin];
+        KeyState* k   = udata->keys + key;
+        if ((int32_t)(k->deadline - now) > 0) {
+            break;
+        }
+        udata->queueBegin   = (udata->queueBegin + 1) % KEY_COUNT;
+        udata->queueLength -= 1;
+        k->queued = false;
+        if (k->pending) {
+            int32_t t = (int32_t)(k->deadline - f0);
+            emit(udata, outBuf, (t > 0) ? t : 0, k->data, k->size);
+            k->pending = false;
+            enqueue(udata, key, k->deadline + udata->window);
+        }
+    }
+}
+
+/**
+ * Emits the pending values of the given channel immediately, so that
+ * controller and pitch bend values are not reordered relative to the
+ * other events of the channel.
+ */
+static void flushChannel(MidiThinnerUserData* udata, auproc_midibuf* outBuf, uint32_t t, int channel)
+{
+    for (uint32_t i = 0; i < udata->queueLength; ++i) {
+        int       key = udata->queue[(udata->queueBegin + i) % KEY_COUNT];
+        KeyState* k   = udata->keys + key;
+        if (k->pending && keyChannel(key) == channel) {
+            emit(udata, outBuf, t, k->data, k->size);
+            k->pending = false;
+        }
+    }
+}
+
+/* ============================================================================================ */
+
+static int processCallback(uint32_t nframes, void* processorData)
+{
+    MidiThinnerUserData*   udata      = (MidiThinnerUserData*) processorData;
+    const auproc_capi*     auprocCapi = udata->auprocCapi;
+    const auproc_midimeth* inMethods  = udata->midiInMethods;
+    const auproc_midimeth* outMethods = udata->midiOutMethods;
+
+    auproc_midibuf* inBuf  = inMethods->getMidiBuffer(udata->midiInConnector, nframes);
+    auproc_midibuf* outBuf = outMethods->getMidiBuffer(udata->midiOutConnector, nframes);
+
+    outMethods->clearBuffer(outBuf);
+
+    uint32_t f0 = auprocCapi->getProcessBeginFrameTime(udata->auprocEngine);
+
+    auproc_midi_event event;
+    uint32_t          eventCount = inMethods->getEventCount(inBuf);
+
+    for (uint32_t i = 0; i < eventCount; ++i)
+    {
+        inMethods->getMidiEvent(&event, inBuf, i);
+        if (event.size == 0) {
+            continue;
+        }
+        flushDue(udata, outBuf, f0, f0 + event.time);
+
+        int key = eventKey(event.buffer, event.size);
+        if (key < 0) {
+            if (event.buffer[0] < 0xF0) {
+                flushChannel(udata, outBuf, event.time, event.buffer[0] & 0x0F);
+            }
+            emit(udata, outBuf, event.time, event.buffer, event.size);
+        }
+        else {
+            KeyState* k = udata->keys + key;
+            if (!k->queued) {
+                emit(udata, outBuf, event.time, event.buffer, event.size);
+                enqueue(udata, key, f0 + event.time + udata->window);
+            } else {
+                memcpy(k->data, event.buffer, event.size);
+                k->size    = event.size;
+                k->pending = true;
+            }
+        }
+    }
+    flushDue(udata, outBuf, f0, f0 + nframes - 1);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static void engineClosedCallback(void* processorData)
+{
+    MidiThinnerUserData* udata = (MidiThinnerUserData*) processorData;
+
+    udata->closed    = true;
+    udata->activated = false;
+}
+
+static void engineReleasedCallback(void* processorData)
+{
+    MidiThinnerUserData* udata = (MidiThinnerUserData*) processorData;
+
+    udata->closed       = true;
+    udata->activated    = false;
+    udata->auprocCapi    = NULL;
+    udata->auprocEngine  = NULL;
+}
+
+/* ============================================================================================ */
+
+static int MidiThinner_new(lua_State* L)
+{
+    const int inArg     = 1;
+    const int windowArg = 3;
+    MidiThinnerUserData* udata = lua_newuserdata(L, sizeof(MidiThinnerUserData));
+    memset(udata, 0, sizeof(MidiThinnerUserData));
+    udata->className = MIDI_THINNER_CLASS_NAME;
+    pushMidiThinnerMeta(L);                               /* -> udata, meta */
+    lua_setmetatable(L, -2);                              /* -> udata */
+    int versionError = 0;
+    const auproc_capi* capi = auproc_get_capi(L, inArg, &versionError);
+    auproc_engine* engine = NULL;
+    auproc_info    info   = {0};
+    if (capi) {
+        engine = capi->getEngine(L, inArg, &info);
+    }
+    if (!capi || !engine) {
+        if (versionError) {
+            return luaL_argerror(L, inArg, "auproc version mismatch");
+        } else {
+            return luaL_argerror(L, inArg, "expected connector object");
+        }
+    }
+    if (lua_isnoneornil(L, windowArg)) {
+        if (info.sampleRate == 0) {
+            return luaL_argerror(L, windowArg, "cannot determine sample rate, window size expected");
+        }
+        udata->window = info.sampleRate / 100;
+    } else {
+        lua_Integer window = luaL_checkinteger(L, windowArg);
+        luaL_argcheck(L, window >= 0 && window <= 0x7FFFFFFF, windowArg, "invalid window size");
+        udata->window = window;
+    }
+
+    const char* processorName = lua_pushfstring(L, "%s: %p", MIDI_THINNER_CLASS_NAME, udata);   /* -> udata, name */
+
+    auproc_con_reg conRegs[2] = {{AUPROC_MIDI, AUPROC_IN,  NULL},
+                                 {AUPROC_MIDI, AUPROC_OUT, NULL}};
+    auproc_con_reg_err regError = {0};
+    auproc_processor* proc = capi->registerProcessor(L, inArg, 2, engine, processorName, udata,
+                                                        processCallback, NULL, engineClosedCallback, engineReleasedCallback,
+                                                        conRegs, &regError);
+    lua_pop(L, 1); /* -> udata */
+
+    if (!proc)
+    {
+        if (regError.conIndex >= 0)
+        {
+            int errArg = inArg + regError.conIndex;
+
+            if (regError.errorType == AUPROC_REG_ERR_CONNCTOR_INVALID)
+            {
+                return luaL_argerror(L, errArg, "invalid connector object");
+            }
+            if (   regError.errorType == AUPROC_REG_ERR_ENGINE_MISMATCH)
+            {
+                const char* msg = lua_pushfstring(L, "connector belongs to other %s",
+                                                     capi->engine_category_name);
+                return luaL_argerror(L, errArg, msg);
+            }
+            if (   regError.errorType == AUPROC_REG_ERR_ARG_INVALID
+                || regError.errorType == AUPROC_REG_ERR_WRONG_DIRECTION
+                || regError.errorType == AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE)
+            {
+                if (errArg == inArg) {
+                    return luaL_argerror(L, errArg, "expected MIDI IN connector");
+                } else {
+                    return luaL_argerror(L, errArg, "expected MIDI OUT connector");
+                }
+            }
+        }
+        return luaL_error(L, "cannot register processor (err=%d)", regError.errorType);
+    }
+
+    udata->processor        = proc;
+    udata->activated        = false;
+    udata->auprocCapi       = capi;
+    udata->auprocEngine     = engine;
+    udata->midiInConnector  = conRegs[0].connector;
+    udata->midiInMethods    = conRegs[0].midiMethods;
+    udata->midiOutConnector = conRegs[1].connector;
+    udata->midiOutMethods   = conRegs[1].midiMethods;
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int MidiThinner_release(lua_State* L)
+{
+    MidiThinnerUserData* udata = luaL_checkudata(L, 1, MIDI_THINNER_CLASS_NAME);
+    udata->closed    = true;
+    udata->activated = false;
+    if (udata->auprocCapi) {
+        udata->auprocCapi->unregisterProcessor(L, udata->auprocEngine, udata->processor);
+        udata->processor   = NULL;
+        udata->auprocCapi   = NULL;
+        udata->auprocEngine = NULL;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int MidiThinner_toString(lua_State* L)
+{
+    MidiThinnerUserData* udata = luaL_checkudata(L, 1, MIDI_THINNER_CLASS_NAME);
+
+    lua_pushfstring(L, "%s: %p", MIDI_THINNER_CLASS_NAME, udata);
+
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int MidiThinner_activate(lua_State* L)
+{
+    MidiThinnerUserData* udata = checkMidiThinnerUdata(L, 1);
+    if (!udata->activated) {
+        udata->auprocCapi->activateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = true;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int MidiThinner_deactivate(lua_State* L)
+{
+    MidiThinnerUserData* udata = checkMidiThinnerUdata(L, 1);
+    if (udata->activated) {
+        udata->auprocCapi->deactivateProcessor(L, udata->auprocEngine, udata->processor);
+        udata->activated = false;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static const luaL_Reg MidiThinnerMethods[] =
+{
+    { "activate",    MidiThinner_activate },
+    { "deactivate",  MidiThinner_deactivate },
+    { "close",       MidiThinner_release },
+    { NULL,          NULL } /* sentinel */
+};
+
+static const luaL_Reg MidiThinnerMetaMethods[] =
+{
+    { "__tostring", MidiThinner_toString },
+    { "__gc",       MidiThinner_release  },
+
+    { NULL,       NULL } /* sentinel */
+};
+
+static const luaL_Reg ModuleFunctions[] =
+{
+    { "new_midi_thinner", MidiThinner_new },
+    { NULL,               NULL } /* sentinel */
+};
+
+/* ============================================================================================ */
+
+static void setupMidiThinnerMeta(lua_State* L)
+{                                                          /* -> meta */
+    lua_pushstring(L, MIDI_THINNER_CLASS_NAME);            /* -> meta, className */
+    lua_setfield(L, -2, "__metatable");                    /* -> meta */
+
+    luaL_setfuncs(L, MidiThinnerMetaMethods, 0);           /* -> meta */
+
+    lua_newtable(L);                                       /* -> meta, MidiThinnerClass */
+    luaL_setfuncs(L, MidiThinnerMethods, 0);               /* -> meta, MidiThinnerClass */
+    lua_setfield (L, -2, "__index");                       /* -> meta */
+}
+
+
+/* ============================================================================================ */
+
+int auproc_midi_thinner_init_module(lua_State* L, int module)
+{
+    if (luaL_newmetatable(L, MIDI_THINNER_CLASS_NAME)) {
+        setupMidiThinnerMeta(L);
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, module);
+        luaL_setfuncs(L, ModuleFunctions, 0);
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+/* ============================================================================================ */
@@ -0,0 +1,8 @@
+#ifndef AUPROC_MIDI_THINNER_H
+#define AUPROC_MIDI_THINNER_H
+
+#include "util.h"
+
+int auproc_midi_thinner_init_module(lua_State* L, int module);
+
+#endif // AUPROC_MIDI_THINNER_H
@@ -0,0 +1,129 @@
+#include "resampler.h"
+#include "simd_util.h"
+
+/* ============================================================================================ */
+
+#define PHASES       256
+#define KAISER_BETA  8.0
+
+/**
+ * Modified Bessel function of the first kind of order zero.
+ */
+static double besselI0(double x)
+{
+    double sum  = 1;
+    double term = 1;
+    for (int k = 1; k < 50; ++k) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum  += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+/**
+ * Kaiser windowed sinc lowpass, x in input frames, cutoff relative 
+ * to the input Nyquist frequency.
+ */
+static double kernel(double x, double cutoff, uint32_t taps)
+{
+    double r = x / (taps / 2);
+    if (r <= -1 || r >= 1) {
+        return 0;
+    }
+    double w = besselI0(KAISER_BETA * sqrt(1 - r * r)) / besselI0(KAISER_BETA);
+    double s = (x == 0) ? 1 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+    return cutoff * s * w;
+}
+
+/* ============================================================================================ */
+
+bool auproc_resampler_init(Resampler* rs, double inRate, double outRate, uint32_t taps)
+{
+    memset(rs, 0, sizeof(Resampler));
+    rs->taps    = taps;
+    rs->phases  = PHASES;
+    rs->step    = inRate / outRate;
+    rs->table   = malloc(sizeof(float) * (PHASES + 1) * taps);
+    rs->history = malloc(sizeof(float) * 2 * taps);
+    if (!rs->table || !rs->history) {
+        auproc_resampler_free(rs);
+        return false;
+    }
+    /* lower the cutoff for downsampling and leave room for the transition band */
+    double cutoff = (outRate < inRate ? outRate / inRate : 1.0) * 0.94;
+
+    for (uint32_t p = 0; p <= PHASES; ++p) {
+        float* row = rs->table + p * taps;
+        for (uint32_t i = 0; i < taps; ++i) {
+            row[i] = kernel((double)(taps / 2 - 1) - i + (double)p / PHASES, cutoff, taps);
+        }
+    }
+    auproc_resampler_reset(rs);
+    return true;
+}
+
+void auproc_resampler_free(Resampler* rs)
+{
+    if (rs->table) {
+        free(rs->table);
+        rs->table = NULL;
+    }
+    if (rs->history) {
+        free(rs->history);
+        rs->history = NULL;
+    }
+}
+
+void auproc_resampler_reset(Resampler* rs)
+{
+    memset(rs->history, 0, sizeof(float) * 2 * rs->taps);
+    rs->historyPos = 0;
+    rs->frac       = 0;
+    rs->pending    = 0;
+}
+
+/* ============================================================================================ */
+
+uint32_t auproc_resampler_process(Resampler* rs, const float* in, uint32_t inCount, uint32_t* inUsed,
+                                  float* out, uint32_t outCount)
+{
+    const uint32_t taps     = rs->taps;
+    float*         history  = rs->history;
+    uint32_t       used     = 0;
+    uint32_t       produced = 0;
+
+    while (produced < outCount) {
+        while (rs->pending > 0) {
+            if (used == inCount) {
+                goto done;
+            }
+            float x = in ? in[used] : 0;
+            used += 1;
+            history[rs->historyPos]        = x;
+            history[rs->historyPos + taps] = x;
+            rs->historyPos = (rs->historyPos + 1 < taps) ? rs->historyPos + 1 : 0;
+            rs->pending -= 1;
+        }
+        /* history + historyPos are the last taps input samples, oldest first */
+        const float* window = history + rs->historyPos;
+        double       phase  = rs->frac * rs->phases;
+        uint32_t     p      = (uint32_t) phase;
+        float        a      = phase - p;
+        float        y0     = vec4_dot(window, rs->table +  p      * taps, taps);
+        float        y1     = vec4_dot(window, rs->table + (p + 1) * taps, taps);
+        out[produced++] = y0 + a * (y1 - y0);
+
+        double next = rs->frac + rs->step;
+        uint32_t k  = (uint32_t) next;
+        rs->frac    = next - k;
+        rs->pending = k;
+    }
+done:
+    *inUsed = used;
+    return produced;
+}
+
+/* ============================================================================================ */
@@ -0,0 +1,49 @@
+#ifndef AUPROC_RESAMPLER_H
+#define AUPROC_RESAMPLER_H
+
+#include "util.h"
+
+typedef struct Resampler Resampler;
+
+/**
+ * Streaming polyphase resampler for arbitrary ratios. The filter table
+ * contains one row of windowed sinc coefficients for each phase, the output
+ * is interpolated linearly between adjacent phases. The state is kept 
+ * across calls, i.e. subsequent chunks of a stream are resampled without
+ * boundary artifacts. Initializing and freeing allocates memory and must 
+ * not be done in the realtime thread.
+ */
+struct Resampler
+{
+    uint32_t  taps;
+    uint32_t  phases;
+    double    step;          /* input frames per output frame */
+    float*    table;         /* [phases + 1][taps] */
+    float*    history;       /* [2 * taps], the last taps input samples stored twice */
+    uint32_t  historyPos;
+    double    frac;          /* position of the next output between two input samples */
+    uint32_t  pending;       /* input samples to be consumed before the next output */
+};
+
+/**
+ * taps - filter length, must be an even number.
+ */
+bool auproc_resampler_init(Resampler* rs, double inRate, double outRate, uint32_t taps);
+
+void auproc_resampler_free(Resampler* rs);
+
+/**
+ * Clears the stream state.
+ */
+void auproc_resampler_reset(Resampler* rs);
+
+/**
+ * Resamples from in until outCount output frames are produced or all 
+ * inCount input frames are consumed. Returns the number of output frames,
+ * inUsed is set to the number of consumed input frames. in may be NULL for 
+ * feeding inCount zero frames.
+ */
+uint32_t auproc_resampler_process(Resampler* rs, const float* in, uint32_t inCount, uint32_t* inUsed,
+                                  float* out, uint32_t outCount);
+
+#endif // AUPROC_RESAMPLER_H
@@ -0,0 +1,228 @@
+#ifndef AUPROC_SIMD_UTIL_H
+#define AUPROC_SIMD_UTIL_H
+
+#include "util.h"
+
+/* -------------------------------------------------------------------------------------------- */
+
+/**
+ * Four float values that are processed in parallel. With GCC and clang the
+ * GCC vector extensions are used, these are compiled to SSE or NEON
+ * instructions independently of the optimization level. Otherwise, or if
+ * AUPROC_SIMD_USE_SCALAR is defined, the operations are plain loops.
+ *
+ * Loads and stores are unaligned.
+ */
+#if !defined(AUPROC_SIMD_USE_SCALAR) && !defined(AUPROC_SIMD_USE_GNU)
+    #if defined(__GNUC__)
+        #define AUPROC_SIMD_USE_GNU
+    #else
+        #define AUPROC_SIMD_USE_SCALAR
+    #endif
+#endif
+
+#define VEC4_WIDTH 4
+
+#if defined(AUPROC_SIMD_USE_GNU)
+    typedef float   Vec4  __attribute__((vector_size(16)));
+    typedef int32_t Vec4i __attribute__((vector_size(16)));
+#else
+    typedef struct { float v[4]; } Vec4;
+#endif
+
+static inline Vec4 vec4_load(const float* p)
+{
+    Vec4 rslt;
+    memcpy(&rslt, p, sizeof(Vec4));
+    return rslt;
+}
+
+static inline void vec4_store(float* p, Vec4 a)
+{
+    memcpy(p, &a, sizeof(Vec4));
+}
+
+static inline Vec4 vec4_set1(float x)
+{
+#if defined(AUPROC_SIMD_USE_GNU)
+    return (Vec4){ x, x, x, x };
+#else
+    Vec4 rslt = {{ x, x, x, x }};
+    return rslt;
+#endif
+}
+
+/**
+ * Returns the vector x0, x0 + dx, x0 + 2 * dx, x0 + 3 * dx.
+ */
+static inline Vec4 vec4_ramp(float x0, float dx)
+{
+#if defined(AUPROC_SIMD_USE_GNU)
+    return (Vec4){ x0, x0 + dx, x0 + 2 * dx, x0 + 3 * dx };
+#else
+    Vec4 rslt = {{ x0, x0 + dx, x0 + 2 * dx, x0 + 3 * dx }};
+    return rslt;
+#endif
+}
+
+static inline Vec4 vec4_add(Vec4 a, Vec4 b)
+{
+#if defined(AUPROC_SIMD_USE_GNU)
+    return a + b;
+#else
+    for (int i = 0; i < 4; ++i) a.v[i] += b.v[i];
+    return a;
+#endif
+}
+
+static inline Vec4 vec4_sub(Vec4 a, Vec4 b)
+{
+#if defined(AUPROC_SIMD_USE_GNU)
+    return a - b;
+#else
+    for (int i = 0; i < 4; ++i) a.v[i] -= b.v[i];
+    return a;
+#endif
+}
+
+static inline Vec4 vec4_mul(Vec4 a, Vec4 b)
+{
+#if defined(AUPROC_SIMD_USE_GNU)
+    return a * b;
+#else
+    for (int i = 0; i < 4; ++i) a.v[i] *= b.v[i];
+    return a;
+#endif
+}
+
+/**
+ * Returns a * b + c.
+ */
+static inline Vec4 vec4_madd(Vec4 a, Vec4 b, Vec4 c)
+{
+#if defined(AUPROC_SIMD_USE_GNU)
+    return a * b + c;
+#else
+    for (int i = 0; i < 4; ++i) c.v[i] += a.v[i] * b.v[i];
+    return c;
+#endif
+}
+
+static inline Vec4 vec4_min(Vec4 a, Vec4 b)
+{
+#if defined(AUPROC_SIMD_USE_GNU)
+    Vec4i m = (a < b);
+    return (Vec4)(((Vec4i)a & m) | ((Vec4i)b & ~m));
+#else
+    for (int i = 0; i < 4; ++i) a.v[i] = (a.v[i] < b.v[i]) ? a.v[i] : b.v[i];
+    return a;
+#endif
+}
+
+static inline Vec4 vec4_max(Vec4 a, Vec4 b)
+{
+#if defined(AUPROC_SIMD_USE_GNU)
+    Vec4i m = (a > b);
+    return (Vec4)(((Vec4i)a & m) | ((Vec4i)b & ~m));
+#else
+    for (int i = 0; i < 4; ++i) a.v[i] = (a.v[i] > b.v[i]) ? a.v[i] : b.v[i];
+    return a;
+#endif
+}
+
+static inline Vec4 vec4_abs(Vec4 a)
+{
+#if defined(AUPROC_SIMD_USE_GNU)
+    const Vec4i m = { 0x7fffffff, 0x7fffffff, 0x7fffffff, 0x7fffffff };
+    return (Vec4)((Vec4i)a & m);
+#else
+    for (int i = 0; i < 4; ++i) a.v[i] = fabsf(a.v[i]);
+    return a;
+#endif
+}
+
+static inline float vec4_get(Vec4 a, int i)
+{
+#if defined(AUPROC_SIMD_USE_GNU)
+    return a[i];
+#else
+    return a.v[i];
+#endif
+}
+
+static inline float vec4_hsum(Vec4 a)
+{
+    return (vec4_get(a, 0) + vec4_get(a, 1)) + (vec4_get(a, 2) + vec4_get(a, 3));
+}
+
+static inline float vec4_hmin(Vec4 a)
+{
+    float x = (vec4_get(a, 0) < vec4_get(a, 1)) ? vec4_get(a, 0) : vec4_get(a, 1);
+    float y = (vec4_get(a, 2) < vec4_get(a, 3)) ? vec4_get(a, 2) : vec4_get(a, 3);
+    return (x < y) ? x : y;
+}
+
+static inline float vec4_hmax(Vec4 a)
+{
+    float x = (vec4_get(a, 0) > vec4_get(a, 1)) ? vec4_get(a, 0) : vec4_get(a, 1);
+    float y = (vec4_get(a, 2) > vec4_get(a, 3)) ? vec4_get(a, 2) : vec4_get(a, 3);
+    return (x > y) ? x : y;
+}
+
+/**
+ * Returns the sum of a[i] * b[i] for i = 0, ..., n - 1.
+ */
+static inline float vec4_dot(const float* restrict a, const float* restrict b, uint32_t n)
+{
+    Vec4     acc = vec4_set1(0);
+    uint32_t i   = 0;
+    for (; i + VEC4_WIDTH <= n; i += VEC4_WIDTH) {
+        acc = vec4_madd(vec4_load(a + i), vec4_load(b + i), acc);
+    }
+    float sum = vec4_hsum(acc);
+    for (; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+/**
+ * out[k] += g * in[k] for k = 0, ..., n - 1.
+ */
+static inline void vec4_mix_gain(float* restrict out, const float* restrict in,
+                                 uint32_t n, float g)
+{
+    const Vec4 gv = vec4_set1(g);
+    uint32_t   k  = 0;
+    for (; k + VEC4_WIDTH <= n; k += VEC4_WIDTH) {
+        vec4_store(out + k, vec4_madd(gv, vec4_load(in + k), vec4_load(out + k)));
+    }
+    for (; k < n; ++k) {
+        out[k] += g * in[k];
+    }
+}
+
+/**
+ * out[k] += (g0 + dg * k) * in[k] for k = 0, ..., n - 1.
+ */
+static inline void vec4_mix_ramp(float* restrict out, const float* restrict in,
+                                 uint32_t n, float g0, float dg)
+{
+    const Vec4 g0v = vec4_set1(g0);
+    const Vec4 dgv = vec4_set1(dg);
+    const Vec4 inc = vec4_set1(VEC4_WIDTH);
+    Vec4       kv  = vec4_ramp(0, 1);
+    uint32_t   k   = 0;
+    for (; k + VEC4_WIDTH <= n; k += VEC4_WIDTH) {
+        Vec4 gv = vec4_madd(dgv, kv, g0v);
+        vec4_store(out + k, vec4_madd(gv, vec4_load(in + k), vec4_load(out + k)));
+        kv = vec4_add(kv, inc);
+    }
+    for (; k < n; ++k) {
+        out[k] += (g0 + dg * k) * in[k];
+    }
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+#endif /* AUPROC_SIMD_UTIL_H */
@@ -7,6 +7,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <limits.h>
+#include <math.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -108,6 +109,54 @@ void auproc_util_quote_string(lua_State* L, const char* s);
 
 int auproc_util_push_string_list(lua_State* L);
 
+/**
+ * Returns the number value of the optional field name in the options table
+ * at arg or def if the field is nil.
+ */
+static inline lua_Number auproc_util_opt_number_field(lua_State* L, int arg, const char* name, lua_Number def)
+{
+    lua_Number rslt = def;
+    lua_getfield(L, arg, name);                           /* -> value */
+    if (!lua_isnil(L, -1)) {
+        if (!lua_isnumber(L, -1)) {
+            const char* msg = lua_pushfstring(L, "number expected for field '%s'", name);
+            luaL_argerror(L, arg, msg);
+        }
+        rslt = lua_tonumber(L, -1);
+    }
+    lua_pop(L, 1);                                        /* -> */
+    return rslt;
+}
+
+/**
+ * Returns the integer value of the optional field name in the options table
+ * at arg or def if the field is nil.
+ */
+static inline lua_Integer auproc_util_opt_integer_field(lua_State* L, int arg, const char* name, lua_Integer def)
+{
+    lua_Integer rslt = def;
+    lua_getfield(L, arg, name);                           /* -> value */
+    if (!lua_isnil(L, -1)) {
+        if (!lua_isnumber(L, -1)) {
+            const char* msg = lua_pushfstring(L, "integer expected for field '%s'", name);
+            luaL_argerror(L, arg, msg);
+        }
+        rslt = lua_tointeger(L, -1);
+    }
+    lua_pop(L, 1);                                        /* -> */
+    return rslt;
+}
+
+/**
+ * Pole of a one-pole smoothing filter y = c * y + (1 - c) * x that reaches
+ * 1 - 1/e of a step within the given time. Returns 0 (no smoothing) for
+ * seconds <= 0.
+ */
+static inline double auproc_util_time_coeff(double seconds, double sampleRate)
+{
+    return (seconds > 0) ? exp(-1.0 / (seconds * sampleRate)) : 0;
+}
+
 /* ============================================================================================ */
 
 